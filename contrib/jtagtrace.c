@@ -0,0 +1,339 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decoder for the binary adapter traces written by OpenOCD's "jtag_trace"
+ * command.  It prints statistics about the queue flushes, which is where
+ * the USB (or network) round trips happen:  how many bits each flush moved,
+ * how many flushes there were per second, and how long the link sat idle
+ * between them.  Lots of small flushes with idle time in between point at
+ * code that should queue more work before calling jtag_execute_queue() or
+ * dap_run().
+ *
+ * The file format is described in src/jtag/trace.h.
+ *
+ * Build with:  cc -O2 -o jtagtrace jtagtrace.c
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC		"OCDTRACE"
+#define HEADER_SIZE		64
+#define RECORD_SIZE		24
+
+#define T_SCAN			1
+#define T_TLR_RESET		2
+#define T_RUNTEST		3
+#define T_RESET			4
+#define T_PATHMOVE		6
+#define T_SLEEP			7
+#define T_STABLECLOCKS	8
+#define T_TMS			9
+#define T_FLUSH			0x10
+#define T_SWD_READ		0x20
+#define T_SWD_WRITE		0x21
+#define T_SWD_SEQ		0x22
+
+#define F_IR			0x01
+#define F_TDI			0x02
+#define F_TDO			0x04
+#define F_TRUNCATED		0x08
+#define F_NO_DATA		0x10
+
+#define MAX_PAYLOAD		256
+
+/* flushes are binned by bit count, in powers of two */
+#define NUM_BINS		33
+
+static uint8_t *ring;
+static uint64_t ring_size;
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *buf)
+{
+	return get_u32(buf) | (uint64_t)get_u32(buf + 4) << 32;
+}
+
+/* copy a record out of the ring, undoing the wrap around */
+static void ring_read(uint64_t pos, uint8_t *buf, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++)
+		buf[i] = ring[(pos + i) % ring_size];
+}
+
+static const char *type_name(unsigned type)
+{
+	switch (type) {
+	case T_SCAN:		return "scan";
+	case T_TLR_RESET:	return "tlr_reset";
+	case T_RUNTEST:		return "runtest";
+	case T_RESET:		return "reset";
+	case T_PATHMOVE:	return "pathmove";
+	case T_SLEEP:		return "sleep";
+	case T_STABLECLOCKS:	return "stableclocks";
+	case T_TMS:		return "tms";
+	case T_FLUSH:		return "flush";
+	case T_SWD_READ:	return "swd_read";
+	case T_SWD_WRITE:	return "swd_write";
+	case T_SWD_SEQ:		return "swd_seq";
+	default:		return "unknown";
+	}
+}
+
+static void dump_bytes(const char *label, const uint8_t *data, unsigned len)
+{
+	printf(" %s=", label);
+	/* bit 0 is the LSB of the first byte; print the most significant first */
+	for (unsigned i = len; i > 0; i--)
+		printf("%02x", data[i - 1]);
+}
+
+static void dump_record(const uint8_t *rec)
+{
+	unsigned type = rec[4];
+	unsigned flags = rec[5];
+	unsigned arg = rec[6] | rec[7] << 8;
+	uint32_t flush_id = get_u32(rec + 8);
+	uint32_t bits = get_u32(rec + 12);
+	uint64_t time_us = get_u64(rec + 16);
+	const uint8_t *payload = rec + RECORD_SIZE;
+
+	if (type == T_FLUSH) {
+		printf("%12.6f flush %" PRIu32 ": %" PRIu32 " bits, %" PRIu32 " us, "
+				"result %d, %" PRIu32 " records\n",
+				time_us / 1e6, flush_id, bits, get_u32(payload),
+				(int32_t)get_u32(payload + 4), get_u32(payload + 8));
+		return;
+	}
+
+	printf("%12.6f   %s", time_us / 1e6, type_name(type));
+
+	switch (type) {
+	case T_SCAN: {
+		unsigned n = (bits + 7) / 8;
+		if (flags & F_TRUNCATED)
+			n = MAX_PAYLOAD;
+		printf(" %s field %u, %" PRIu32 " bits", flags & F_IR ? "ir" : "dr", arg, bits);
+		if (flags & F_TDI) {
+			dump_bytes("tdi", payload, n);
+			payload += n;
+		}
+		if (flags & F_TDO)
+			dump_bytes("tdo", payload, n);
+		if (flags & F_TRUNCATED)
+			printf(" (truncated)");
+		break;
+	}
+	case T_RESET:
+		printf(" trst %d srst %d", (int8_t)(arg & 0xff), (int8_t)(arg >> 8));
+		break;
+	case T_SWD_READ:
+	case T_SWD_WRITE:
+		printf(" %s reg 0x%x", arg & 0x02 ? "AP" : "DP", (arg >> 1) & 0x0c);
+		if (flags & F_NO_DATA)
+			printf(" (discarded)");
+		else
+			printf(" 0x%08" PRIx32, get_u32(payload));
+		break;
+	case T_SWD_SEQ:
+		printf(" %u, %" PRIu32 " bits", arg, bits);
+		break;
+	case T_SLEEP:
+		printf(" %" PRIu32 " us", bits);
+		break;
+	case T_TLR_RESET:
+		break;
+	default:
+		printf(" %" PRIu32, bits);
+		break;
+	}
+
+	printf("\n");
+}
+
+static unsigned bin_of(uint32_t bits)
+{
+	unsigned bin = 0;
+
+	while (bits) {
+		bin++;
+		bits >>= 1;
+	}
+
+	return bin;
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "v")) != EOF) {
+		switch (c) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1) {
+usage:
+		fprintf(stderr, "usage: %s [-v] tracefile\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	uint8_t header[HEADER_SIZE];
+	if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE
+			|| memcmp(header, TRACE_MAGIC, 8) != 0) {
+		fprintf(stderr, "%s: not an OpenOCD adapter trace\n", argv[optind]);
+		return 1;
+	}
+
+	uint32_t version = get_u32(header + 8);
+	uint32_t header_size = get_u32(header + 12);
+	ring_size = get_u64(header + 16);
+	uint64_t read_pos = get_u64(header + 24);
+	uint64_t write_pos = get_u64(header + 32);
+
+	if (version != 1 || ring_size == 0 || write_pos - read_pos > ring_size) {
+		fprintf(stderr, "%s: unsupported or corrupt trace\n", argv[optind]);
+		return 1;
+	}
+
+	ring = malloc(ring_size);
+	if (!ring || fseek(f, header_size, SEEK_SET) != 0
+			|| fread(ring, 1, ring_size, f) != ring_size) {
+		fprintf(stderr, "%s: truncated trace\n", argv[optind]);
+		return 1;
+	}
+	fclose(f);
+
+	uint64_t type_count[256] = { 0 };
+	uint64_t bins[NUM_BINS] = { 0 };
+	uint64_t num_flushes = 0, total_bits = 0, busy_us = 0, idle_us = 0;
+	uint32_t min_bits = UINT32_MAX, max_bits = 0, max_flush_us = 0;
+	uint64_t max_idle_us = 0, first_us = 0, last_end_us = 0;
+
+	uint8_t *rec = NULL;
+	uint32_t rec_max = 0;
+
+	for (uint64_t pos = read_pos; pos < write_pos; ) {
+		uint8_t len_buf[4];
+		ring_read(pos, len_buf, 4);
+		uint32_t len = get_u32(len_buf);
+
+		if (len < RECORD_SIZE || len > write_pos - pos) {
+			fprintf(stderr, "corrupt record at position %" PRIu64 "\n", pos);
+			break;
+		}
+
+		if (len > rec_max) {
+			rec = realloc(rec, len);
+			rec_max = len;
+		}
+		ring_read(pos, rec, len);
+		pos += len;
+
+		type_count[rec[4]]++;
+		if (verbose)
+			dump_record(rec);
+
+		if (rec[4] != T_FLUSH)
+			continue;
+
+		uint32_t bits = get_u32(rec + 12);
+		uint64_t start_us = get_u64(rec + 16);
+		uint32_t duration_us = get_u32(rec + RECORD_SIZE);
+
+		if (num_flushes == 0) {
+			first_us = start_us;
+		} else if (start_us > last_end_us) {
+			uint64_t idle = start_us - last_end_us;
+			idle_us += idle;
+			if (idle > max_idle_us)
+				max_idle_us = idle;
+		}
+
+		num_flushes++;
+		total_bits += bits;
+		busy_us += duration_us;
+		bins[bin_of(bits)]++;
+		if (bits < min_bits)
+			min_bits = bits;
+		if (bits > max_bits)
+			max_bits = bits;
+		if (duration_us > max_flush_us)
+			max_flush_us = duration_us;
+		last_end_us = start_us + duration_us;
+	}
+	free(rec);
+
+	if (num_flushes == 0) {
+		printf("no queue flushes in trace\n");
+		return 0;
+	}
+
+	uint64_t span_us = last_end_us - first_us;
+
+	printf("%" PRIu64 " flushes in %.3f s", num_flushes, span_us / 1e6);
+	if (span_us)
+		printf(", %.1f flushes/s", num_flushes * 1e6 / span_us);
+	printf("\n");
+	printf("bits per flush: min %" PRIu32 ", avg %.1f, max %" PRIu32 "\n",
+			min_bits, (double)total_bits / num_flushes, max_bits);
+	printf("flush time: avg %.1f us, max %" PRIu32 " us, total %.3f s\n",
+			(double)busy_us / num_flushes, max_flush_us, busy_us / 1e6);
+	if (num_flushes > 1)
+		printf("idle between flushes: avg %.1f us, max %" PRIu64 " us, total %.3f s\n",
+				(double)idle_us / (num_flushes - 1), max_idle_us, idle_us / 1e6);
+	if (busy_us)
+		printf("throughput while flushing: %.1f kbit/s\n", total_bits * 1e3 / busy_us);
+
+	printf("\nflushes by bits moved:\n");
+	for (unsigned i = 0; i < NUM_BINS; i++) {
+		if (!bins[i])
+			continue;
+		if (i == 0)
+			printf("  %10u       : %" PRIu64 "\n", 0, bins[i]);
+		else
+			printf("  %10" PRIu64 " and up: %" PRIu64 "\n",
+					(uint64_t)1 << (i - 1), bins[i]);
+	}
+
+	printf("\nrecords:\n");
+	for (unsigned i = 0; i < 256; i++) {
+		if (type_count[i])
+			printf("  %-12s %" PRIu64 "\n", type_name(i), type_count[i]);
+	}
+
+	return 0;
+}
@@ -38,8 +38,20 @@
   Or if you want to test UNIX sockets, run both on Raspberry Pi:
   socat UNIX-LISTEN:/tmp/remotebitbang-socket,fork EXEC:"sudo ./remote_bitbang_sysfsgpio tck 11 tms 25 tdo 9 tdi 10"
   openocd -c "interface remote_bitbang; remote_bitbang_host /tmp/remotebitbang-socket" -f target/stm32f1x.cfg
+
+  Without any hardware, "loopback" simulates a single TAP stuck in BYPASS:
+  TDO returns the TDI value latched on the previous rising edge of TCK.
+  This is enough to measure the throughput of the protocol itself, which
+  is printed on stderr when the connection is closed:
+  socat TCP-LISTEN:7777,fork EXEC:"./remote_bitbang_sysfsgpio loopback"
+  openocd -c "interface remote_bitbang; remote_bitbang_port 7777" \
+	  -c "jtag newtap sim tap -irlen 1 -ircapture 0 -irmask 0" \
+	  -c "init; drscan sim.tap 32 0 ; shutdown"
 */
 
+/* for clock_gettime() with -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -48,6 +60,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #define LOG_ERROR(...)		do {					\
 		fprintf(stderr, __VA_ARGS__);				\
@@ -293,29 +306,113 @@ static void cleanup_all_fds(void)
 	cleanup_fd(srst_fd, srst_gpio);
 }
 
+/*
+ * Loopback simulation: a one bit shift register between TDI and TDO,
+ * clocked on the rising edge of TCK.
+ */
+static int loopback;
+static int loopback_tck;
+static int loopback_tdi;
+static int loopback_tdo;
+
+static int loopback_read(void)
+{
+	return loopback_tdo ? '1' : '0';
+}
+
+static void loopback_write(int tck, int tms, int tdi)
+{
+	if (tck && !loopback_tck)
+		loopback_tdo = loopback_tdi;
+	loopback_tck = tck;
+	loopback_tdi = tdi;
+}
+
+/* protocol statistics, reported when the connection is closed */
+static unsigned long long stat_clocks;
+static unsigned long long stat_reads;
+static unsigned long long stat_flushes;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report_stats(double elapsed)
+{
+	if (elapsed <= 0)
+		return;
+
+	LOG_WARNING("%llu TCK cycles, %llu TDO reads in %llu replies, %.3f s",
+		 stat_clocks, stat_reads, stat_flushes, elapsed);
+	LOG_WARNING("%.0f TCK/s, %.0f TDO bits/s",
+		 stat_clocks / elapsed, stat_reads / elapsed);
+}
+
+/*
+ * Requests are read in chunks and all replies to a chunk are sent with a
+ * single write. A client that waits for every 'R' still gets its answer
+ * straight away, while a client that pipelines many 'R' requests gets them
+ * back in bulk instead of one write() per bit.
+ */
 static void process_remote_protocol(void)
 {
-	int c;
-	while (1) {
-		c = getchar();
-		if (c == EOF || c == 'Q') /* Quit */
-			break;
-		else if (c == 'b' || c == 'B') /* Blink */
+	char in[4096];
+	char out[sizeof(in)];
+	double start = now();
+	int quit = 0;
+
+	while (!quit) {
+		ssize_t len = read(STDIN_FILENO, in, sizeof(in));
+		if (len < 0 && errno == EINTR)
 			continue;
-		else if (c >= 'r' && c <= 'r' + 2) { /* Reset */
-			char d = c - 'r';
-			sysfsgpio_reset(!!(d & 2),
-					(d & 1));
-		} else if (c >= '0' && c <= '0' + 7) {/* Write */
-			char d = c - '0';
-			sysfsgpio_write(!!(d & 4),
-					!!(d & 2),
-					(d & 1));
-		} else if (c == 'R')
-			putchar(sysfsgpio_read());
-		else
-			LOG_ERROR("Unknown command '%c' received", c);
+		if (len <= 0)
+			break;
+
+		size_t out_len = 0;
+		for (ssize_t i = 0; i < len; i++) {
+			char c = in[i];
+			if (c == 'Q') { /* Quit */
+				quit = 1;
+				break;
+			} else if (c == 'b' || c == 'B') /* Blink */
+				continue;
+			else if (c >= 'r' && c <= 'r' + 2) { /* Reset */
+				char d = c - 'r';
+				if (!loopback)
+					sysfsgpio_reset(!!(d & 2),
+							(d & 1));
+			} else if (c >= '0' && c <= '0' + 7) {/* Write */
+				char d = c - '0';
+				if (d & 4)
+					stat_clocks++;
+				if (loopback)
+					loopback_write(!!(d & 4),
+							!!(d & 2),
+							(d & 1));
+				else
+					sysfsgpio_write(!!(d & 4),
+							!!(d & 2),
+							(d & 1));
+			} else if (c == 'R') {
+				stat_reads++;
+				out[out_len++] = loopback ? loopback_read() : sysfsgpio_read();
+			} else
+				LOG_ERROR("Unknown command '%c' received", c);
+		}
+
+		if (out_len) {
+			stat_flushes++;
+			if (write(STDOUT_FILENO, out, out_len) != (ssize_t)out_len) {
+				LOG_ERROR("Couldn't send read responses");
+				break;
+			}
+		}
 	}
+
+	report_stats(now() - start);
 }
 
 int main(int argc, char *argv[])
@@ -335,12 +432,21 @@ int main(int argc, char *argv[])
 			trst_gpio = atoi(argv[++i]);
 		else if (!strcmp(argv[i], "srst"))
 			srst_gpio = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "loopback"))
+			loopback = 1;
 		else {
-			LOG_ERROR("Usage:\n%s ((tck|tms|tdo|tdi|trst|srst) num)*", argv[0]);
+			LOG_ERROR("Usage:\n%s ((tck|tms|tdo|tdi|trst|srst) num)*\n"
+					"%s loopback", argv[0], argv[0]);
 			return -1;
 		}
 	}
 
+	if (loopback) {
+		LOG_WARNING("Simulating a TAP in BYPASS, no GPIOs used");
+		process_remote_protocol();
+		return 0;
+	}
+
 	if (!(is_gpio_valid(tck_gpio)
 			&& is_gpio_valid(tms_gpio)
 			&& is_gpio_valid(tdi_gpio)
@@ -397,7 +503,6 @@ int main(int argc, char *argv[])
 	LOG_WARNING("SysfsGPIO num: srst = %d", srst_gpio);
 	LOG_WARNING("SysfsGPIO num: trst = %d", trst_gpio);
 
-	setvbuf(stdout, NULL, _IONBF, 0);
 	process_remote_protocol();
 
 	cleanup_all_fds();
@@ -574,6 +574,7 @@ static int at91sam7_read_part_info(struct flash_bank *bank)
 				struct flash_bank *fb = malloc(sizeof(struct flash_bank));
 				fb->target = target;
 				fb->driver = bank->driver;
+				fb->write_chunk_size = bank->write_chunk_size;
 				fb->driver_priv = malloc(sizeof(struct at91sam7_flash_bank));
 				fb->name = "sam7_probed";
 				fb->next = NULL;
@@ -812,6 +813,7 @@ FLASH_BANK_COMMAND_HANDLER(at91sam7_flash_bank_command)
 				struct flash_bank *fb = malloc(sizeof(struct flash_bank));
 				fb->target = target;
 				fb->driver = bank->driver;
+				fb->write_chunk_size = bank->write_chunk_size;
 				fb->driver_priv = malloc(sizeof(struct at91sam7_flash_bank));
 				fb->name = "sam7_probed";
 				fb->next = NULL;
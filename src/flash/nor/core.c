@@ -41,6 +41,7 @@ int flash_driver_erase(struct flash_bank *bank, int first, int last)
 	int retval;
 
 	retval = bank->driver->erase(bank, first, last);
+	target_mem_cache_invalidate(bank->target);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %d to %d", first, last);
 
@@ -79,6 +80,7 @@ int flash_driver_protect(struct flash_bank *bank, int set, int first, int last)
 	 * Drivers only receive valid protection block range.
 	 */
 	retval = bank->driver->protect(bank, set, first, last);
+	target_mem_cache_invalidate(bank->target);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed setting protection for blocks %d to %d", first, last);
 
@@ -91,6 +93,7 @@ int flash_driver_write(struct flash_bank *bank,
 	int retval;
 
 	retval = bank->driver->write(bank, buffer, offset, count);
+	target_mem_cache_invalidate(bank->target);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error writing to flash at address 0x%08" PRIx32 " at offset 0x%8.8" PRIx32,
@@ -559,8 +562,121 @@ static int compare_section(const void *a, const void *b)
 		return -1;
 }
 
+/* Chunks end on a sector boundary, so that drivers with alignment
+ * requirements see the same offsets as for a write of the whole run. */
+static uint32_t flash_write_chunk(struct flash_bank *bank,
+	uint32_t offset, uint32_t remaining)
+{
+	uint32_t end;
+	int sector;
+
+	if (bank->write_chunk_size == 0 || remaining <= bank->write_chunk_size)
+		return remaining;
+
+	end = offset + bank->write_chunk_size;
+	for (sector = 0; sector < bank->num_sectors; sector++) {
+		uint32_t sector_end = bank->sectors[sector].offset
+			+ bank->sectors[sector].size;
+		if (sector_end >= end) {
+			end = sector_end;
+			break;
+		}
+	}
+
+	return MIN(end - offset, remaining);
+}
+
+/* Check whether the flash at @a offset of @a bank already holds @a size
+ * bytes of @a buffer. */
+static bool flash_unchanged(struct flash_bank *bank, uint32_t offset,
+	const uint8_t *buffer, uint32_t size)
+{
+	uint32_t address = bank->base + offset;
+
+	/* Only a bank read through target memory is sure to show its contents
+	 * at bank->base, so that the target can checksum them in place.  The
+	 * others (SPI flash behind a controller, faux, ...) are read back. */
+	if (bank->driver->read == default_flash_read) {
+		uint32_t image_crc, flash_crc;
+
+		if (image_calculate_checksum(buffer, size, &image_crc) != ERROR_OK)
+			return false;
+
+		if (target_checksum_memory(bank->target, address, size, &flash_crc) != ERROR_OK) {
+			LOG_DEBUG("couldn't checksum flash at 0x%8.8" PRIx32 ", writing it", address);
+			return false;
+		}
+
+		return image_crc == flash_crc;
+	}
+
+	if (bank->driver->read == NULL)
+		return false;
+
+	uint8_t *contents = malloc(size);
+	bool unchanged = contents != NULL
+		&& flash_driver_read(bank, contents, offset, size) == ERROR_OK
+		&& memcmp(contents, buffer, size) == 0;
+
+	free(contents);
+	return unchanged;
+}
+
+/* Erase (if requested) and program only those sectors of a chunk whose
+ * contents differ from the image.  The whole chunk is compared first, so
+ * an unchanged chunk costs a single checksum on the target. */
+static int flash_write_changed(struct flash_bank *bank, uint8_t *buffer,
+	uint32_t offset, uint32_t count, int erase,
+	uint32_t *written, uint32_t *skipped)
+{
+	struct target *target = bank->target;
+	uint32_t address = bank->base + offset;
+	uint32_t done = 0;
+	int sector = 0;
+	int retval;
+
+	if (flash_unchanged(bank, offset, buffer, count)) {
+		*skipped += count;
+		return ERROR_OK;
+	}
+
+	while (done < count) {
+		uint32_t piece = count - done;
+
+		for (; sector < bank->num_sectors; sector++) {
+			uint32_t sector_end = bank->sectors[sector].offset
+				+ bank->sectors[sector].size;
+			if (sector_end > offset + done) {
+				piece = MIN(piece, sector_end - (offset + done));
+				break;
+			}
+		}
+
+		/* no need to compare again if the chunk is a single sector */
+		if (piece != count && flash_unchanged(bank, offset + done, buffer + done, piece)) {
+			*skipped += piece;
+			done += piece;
+			continue;
+		}
+
+		retval = ERROR_OK;
+		if (erase)
+			retval = flash_erase_address_range(target, true, address + done, piece);
+		if (retval == ERROR_OK)
+			retval = flash_driver_write(bank, buffer + done, offset + done, piece);
+		if (retval != ERROR_OK)
+			return retval;
+
+		*written += piece;
+		done += piece;
+	}
+
+	return ERROR_OK;
+}
+
 int flash_write_unlock(struct target *target, struct image *image,
-	uint32_t *written, int erase, bool unlock)
+	uint32_t *written, int erase, bool unlock, bool incremental,
+	uint32_t *skipped)
 {
 	int retval = ERROR_OK;
 
@@ -568,13 +684,14 @@ int flash_write_unlock(struct target *target, struct image *image,
 	uint32_t section_offset;
 	struct flash_bank *c;
 	int *padding;
+	uint8_t *buffer = NULL;
+	uint32_t buffer_alloc = 0;
+	uint32_t total_written = 0;
+	uint32_t total_skipped = 0;
 
 	section = 0;
 	section_offset = 0;
 
-	if (written)
-		*written = 0;
-
 	if (erase) {
 		/* assume all sectors need erasing - stops any problems
 		 * when flash_write is called multiple times */
@@ -598,8 +715,7 @@ int flash_write_unlock(struct target *target, struct image *image,
 
 	/* loop until we reach end of the image */
 	while (section < image->num_sections) {
-		uint32_t buffer_size;
-		uint8_t *buffer;
+		uint32_t run_offset;
 		int section_last;
 		uint32_t run_address = sections[section]->base_address + section_offset;
 		uint32_t run_size = sections[section]->size - section_offset;
@@ -694,84 +810,133 @@ int flash_write_unlock(struct target *target, struct image *image,
 			run_size += delta;
 		}
 
-		/* allocate buffer */
-		buffer = malloc(run_size);
-		if (buffer == NULL) {
-			LOG_ERROR("Out of memory for flash bank buffer");
-			retval = ERROR_FAIL;
-			goto done;
-		}
-		buffer_size = 0;
-
-		/* read sections to the buffer */
-		while (buffer_size < run_size) {
-			size_t size_read;
-
-			size_read = run_size - buffer_size;
-			if (size_read > sections[section]->size - section_offset)
-				size_read = sections[section]->size - section_offset;
-
-			/* KLUDGE!
-			 *
-			 * #¤%#"%¤% we have to figure out the section # from the sorted
-			 * list of pointers to sections to invoke image_read_section()...
-			 */
-			intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
-			int t_section_num = diff / sizeof(struct imagesection);
-
-			LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
-					"section_offset = %d, buffer_size = %d, size_read = %d",
-				(int)section, (int)t_section_num, (int)section_offset,
-				(int)buffer_size, (int)size_read);
-			retval = image_read_section(image, t_section_num, section_offset,
-					size_read, buffer + buffer_size, &size_read);
-			if (retval != ERROR_OK || size_read == 0) {
-				free(buffer);
-				goto done;
-			}
-
-			/* see if we need to pad the section */
-			while (padding[section]--)
-				(buffer + buffer_size)[size_read++] = c->default_padded_value;
-
-			buffer_size += size_read;
-			section_offset += size_read;
-
-			if (section_offset >= sections[section]->size) {
-				section++;
-				section_offset = 0;
-			}
-		}
-
 		retval = ERROR_OK;
 
 		if (unlock)
 			retval = flash_unlock_address_range(target, run_address, run_size);
 		if (retval == ERROR_OK) {
-			if (erase) {
+			/* in incremental mode, only sectors that differ get erased */
+			if (erase && !incremental) {
 				/* calculate and erase sectors */
 				retval = flash_erase_address_range(target,
 						true, run_address, run_size);
 			}
 		}
+		if (retval != ERROR_OK)
+			goto done;
 
-		if (retval == ERROR_OK) {
-			/* write flash sectors */
-			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
-		}
+		/* program the run chunk by chunk, the image is decoded into a
+		 * single buffer of about c->write_chunk_size bytes */
+		for (run_offset = 0; run_offset < run_size; ) {
+			uint32_t bank_offset = run_address + run_offset - c->base;
+			uint32_t chunk_size = flash_write_chunk(c, bank_offset, run_size - run_offset);
+			uint32_t buffer_size = 0;
+			int section_num = sections[section] - image->sections;
+			const uint8_t *data;
+
+			/* a chunk within a single section of an image being built in
+			 * memory (gdb's vFlash image) is handed to the driver as it is.
+			 * Drivers may patch the data they get, lpc2000 stores its
+			 * vector checksum in it, so this is only done for data that
+			 * is private and writable; mapped files are read-only and
+			 * are copied to the buffer like everything else. */
+			if (image->type == IMAGE_BUILDER
+					&& section_offset + chunk_size <= sections[section]->size
+					&& image_section_data(image, section_num, section_offset,
+						chunk_size, &data) == ERROR_OK) {
+				section_offset += chunk_size;
+				if (section_offset == sections[section]->size && padding[section] <= 0) {
+					section++;
+					section_offset = 0;
+				}
+				goto write_chunk;
+			}
 
-		free(buffer);
+			if (chunk_size > buffer_alloc) {
+				free(buffer);
+				buffer = malloc(chunk_size);
+				if (buffer == NULL) {
+					LOG_ERROR("Out of memory for flash bank buffer");
+					buffer_alloc = 0;
+					retval = ERROR_FAIL;
+					goto done;
+				}
+				buffer_alloc = chunk_size;
+			}
 
-		if (retval != ERROR_OK) {
-			/* abort operation */
-			goto done;
-		}
+			/* read sections to the buffer */
+			while (buffer_size < chunk_size) {
+				if (section_offset < sections[section]->size) {
+					size_t size_read;
+
+					size_read = chunk_size - buffer_size;
+					if (size_read > sections[section]->size - section_offset)
+						size_read = sections[section]->size - section_offset;
+
+					/* the sections are sorted, but the image wants its own number */
+					section_num = sections[section] - image->sections;
+
+					LOG_DEBUG("image_read_section: section = %d, section_num = %d, "
+							"section_offset = %d, buffer_size = %d, size_read = %d",
+						(int)section, section_num, (int)section_offset,
+						(int)buffer_size, (int)size_read);
+					retval = image_read_section(image, section_num, section_offset,
+							size_read, buffer + buffer_size, &size_read);
+					if (retval != ERROR_OK || size_read == 0)
+						goto done;
+
+					buffer_size += size_read;
+					section_offset += size_read;
+				}
+
+				/* see if we need to pad the section, the padding may
+				 * continue in the next chunk */
+				if (section_offset >= sections[section]->size && padding[section] > 0) {
+					uint32_t pad = MIN((uint32_t)padding[section],
+							chunk_size - buffer_size);
+					memset(buffer + buffer_size, c->default_padded_value, pad);
+					buffer_size += pad;
+					padding[section] -= pad;
+				}
 
-		if (written != NULL)
-			*written += run_size;	/* add run size to total written counter */
+				if (section_offset >= sections[section]->size && padding[section] <= 0) {
+					section++;
+					section_offset = 0;
+				}
+			}
+			data = buffer;
+
+write_chunk:
+			LOG_DEBUG("writing 0x%" PRIx32 " bytes at bank offset 0x%" PRIx32,
+				chunk_size, bank_offset);
+
+			/* data is either our buffer or a builder image's own copy */
+			if (incremental) {
+				retval = flash_write_changed(c, (uint8_t *)data, bank_offset, chunk_size,
+						erase, &total_written, &total_skipped);
+			} else {
+				/* write flash sectors */
+				retval = flash_driver_write(c, (uint8_t *)data, bank_offset, chunk_size);
+				if (retval == ERROR_OK)
+					total_written += chunk_size;
+			}
+			if (retval != ERROR_OK) {
+				/* abort operation */
+				goto done;
+			}
+
+			run_offset += chunk_size;
+			keep_alive();
+		}
 	}
 
 done:
+	if (written)
+		*written = total_written;
+	if (skipped)
+		*skipped = total_skipped;
+
+	free(buffer);
 	free(sections);
 	free(padding);
 
@@ -781,7 +946,7 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, int erase)
 {
-	return flash_write_unlock(target, image, written, erase, false);
+	return flash_write_unlock(target, image, written, erase, false, false, NULL);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size, int num_blocks)
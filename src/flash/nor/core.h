@@ -97,6 +97,11 @@ struct flash_bank {
 	 * erased value. Defaults to 0xFF. */
 	uint8_t default_padded_value;
 
+	/** Image data passed to the driver per write() call, rounded up to a
+	 * sector boundary; 0 writes each contiguous run at once.  Defaults to
+	 * flash_driver::write_chunk_size. */
+	uint32_t write_chunk_size;
+
 	/**
 	 * The number of sectors on this chip.  This value will
 	 * be set intially to 0, and the flash driver must set this to
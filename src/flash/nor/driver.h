@@ -209,8 +209,22 @@ struct flash_driver {
 	 * @returns ERROR_OK if successful; otherwise, an error code.
 	 */
 	int (*auto_probe)(struct flash_bank *bank);
+
+	/**
+	 * How much image data "flash write_image" decodes and passes to
+	 * write() at a time for banks of this driver, see
+	 * flash_bank::write_chunk_size.  Drivers that program a contiguous
+	 * run correctly when it arrives in several write() calls at
+	 * increasing, sector aligned offsets set this, usually to
+	 * FLASH_WRITE_CHUNK_SIZE_DEFAULT.  Zero, the default, writes every
+	 * run in a single call.
+	 */
+	uint32_t write_chunk_size;
 };
 
+/* write_chunk_size for drivers that can program a run in chunks */
+#define FLASH_WRITE_CHUNK_SIZE_DEFAULT	(256 * 1024)
+
 #define FLASH_BANK_COMMAND_HANDLER(name) \
 	static __FLASH_BANK_COMMAND(name)
 
@@ -53,6 +53,7 @@ FLASH_BANK_COMMAND_HANDLER(faux_flash_bank_command)
 		LOG_ERROR("no memory for flash bank info");
 		return ERROR_FAIL;
 	}
+	memset(info->memory, 0xff, bank->size);
 	bank->driver_priv = info;
 
 	/* Use 0x10000 as a fixed sector size. */
@@ -98,6 +99,14 @@ static int faux_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t o
 	return ERROR_OK;
 }
 
+/* the contents are kept here, not in target memory at the bank's base */
+static int faux_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	struct faux_flash_bank *info = bank->driver_priv;
+	memcpy(buffer, info->memory + offset, count);
+	return ERROR_OK;
+}
+
 static int faux_protect_check(struct flash_bank *bank)
 {
 	return ERROR_OK;
@@ -131,10 +140,11 @@ struct flash_driver faux_flash = {
 	.erase = faux_erase,
 	.protect = faux_protect,
 	.write = faux_write,
-	.read = default_flash_read,
+	.read = faux_read,
 	.probe = faux_probe,
 	.auto_probe = faux_probe,
 	.erase_check = default_flash_blank_check,
 	.protect_check = faux_protect_check,
-	.info = faux_info
+	.info = faux_info,
+	.write_chunk_size = FLASH_WRITE_CHUNK_SIZE_DEFAULT,
 };
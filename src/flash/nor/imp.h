@@ -42,8 +42,16 @@ int flash_driver_write(struct flash_bank *bank,
 int flash_driver_read(struct flash_bank *bank,
 		uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/**
+ * Write an image to flash memory of the given target, optionally
+ * unlocking and erasing the sectors it covers first.
+ *
+ * In @a incremental mode, checksums of the flash contents are compared
+ * with the image first, and only the sectors that differ are erased and
+ * programmed.  The number of bytes left alone is returned in @a skipped.
+ */
 int flash_write_unlock(struct target *target, struct image *image,
-		uint32_t *written, int erase, bool unlock);
+		uint32_t *written, int erase, bool unlock, bool incremental,
+		uint32_t *skipped);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
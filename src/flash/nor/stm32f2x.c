@@ -1463,4 +1463,5 @@ struct flash_driver stm32f2x_flash = {
 	.erase_check = default_flash_blank_check,
 	.protect_check = stm32x_protect_check,
 	.info = get_stm32x_info,
+	.write_chunk_size = FLASH_WRITE_CHUNK_SIZE_DEFAULT,
 };
@@ -934,4 +934,5 @@ struct flash_driver stm32l4x_flash = {
 	.erase_check = default_flash_blank_check,
 	.protect_check = stm32l4_protect_check,
 	.info = get_stm32l4_info,
+	.write_chunk_size = FLASH_WRITE_CHUNK_SIZE_DEFAULT,
 };
@@ -395,12 +395,14 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 
 	struct image image;
 	uint32_t written;
+	uint32_t skipped;
 
 	int retval;
 
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool incremental = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -413,6 +415,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD_CTX, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "incremental") == 0) {
+			incremental = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD_CTX, "incremental write enabled");
 		} else
 			break;
 	}
@@ -442,7 +449,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock);
+	retval = flash_write_unlock(target, &image, &written, auto_erase, auto_unlock,
+			incremental, &skipped);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -452,6 +460,9 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD_CTX, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		if (incremental)
+			command_print(CMD_CTX, "skipped %" PRIu32 " bytes already in flash",
+				skipped);
 	}
 
 	image_close(&image);
@@ -810,6 +821,25 @@ void flash_set_dirty(void)
 	}
 }
 
+COMMAND_HANDLER(handle_flash_write_chunk_size_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct flash_bank *p;
+	int retval = CALL_COMMAND_HANDLER(flash_command_get_bank, 0, &p);
+	if (ERROR_OK != retval)
+		return retval;
+
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], p->write_chunk_size);
+
+	command_print(CMD_CTX, "write chunk size of flash bank %u: %" PRIu32 " bytes",
+			p->bank_number, p->write_chunk_size);
+
+	return retval;
+}
+
 COMMAND_HANDLER(handle_flash_padded_value_command)
 {
 	if (CMD_ARGC != 2)
@@ -909,10 +939,12 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [incremental] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
 			"and/or erase the region to be used.  Allow optional "
-			"offset from beginning of bank (defaults to zero)",
+			"offset from beginning of bank (defaults to zero).  "
+			"If 'incremental' is specified, only sectors whose "
+			"contents differ from the image are erased and written.",
 	},
 	{
 		.name = "read_bank",
@@ -949,6 +981,14 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.usage = "bank_id value",
 		.help = "Set default flash padded value",
 	},
+	{
+		.name = "write_chunk_size",
+		.handler = handle_flash_write_chunk_size_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id [size_bytes]",
+		.help = "Display or set how much image data 'flash write_image' "
+			"passes to the driver of a bank at a time (0 for no limit).",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -1014,6 +1054,7 @@ COMMAND_HANDLER(handle_flash_bank_command)
 	COMMAND_PARSE_NUMBER(int, CMD_ARGV[3], c->chip_width);
 	COMMAND_PARSE_NUMBER(int, CMD_ARGV[4], c->bus_width);
 	c->default_padded_value = c->erased_value = 0xff;
+	c->write_chunk_size = driver->write_chunk_size;
 	c->num_sectors = 0;
 	c->sectors = NULL;
 	c->num_prot_blocks = 0;
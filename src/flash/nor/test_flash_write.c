@@ -0,0 +1,377 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Runs flash_write_unlock() against an in-memory flash bank that behaves
+ * like the faux driver, with no target behind it.
+ *
+ * Usage: test_flash_write [iterations [seed]]
+ *        test_flash_write bench [chunk_size [MiB]]
+ *
+ * "make check" writes random images with several chunk sizes, full and
+ * incremental, and compares the resulting flash contents with the image.
+ * "bench" writes an Intel hex file of the given size (16 MiB by default)
+ * in one process and reports the time until the driver sees the first
+ * data, the total time and the peak memory use; run it once per chunk
+ * size, as the peak can't go down again within a process.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "imp.h"
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <target/image.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_BANK_BASE		0x08000000
+#define TEST_SECTOR_SIZE	0x10000
+
+/* what the flash layer needs from outside, without a target */
+int debug_level = LOG_LVL_WARNING;
+
+void log_printf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+	va_list ap;
+
+	if (level > debug_level)
+		return;
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+}
+
+void log_printf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+void keep_alive(void)
+{
+}
+
+void flash_set_dirty(void)
+{
+}
+
+struct target *get_target(const char *id)
+{
+	return NULL;
+}
+
+void target_mem_cache_invalidate(struct target *target)
+{
+}
+
+int target_read_buffer(struct target *target, uint32_t address, uint32_t size, uint8_t *buffer)
+{
+	return ERROR_FAIL;
+}
+
+int target_read_memory(struct target *target, uint32_t address, uint32_t size,
+		uint32_t count, uint8_t *buffer)
+{
+	return ERROR_FAIL;
+}
+
+int target_checksum_memory(struct target *target, uint32_t address, uint32_t size, uint32_t *crc)
+{
+	return ERROR_FAIL;
+}
+
+int target_blank_check_memory(struct target *target, uint32_t address, uint32_t size,
+		uint32_t *blank, uint8_t erased_value)
+{
+	return ERROR_FAIL;
+}
+
+FILE *open_file_from_path(const char *file, const char *mode)
+{
+	return fopen(file, mode);
+}
+
+bool flash_driver_name_matches(const char *name, const char *expected)
+{
+	return strcmp(name, expected) == 0;
+}
+
+unsigned get_flash_name_index(const char *name)
+{
+	return 0;
+}
+
+/* the flash itself, kept on the host like the faux driver does */
+static uint8_t *flash_memory;
+static unsigned long write_calls;
+static int64_t first_write_ms;
+
+static int test_erase(struct flash_bank *bank, int first, int last)
+{
+	memset(flash_memory + bank->sectors[first].offset, 0xff,
+			(last - first + 1) * TEST_SECTOR_SIZE);
+	return ERROR_OK;
+}
+
+static int test_protect(struct flash_bank *bank, int set, int first, int last)
+{
+	return ERROR_OK;
+}
+
+static int test_write(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count)
+{
+	if (write_calls++ == 0)
+		first_write_ms = timeval_ms();
+	memcpy(flash_memory + offset, buffer, count);
+	return ERROR_OK;
+}
+
+static int test_read(struct flash_bank *bank, uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	memcpy(buffer, flash_memory + offset, count);
+	return ERROR_OK;
+}
+
+static int test_probe(struct flash_bank *bank)
+{
+	return ERROR_OK;
+}
+
+static struct flash_driver test_flash = {
+	.name = "test",
+	.erase = test_erase,
+	.protect = test_protect,
+	.write = test_write,
+	.read = test_read,
+	.probe = test_probe,
+	.auto_probe = test_probe,
+	.write_chunk_size = FLASH_WRITE_CHUNK_SIZE_DEFAULT,
+};
+
+static struct flash_bank test_bank = {
+	.name = "test",
+	.driver = &test_flash,
+	.base = TEST_BANK_BASE,
+	.erased_value = 0xff,
+	.default_padded_value = 0xff,
+};
+
+static int test_bank_init(uint32_t size)
+{
+	test_bank.size = size;
+	test_bank.num_sectors = size / TEST_SECTOR_SIZE;
+	test_bank.sectors = calloc(test_bank.num_sectors, sizeof(struct flash_sector));
+	flash_memory = malloc(size);
+	if (test_bank.sectors == NULL || flash_memory == NULL)
+		return ERROR_FAIL;
+
+	for (int i = 0; i < test_bank.num_sectors; i++) {
+		test_bank.sectors[i].offset = i * TEST_SECTOR_SIZE;
+		test_bank.sectors[i].size = TEST_SECTOR_SIZE;
+		test_bank.sectors[i].is_erased = -1;
+	}
+	memset(flash_memory, 0xff, size);
+	flash_bank_add(&test_bank);
+
+	return ERROR_OK;
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+#define CHECK_BANK_SIZE		(16 * TEST_SECTOR_SIZE)
+
+static int check(unsigned long iterations)
+{
+	static const uint32_t chunk_sizes[] = { 0, 1, 4096, 100000, FLASH_WRITE_CHUNK_SIZE_DEFAULT };
+	uint8_t *expected = malloc(CHECK_BANK_SIZE);
+	uint8_t *data = malloc(CHECK_BANK_SIZE);
+
+	if (expected == NULL || data == NULL || test_bank_init(CHECK_BANK_SIZE) != ERROR_OK)
+		return 1;
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		struct image image;
+		uint32_t chunk_size = chunk_sizes[rng() % ARRAY_SIZE(chunk_sizes)];
+		bool incremental = rng() & 1;
+		uint32_t address = rng() % (2 * TEST_SECTOR_SIZE);
+		uint32_t previous_end = 0;
+		uint32_t written, skipped = 0;
+
+		if (image_open(&image, "", "build") != ERROR_OK)
+			return 1;
+
+		/* sections with gaps, some within a sector, some across several;
+		 * the gaps between sections are written with the padded value */
+		memcpy(expected, flash_memory, CHECK_BANK_SIZE);
+		for (int s = 1 + rng() % 5; s > 0; s--) {
+			uint32_t size = 1 + rng() % (3 * TEST_SECTOR_SIZE);
+			uint32_t gap = rng() % (2 * TEST_SECTOR_SIZE);
+
+			if (address + size > CHECK_BANK_SIZE)
+				break;
+			for (uint32_t i = 0; i < size; i++)
+				data[i] = rng();
+			/* incremental writes should find some data unchanged */
+			if (incremental && (rng() & 1))
+				memcpy(data, flash_memory + address, size);
+			image_add_section(&image, TEST_BANK_BASE + address, size, 0, data);
+			memcpy(expected + address, data, size);
+			if (previous_end)
+				memset(expected + previous_end, test_bank.default_padded_value,
+						previous_end < address ? address - previous_end : 0);
+			previous_end = address + size;
+			address += size + gap;
+		}
+
+		test_bank.write_chunk_size = chunk_size;
+		int retval = flash_write_unlock(NULL, &image, &written, 0, false, incremental, &skipped);
+		image_close(&image);
+
+		if (retval != ERROR_OK) {
+			printf("FAIL: iteration %lu, chunk size %" PRIu32 ": error %d\n",
+					n, chunk_size, retval);
+			return 1;
+		}
+		if (memcmp(flash_memory, expected, CHECK_BANK_SIZE)) {
+			printf("FAIL: iteration %lu, chunk size %" PRIu32 "%s: flash contents differ\n",
+					n, chunk_size, incremental ? ", incremental" : "");
+			return 1;
+		}
+	}
+
+	free(expected);
+	free(data);
+	return 0;
+}
+
+/* an Intel hex file of @a size bytes of data, in 32 byte records */
+static int write_hex_file(const char *filename, uint32_t size)
+{
+	FILE *f = fopen(filename, "w");
+
+	if (f == NULL)
+		return ERROR_FAIL;
+
+	for (uint32_t offset = 0; offset < size; offset += 32) {
+		uint32_t address = TEST_BANK_BASE + offset;
+		uint8_t sum;
+
+		if (offset % 0x10000 == 0) {
+			sum = 2 + 4 + (address >> 24) + (address >> 16);
+			fprintf(f, ":02000004%04X%02X\n", (unsigned)(address >> 16), (uint8_t)-sum);
+		}
+
+		sum = 32 + (address >> 8) + address;
+		fprintf(f, ":20%04X00", (unsigned)(address & 0xffff));
+		for (int i = 0; i < 32; i++) {
+			uint8_t byte = rng();
+			sum += byte;
+			fprintf(f, "%02X", byte);
+		}
+		fprintf(f, "%02X\n", (uint8_t)-sum);
+	}
+	fprintf(f, ":00000001FF\n");
+
+	return fclose(f) == 0 ? ERROR_OK : ERROR_FAIL;
+}
+
+static long peak_rss_kib(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+	return usage.ru_maxrss;
+}
+
+static int bench(uint32_t chunk_size, uint32_t size)
+{
+	char filename[] = "/tmp/test_flash_write.XXXXXX";
+	struct image image;
+	uint32_t written;
+	int fd = mkstemp(filename);
+
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	rng_state = 1;
+	if (write_hex_file(filename, size) != ERROR_OK
+			|| test_bank_init(DIV_ROUND_UP(size, TEST_SECTOR_SIZE) * TEST_SECTOR_SIZE) != ERROR_OK
+			|| image_open(&image, filename, "ihex") != ERROR_OK) {
+		remove(filename);
+		return 1;
+	}
+
+	long rss_before = peak_rss_kib();
+	test_bank.write_chunk_size = chunk_size;
+	int64_t start = timeval_ms();
+	int retval = flash_write_unlock(NULL, &image, &written, 1, false, false, NULL);
+	int64_t end = timeval_ms();
+
+	image_close(&image);
+	remove(filename);
+	if (retval != ERROR_OK)
+		return 1;
+
+	printf("chunk size %" PRIu32 ", %" PRIu32 " KiB of hex data: first write after %"
+			PRId64 " ms, %lu writes in %" PRId64 " ms, peak RSS +%ld KiB\n",
+			chunk_size, size / 1024, first_write_ms - start, write_calls,
+			end - start, peak_rss_kib() - rss_before);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 2000;
+	uint64_t seed = time(NULL);
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		uint32_t chunk_size = argc > 2 ? strtoul(argv[2], NULL, 0) : FLASH_WRITE_CHUNK_SIZE_DEFAULT;
+		uint32_t mib = argc > 3 ? strtoul(argv[3], NULL, 0) : 16;
+		return bench(chunk_size, mib * 1024 * 1024) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("flash write fuzz test, %lu iterations, seed %llu\n",
+			iterations, (unsigned long long)seed);
+
+	return check(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
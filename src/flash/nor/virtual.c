@@ -67,6 +67,9 @@ FLASH_BANK_COMMAND_HANDLER(virtual_flash_bank_command)
 	/* save master bank name - use this to get settings later */
 	bank->driver_priv = strdup(bank_name);
 
+	/* writes go to the master's driver */
+	bank->write_chunk_size = master_bank->write_chunk_size;
+
 	return ERROR_OK;
 }
 
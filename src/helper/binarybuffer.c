@@ -26,6 +26,10 @@
 #include "log.h"
 #include "binarybuffer.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static const unsigned char bit_reverse_table256[] = {
 	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
 	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
@@ -128,48 +132,76 @@ void *buf_set_ones(void *_buf, unsigned size)
 	return buf;
 }
 
+/* Returns @a n (1-8) bits of @a src starting at bit @a shift (0-7) in the
+ * low bits of the result; the bits above are garbage.  src[1] is only
+ * touched when the bits extend into it. */
+static inline uint8_t buf_get_bits(const uint8_t *src, unsigned shift, unsigned n)
+{
+	uint8_t bits = src[0] >> shift;
+
+	if (shift + n > 8)
+		bits |= src[1] << (8 - shift);
+
+	return bits;
+}
+
+/* Copies @a len bits from @a src, starting at bit @a shift, to the
+ * byte-aligned @a dst, including the bits of a partial last byte. */
+static void buf_set_aligned(uint8_t *dst, const uint8_t *src, unsigned shift, unsigned len)
+{
+	if (shift == 0) {
+		memcpy(dst, src, len / 8);
+		dst += len / 8;
+		src += len / 8;
+	} else {
+		/* each destination word takes the rest of one source word and
+		 * the start of the next */
+		for (; len >= 64; len -= 64) {
+			uint64_t bits = le_to_h_u64(src) >> shift | (uint64_t)src[8] << (64 - shift);
+			h_u64_to_le(dst, bits);
+			dst += 8;
+			src += 8;
+		}
+		for (; len >= 8; len -= 8) {
+			*dst++ = src[0] >> shift | src[1] << (8 - shift);
+			src++;
+		}
+	}
+
+	len %= 8;
+	if (len) {
+		uint8_t mask = (1 << len) - 1;
+		*dst = (*dst & ~mask) | (buf_get_bits(src, shift, len) & mask);
+	}
+}
+
 void *buf_set_buf(const void *_src, unsigned src_start,
 	void *_dst, unsigned dst_start, unsigned len)
 {
-	const uint8_t *src = _src;
-	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
-
-	sb = src_start / 8;
-	db = dst_start / 8;
-	sq = src_start % 8;
-	dq = dst_start % 8;
-	lb = len / 8;
-	lq = len % 8;
-
-	src += sb;
-	dst += db;
-
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
+	const uint8_t *src = (const uint8_t *)_src + src_start / 8;
+	uint8_t *dst = (uint8_t *)_dst + dst_start / 8;
+	unsigned sq = src_start % 8;
+	unsigned dq = dst_start % 8;
+
+	if (len == 0)
 		return _dst;
-	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
-		}
+	/* fill up the first destination byte, then the destination is byte
+	 * aligned and the source just shifted by a constant amount */
+	if (dq) {
+		unsigned n = MIN(len, 8 - dq);
+		uint8_t mask = ((1 << n) - 1) << dq;
+
+		*dst = (*dst & ~mask) | ((buf_get_bits(src, sq, n) << dq) & mask);
+		dst++;
+		sq += n;
+		src += sq / 8;
+		sq %= 8;
+		len -= n;
 	}
 
+	buf_set_aligned(dst, src, sq, len);
+
 	return _dst;
 }
 
@@ -374,6 +406,100 @@ void bit_copy_discard(struct bit_copy_queue *q)
 	}
 }
 
+/* value + 1 of each hex digit, 0 for anything else */
+static const uint8_t hex_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/* value of a hex digit, or -1 */
+static inline int hex_value(char c)
+{
+	return hex_values[(uint8_t)c] - 1;
+}
+
+#ifdef __SSE2__
+
+/* Map 16 nibbles (0..15) to their lower case hex digits. */
+static inline __m128i hex_digits_sse2(__m128i nibbles)
+{
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i letter_offset = _mm_set1_epi8('a' - '0' - 10);
+	__m128i is_letter = _mm_cmpgt_epi8(nibbles, nine);
+
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+			_mm_and_si128(is_letter, letter_offset));
+}
+
+/* Encode 16 bytes at a time, returns the number of bytes done. */
+static size_t hexify_sse2(char *hex, const uint8_t *bin, size_t count, uint8_t *sum)
+{
+	const __m128i low_nibble = _mm_set1_epi8(0x0f);
+	__m128i acc = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(bin + i));
+		__m128i hi = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+		__m128i lo = hex_digits_sse2(_mm_and_si128(v, low_nibble));
+		__m128i out0 = _mm_unpacklo_epi8(hi, lo);
+		__m128i out1 = _mm_unpackhi_epi8(hi, lo);
+
+		_mm_storeu_si128((__m128i *)(hex + 2 * i), out0);
+		_mm_storeu_si128((__m128i *)(hex + 2 * i + 16), out1);
+
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(out0, _mm_setzero_si128()));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(out1, _mm_setzero_si128()));
+	}
+
+	*sum += _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+
+	return i;
+}
+
+/* Decode 32 hex digits at a time, stops at the first block that holds
+ * anything but hex digits. Returns the number of bytes done. */
+static size_t unhexify_sse2(uint8_t *bin, const char *hex, size_t count)
+{
+	const __m128i minus_one = _mm_set1_epi8(-1);
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i result[2];
+
+		for (int half = 0; half < 2; half++) {
+			__m128i c = _mm_loadu_si128((const __m128i *)(hex + 2 * i + 16 * half));
+			/* the subtractions wrap, so each range check is exact */
+			__m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+			__m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+					_mm_set1_epi8('a'));
+			__m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, minus_one),
+					_mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+			__m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letter, minus_one),
+					_mm_cmplt_epi8(letter, _mm_set1_epi8(6)));
+
+			if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff)
+				return i;
+
+			__m128i nibbles = _mm_or_si128(_mm_and_si128(is_digit, digit),
+					_mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+
+			/* high nibble in the low byte of each 16 bit lane */
+			result[half] = _mm_or_si128(
+					_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4),
+					_mm_srli_epi16(nibbles, 8));
+		}
+
+		_mm_storeu_si128((__m128i *)(bin + i), _mm_packus_epi16(result[0], result[1]));
+	}
+
+	return i;
+}
+
+#endif /* __SSE2__ */
+
 /**
  * Convert a string of hexadecimal pairs into its binary
  * representation.
@@ -388,28 +514,67 @@ void bit_copy_discard(struct bit_copy_queue *q)
  */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 {
-	size_t i;
-	char tmp;
+	size_t i = 0;
 
 	if (!bin || !hex)
 		return 0;
 
-	memset(bin, 0, count);
+#ifdef __SSE2__
+	/* the blocks must not be read past the end of the string, which
+	 * may well end before 2 * count characters */
+	i = unhexify_sse2(bin, hex, strnlen(hex, 2 * count) / 2);
+#endif
 
-	for (i = 0; i < 2 * count; i++) {
-		if (hex[i] >= 'a' && hex[i] <= 'f')
-			tmp = hex[i] - 'a' + 10;
-		else if (hex[i] >= 'A' && hex[i] <= 'F')
-			tmp = hex[i] - 'A' + 10;
-		else if (hex[i] >= '0' && hex[i] <= '9')
-			tmp = hex[i] - '0';
-		else
-			return i / 2;
+	for (; i < count; i++) {
+		int hi = hex_value(hex[2 * i]);
+		int lo = hi < 0 ? -1 : hex_value(hex[2 * i + 1]);
+
+		if (lo < 0) {
+			/* leave the same result as a digit by digit conversion */
+			memset(bin + i, 0, count - i);
+			if (hi >= 0)
+				bin[i] = hi << 4;
+			return i;
+		}
 
-		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+		bin[i] = (hi << 4) | lo;
 	}
 
-	return i / 2;
+	return i;
+}
+
+/**
+ * Convert binary data into a string of hexadecimal pairs, without
+ * null-terminator, and add up the generated characters on the way.
+ *
+ * This is what the GDB remote protocol needs for memory and register
+ * replies, the packet checksum comes for free with the conversion.
+ *
+ * @param[out] hex Buffer to store the @p count * 2 hexadecimal characters.
+ * @param[in] bin Buffer with binary data to convert into hexadecimal pairs.
+ * @param[in] count Number of bytes to convert.
+ *
+ * @returns The sum, modulo 256, of all characters stored into @p hex.
+ */
+uint8_t hexify_checksum(char *hex, const uint8_t *bin, size_t count)
+{
+	uint8_t sum = 0;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	i = hexify_sse2(hex, bin, count, &sum);
+#endif
+
+	for (; i < count; i++) {
+		char hi = hex_digits[bin[i] >> 4];
+		char lo = hex_digits[bin[i] & 0x0f];
+
+		hex[2 * i] = hi;
+		hex[2 * i + 1] = lo;
+		sum += hi + lo;
+	}
+
+	return sum;
 }
 
 /**
@@ -426,16 +591,21 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
  */
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
+	size_t whole = count;
 	size_t i;
-	uint8_t tmp;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
-	}
+	if (whole > (length - 1) / 2)
+		whole = (length - 1) / 2;
+
+	hexify_checksum(hex, bin, whole);
+	i = 2 * whole;
+
+	/* the output may end in the middle of a byte */
+	if (whole < count && i < length - 1)
+		hex[i++] = hex_digits[bin[whole] >> 4];
 
 	hex[i] = 0;
 
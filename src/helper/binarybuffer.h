@@ -48,12 +48,16 @@ static inline void buf_set_u32(uint8_t *_buffer,
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
 	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
-			else
-				buffer[i / 8] &= ~(1 << (i % 8));
-		}
+		/* the field spans at most five bytes, shift it into place in a
+		 * 64-bit word and merge it into those bytes only */
+		unsigned shift = first % 8;
+		unsigned bytes = (shift + num + 7) / 8;
+		uint64_t mask = (((uint64_t)1 << num) - 1) << shift;
+		uint64_t bits = ((uint64_t)value << shift) & mask;
+
+		buffer += first / 8;
+		for (unsigned i = 0; i < bytes; i++)
+			buffer[i] = (buffer[i] & ~(mask >> (8 * i))) | (bits >> (8 * i));
 	}
 }
 
@@ -86,11 +90,20 @@ static inline void buf_set_u64(uint8_t *_buffer,
 		buffer[1] = (value >> 8) & 0xff;
 		buffer[0] = (value >> 0) & 0xff;
 	} else {
-		for (unsigned i = first; i < first + num; i++) {
-			if (((value >> (i - first)) & 1) == 1)
-				buffer[i / 8] |= 1 << (i % 8);
-			else
-				buffer[i / 8] &= ~(1 << (i % 8));
+		/* as buf_set_u32(), but a misaligned field can spill into a
+		 * ninth byte that doesn't fit the 64-bit word */
+		unsigned shift = first % 8;
+		unsigned bytes = (shift + num + 7) / 8;
+		uint64_t field = num < 64 ? ((uint64_t)1 << num) - 1 : ~(uint64_t)0;
+		uint64_t mask = field << shift;
+		uint64_t bits = (value << shift) & mask;
+
+		buffer += first / 8;
+		for (unsigned i = 0; i < bytes && i < 8; i++)
+			buffer[i] = (buffer[i] & ~(mask >> (8 * i))) | (bits >> (8 * i));
+		if (bytes > 8) {
+			uint8_t top = field >> (64 - shift);
+			buffer[8] = (buffer[8] & ~top) | ((value >> (64 - shift)) & top);
 		}
 	}
 }
@@ -115,12 +128,16 @@ static inline uint32_t buf_get_u32(const uint8_t *_buffer,
 				(((uint32_t)buffer[1]) << 8) |
 				(((uint32_t)buffer[0]) << 0);
 	} else {
-		uint32_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result |= 1 << (i - first);
-		}
-		return result;
+		/* gather the (at most five) bytes the field spans */
+		unsigned shift = first % 8;
+		unsigned bytes = (shift + num + 7) / 8;
+		uint64_t bits = 0;
+
+		buffer += first / 8;
+		for (unsigned i = 0; i < bytes; i++)
+			bits |= (uint64_t)buffer[i] << (8 * i);
+
+		return (bits >> shift) & (((uint64_t)1 << num) - 1);
 	}
 }
 
@@ -153,12 +170,18 @@ static inline uint64_t buf_get_u64(const uint8_t *_buffer,
 				(((uint64_t)buffer[1]) << 8)  |
 				(((uint64_t)buffer[0]) << 0));
 	} else {
-		uint64_t result = 0;
-		for (unsigned i = first; i < first + num; i++) {
-			if (((buffer[i / 8] >> (i % 8)) & 1) == 1)
-				result = result | ((uint64_t)1 << (uint64_t)(i - first));
-		}
-		return result;
+		unsigned shift = first % 8;
+		unsigned bytes = (shift + num + 7) / 8;
+		uint64_t bits = 0;
+
+		buffer += first / 8;
+		for (unsigned i = 0; i < bytes && i < 8; i++)
+			bits |= (uint64_t)buffer[i] << (8 * i);
+		bits >>= shift;
+		if (bytes > 8)
+			bits |= (uint64_t)buffer[8] << (64 - shift);
+
+		return num < 64 ? bits & (((uint64_t)1 << num) - 1) : bits;
 	}
 }
 
@@ -236,6 +259,7 @@ void bit_copy_discard(struct bit_copy_queue *q);
  * used in ti-icdi driver and gdb server */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count);
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t out_maxlen);
+uint8_t hexify_checksum(char *hex, const uint8_t *bin, size_t count);
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count);
 
 #endif /* OPENOCD_HELPER_BINARYBUFFER_H */
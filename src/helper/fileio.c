@@ -30,14 +30,32 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	/* mapping handed out by fileio_map() */
+	const uint8_t *map;
+	size_t map_size;
 };
 
+static void fileio_unmap(struct fileio *fileio)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap((void *)fileio->map, fileio->map_size);
+#endif
+
+	fileio->map = NULL;
+	fileio->map_size = 0;
+}
+
 static inline int fileio_close_local(struct fileio *fileio)
 {
 	int retval = fclose(fileio->file);
@@ -127,6 +145,8 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
+	tmp->map_size = 0;
 
 	retval = fileio_open_local(tmp);
 
@@ -145,6 +165,8 @@ int fileio_close(struct fileio *fileio)
 {
 	int retval;
 
+	fileio_unmap(fileio);
+
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -167,6 +189,37 @@ int fileio_seek(struct fileio *fileio, size_t position)
 	return ERROR_OK;
 }
 
+int fileio_map(struct fileio *fileio, const uint8_t **data, size_t *size)
+{
+	if (fileio->map) {
+		*data = fileio->map;
+		*size = fileio->map_size;
+		return ERROR_OK;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	/* nothing to map, and mmap() refuses zero length mappings */
+	if (fileio->access != FILEIO_READ || fileio->size == 0)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE, fileno(fileio->file), 0);
+	if (map == MAP_FAILED) {
+		LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+
+	fileio->map = map;
+	fileio->map_size = fileio->size;
+
+	*data = fileio->map;
+	*size = fileio->map_size;
+
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
+
 static int fileio_local_read(struct fileio *fileio, size_t size, void *buffer,
 		size_t *size_read)
 {
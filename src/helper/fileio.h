@@ -55,6 +55,14 @@ int fileio_read(struct fileio *fileio,
 int fileio_write(struct fileio *fileio,
 		size_t size, const void *buffer, size_t *size_written);
 
+/**
+ * Map the whole content of a file opened for reading into memory.  The
+ * mapping stays valid until fileio_close().
+ * @returns ERROR_FILEIO_OPERATION_NOT_SUPPORTED if the host or the file
+ * (e.g. an empty one) does not allow it; use fileio_read() then.
+ */
+int fileio_map(struct fileio *fileio, const uint8_t **data, size_t *size);
+
 int fileio_read_u32(struct fileio *fileio, uint32_t *data);
 int fileio_write_u32(struct fileio *fileio, uint32_t data);
 int fileio_size(struct fileio *fileio, size_t *size);
@@ -61,8 +61,43 @@ static const char * const log_strings[5] = {
 static int count;
 
 static struct store_log_forward *log_head;
+static struct store_log_forward *log_tail;
 static int log_forward_count;
 
+/*
+ * Log output is collected in a buffer instead of being flushed line by
+ * line; with debug output enabled the flushes alone used to dominate.
+ * The buffer is written out when it fills up, when a message of level
+ * info or above comes along, when LOG_FLUSH_INTERVAL has passed since
+ * the last flush and whenever the server loop comes around or
+ * keep_alive() is called.
+ */
+#define LOG_BUFFER_SIZE		(64 * 1024)
+#define LOG_FLUSH_INTERVAL	100		/* ms */
+
+static char log_buffer[LOG_BUFFER_SIZE];
+static size_t log_buffer_len;
+static int64_t log_last_flush;
+
+/*
+ * Rate limiting of debug messages per call site, i.e. per LOG_DEBUG()
+ * statement.  A call site that logs more than log_rate_limit messages
+ * within a second is silenced for the rest of that second; how many
+ * messages were dropped is reported once it logs again.
+ */
+#define LOG_CALLSITES		1024
+
+struct log_callsite {
+	const char *file;
+	unsigned line;
+	int64_t window_start;
+	unsigned count;
+	unsigned suppressed;
+};
+
+static struct log_callsite log_callsites[LOG_CALLSITES];
+static unsigned log_rate_limit;		/* messages per second, 0 for no limit */
+
 struct store_log_forward {
 	struct store_log_forward *next;
 	const char *file;
@@ -92,15 +127,106 @@ static void log_forward(const char *file, unsigned line, const char *function, c
 		log->next = NULL;
 		if (log_head == NULL)
 			log_head = log;
-		else {
-			/* append to tail */
-			struct store_log_forward *t;
-			t = log_head;
-			while (t->next != NULL)
-				t = t->next;
-			t->next = log;
+		else
+			log_tail->next = log;
+		log_tail = log;
+	}
+}
+
+void log_flush(void)
+{
+	if (log_output == NULL || log_buffer_len == 0)
+		return;
+
+	fwrite(log_buffer, 1, log_buffer_len, log_output);
+	log_buffer_len = 0;
+	fflush(log_output);
+
+	log_last_flush = timeval_ms();
+}
+
+static void log_write(const char *format, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 1, 2)));
+
+static void log_write(const char *format, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, format);
+	len = vsnprintf(log_buffer + log_buffer_len, sizeof(log_buffer) - log_buffer_len, format, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return;
+
+	if ((size_t)len < sizeof(log_buffer) - log_buffer_len) {
+		log_buffer_len += len;
+		return;
+	}
+
+	/* didn't fit, make room and try again */
+	log_flush();
+
+	va_start(ap, format);
+	if ((size_t)len < sizeof(log_buffer)) {
+		vsnprintf(log_buffer, sizeof(log_buffer), format, ap);
+		log_buffer_len = len;
+	} else
+		vfprintf(log_output, format, ap);
+	va_end(ap);
+}
+
+/* Should a message from this call site be dropped? */
+static bool log_rate_limited(const char *file, unsigned line)
+{
+	/* file names are string literals, the pointer identifies the file */
+	uintptr_t key = (uintptr_t)file ^ (line * 2654435761u);
+	unsigned h = (key ^ (key >> 16)) % LOG_CALLSITES;
+	struct log_callsite *site = NULL;
+
+	for (unsigned i = 0; i < 8; i++) {
+		struct log_callsite *c = &log_callsites[(h + i) % LOG_CALLSITES];
+		if (c->file == NULL || (c->file == file && c->line == line)) {
+			site = c;
+			break;
 		}
 	}
+
+	/* too many call sites, don't bother */
+	if (site == NULL)
+		return false;
+
+	int64_t now = timeval_ms();
+
+	if (site->file == NULL) {
+		site->file = file;
+		site->line = line;
+		site->window_start = now;
+	}
+
+	if (now - site->window_start >= 1000) {
+		unsigned suppressed = site->suppressed;
+
+		site->window_start = now;
+		site->count = 0;
+		site->suppressed = 0;
+
+		if (suppressed) {
+			const char *f = strrchr(file, '/');
+			log_printf_lf(LOG_LVL_DEBUG, file, line, "log_rate_limit",
+					"%u messages from %s:%u suppressed", suppressed,
+					f ? f + 1 : file, line);
+		}
+	}
+
+	if (site->count >= log_rate_limit) {
+		site->suppressed++;
+		return true;
+	}
+
+	site->count++;
+	return false;
 }
 
 /* The log_puts() serves to somewhat different goals:
@@ -122,8 +248,8 @@ static void log_puts(enum log_levels level,
 	char *f;
 	if (level == LOG_LVL_OUTPUT) {
 		/* do not prepend any headers, just print out what we were given and return */
-		fputs(string, log_output);
-		fflush(log_output);
+		log_write("%s", string);
+		log_flush();
 		return;
 	}
 
@@ -139,7 +265,7 @@ static void log_puts(enum log_levels level,
 			struct mallinfo info;
 			info = mallinfo();
 #endif
-			fprintf(log_output, "%s%d %" PRId64 " %s:%d %s()"
+			log_write("%s%d %" PRId64 " %s:%d %s()"
 #ifdef _DEBUG_FREE_SPACE_
 				" %d"
 #endif
@@ -151,7 +277,7 @@ static void log_puts(enum log_levels level,
 		} else {
 			/* if we are using gdb through pipes then we do not want any output
 			 * to the pipe otherwise we get repeated strings */
-			fprintf(log_output, "%s%s",
+			log_write("%s%s",
 				(level > LOG_LVL_USER) ? log_strings[level + 1] : "", string);
 		}
 	} else {
@@ -159,7 +285,9 @@ static void log_puts(enum log_levels level,
 		 *nothing. */
 	}
 
-	fflush(log_output);
+	/* what the user needs to see right away, the rest can wait a little */
+	if (level <= LOG_LVL_INFO || timeval_ms() - log_last_flush >= LOG_FLUSH_INTERVAL)
+		log_flush();
 
 	/* Never forward LOG_LVL_DEBUG, too verbose and they can be found in the log if need be */
 	if (level <= LOG_LVL_INFO)
@@ -201,6 +329,9 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	if (level > debug_level)
 		return;
 
+	if (level == LOG_LVL_DEBUG && log_rate_limit && log_rate_limited(file, line))
+		return;
+
 	tmp = alloc_vprintf(format, args);
 
 	if (!tmp)
@@ -252,13 +383,31 @@ COMMAND_HANDLER(handle_log_output_command)
 	if (CMD_ARGC == 1) {
 		FILE *file = fopen(CMD_ARGV[0], "w");
 
-		if (file)
+		if (file) {
+			log_flush();
 			log_output = file;
+		}
 	}
 
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_log_rate_limit_command)
+{
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], log_rate_limit);
+	else if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (log_rate_limit)
+		command_print(CMD_CTX, "log_rate_limit: %u debug messages per second and call site",
+				log_rate_limit);
+	else
+		command_print(CMD_CTX, "log_rate_limit: off");
+
+	return ERROR_OK;
+}
+
 static struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -276,6 +425,15 @@ static struct command_registration log_command_handlers[] = {
 			"2 (default) adds other info; 3 adds debugging.",
 		.usage = "number",
 	},
+	{
+		.name = "log_rate_limit",
+		.handler = handle_log_rate_limit_command,
+		.mode = COMMAND_ANY,
+		.help = "Limit the number of debug messages per second that "
+			"each LOG_DEBUG statement may log (0, the default, "
+			"means no limit).",
+		.usage = "[messages_per_second]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -304,11 +462,14 @@ void log_init(void)
 	if (log_output == NULL)
 		log_output = stderr;
 
-	start = last_time = timeval_ms();
+	start = last_time = log_last_flush = timeval_ms();
+
+	atexit(log_flush);
 }
 
 int set_log_output(struct command_context *cmd_ctx, FILE *output)
 {
+	log_flush();
 	log_output = output;
 	return ERROR_OK;
 }
@@ -415,6 +576,11 @@ char *alloc_printf(const char *format, ...)
 void keep_alive()
 {
 	current_time = timeval_ms();
+
+	/* long operations may not log again for a while */
+	if (log_buffer_len && current_time - log_last_flush >= LOG_FLUSH_INTERVAL)
+		log_flush();
+
 	if (current_time-last_time > 1000) {
 		extern int gdb_actual_connections;
 
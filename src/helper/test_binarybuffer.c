@@ -0,0 +1,230 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Checks the bitfield accessors of binarybuffer.h against straightforward
+ * bit by bit implementations, with random buffers, offsets and widths.
+ * Every byte of the buffers is compared, so a write outside of the field
+ * is caught as well as a wrong value.
+ *
+ * Usage: test_binarybuffer [iterations [seed]]
+ *        test_binarybuffer bench
+ *
+ * "make check" runs the fuzz test; "bench" times the accessors against
+ * the bit by bit versions instead.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "binarybuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* big enough for a 64 bit field at any bit offset the fuzzer picks */
+#define TEST_BUF_SIZE		48
+#define TEST_MAX_OFFSET		(8 * (TEST_BUF_SIZE - 9))
+
+static uint32_t ref_get_u32(const uint8_t *buffer, unsigned first, unsigned num)
+{
+	uint32_t result = 0;
+
+	for (unsigned i = 0; i < num; i++) {
+		if ((buffer[(first + i) / 8] >> ((first + i) % 8)) & 1)
+			result |= (uint32_t)1 << i;
+	}
+
+	return result;
+}
+
+static uint64_t ref_get_u64(const uint8_t *buffer, unsigned first, unsigned num)
+{
+	uint64_t result = 0;
+
+	for (unsigned i = 0; i < num; i++) {
+		if ((buffer[(first + i) / 8] >> ((first + i) % 8)) & 1)
+			result |= (uint64_t)1 << i;
+	}
+
+	return result;
+}
+
+static void ref_set_u64(uint8_t *buffer, unsigned first, unsigned num, uint64_t value)
+{
+	for (unsigned i = 0; i < num; i++) {
+		unsigned bit = first + i;
+
+		if ((value >> i) & 1)
+			buffer[bit / 8] |= 1 << (bit % 8);
+		else
+			buffer[bit / 8] &= ~(1 << (bit % 8));
+	}
+}
+
+static void ref_set_buf(const uint8_t *src, unsigned src_start,
+		uint8_t *dst, unsigned dst_start, unsigned len)
+{
+	for (unsigned i = 0; i < len; i++)
+		ref_set_u64(dst, dst_start + i, 1, (src[(src_start + i) / 8] >> ((src_start + i) % 8)) & 1);
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static void rng_fill(uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		buf[i] = rng();
+}
+
+static int fail(const char *what, unsigned long iteration, unsigned first, unsigned num)
+{
+	printf("FAIL: %s, iteration %lu, first %u, num %u\n", what, iteration, first, num);
+	return 1;
+}
+
+static int fuzz(unsigned long iterations)
+{
+	uint8_t buf[TEST_BUF_SIZE], ref[TEST_BUF_SIZE], src[TEST_BUF_SIZE];
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		unsigned first = rng() % TEST_MAX_OFFSET;
+		unsigned num32 = 1 + rng() % 32;
+		unsigned num64 = 1 + rng() % 64;
+		uint64_t value = rng();
+
+		rng_fill(buf, sizeof(buf));
+
+		if (buf_get_u32(buf, first, num32) != ref_get_u32(buf, first, num32))
+			return fail("buf_get_u32", n, first, num32);
+		if (buf_get_u64(buf, first, num64) != ref_get_u64(buf, first, num64))
+			return fail("buf_get_u64", n, first, num64);
+
+		memcpy(ref, buf, sizeof(buf));
+		buf_set_u32(buf, first, num32, value);
+		ref_set_u64(ref, first, num32, value);
+		if (memcmp(buf, ref, sizeof(buf)))
+			return fail("buf_set_u32", n, first, num32);
+
+		buf_set_u64(buf, first, num64, value);
+		ref_set_u64(ref, first, num64, value);
+		if (memcmp(buf, ref, sizeof(buf)))
+			return fail("buf_set_u64", n, first, num64);
+
+		unsigned src_start = rng() % (8 * TEST_BUF_SIZE);
+		unsigned dst_start = rng() % (8 * TEST_BUF_SIZE);
+		unsigned len = rng() % (8 * TEST_BUF_SIZE - MAX(src_start, dst_start) + 1);
+
+		rng_fill(src, sizeof(src));
+		buf_set_buf(src, src_start, buf, dst_start, len);
+		ref_set_buf(src, src_start, ref, dst_start, len);
+		if (memcmp(buf, ref, sizeof(buf)))
+			return fail("buf_set_buf", n, dst_start, len);
+	}
+
+	return 0;
+}
+
+#define BENCH_FIELDS		4096
+#define BENCH_ROUNDS		2000
+#define BENCH_COPY_BYTES	4096
+
+static double elapsed_ns(clock_t start, unsigned long count)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count;
+}
+
+static void bench(void)
+{
+	static uint8_t buf[BENCH_FIELDS * 5], dst[BENCH_COPY_BYTES + 1];
+	volatile uint32_t sink = 0;
+	unsigned long count = (unsigned long)BENCH_FIELDS * BENCH_ROUNDS;
+	clock_t start;
+
+	rng_fill(buf, sizeof(buf));
+
+	/* 32 bit fields at every bit offset modulo 8 */
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		for (unsigned i = 0; i < BENCH_FIELDS; i++)
+			sink += buf_get_u32(buf, 33 * i, 32);
+	printf("buf_get_u32, unaligned:  %6.1f ns\n", elapsed_ns(start, count));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		for (unsigned i = 0; i < BENCH_FIELDS; i++)
+			sink += ref_get_u32(buf, 33 * i, 32);
+	printf("  bit by bit:            %6.1f ns\n", elapsed_ns(start, count));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		for (unsigned i = 0; i < BENCH_FIELDS; i++)
+			buf_set_u32(buf, 33 * i, 32, i);
+	printf("buf_set_u32, unaligned:  %6.1f ns\n", elapsed_ns(start, count));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		for (unsigned i = 0; i < BENCH_FIELDS; i++)
+			ref_set_u64(buf, 33 * i, 32, i);
+	printf("  bit by bit:            %6.1f ns\n", elapsed_ns(start, count));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		bit_copy(dst, 3, buf, r % 8, 8 * BENCH_COPY_BYTES - 8);
+	printf("bit_copy %d bytes:     %8.1f ns\n", BENCH_COPY_BYTES, elapsed_ns(start, BENCH_ROUNDS));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS / 10; r++)
+		ref_set_buf(buf, r % 8, dst, 3, 8 * BENCH_COPY_BYTES - 8);
+	printf("  bit by bit:          %8.1f ns\n", elapsed_ns(start, BENCH_ROUNDS / 10));
+
+	(void)sink;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 200000;
+	uint64_t seed = time(NULL);
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		rng_state = 1;
+		bench();
+		return 0;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("binarybuffer fuzz test, %lu iterations, seed %llu\n",
+			iterations, (unsigned long long)seed);
+
+	return fuzz(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Checks hexify(), hexify_checksum() and unhexify() against the digit by
+ * digit conversions they replaced, with random data and lengths, mixed
+ * case digits and strings that end early or hold something else.  Each
+ * hex string is allocated to its exact length, so that a build with
+ * -fsanitize=address catches a read past its end.
+ *
+ * The program is built twice: test_hexify uses the SSE2 kernels where the
+ * compiler targets SSE2, test_hexify_scalar is built without them.
+ *
+ * Usage: test_hexify [iterations [seed]]
+ *        test_hexify bench
+ *
+ * "make check" runs the fuzz test; "bench" compares the throughput of
+ * the conversions with the digit by digit ones.  Run "bench" in both
+ * programs to compare the SSE2 and the scalar code.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "binarybuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#define TEST_HEX_PATH	"SSE2"
+#else
+#define TEST_HEX_PATH	"scalar"
+#endif
+
+static const char ref_digits[] = "0123456789abcdef";
+
+/* the conversions as they were, one digit at a time */
+static size_t ref_unhexify(uint8_t *bin, const char *hex, size_t count)
+{
+	size_t i;
+	char tmp;
+
+	memset(bin, 0, count);
+
+	for (i = 0; i < 2 * count; i++) {
+		if (hex[i] >= 'a' && hex[i] <= 'f')
+			tmp = hex[i] - 'a' + 10;
+		else if (hex[i] >= 'A' && hex[i] <= 'F')
+			tmp = hex[i] - 'A' + 10;
+		else if (hex[i] >= '0' && hex[i] <= '9')
+			tmp = hex[i] - '0';
+		else
+			return i / 2;
+
+		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+	}
+
+	return i / 2;
+}
+
+static size_t ref_hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
+{
+	size_t i;
+
+	if (!length)
+		return 0;
+
+	for (i = 0; i < length - 1 && i < 2 * count; i++)
+		hex[i] = ref_digits[(bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f];
+
+	hex[i] = 0;
+
+	return i;
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static void rng_fill(uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		buf[i] = rng();
+}
+
+/* long enough for several 16 byte blocks and a tail */
+#define TEST_MAX_BYTES		300
+
+static int fail(const char *what, unsigned long iteration, size_t count)
+{
+	printf("FAIL: %s, iteration %lu, count %zu\n", what, iteration, count);
+	return 1;
+}
+
+static int fuzz(unsigned long iterations)
+{
+	uint8_t bin[TEST_MAX_BYTES], out[TEST_MAX_BYTES], ref[TEST_MAX_BYTES];
+	char hex[2 * TEST_MAX_BYTES + 1], ref_hex[2 * TEST_MAX_BYTES + 1];
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		size_t count = rng() % (TEST_MAX_BYTES + 1);
+		size_t length = rng() % (2 * count + 2);
+
+		rng_fill(bin, count);
+
+		/* hexify(), cut short anywhere, in the middle of a byte too */
+		memset(hex, 'x', sizeof(hex));
+		memset(ref_hex, 'x', sizeof(ref_hex));
+		if (rng() & 1)
+			length = 2 * count + 1;
+		if (hexify(hex, bin, count, length) != ref_hexify(ref_hex, bin, count, length)
+				|| memcmp(hex, ref_hex, sizeof(hex)))
+			return fail("hexify", n, count);
+
+		uint8_t sum = 0;
+		memset(hex, 'x', sizeof(hex));
+		ref_hexify(ref_hex, bin, count, 2 * count + 1);
+		for (size_t i = 0; i < 2 * count; i++)
+			sum += ref_hex[i];
+		if (hexify_checksum(hex, bin, count) != sum
+				|| memcmp(hex, ref_hex, 2 * count) || hex[2 * count] != 'x')
+			return fail("hexify_checksum", n, count);
+
+		/* unhexify() of mixed case digits, maybe with something else
+		 * in them, maybe ending before count pairs */
+		for (size_t i = 0; i < 2 * count; i++) {
+			if (rng() % 4 == 0 && ref_hex[i] >= 'a')
+				ref_hex[i] += 'A' - 'a';
+		}
+		size_t hex_len = 2 * count;
+		switch (rng() % 4) {
+		case 0:
+			if (count)
+				ref_hex[rng() % (2 * count)] = "gG/:@`\x80 "[rng() % 8];
+			break;
+		case 1:
+			hex_len = rng() % (2 * count + 1);
+			break;
+		}
+
+		char *input = malloc(hex_len + 1);
+		if (input == NULL)
+			return 1;
+		memcpy(input, ref_hex, hex_len);
+		input[hex_len] = 0;
+
+		rng_fill(out, count);
+		memcpy(ref, out, count);
+		size_t converted = unhexify(out, input, count);
+		size_t ref_converted = ref_unhexify(ref, input, count);
+		free(input);
+
+		if (converted != ref_converted || memcmp(out, ref, count))
+			return fail("unhexify", n, count);
+	}
+
+	return 0;
+}
+
+#define BENCH_BYTES		(1024 * 1024)
+#define BENCH_ROUNDS		50
+
+static double mb_per_s(clock_t start, unsigned rounds)
+{
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	return (double)BENCH_BYTES * rounds / seconds / 1e6;
+}
+
+static int bench(void)
+{
+	uint8_t *bin = malloc(BENCH_BYTES);
+	char *hex = malloc(2 * BENCH_BYTES + 1);
+	volatile unsigned sink = 0;
+	clock_t start;
+
+	if (bin == NULL || hex == NULL)
+		return 1;
+
+	rng_fill(bin, BENCH_BYTES);
+	printf("%s code, MB of binary data per second:\n", TEST_HEX_PATH);
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		sink += hexify(hex, bin, BENCH_BYTES, 2 * BENCH_BYTES + 1);
+	printf("hexify             %8.0f\n", mb_per_s(start, BENCH_ROUNDS));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		sink += hexify_checksum(hex, bin, BENCH_BYTES);
+	printf("hexify_checksum    %8.0f\n", mb_per_s(start, BENCH_ROUNDS));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS / 10; r++)
+		sink += ref_hexify(hex, bin, BENCH_BYTES, 2 * BENCH_BYTES + 1);
+	printf("  digit by digit   %8.0f\n", mb_per_s(start, BENCH_ROUNDS / 10));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		sink += unhexify(bin, hex, BENCH_BYTES);
+	printf("unhexify           %8.0f\n", mb_per_s(start, BENCH_ROUNDS));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS / 10; r++)
+		sink += ref_unhexify(bin, hex, BENCH_BYTES);
+	printf("  digit by digit   %8.0f\n", mb_per_s(start, BENCH_ROUNDS / 10));
+
+	free(bin);
+	free(hex);
+	(void)sink;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 100000;
+	uint64_t seed = time(NULL);
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		rng_state = 1;
+		return bench() ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("hex conversion fuzz test, %s code, %lu iterations, seed %llu\n",
+			TEST_HEX_PATH, iterations, (unsigned long long)seed);
+
+	return fuzz(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -41,6 +41,8 @@ int timeval_add_time(struct timeval *result, long sec, long usec);
 
 /** @returns gettimeofday() timeval as 64-bit in ms */
 int64_t timeval_ms(void);
+/** @returns a monotonic clock in ms, falls back to timeval_ms() */
+int64_t monotonic_ms(void);
 
 struct duration {
 	struct timeval start;
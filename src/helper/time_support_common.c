@@ -39,3 +39,16 @@ int64_t timeval_ms(void)
 		return retval;
 	return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
 }
+
+/* like timeval_ms(), but not affected by changes of the wall clock,
+ * which makes it the one to use for deadlines
+ */
+int64_t monotonic_ms(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+		return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+	return timeval_ms();
+}
@@ -34,6 +34,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "trace.h"
 #include <transport/transport.h>
 
 #ifdef HAVE_STRINGS_H
@@ -520,6 +521,9 @@ static const struct command_registration interface_command_handlers[] = {
 			"[srst_push_pull|srst_open_drain] "
 			"[connect_deassert_srst|connect_assert_srst]",
 	},
+	{
+		.chain = jtag_trace_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
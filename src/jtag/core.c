@@ -33,6 +33,7 @@
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
+#include "trace.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
 
@@ -836,7 +837,14 @@ int default_interface_jtag_execute_queue(void)
 		return ERROR_FAIL;
 	}
 
-	return jtag->execute_queue();
+	if (!jtag_trace_enabled())
+		return jtag->execute_queue();
+
+	int64_t start_us = jtag_trace_now();
+	int retval = jtag->execute_queue();
+	jtag_trace_queue(start_us, jtag_trace_now(), retval);
+
+	return retval;
 }
 
 void jtag_execute_queue_noclear(void)
@@ -1472,6 +1480,8 @@ int jtag_init_inner(struct command_context *cmd_ctx)
 
 int adapter_quit(void)
 {
+	jtag_trace_stop();
+
 	if (!jtag || !jtag->quit)
 		return ERROR_OK;
 
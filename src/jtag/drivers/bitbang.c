@@ -185,10 +185,33 @@ static void bitbang_stableclocks(int num_cycles)
 	}
 }
 
+/* Upper bound on TDO samples requested through bitbang_interface->sample()
+ * before they are collected. This keeps the number of unread replies
+ * small enough to fit in the socket/pipe buffers of remote drivers, so
+ * neither side can block on a full buffer while the other is writing.
+ */
+#define BITBANG_MAX_PENDING_SAMPLES 4096
+
+static void bitbang_read_samples(uint8_t *buffer, int first, int last)
+{
+	for (int i = first; i < last; i++) {
+		int bytec = i/8;
+		int bcval = 1 << (i % 8);
+
+		if (bitbang_interface->read_sample())
+			buffer[bytec] |= bcval;
+		else
+			buffer[bytec] &= ~bcval;
+	}
+}
+
 static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
 {
 	tap_state_t saved_end_state = tap_get_end_state();
 	int bit_cnt;
+	bool sampled = (type != SCAN_OUT) && bitbang_interface->sample;
+	/* first bit whose TDO sample has been requested but not read yet */
+	int unread = 0;
 
 	if (!((!ir_scan &&
 			(tap_get_state() == TAP_DRSHIFT)) ||
@@ -219,12 +242,19 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 
 		bitbang_interface->write(0, tms, tdi);
 
-		if (type != SCAN_OUT)
+		if (sampled)
+			bitbang_interface->sample();
+		else if (type != SCAN_OUT)
 			val = bitbang_interface->read();
 
 		bitbang_interface->write(1, tms, tdi);
 
-		if (type != SCAN_OUT) {
+		if (sampled) {
+			if (bit_cnt + 1 - unread == BITBANG_MAX_PENDING_SAMPLES) {
+				bitbang_read_samples(buffer, unread, bit_cnt + 1);
+				unread = bit_cnt + 1;
+			}
+		} else if (type != SCAN_OUT) {
 			if (val)
 				buffer[bytec] |= bcval;
 			else
@@ -232,6 +262,9 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 		}
 	}
 
+	if (sampled)
+		bitbang_read_samples(buffer, unread, scan_size);
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
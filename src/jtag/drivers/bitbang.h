@@ -28,6 +28,15 @@ struct bitbang_interface {
 	/* low level callbacks (for bitbang)
 	 */
 	int (*read)(void);
+
+	/* optional split TDO read: sample() requests a TDO sample without
+	 * waiting for it, read_sample() returns the oldest requested sample.
+	 * Drivers with a long round trip implement these so that a whole scan
+	 * can be sent before any TDO bit is waited for.
+	 */
+	void (*sample)(void);
+	int (*read_sample)(void);
+
 	void (*write)(int tck, int tms, int tdi);
 	void (*reset)(int trst, int srst);
 	void (*blink)(int on);
@@ -43,6 +43,14 @@ static char *remote_bitbang_port;
 FILE *remote_bitbang_in;
 FILE *remote_bitbang_out;
 
+/* 'R' requests sent (or buffered) whose replies have not been read yet */
+static unsigned remote_bitbang_pending;
+
+/* replies read in bulk by remote_bitbang_read_sample() */
+static char remote_bitbang_rx[4096];
+static unsigned remote_bitbang_rx_start;
+static unsigned remote_bitbang_rx_end;
+
 static void remote_bitbang_putc(int c)
 {
 	if (EOF == fputc(c, remote_bitbang_out))
@@ -75,15 +83,8 @@ static int remote_bitbang_quit(void)
 	return ERROR_OK;
 }
 
-/* Get the next read response. */
-static int remote_bitbang_rread(void)
+static int remote_bitbang_decode(int c)
 {
-	if (EOF == fflush(remote_bitbang_out)) {
-		remote_bitbang_quit();
-		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
-	}
-
-	int c = fgetc(remote_bitbang_in);
 	switch (c) {
 		case '0':
 			return 0;
@@ -96,12 +97,60 @@ static int remote_bitbang_rread(void)
 	}
 }
 
+static void remote_bitbang_flush(void)
+{
+	if (EOF == fflush(remote_bitbang_out)) {
+		remote_bitbang_quit();
+		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
+	}
+}
+
+/* Get the next read response. */
+static int remote_bitbang_rread(void)
+{
+	remote_bitbang_flush();
+
+	return remote_bitbang_decode(fgetc(remote_bitbang_in));
+}
+
 static int remote_bitbang_read(void)
 {
 	remote_bitbang_putc('R');
 	return remote_bitbang_rread();
 }
 
+/* The protocol is a plain byte stream answered in order, so a server sees
+ * no difference between one 'R' per round trip and a whole scan worth of
+ * them sent back to back. Only the replies are collected later.
+ */
+static void remote_bitbang_sample(void)
+{
+	remote_bitbang_putc('R');
+	remote_bitbang_pending++;
+}
+
+static int remote_bitbang_read_sample(void)
+{
+	if (remote_bitbang_rx_start == remote_bitbang_rx_end) {
+		unsigned count = remote_bitbang_pending;
+		if (count > sizeof(remote_bitbang_rx))
+			count = sizeof(remote_bitbang_rx);
+
+		remote_bitbang_flush();
+
+		if (count == 0 || fread(remote_bitbang_rx, 1, count, remote_bitbang_in) != count) {
+			remote_bitbang_quit();
+			REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: missing read response");
+		}
+
+		remote_bitbang_rx_start = 0;
+		remote_bitbang_rx_end = count;
+	}
+
+	remote_bitbang_pending--;
+	return remote_bitbang_decode(remote_bitbang_rx[remote_bitbang_rx_start++]);
+}
+
 static void remote_bitbang_write(int tck, int tms, int tdi)
 {
 	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
@@ -122,6 +171,8 @@ static void remote_bitbang_blink(int on)
 
 static struct bitbang_interface remote_bitbang_bitbang = {
 	.read = &remote_bitbang_read,
+	.sample = &remote_bitbang_sample,
+	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
 	.reset = &remote_bitbang_reset,
 	.blink = &remote_bitbang_blink,
@@ -0,0 +1,614 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/**
+ * @file
+ * Binary trace of JTAG queue flushes and SWD transactions.
+ *
+ * Records are written into a ring that is mapped onto the trace file, so
+ * tracing costs a few memcpy()s per transaction and the trace survives a
+ * crash of OpenOCD.  The file format is described in trace.h; the decoder
+ * is contrib/jtagtrace.c.
+ *
+ * JTAG commands are recorded after the driver executed the queue, while
+ * the commands and their TDO buffers are still around.  SWD transactions
+ * go straight to the driver, so tracing wraps the interface's swd_driver
+ * and records the queued transactions when run() returns.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag.h"
+#include "swd.h"
+#include "interface.h"
+#include "commands.h"
+#include "trace.h"
+
+#include <helper/time_support.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+extern struct jtag_interface *jtag_interface;
+
+/* a queued SWD transaction, recorded once the driver has run it */
+struct trace_swd_op {
+	uint8_t type;
+	uint8_t arg;
+	uint32_t ap_delay;
+	uint32_t value;
+	uint32_t *dest;
+};
+
+static struct {
+	bool enabled;
+	char *filename;
+
+	/* header followed by the ring */
+	uint8_t *map;
+	size_t map_size;
+#ifdef HAVE_SYS_MMAN_H
+	int fd;
+#else
+	FILE *file;
+#endif
+
+	uint8_t *ring;
+	uint64_t ring_size;
+	uint64_t read_pos;
+	uint64_t write_pos;
+
+	int64_t start_us;
+	/* timestamp of the records being written */
+	int64_t flush_us;
+	uint32_t flush_id;
+
+	uint64_t num_records;
+	uint64_t num_overwritten;
+
+	/* the interface's SWD driver and our wrapper around it */
+	const struct swd_driver *swd;
+	struct swd_driver swd_wrapper;
+	struct trace_swd_op *swd_ops;
+	unsigned num_swd_ops;
+	unsigned max_swd_ops;
+} trace;
+
+bool jtag_trace_enabled(void)
+{
+	return trace.enabled;
+}
+
+int64_t jtag_trace_now(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void ring_write(const uint8_t *data, uint64_t len)
+{
+	uint64_t offset = trace.write_pos % trace.ring_size;
+	uint64_t first = MIN(len, trace.ring_size - offset);
+
+	memcpy(trace.ring + offset, data, first);
+	memcpy(trace.ring, data + first, len - first);
+	trace.write_pos += len;
+}
+
+static uint32_t ring_get_u32(uint64_t pos)
+{
+	uint8_t buf[4];
+
+	for (unsigned i = 0; i < 4; i++)
+		buf[i] = trace.ring[(pos + i) % trace.ring_size];
+
+	return le_to_h_u32(buf);
+}
+
+static void trace_update_header(void)
+{
+	h_u64_to_le(trace.map + 24, trace.read_pos);
+	h_u64_to_le(trace.map + 32, trace.write_pos);
+}
+
+static void trace_record(uint8_t type, uint8_t flags, uint16_t arg, uint32_t bits,
+		const uint8_t *data1, unsigned len1, const uint8_t *data2, unsigned len2)
+{
+	static const uint8_t zeroes[4];
+	uint32_t len = JTAG_TRACE_RECORD_SIZE + len1 + len2;
+	unsigned pad = (4 - (len & 3)) & 3;
+
+	len += pad;
+
+	/* drop the oldest records to make room */
+	while (trace.write_pos + len - trace.read_pos > trace.ring_size) {
+		trace.read_pos += ring_get_u32(trace.read_pos);
+		trace.num_overwritten++;
+	}
+
+	uint8_t header[JTAG_TRACE_RECORD_SIZE];
+	h_u32_to_le(header, len);
+	header[4] = type;
+	header[5] = flags;
+	h_u16_to_le(header + 6, arg);
+	h_u32_to_le(header + 8, trace.flush_id);
+	h_u32_to_le(header + 12, bits);
+	h_u64_to_le(header + 16, trace.flush_us - trace.start_us);
+
+	ring_write(header, sizeof(header));
+	if (len1)
+		ring_write(data1, len1);
+	if (len2)
+		ring_write(data2, len2);
+	ring_write(zeroes, pad);
+
+	trace.num_records++;
+	trace_update_header();
+}
+
+static void trace_flush_record(int64_t start_us, int64_t end_us, int result,
+		uint32_t bits, uint32_t num_records)
+{
+	uint8_t payload[12];
+
+	trace.flush_id++;
+	trace.flush_us = start_us;
+
+	h_u32_to_le(payload, end_us - start_us);
+	h_u32_to_le(payload + 4, result);
+	h_u32_to_le(payload + 8, num_records);
+
+	trace_record(JTAG_TRACE_FLUSH, 0, 0, bits, payload, sizeof(payload), NULL, 0);
+}
+
+#if !BUILD_ZY1000
+
+static void trace_scan_field(const struct scan_field *field, bool ir_scan, unsigned index)
+{
+	unsigned len = DIV_ROUND_UP(field->num_bits, 8);
+	uint8_t flags = ir_scan ? JTAG_TRACE_F_IR : 0;
+
+	if (len > JTAG_TRACE_MAX_PAYLOAD) {
+		len = JTAG_TRACE_MAX_PAYLOAD;
+		flags |= JTAG_TRACE_F_TRUNCATED;
+	}
+
+	if (field->out_value)
+		flags |= JTAG_TRACE_F_TDI;
+	if (field->in_value)
+		flags |= JTAG_TRACE_F_TDO;
+
+	trace_record(JTAG_TRACE_SCAN, flags, index, field->num_bits,
+			field->out_value, field->out_value ? len : 0,
+			field->in_value, field->in_value ? len : 0);
+}
+
+static uint32_t trace_command_bits(const struct jtag_command *cmd)
+{
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		return jtag_scan_size(cmd->cmd.scan);
+	case JTAG_RUNTEST:
+		return cmd->cmd.runtest->num_cycles;
+	case JTAG_STABLECLOCKS:
+		return cmd->cmd.stableclocks->num_cycles;
+	case JTAG_PATHMOVE:
+		return cmd->cmd.pathmove->num_states;
+	case JTAG_TMS:
+		return cmd->cmd.tms->num_bits;
+	default:
+		return 0;
+	}
+}
+
+void jtag_trace_queue(int64_t start_us, int64_t end_us, int result)
+{
+	if (!trace.enabled || jtag_command_queue == NULL)
+		return;
+
+	uint32_t bits = 0;
+	uint32_t num_records = 0;
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		bits += trace_command_bits(cmd);
+		num_records += cmd->type == JTAG_SCAN ? cmd->cmd.scan->num_fields : 1;
+	}
+
+	trace_flush_record(start_us, end_us, result, bits, num_records);
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			for (int i = 0; i < cmd->cmd.scan->num_fields; i++)
+				trace_scan_field(&cmd->cmd.scan->fields[i], cmd->cmd.scan->ir_scan, i);
+			break;
+		case JTAG_RESET:
+			trace_record(JTAG_TRACE_RESET, 0,
+					(cmd->cmd.reset->trst & 0xff) | (cmd->cmd.reset->srst & 0xff) << 8,
+					0, NULL, 0, NULL, 0);
+			break;
+		case JTAG_SLEEP:
+			trace_record(JTAG_TRACE_SLEEP, 0, 0, cmd->cmd.sleep->us, NULL, 0, NULL, 0);
+			break;
+		case JTAG_TMS: {
+			unsigned len = DIV_ROUND_UP(cmd->cmd.tms->num_bits, 8);
+			uint8_t flags = JTAG_TRACE_F_TDI;
+			if (len > JTAG_TRACE_MAX_PAYLOAD) {
+				len = JTAG_TRACE_MAX_PAYLOAD;
+				flags |= JTAG_TRACE_F_TRUNCATED;
+			}
+			trace_record(JTAG_TRACE_TMS, flags, 0, cmd->cmd.tms->num_bits,
+					cmd->cmd.tms->bits, len, NULL, 0);
+			break;
+		}
+		default:
+			trace_record(cmd->type, 0, 0, trace_command_bits(cmd), NULL, 0, NULL, 0);
+			break;
+		}
+	}
+}
+
+#else
+
+void jtag_trace_queue(int64_t start_us, int64_t end_us, int result)
+{
+	/* the minidriver has no command queue to look at */
+}
+
+#endif
+
+/* request, ACK, data and parity with the turnarounds */
+#define SWD_TRANSFER_BITS	46
+
+static unsigned trace_swd_seq_bits(enum swd_special_seq seq)
+{
+	switch (seq) {
+	case LINE_RESET:
+		return swd_seq_line_reset_len;
+	case JTAG_TO_SWD:
+		return swd_seq_jtag_to_swd_len;
+	case SWD_TO_JTAG:
+		return swd_seq_swd_to_jtag_len;
+	case SWD_TO_DORMANT:
+		return swd_seq_swd_to_dormant_len;
+	case DORMANT_TO_SWD:
+		return swd_seq_dormant_to_swd_len;
+	default:
+		return 0;
+	}
+}
+
+static void trace_swd_queue(uint8_t type, uint8_t arg, uint32_t ap_delay,
+		uint32_t value, uint32_t *dest)
+{
+	if (trace.num_swd_ops == trace.max_swd_ops) {
+		unsigned new_max = trace.max_swd_ops ? trace.max_swd_ops * 2 : 64;
+		struct trace_swd_op *new_ops = realloc(trace.swd_ops, new_max * sizeof(*new_ops));
+		if (new_ops == NULL)
+			return;
+		trace.swd_ops = new_ops;
+		trace.max_swd_ops = new_max;
+	}
+
+	struct trace_swd_op *op = &trace.swd_ops[trace.num_swd_ops++];
+	op->type = type;
+	op->arg = arg;
+	op->ap_delay = ap_delay;
+	op->value = value;
+	op->dest = dest;
+}
+
+static int trace_swd_switch_seq(enum swd_special_seq seq)
+{
+	trace_swd_queue(JTAG_TRACE_SWD_SEQ, seq, 0, 0, NULL);
+	return trace.swd->switch_seq(seq);
+}
+
+static void trace_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	trace_swd_queue(JTAG_TRACE_SWD_READ, cmd,
+			cmd & SWD_CMD_APnDP ? ap_delay_hint : 0, 0, value);
+	trace.swd->read_reg(cmd, value, ap_delay_hint);
+}
+
+static void trace_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	trace_swd_queue(JTAG_TRACE_SWD_WRITE, cmd,
+			cmd & SWD_CMD_APnDP ? ap_delay_hint : 0, value, NULL);
+	trace.swd->write_reg(cmd, value, ap_delay_hint);
+}
+
+static int trace_swd_run(void)
+{
+	int64_t start_us = jtag_trace_now();
+	int retval = trace.swd->run();
+	int64_t end_us = jtag_trace_now();
+
+	if (!trace.enabled) {
+		trace.num_swd_ops = 0;
+		return retval;
+	}
+
+	uint32_t bits = 0;
+	for (unsigned i = 0; i < trace.num_swd_ops; i++) {
+		struct trace_swd_op *op = &trace.swd_ops[i];
+		if (op->type == JTAG_TRACE_SWD_SEQ)
+			bits += trace_swd_seq_bits(op->arg);
+		else
+			bits += SWD_TRANSFER_BITS + op->ap_delay;
+	}
+
+	trace_flush_record(start_us, end_us, retval, bits, trace.num_swd_ops);
+
+	for (unsigned i = 0; i < trace.num_swd_ops; i++) {
+		struct trace_swd_op *op = &trace.swd_ops[i];
+		uint8_t payload[4];
+		uint8_t flags = 0;
+
+		if (op->type == JTAG_TRACE_SWD_SEQ) {
+			trace_record(op->type, 0, op->arg, trace_swd_seq_bits(op->arg),
+					NULL, 0, NULL, 0);
+			continue;
+		}
+
+		if (op->type == JTAG_TRACE_SWD_READ) {
+			if (op->dest)
+				op->value = *op->dest;
+			else
+				flags |= JTAG_TRACE_F_NO_DATA;
+		}
+
+		h_u32_to_le(payload, op->value);
+		trace_record(op->type, flags, op->arg, SWD_TRANSFER_BITS + op->ap_delay,
+				payload, sizeof(payload), NULL, 0);
+	}
+
+	trace.num_swd_ops = 0;
+
+	return retval;
+}
+
+static void trace_swd_wrap(void)
+{
+	if (jtag_interface == NULL || jtag_interface->swd == NULL)
+		return;
+
+	trace.swd = jtag_interface->swd;
+	trace.swd_wrapper = *trace.swd;
+
+	/* only wrap what the driver has, adi_v5_swd checks for NULL */
+	if (trace.swd->switch_seq)
+		trace.swd_wrapper.switch_seq = trace_swd_switch_seq;
+	if (trace.swd->read_reg)
+		trace.swd_wrapper.read_reg = trace_swd_read_reg;
+	if (trace.swd->write_reg)
+		trace.swd_wrapper.write_reg = trace_swd_write_reg;
+	if (trace.swd->run)
+		trace.swd_wrapper.run = trace_swd_run;
+
+	jtag_interface->swd = &trace.swd_wrapper;
+}
+
+static void trace_swd_unwrap(void)
+{
+	if (trace.swd == NULL)
+		return;
+
+	/* transactions queued but not yet run are simply not traced */
+	if (jtag_interface && jtag_interface->swd == &trace.swd_wrapper)
+		jtag_interface->swd = trace.swd;
+	trace.swd = NULL;
+
+	free(trace.swd_ops);
+	trace.swd_ops = NULL;
+	trace.num_swd_ops = 0;
+	trace.max_swd_ops = 0;
+}
+
+static int trace_map_file(const char *filename)
+{
+#ifdef HAVE_SYS_MMAN_H
+	trace.fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (trace.fd == -1) {
+		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	if (ftruncate(trace.fd, trace.map_size) != 0) {
+		LOG_ERROR("couldn't resize %s: %s", filename, strerror(errno));
+		close(trace.fd);
+		return ERROR_FAIL;
+	}
+
+	trace.map = mmap(NULL, trace.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, trace.fd, 0);
+	if (trace.map == MAP_FAILED) {
+		LOG_ERROR("couldn't map %s: %s", filename, strerror(errno));
+		trace.map = NULL;
+		close(trace.fd);
+		return ERROR_FAIL;
+	}
+#else
+	/* no mmap(); keep the ring in memory and write it out when stopping */
+	trace.file = fopen(filename, "wb");
+	if (trace.file == NULL) {
+		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	trace.map = calloc(1, trace.map_size);
+	if (trace.map == NULL) {
+		LOG_ERROR("Out of memory");
+		fclose(trace.file);
+		return ERROR_FAIL;
+	}
+#endif
+
+	return ERROR_OK;
+}
+
+static void trace_unmap_file(void)
+{
+#ifdef HAVE_SYS_MMAN_H
+	munmap(trace.map, trace.map_size);
+	close(trace.fd);
+#else
+	if (fwrite(trace.map, 1, trace.map_size, trace.file) != trace.map_size)
+		LOG_ERROR("couldn't write %s", trace.filename);
+	fclose(trace.file);
+	free(trace.map);
+#endif
+	trace.map = NULL;
+}
+
+static int jtag_trace_start(const char *filename, unsigned size_kb)
+{
+	jtag_trace_stop();
+
+	trace.ring_size = (uint64_t)size_kb * 1024;
+	trace.map_size = JTAG_TRACE_HEADER_SIZE + trace.ring_size;
+
+	if (trace_map_file(filename) != ERROR_OK)
+		return ERROR_FAIL;
+
+	trace.filename = strdup(filename);
+	trace.ring = trace.map + JTAG_TRACE_HEADER_SIZE;
+	trace.read_pos = 0;
+	trace.write_pos = 0;
+	trace.start_us = jtag_trace_now();
+	trace.flush_id = 0;
+	trace.num_records = 0;
+	trace.num_overwritten = 0;
+
+	memset(trace.map, 0, JTAG_TRACE_HEADER_SIZE);
+	memcpy(trace.map, JTAG_TRACE_MAGIC, 8);
+	h_u32_to_le(trace.map + 8, JTAG_TRACE_VERSION);
+	h_u32_to_le(trace.map + 12, JTAG_TRACE_HEADER_SIZE);
+	h_u64_to_le(trace.map + 16, trace.ring_size);
+	h_u64_to_le(trace.map + 40, trace.start_us);
+	trace_update_header();
+
+	trace_swd_wrap();
+	trace.enabled = true;
+
+	return ERROR_OK;
+}
+
+void jtag_trace_stop(void)
+{
+	if (!trace.enabled)
+		return;
+
+	trace.enabled = false;
+	trace_swd_unwrap();
+	trace_unmap_file();
+
+	LOG_INFO("traced %" PRIu64 " records in %" PRIu32 " flushes to %s",
+			trace.num_records, trace.flush_id, trace.filename);
+
+	free(trace.filename);
+	trace.filename = NULL;
+}
+
+COMMAND_HANDLER(handle_jtag_trace_start_command)
+{
+	unsigned size_kb = 1024;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], size_kb);
+
+	if (size_kb < 4) {
+		command_print(CMD_CTX, "trace ring must be at least 4 KiB");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	return jtag_trace_start(CMD_ARGV[0], size_kb);
+}
+
+COMMAND_HANDLER(handle_jtag_trace_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	jtag_trace_stop();
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_trace_status_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!trace.enabled) {
+		command_print(CMD_CTX, "tracing is off");
+		return ERROR_OK;
+	}
+
+	command_print(CMD_CTX, "tracing to %s%s", trace.filename,
+			trace.swd ? " (JTAG and SWD)" : "");
+	command_print(CMD_CTX, "%" PRIu32 " flushes, %" PRIu64 " records, "
+			"%" PRIu64 " overwritten",
+			trace.flush_id, trace.num_records, trace.num_overwritten);
+	command_print(CMD_CTX, "%" PRIu64 " of %" PRIu64 " bytes in use",
+			trace.write_pos - trace.read_pos, trace.ring_size);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration jtag_trace_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_jtag_trace_start_command,
+		.mode = COMMAND_ANY,
+		.help = "Start recording JTAG queue flushes and SWD transactions "
+			"to a ring of the given size in the file.",
+		.usage = "filename [size_kb]",
+	},
+	{
+		.name = "stop",
+		.handler = handle_jtag_trace_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "Stop recording and close the trace file.",
+		.usage = "",
+	},
+	{
+		.name = "status",
+		.handler = handle_jtag_trace_status_command,
+		.mode = COMMAND_ANY,
+		.help = "Display what has been recorded so far.",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration jtag_trace_command_handlers[] = {
+	{
+		.name = "jtag_trace",
+		.mode = COMMAND_ANY,
+		.help = "binary trace of debug adapter transactions",
+		.usage = "",
+		.chain = jtag_trace_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
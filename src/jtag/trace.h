@@ -0,0 +1,116 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_JTAG_TRACE_H
+#define OPENOCD_JTAG_TRACE_H
+
+#include <helper/command.h>
+
+/**
+ * @file
+ * Binary trace of the transactions sent to the debug adapter.
+ *
+ * The trace file starts with a header of JTAG_TRACE_HEADER_SIZE bytes,
+ * followed by a ring of records.  All fields are little endian.
+ *
+ * Header:
+ *   0  char[8]  magic, JTAG_TRACE_MAGIC
+ *   8  u32      version, JTAG_TRACE_VERSION
+ *  12  u32      header size
+ *  16  u64      ring size in bytes
+ *  24  u64      read position (oldest record still in the ring)
+ *  32  u64      write position (end of the newest record)
+ *  40  u64      start time, in microseconds since the epoch
+ *
+ * Positions count bytes since the trace was started; the ring offset
+ * of a position is (position % ring size).  Records may wrap around the
+ * end of the ring.
+ *
+ * Record:
+ *   0  u32      record length, including this header and the payload,
+ *               rounded up to a multiple of four
+ *   4  u8       type, enum jtag_trace_type
+ *   5  u8       flags, JTAG_TRACE_F_*
+ *   6  u16      type specific argument
+ *   8  u32      id of the queue flush the record belongs to
+ *  12  u32      bit count (or cycles, states, microseconds; see below)
+ *  16  u64      time the queue flush started, in microseconds since
+ *               the start of the trace
+ *  24           payload
+ */
+
+#define JTAG_TRACE_MAGIC		"OCDTRACE"
+#define JTAG_TRACE_VERSION		1
+#define JTAG_TRACE_HEADER_SIZE	64
+#define JTAG_TRACE_RECORD_SIZE	24
+
+enum jtag_trace_type {
+	/* The first ones match enum jtag_command_type.
+	 *
+	 * SCAN: one record per scan field; bit count is the field width,
+	 * the argument the index of the field in the scan.  Payload is the TDI
+	 * data if JTAG_TRACE_F_TDI is set, then the TDO data if
+	 * JTAG_TRACE_F_TDO is set, each (bit count + 7) / 8 bytes.
+	 * TLR_RESET: no bit count.
+	 * RUNTEST, STABLECLOCKS: bit count is the number of TCK cycles.
+	 * RESET: argument is trst | srst << 8, as in struct reset_command.
+	 * PATHMOVE: bit count is the number of states passed.
+	 * SLEEP: bit count is the time in microseconds.
+	 * TMS: bit count is the sequence length, payload the TMS bits.
+	 */
+	JTAG_TRACE_SCAN = 1,
+	JTAG_TRACE_TLR_RESET = 2,
+	JTAG_TRACE_RUNTEST = 3,
+	JTAG_TRACE_RESET = 4,
+	JTAG_TRACE_PATHMOVE = 6,
+	JTAG_TRACE_SLEEP = 7,
+	JTAG_TRACE_STABLECLOCKS = 8,
+	JTAG_TRACE_TMS = 9,
+
+	/* Starts every flush.  Bit count is the number of bits clocked
+	 * (roughly, for SWD); payload is u32 duration in microseconds,
+	 * s32 result of the flush and u32 number of records that follow. */
+	JTAG_TRACE_FLUSH = 0x10,
+
+	/* SWD register access: argument is the SWD request byte, bit
+	 * count the number of bits clocked for it including the idle
+	 * cycles, payload the u32 value written or read. */
+	JTAG_TRACE_SWD_READ = 0x20,
+	JTAG_TRACE_SWD_WRITE = 0x21,
+	/* SWD special sequence: argument is the enum swd_special_seq */
+	JTAG_TRACE_SWD_SEQ = 0x22,
+};
+
+#define JTAG_TRACE_F_IR			0x01	/* SCAN is an IR scan */
+#define JTAG_TRACE_F_TDI		0x02	/* payload has TDI data */
+#define JTAG_TRACE_F_TDO		0x04	/* payload has TDO data */
+#define JTAG_TRACE_F_TRUNCATED	0x08	/* payload cut to JTAG_TRACE_MAX_PAYLOAD */
+#define JTAG_TRACE_F_NO_DATA	0x10	/* SWD read without destination */
+
+/** Longest TDI or TDO payload stored per scan field, in bytes */
+#define JTAG_TRACE_MAX_PAYLOAD	256
+
+/** Called around the JTAG driver's execute_queue() by the core. */
+bool jtag_trace_enabled(void);
+void jtag_trace_queue(int64_t start_us, int64_t end_us, int result);
+
+/** @returns the current time in microseconds, for jtag_trace_queue() */
+int64_t jtag_trace_now(void);
+
+void jtag_trace_stop(void);
+
+extern const struct command_registration jtag_trace_command_handlers[];
+
+#endif /* OPENOCD_JTAG_TRACE_H */
@@ -23,6 +23,7 @@
 #include "virtex2.h"
 #include "xilinx_bit.h"
 #include "pld.h"
+#include <helper/time_support.h>
 
 static int virtex2_set_instr(struct jtag_tap *tap, uint32_t new_instr)
 {
@@ -125,20 +126,71 @@ static int virtex2_read_stat(struct pld_device *pld_device, uint32_t *status)
 	return ERROR_OK;
 }
 
+/* The bitstream is read and shifted in pieces of this size, so neither the
+ * file nor the JTAG queue has to hold more than one of them at a time. */
+#define VIRTEX2_LOAD_CHUNK_SIZE	(256 * 1024)
+
+/* how often a long load reports its progress, in ms */
+#define VIRTEX2_PROGRESS_INTERVAL	1000
+
+/* Reverse the bit order within each byte, eight bytes at a time */
+static void virtex2_flip_bytes(uint8_t *buffer, uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		uint64_t x;
+
+		memcpy(&x, buffer + i, 8);
+		x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+		x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+		x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+		memcpy(buffer + i, &x, 8);
+	}
+
+	for (; i < size; i++)
+		buffer[i] = flip_u32(buffer[i], 8);
+}
+
 static int virtex2_load(struct pld_device *pld_device, const char *filename)
 {
 	struct virtex2_pld_device *virtex2_info = pld_device->driver_priv;
 	struct xilinx_bit_file bit_file;
+	struct duration bench;
+	struct jtag_tap *tap;
+	unsigned int before = 0, after = 0;
+	bool found = false;
+	uint8_t *buffer, *bypass;
+	uint32_t done = 0;
+	int64_t last_progress;
 	int retval;
-	unsigned int i;
-	struct scan_field field;
-
-	field.in_value = NULL;
 
-	retval = xilinx_read_bit_file(&bit_file, filename);
+	retval = xilinx_open_bit_file(&bit_file, filename);
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* The CFG_IN shift is split over several DR scans, all of them ending
+	 * in DRPAUSE.  No Capture-DR happens on the way back to DRSHIFT, so
+	 * the FPGA sees a single continuous shift -- as long as the bits of
+	 * the bypassed TAPs around it are shifted only once, before and after
+	 * the bitstream, instead of with every piece. */
+	for (tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = jtag_tap_next_enabled(tap)) {
+		if (tap == virtex2_info->tap)
+			found = true;
+		else if (found)
+			after++;
+		else
+			before++;
+	}
+
+	buffer = malloc(MIN(bit_file.length, VIRTEX2_LOAD_CHUNK_SIZE) + 1);
+	bypass = calloc(DIV_ROUND_UP(MAX(before, after), 8) + 1, 1);
+	if (buffer == NULL || bypass == NULL) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
 	virtex2_set_instr(virtex2_info->tap, 0xb);	/* JPROG_B */
 	jtag_execute_queue();
 	jtag_add_sleep(1000);
@@ -146,17 +198,50 @@ static int virtex2_load(struct pld_device *pld_device, const char *filename)
 	virtex2_set_instr(virtex2_info->tap, 0x5);	/* CFG_IN */
 	jtag_execute_queue();
 
-	for (i = 0; i < bit_file.length; i++)
-		bit_file.data[i] = flip_u32(bit_file.data[i], 8);
+	duration_start(&bench);
+	last_progress = timeval_ms();
 
-	field.num_bits = bit_file.length * 8;
-	field.out_value = bit_file.data;
+	if (before > 0)
+		jtag_add_plain_dr_scan(before, bypass, NULL, TAP_DRPAUSE);
 
-	jtag_add_dr_scan(virtex2_info->tap, 1, &field, TAP_DRPAUSE);
-	jtag_execute_queue();
+	while (done < bit_file.length) {
+		uint32_t size = MIN(bit_file.length - done, VIRTEX2_LOAD_CHUNK_SIZE);
+
+		retval = xilinx_read_bit_data(&bit_file, buffer, size);
+		if (retval != ERROR_OK)
+			break;
+
+		virtex2_flip_bytes(buffer, size);
+
+		jtag_add_plain_dr_scan(size * 8, buffer, NULL, TAP_DRPAUSE);
+		retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			break;
+
+		done += size;
+		LOG_DEBUG("shifted %" PRIu32 " of %" PRIu32 " bytes", done, bit_file.length);
+		if (done < bit_file.length && timeval_ms() - last_progress >= VIRTEX2_PROGRESS_INTERVAL) {
+			LOG_INFO("shifted %" PRIu32 " of %" PRIu32 " bytes of bitstream (%u%%)",
+				done, bit_file.length, (unsigned)((uint64_t)done * 100 / bit_file.length));
+			last_progress = timeval_ms();
+		}
+		keep_alive();
+	}
+
+	if (retval == ERROR_OK && after > 0)
+		jtag_add_plain_dr_scan(after, bypass, NULL, TAP_DRPAUSE);
 
 	jtag_add_tlr();
 
+	if (retval != ERROR_OK) {
+		jtag_execute_queue();
+		goto out;
+	}
+
+	if (duration_measure(&bench) == ERROR_OK)
+		LOG_INFO("shifted %" PRIu32 " bytes of bitstream in %fs (%0.3f KiB/s)",
+			done, duration_elapsed(&bench), duration_kbps(&bench, done));
+
 	if (!(virtex2_info->no_jstart))
 		virtex2_set_instr(virtex2_info->tap, 0xc);	/* JSTART */
 	jtag_add_runtest(13, TAP_IDLE);
@@ -166,9 +251,14 @@ static int virtex2_load(struct pld_device *pld_device, const char *filename)
 		virtex2_set_instr(virtex2_info->tap, 0xc);	/* JSTART */
 	jtag_add_runtest(13, TAP_IDLE);
 	virtex2_set_instr(virtex2_info->tap, 0x3f);		/* BYPASS */
-	jtag_execute_queue();
+	retval = jtag_execute_queue();
 
-	return ERROR_OK;
+out:
+	free(bypass);
+	free(buffer);
+	xilinx_free_bit_file(&bit_file);
+
+	return retval;
 }
 
 COMMAND_HANDLER(virtex2_handle_read_stat_command)
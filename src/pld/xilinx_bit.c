@@ -26,29 +26,68 @@
 
 #include <sys/stat.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* gzread() passes files that aren't compressed through unchanged, so with
+ * zlib all files are read through it */
+static void *input_open(const char *filename)
+{
+#ifdef HAVE_ZLIB
+	return gzopen(filename, "rb");
+#else
+	return fopen(filename, "rb");
+#endif
+}
+
+static uint32_t input_read(void *input, void *buffer, uint32_t size)
+{
+#ifdef HAVE_ZLIB
+	uint32_t done = 0;
+
+	/* gzread() takes an unsigned int and returns an int */
+	while (done < size) {
+		int count = gzread(input, (uint8_t *)buffer + done, MIN(size - done, 0x40000000u));
+		if (count <= 0)
+			break;
+		done += count;
+	}
+
+	return done;
+#else
+	return fread(buffer, 1, size, input);
+#endif
+}
 
-static int read_section(FILE *input_file, int length_size, char section,
+static void input_close(void *input)
+{
+#ifdef HAVE_ZLIB
+	gzclose(input);
+#else
+	fclose(input);
+#endif
+}
+
+static int read_section(void *input_file, int length_size, char section,
 	uint32_t *buffer_length, uint8_t **buffer)
 {
 	uint8_t length_buffer[4];
-	int length;
+	uint32_t length;
 	char section_char;
-	int read_count;
 
 	if ((length_size != 2) && (length_size != 4)) {
 		LOG_ERROR("BUG: length_size neither 2 nor 4");
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	read_count = fread(&section_char, 1, 1, input_file);
-	if (read_count != 1)
+	if (input_read(input_file, &section_char, 1) != 1)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	if (section_char != section)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
-	read_count = fread(length_buffer, 1, length_size, input_file);
-	if (read_count != length_size)
+	if (input_read(input_file, length_buffer, length_size) != (uint32_t)length_size)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	if (length_size == 4)
@@ -59,24 +98,31 @@ static int read_section(FILE *input_file, int length_size, char section,
 	if (buffer_length)
 		*buffer_length = length;
 
+	/* without a buffer the section is left to be read by the caller */
+	if (!buffer)
+		return ERROR_OK;
+
 	*buffer = malloc(length);
+	if (*buffer == NULL && length > 0) {
+		LOG_ERROR("couldn't allocate %" PRIu32 " bytes for section '%c'", length, section);
+		return ERROR_PLD_FILE_LOAD_FAILED;
+	}
 
-	read_count = fread(*buffer, 1, length, input_file);
-	if (read_count != length)
+	if (input_read(input_file, *buffer, length) != length)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 
 	return ERROR_OK;
 }
 
-int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
+int xilinx_open_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
 {
-	FILE *input_file;
 	struct stat input_stat;
-	int read_count;
 
 	if (!filename || !bit_file)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	memset(bit_file, 0, sizeof(*bit_file));
+
 	if (stat(filename, &input_stat) == -1) {
 		LOG_ERROR("couldn't stat() %s: %s", filename, strerror(errno));
 		return ERROR_PLD_FILE_LOAD_FAILED;
@@ -92,37 +138,108 @@ int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	input_file = fopen(filename, "rb");
-	if (input_file == NULL) {
+	bit_file->input = input_open(filename);
+	if (bit_file->input == NULL) {
 		LOG_ERROR("couldn't open %s: %s", filename, strerror(errno));
 		return ERROR_PLD_FILE_LOAD_FAILED;
 	}
 
-	read_count = fread(bit_file->unknown_header, 1, 13, input_file);
-	if (read_count != 13) {
+	if (input_read(bit_file->input, bit_file->unknown_header, 13) != 13) {
 		LOG_ERROR("couldn't read unknown_header from file '%s'", filename);
-		return ERROR_PLD_FILE_LOAD_FAILED;
+		goto fail;
 	}
 
-	if (read_section(input_file, 2, 'a', NULL, &bit_file->source_file) != ERROR_OK)
-		return ERROR_PLD_FILE_LOAD_FAILED;
+#ifndef HAVE_ZLIB
+	if (bit_file->unknown_header[0] == 0x1f && bit_file->unknown_header[1] == 0x8b) {
+		LOG_ERROR("%s is compressed, but OpenOCD was built without zlib", filename);
+		goto fail;
+	}
+#endif
 
-	if (read_section(input_file, 2, 'b', NULL, &bit_file->part_name) != ERROR_OK)
-		return ERROR_PLD_FILE_LOAD_FAILED;
+	if (read_section(bit_file->input, 2, 'a', NULL, &bit_file->source_file) != ERROR_OK)
+		goto fail;
 
-	if (read_section(input_file, 2, 'c', NULL, &bit_file->date) != ERROR_OK)
-		return ERROR_PLD_FILE_LOAD_FAILED;
+	if (read_section(bit_file->input, 2, 'b', NULL, &bit_file->part_name) != ERROR_OK)
+		goto fail;
 
-	if (read_section(input_file, 2, 'd', NULL, &bit_file->time) != ERROR_OK)
-		return ERROR_PLD_FILE_LOAD_FAILED;
+	if (read_section(bit_file->input, 2, 'c', NULL, &bit_file->date) != ERROR_OK)
+		goto fail;
 
-	if (read_section(input_file, 4, 'e', &bit_file->length, &bit_file->data) != ERROR_OK)
-		return ERROR_PLD_FILE_LOAD_FAILED;
+	if (read_section(bit_file->input, 2, 'd', NULL, &bit_file->time) != ERROR_OK)
+		goto fail;
+
+	if (read_section(bit_file->input, 4, 'e', &bit_file->length, NULL) != ERROR_OK)
+		goto fail;
 
-	LOG_DEBUG("bit_file: %s %s %s,%s %" PRIi32 "", bit_file->source_file, bit_file->part_name,
+	bit_file->data_left = bit_file->length;
+
+	LOG_DEBUG("bit_file: %s %s %s,%s %" PRIu32 "", bit_file->source_file, bit_file->part_name,
 		bit_file->date, bit_file->time, bit_file->length);
 
-	fclose(input_file);
+	return ERROR_OK;
+
+fail:
+	xilinx_free_bit_file(bit_file);
+	return ERROR_PLD_FILE_LOAD_FAILED;
+}
+
+int xilinx_read_bit_data(struct xilinx_bit_file *bit_file, uint8_t *buffer, uint32_t size)
+{
+	if (bit_file->input == NULL || size > bit_file->data_left) {
+		LOG_ERROR("BUG: reading past the end of the bitstream");
+		return ERROR_FAIL;
+	}
+
+	if (input_read(bit_file->input, buffer, size) != size) {
+		LOG_ERROR("bitstream is shorter than the %" PRIu32 " bytes given in its header",
+			bit_file->length);
+		return ERROR_PLD_FILE_LOAD_FAILED;
+	}
+
+	bit_file->data_left -= size;
+
+	return ERROR_OK;
+}
+
+void xilinx_free_bit_file(struct xilinx_bit_file *bit_file)
+{
+	if (bit_file->input)
+		input_close(bit_file->input);
+	bit_file->input = NULL;
+
+	free(bit_file->source_file);
+	free(bit_file->part_name);
+	free(bit_file->date);
+	free(bit_file->time);
+	free(bit_file->data);
+	bit_file->source_file = NULL;
+	bit_file->part_name = NULL;
+	bit_file->date = NULL;
+	bit_file->time = NULL;
+	bit_file->data = NULL;
+}
+
+int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename)
+{
+	int retval = xilinx_open_bit_file(bit_file, filename);
+	if (retval != ERROR_OK)
+		return retval;
+
+	bit_file->data = malloc(bit_file->length);
+	if (bit_file->data == NULL && bit_file->length > 0) {
+		LOG_ERROR("couldn't allocate %" PRIu32 " bytes for the bitstream", bit_file->length);
+		retval = ERROR_PLD_FILE_LOAD_FAILED;
+	} else {
+		retval = xilinx_read_bit_data(bit_file, bit_file->data, bit_file->length);
+	}
+
+	if (retval != ERROR_OK) {
+		xilinx_free_bit_file(bit_file);
+		return retval;
+	}
+
+	input_close(bit_file->input);
+	bit_file->input = NULL;
 
 	return ERROR_OK;
 }
@@ -27,8 +27,24 @@ struct xilinx_bit_file {
 	uint8_t *time;
 	uint32_t length;
 	uint8_t *data;
+
+	/* open file and bytes of data not read yet, for xilinx_read_bit_data() */
+	void *input;
+	uint32_t data_left;
 };
 
+/** Read the whole bitstream into bit_file->data. */
 int xilinx_read_bit_file(struct xilinx_bit_file *bit_file, const char *filename);
 
+/**
+ * Read only the header of a bitstream, leaving the file open for
+ * xilinx_read_bit_data().  bit_file->length is the size of the data.
+ * Files compressed with gzip are accepted if OpenOCD was built with zlib.
+ */
+int xilinx_open_bit_file(struct xilinx_bit_file *bit_file, const char *filename);
+/** Read the next @a size bytes of the bitstream data into @a buffer. */
+int xilinx_read_bit_data(struct xilinx_bit_file *bit_file, uint8_t *buffer, uint32_t size);
+/** Close the file and free what either of the above allocated. */
+void xilinx_free_bit_file(struct xilinx_bit_file *bit_file);
+
 #endif /* OPENOCD_PLD_XILINX_BIT_H */
@@ -207,18 +207,30 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	int rtos_detected = 0;
 	uint64_t addr = 0;
 	size_t reply_len;
-	char reply[GDB_BUFFER_SIZE], cur_sym[GDB_BUFFER_SIZE / 2] = "";
+	/* too big for the stack with a large GDB_BUFFER_SIZE */
+	const size_t reply_size = GDB_BUFFER_SIZE;
+	char *reply = malloc(reply_size), *cur_sym = malloc(GDB_BUFFER_SIZE / 2);
 	symbol_table_elem_t *next_sym = NULL;
 	struct target *target = get_target_from_connection(connection);
 	struct rtos *os = target->rtos;
 
+	if (reply == NULL || cur_sym == NULL) {
+		LOG_ERROR("out of memory");
+		free(reply);
+		free(cur_sym);
+		gdb_put_packet(connection, "OK", 2);
+		return 0;
+	}
+
 	reply_len = sprintf(reply, "OK");
 
 	if (!os)
 		goto done;
 
 	/* Decode any symbol name in the packet*/
-	size_t len = unhexify((uint8_t *)cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
+	const char *hex_sym = strchr(packet + 8, ':') + 1;
+	size_t len = unhexify((uint8_t *)cur_sym, hex_sym,
+			MIN(strlen(hex_sym), GDB_BUFFER_SIZE / 2 - 1));
 	cur_sym[len] = 0;
 
 	if ((strcmp(packet, "qSymbol::") != 0) &&               /* GDB is not offering symbol lookup for the first time */
@@ -260,18 +272,20 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 		}
 	}
 
-	if (8 + (strlen(next_sym->symbol_name) * 2) + 1 > sizeof(reply)) {
+	if (8 + (strlen(next_sym->symbol_name) * 2) + 1 > reply_size) {
 		LOG_ERROR("ERROR: RTOS symbol '%s' name is too long for GDB!", next_sym->symbol_name);
 		goto done;
 	}
 
-	reply_len = snprintf(reply, sizeof(reply), "qSymbol:");
+	reply_len = snprintf(reply, reply_size, "qSymbol:");
 	reply_len += hexify(reply + reply_len,
 		(const uint8_t *)next_sym->symbol_name, strlen(next_sym->symbol_name),
-		sizeof(reply) - reply_len);
+		reply_size - reply_len);
 
 done:
 	gdb_put_packet(connection, reply, reply_len);
+	free(reply);
+	free(cur_sym);
 	return rtos_detected;
 }
 
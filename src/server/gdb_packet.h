@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_GDB_PACKET_H
+#define OPENOCD_SERVER_GDB_PACKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* @returns true if any of the eight characters in @a v is '#' or '}' */
+static inline bool gdb_has_special(uint64_t v)
+{
+	/* a byte of x is zero where the character matched, and
+	 * (x - ones) & ~x sets the high bit of such bytes */
+	const uint64_t ones = 0x0101010101010101ull;
+	const uint64_t highs = 0x8080808080808080ull;
+	uint64_t hash = v ^ (ones * '#');
+	uint64_t brace = v ^ (ones * '}');
+
+	return ((hash - ones) & ~hash & highs) | ((brace - ones) & ~brace & highs);
+}
+
+enum gdb_unescape_result {
+	GDB_UNESCAPE_MORE,	/* all input used, or it ends in the middle of an escape */
+	GDB_UNESCAPE_END,	/* the '#' after the packet data was reached */
+	GDB_UNESCAPE_FULL,	/* the output has no room for the next character */
+};
+
+/**
+ * Copy the packet data received so far from [*in, end) to [*out, out_end),
+ * undoing the '}' escapes of binary data, and add the characters as sent
+ * to @a checksum unless @a noack.  Eight characters at a time are copied
+ * while there is nothing to unescape, that's all of a packet without
+ * binary data.
+ *
+ * @a in and @a out are advanced past what was used and stored.  After
+ * GDB_UNESCAPE_END, @a in points behind the '#'.  An escape split over two
+ * reads is left in the input for the caller.
+ */
+static inline enum gdb_unescape_result gdb_unescape(const char **in, const char *end,
+		char **out, char *out_end, unsigned char *checksum, bool noack)
+{
+	const char *p = *in;
+	char *o = *out;
+	enum gdb_unescape_result result = GDB_UNESCAPE_MORE;
+
+	while (p < end) {
+		if (end - p >= 8 && out_end - o >= 8) {
+			uint64_t v;
+			memcpy(&v, p, sizeof(v));
+			if (!gdb_has_special(v)) {
+				memcpy(o, p, sizeof(v));
+				if (!noack) {
+					for (int i = 0; i < 8; i++)
+						*checksum += p[i];
+				}
+				p += 8;
+				o += 8;
+				continue;
+			}
+		}
+
+		if (*p == '#') {
+			p++;
+			result = GDB_UNESCAPE_END;
+			break;
+		}
+
+		if (o == out_end) {
+			result = GDB_UNESCAPE_FULL;
+			break;
+		}
+
+		if (*p == '}') {
+			if (p + 1 == end)
+				break;
+			/* data transmitted in binary mode (X packet)
+			 * uses 0x7d as escape character */
+			*checksum += p[0] + p[1];
+			*o++ = p[1] ^ 0x20;
+			p += 2;
+		} else {
+			*checksum += *p;
+			*o++ = *p++;
+		}
+	}
+
+	*in = p;
+	*out = o;
+	return result;
+}
+
+#endif /* OPENOCD_SERVER_GDB_PACKET_H */
@@ -44,6 +44,7 @@
 #include "server.h"
 #include <flash/nor/core.h>
 #include "gdb_server.h"
+#include "gdb_packet.h"
 #include <target/image.h>
 #include <jtag/jtag.h>
 #include "rtos/rtos.h"
@@ -71,6 +72,15 @@ struct gdb_connection {
 	int ctrl_c;
 	enum target_state frontend_state;
 	struct image *vflash_image;
+	/* set once gdb-flash-write-start was sent for the current download,
+	 * which may program banks before vFlashDone, see gdb_vflash_write() */
+	bool vflash_writing;
+	int vflash_result;			/* first error of the download */
+	/* banks programmed before vFlashDone, which later data must not touch */
+	struct flash_bank **vflash_banks;
+	unsigned vflash_num_banks;
+	uint32_t vflash_next;		/* end of the last vFlashWrite */
+	bool vflash_deferred;		/* out of order download, write all at vFlashDone */
 	int closed;
 	int busy;
 	int noack_mode;
@@ -92,6 +102,19 @@ struct gdb_connection {
 	struct target_desc_format target_desc;
 	/* temporarily used for thread list support */
 	char *thread_list;
+	/* last packet received, see gdb_get_packet() */
+	char *packet;
+	int packet_max;
+	/* reused for replies that are built in place, see gdb_packet_buffer() */
+	char *packet_buffer;
+	size_t packet_buffer_size;
+	/* memory prefetched for sequential 'm' packets, see gdb_read_memory() */
+	uint8_t *read_ahead;
+	uint32_t read_ahead_size;		/* allocated */
+	uint32_t read_ahead_address;
+	uint32_t read_ahead_len;		/* valid bytes, 0 if none */
+	uint32_t read_ahead_generation;	/* target->mem_generation when read */
+	uint32_t next_read_address;		/* where a sequential read would start */
 };
 
 #if 0
@@ -104,6 +127,7 @@ static int gdb_breakpoint_override;
 static enum breakpoint_type gdb_breakpoint_override_type;
 
 static int gdb_error(struct connection *connection, int retval);
+static void gdb_vflash_end(struct connection *connection);
 static char *gdb_port;
 static char *gdb_port_next;
 
@@ -127,6 +151,10 @@ static int gdb_flash_program = 1;
  */
 static int gdb_report_data_abort;
 
+/* number of bytes read beyond a memory read packet once GDB is seen
+ * reading memory sequentially; 0 disables read-ahead */
+static uint32_t gdb_read_ahead;
+
 /* set if we are sending target descriptions to gdb
  * via qXfer:features:read packet */
 /* enabled by default */
@@ -345,11 +373,11 @@ static int gdb_write(struct connection *connection, void *data, int len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+/* A framed packet has its '$' and "#xx" trailer already in place around
+ * the payload, see gdb_put_framed_packet(). */
 static int gdb_put_packet_inner(struct connection *connection,
-		char *buffer, int len)
+		char *buffer, int len, unsigned char my_checksum, bool framed)
 {
-	int i;
-	unsigned char my_checksum = 0;
 #ifdef _DEBUG_GDB_IO_
 	char *debug_buffer;
 #endif
@@ -357,9 +385,6 @@ static int gdb_put_packet_inner(struct connection *connection,
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
 
-	for (i = 0; i < len; i++)
-		my_checksum += buffer[i];
-
 #ifdef _DEBUG_GDB_IO_
 	/*
 	 * At this point we should have nothing in the input queue from GDB,
@@ -396,7 +421,11 @@ static int gdb_put_packet_inner(struct connection *connection,
 
 		char local_buffer[1024];
 		local_buffer[0] = '$';
-		if ((size_t)len + 4 <= sizeof(local_buffer)) {
+		if (framed) {
+			retval = gdb_write(connection, buffer - 1, len + 4);
+			if (retval != ERROR_OK)
+				return retval;
+		} else if ((size_t)len + 4 <= sizeof(local_buffer)) {
 			/* performance gain on smaller packets by only a single call to gdb_write() */
 			memcpy(local_buffer + 1, buffer, len++);
 			len += snprintf(local_buffer + len, sizeof(local_buffer) - len, "#%02x", my_checksum);
@@ -471,8 +500,13 @@ static int gdb_put_packet_inner(struct connection *connection,
 int gdb_put_packet(struct connection *connection, char *buffer, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
+	unsigned char my_checksum = 0;
+
+	for (int i = 0; i < len; i++)
+		my_checksum += buffer[i];
+
 	gdb_con->busy = 1;
-	int retval = gdb_put_packet_inner(connection, buffer, len);
+	int retval = gdb_put_packet_inner(connection, buffer, len, my_checksum, false);
 	gdb_con->busy = 0;
 
 	/* we sent some data, reset timer for keep alive messages */
@@ -481,8 +515,87 @@ int gdb_put_packet(struct connection *connection, char *buffer, int len)
 	return retval;
 }
 
+/* Get the per-connection buffer that replies can be built in, large enough
+ * for @a size bytes. It is kept around for the next packet.
+ */
+static char *gdb_packet_buffer(struct connection *connection, size_t size)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	if (size > gdb_con->packet_buffer_size) {
+		char *buffer = realloc(gdb_con->packet_buffer, size);
+		if (buffer == NULL)
+			return NULL;
+		gdb_con->packet_buffer = buffer;
+		gdb_con->packet_buffer_size = size;
+	}
+
+	return gdb_con->packet_buffer;
+}
+
+/* Send a reply built in place: @a frame holds the '$', then @a len bytes of
+ * payload followed by room for the "#xx" trailer, so the whole packet goes
+ * out with a single write and without another pass over the payload.
+ */
+static int gdb_put_framed_packet(struct connection *connection,
+		char *frame, int len, unsigned char my_checksum)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	static const char hex[] = "0123456789abcdef";
+
+	frame[0] = '$';
+	frame[len + 1] = '#';
+	frame[len + 2] = hex[my_checksum >> 4];
+	frame[len + 3] = hex[my_checksum & 0xf];
+
+	gdb_con->busy = 1;
+	int retval = gdb_put_packet_inner(connection, frame + 1, len, my_checksum, true);
+	gdb_con->busy = 0;
+
+	/* we sent some data, reset timer for keep alive messages */
+	kept_alive();
+
+	return retval;
+}
+
+/* Make room for @a size bytes plus a terminating zero in the packet
+ * buffer of the connection.  It grows up to the PacketSize we announce. */
+static int gdb_packet_grow(struct gdb_connection *gdb_con, int size)
+{
+	if (size >= GDB_BUFFER_SIZE) {
+		LOG_ERROR("packet buffer too small");
+		return ERROR_GDB_BUFFER_TOO_SMALL;
+	}
+
+	int new_max = gdb_con->packet_max ? gdb_con->packet_max : 1024;
+	while (new_max <= size)
+		new_max *= 2;
+	if (new_max > GDB_BUFFER_SIZE)
+		new_max = GDB_BUFFER_SIZE;
+
+	char *packet = realloc(gdb_con->packet, new_max);
+	if (packet == NULL) {
+		LOG_ERROR("out of memory");
+		return ERROR_FAIL;
+	}
+	gdb_con->packet = packet;
+	gdb_con->packet_max = new_max;
+
+	return ERROR_OK;
+}
+
+static inline int gdb_packet_reserve(struct gdb_connection *gdb_con, int size)
+{
+	if (size < gdb_con->packet_max)
+		return ERROR_OK;
+
+	return gdb_packet_grow(gdb_con, size);
+}
+
+/* Receive the rest of a packet after its '$' into gdb_con->packet,
+ * undoing the '}' escapes of binary data on the way. */
 static inline int fetch_packet(struct connection *connection,
-		int *checksum_ok, int noack, int *len, char *buffer)
+		int *checksum_ok, int noack, int *len)
 {
 	unsigned char my_checksum = 0;
 	char checksum[3];
@@ -490,9 +603,7 @@ static inline int fetch_packet(struct connection *connection,
 	int retval = ERROR_OK;
 
 	struct gdb_connection *gdb_con = connection->priv;
-	my_checksum = 0;
 	int count = 0;
-	count = 0;
 
 	/* move this over into local variables to use registers and give the
 	 * more freedom to optimize */
@@ -500,54 +611,37 @@ static inline int fetch_packet(struct connection *connection,
 	int buf_cnt = gdb_con->buf_cnt;
 
 	for (;; ) {
-		/* The common case is that we have an entire packet with no escape chars.
-		 * We need to leave at least 2 bytes in the buffer to have
-		 * gdb_get_char() update various bits and bobs correctly.
-		 */
-		if ((buf_cnt > 2) && ((buf_cnt + count) < *len)) {
-			/* The compiler will struggle a bit with constant propagation and
-			 * aliasing, so we help it by showing that these values do not
-			 * change inside the loop
-			 */
-			int i;
-			char *buf = buf_p;
-			int run = buf_cnt - 2;
-			i = 0;
-			int done = 0;
-			while (i < run) {
-				character = *buf++;
-				i++;
-				if (character == '#') {
-					/* Danger! character can be '#' when esc is
-					 * used so we need an explicit boolean for done here. */
-					done = 1;
-					break;
-				}
+		/* Unescape what has been received so far, eight characters at a
+		 * time while there is nothing to unescape; that's all of a packet
+		 * without binary data.  Escapes split over two reads are left to
+		 * the slow path below. */
+		const char *p = buf_p;
+
+		/* the input can't unescape to more characters than it has */
+		retval = gdb_packet_reserve(gdb_con, MIN(count + buf_cnt, GDB_BUFFER_SIZE - 1));
+		if (retval != ERROR_OK)
+			break;
 
-				if (character == '}') {
-					/* data transmitted in binary mode (X packet)
-					 * uses 0x7d as escape character */
-					my_checksum += character & 0xff;
-					character = *buf++;
-					i++;
-					my_checksum += character & 0xff;
-					buffer[count++] = (character ^ 0x20) & 0xff;
-				} else {
-					my_checksum += character & 0xff;
-					buffer[count++] = character & 0xff;
-				}
-			}
-			buf_p += i;
-			buf_cnt -= i;
-			if (done)
-				break;
-		}
-		if (count > *len) {
+		char *out = gdb_con->packet + count;
+		enum gdb_unescape_result result = gdb_unescape(&p, buf_p + buf_cnt, &out,
+				gdb_con->packet + gdb_con->packet_max - 1, &my_checksum, noack);
+		bool done = result == GDB_UNESCAPE_END;
+
+		if (result == GDB_UNESCAPE_FULL) {
 			LOG_ERROR("packet buffer too small");
 			retval = ERROR_GDB_BUFFER_TOO_SMALL;
-			break;
 		}
 
+		int used = p - buf_p;
+		count = out - gdb_con->packet;
+		buf_cnt -= used;
+		buf_p += used;
+		connection->input_pending = buf_cnt > 0;
+
+		if (done || retval != ERROR_OK)
+			break;
+
+		/* reads more input once the buffer is empty */
 		retval = gdb_get_char_fast(connection, &character, &buf_p, &buf_cnt);
 		if (retval != ERROR_OK)
 			break;
@@ -555,21 +649,21 @@ static inline int fetch_packet(struct connection *connection,
 		if (character == '#')
 			break;
 
-		if (character == '}') {
-			/* data transmitted in binary mode (X packet)
-			 * uses 0x7d as escape character */
-			my_checksum += character & 0xff;
+		my_checksum += character & 0xff;
 
+		if (character == '}') {
 			retval = gdb_get_char_fast(connection, &character, &buf_p, &buf_cnt);
 			if (retval != ERROR_OK)
 				break;
 
 			my_checksum += character & 0xff;
-			buffer[count++] = (character ^ 0x20) & 0xff;
-		} else {
-			my_checksum += character & 0xff;
-			buffer[count++] = character & 0xff;
+			character ^= 0x20;
 		}
+
+		retval = gdb_packet_reserve(gdb_con, count + 1);
+		if (retval != ERROR_OK)
+			break;
+		gdb_con->packet[count++] = character & 0xff;
 	}
 
 	gdb_con->buf_p = buf_p;
@@ -596,8 +690,7 @@ static inline int fetch_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
-static int gdb_get_packet_inner(struct connection *connection,
-		char *buffer, int *len)
+static int gdb_get_packet_inner(struct connection *connection, int *len)
 {
 	int character;
 	int retval;
@@ -650,11 +743,11 @@ static int gdb_get_packet_inner(struct connection *connection,
 		/* explicit code expansion here to get faster inlined code in -O3 by not
 		 * calculating checksum */
 		if (gdb_con->noack_mode) {
-			retval = fetch_packet(connection, &checksum_ok, 1, len, buffer);
+			retval = fetch_packet(connection, &checksum_ok, 1, len);
 			if (retval != ERROR_OK)
 				return retval;
 		} else {
-			retval = fetch_packet(connection, &checksum_ok, 0, len, buffer);
+			retval = fetch_packet(connection, &checksum_ok, 0, len);
 			if (retval != ERROR_OK)
 				return retval;
 		}
@@ -676,13 +769,26 @@ static int gdb_get_packet_inner(struct connection *connection,
 	return ERROR_OK;
 }
 
-static int gdb_get_packet(struct connection *connection, char *buffer, int *len)
+/* The packet is left zero terminated in the connection's packet buffer,
+ * where it stays valid until the next packet is received. */
+static int gdb_get_packet(struct connection *connection, char **packet, int *len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
 	gdb_con->busy = 1;
-	int retval = gdb_get_packet_inner(connection, buffer, len);
+	int retval = gdb_get_packet_inner(connection, len);
 	gdb_con->busy = 0;
-	return retval;
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* empty packets and Ctrl-C don't touch the buffer */
+	retval = gdb_packet_reserve(gdb_con, *len);
+	if (retval != ERROR_OK)
+		return retval;
+
+	gdb_con->packet[*len] = '\0';
+	*packet = gdb_con->packet;
+
+	return ERROR_OK;
 }
 
 static int gdb_output_con(struct connection *connection, const char *line)
@@ -929,6 +1035,12 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->ctrl_c = 0;
 	gdb_connection->frontend_state = TARGET_HALTED;
 	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_writing = false;
+	gdb_connection->vflash_result = ERROR_OK;
+	gdb_connection->vflash_banks = NULL;
+	gdb_connection->vflash_num_banks = 0;
+	gdb_connection->vflash_next = 0;
+	gdb_connection->vflash_deferred = false;
 	gdb_connection->closed = 0;
 	gdb_connection->busy = 0;
 	gdb_connection->noack_mode = 0;
@@ -938,6 +1050,16 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->target_desc.tdesc = NULL;
 	gdb_connection->target_desc.tdesc_length = 0;
 	gdb_connection->thread_list = NULL;
+	gdb_connection->packet_buffer = NULL;
+	gdb_connection->packet_buffer_size = 0;
+	gdb_connection->packet = NULL;
+	gdb_connection->packet_max = 0;
+	gdb_connection->read_ahead = NULL;
+	gdb_connection->read_ahead_size = 0;
+	gdb_connection->read_ahead_address = 0;
+	gdb_connection->read_ahead_len = 0;
+	gdb_connection->read_ahead_generation = 0;
+	gdb_connection->next_read_address = 0;
 
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -1022,15 +1144,15 @@ static int gdb_connection_closed(struct connection *connection)
 		gdb_actual_connections);
 
 	/* see if an image built with vFlash commands is left */
-	if (gdb_connection->vflash_image) {
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
-	}
+	gdb_vflash_end(connection);
 
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, gdb_service->target);
 
+	free(gdb_connection->packet_buffer);
+	free(gdb_connection->packet);
+	free(gdb_connection->read_ahead);
+
 	if (connection->priv) {
 		free(connection->priv);
 		connection->priv = NULL;
@@ -1103,9 +1225,14 @@ static void gdb_str_to_target(struct target *target,
 	buf = reg->value;
 	buf_len = DIV_ROUND_UP(reg->size, 8);
 
+	if (target->endianness == TARGET_LITTLE_ENDIAN) {
+		hexify(tstr, buf, buf_len, buf_len * 2 + 1);
+		return;
+	}
+
 	for (i = 0; i < buf_len; i++) {
 		int j = gdb_reg_pos(target, i, buf_len);
-		tstr += sprintf(tstr, "%02x", buf[j]);
+		tstr += hexify(tstr, &buf[j], 1, 3);
 	}
 }
 
@@ -1118,16 +1245,18 @@ static void gdb_target_to_reg(struct target *target,
 		exit(-1);
 	}
 
-	int i;
-	for (i = 0; i < str_len; i += 2) {
-		unsigned t;
-		if (sscanf(tstr + i, "%02x", &t) != 1) {
-			LOG_ERROR("BUG: unable to convert register value");
-			exit(-1);
-		}
+	int len = str_len / 2;
+	if (unhexify(bin, tstr, len) != (size_t)len) {
+		LOG_ERROR("BUG: unable to convert register value");
+		exit(-1);
+	}
 
-		int j = gdb_reg_pos(target, i/2, str_len/2);
-		bin[j] = t;
+	if (target->endianness != TARGET_LITTLE_ENDIAN) {
+		for (int i = 0; i < len / 2; i++) {
+			uint8_t t = bin[i];
+			bin[i] = bin[len - 1 - i];
+			bin[len - 1 - i] = t;
+		}
 	}
 }
 
@@ -1345,21 +1474,84 @@ static int gdb_error(struct connection *connection, int retval)
 	return ERROR_OK;
 }
 
-/* We don't have to worry about the default 2 second timeout for GDB packets,
- * because GDB breaks up large memory reads into smaller reads.
+/* Reads memory for an 'm' packet.
  *
- * 8191 bytes by the looks of it. Why 8191 bytes instead of 8192?????
+ * GDB breaks up large reads (x/1000x, dump memory) into packets of at
+ * most half the PacketSize we announce.  When a read starts where the
+ * previous one ended, read gdb_read_ahead bytes more than asked for in
+ * the same target access and answer the following packets from that.
+ * The prefetched data is dropped on any other packet and whenever the
+ * target layer says memory may have changed.
  */
+static int gdb_read_memory(struct connection *connection,
+		uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	bool sequential = addr == gdb_con->next_read_address;
+	int retval;
+
+	gdb_con->next_read_address = addr + len;
+
+	if (target->state != TARGET_HALTED
+			|| gdb_con->read_ahead_generation != target->mem_generation)
+		gdb_con->read_ahead_len = 0;
+
+	uint32_t offset = addr - gdb_con->read_ahead_address;
+	if (gdb_con->read_ahead_len && offset < gdb_con->read_ahead_len
+			&& len <= gdb_con->read_ahead_len - offset) {
+		memcpy(buffer, gdb_con->read_ahead + offset, len);
+		return ERROR_OK;
+	}
+
+	gdb_con->read_ahead_len = 0;
+
+	if (!sequential || gdb_read_ahead == 0 || target->state != TARGET_HALTED)
+		return target_read_buffer(target, addr, len, buffer);
+
+	/* stop at the end of the address space */
+	uint32_t size = len + gdb_read_ahead;
+	if (addr + len - 1 < addr || size < len)
+		return target_read_buffer(target, addr, len, buffer);
+	if (addr + size - 1 < addr)
+		size = -addr;
+
+	if (target_mem_is_volatile(target, addr, size))
+		return target_read_buffer(target, addr, len, buffer);
+
+	if (size > gdb_con->read_ahead_size) {
+		uint8_t *read_ahead = realloc(gdb_con->read_ahead, size);
+		if (read_ahead == NULL)
+			return target_read_buffer(target, addr, len, buffer);
+		gdb_con->read_ahead = read_ahead;
+		gdb_con->read_ahead_size = size;
+	}
+
+	/* the memory behind the request may not be readable */
+	retval = target_read_buffer(target, addr, size, gdb_con->read_ahead);
+	if (retval != ERROR_OK)
+		return target_read_buffer(target, addr, len, buffer);
+
+	LOG_DEBUG("read ahead 0x%8.8" PRIx32 ", %" PRIu32 " bytes", addr, size);
+
+	gdb_con->read_ahead_address = addr;
+	gdb_con->read_ahead_len = size;
+	gdb_con->read_ahead_generation = target->mem_generation;
+
+	memcpy(buffer, gdb_con->read_ahead, len);
+
+	return ERROR_OK;
+}
+
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
-	struct target *target = get_target_from_connection(connection);
 	char *separator;
 	uint32_t addr = 0;
 	uint32_t len = 0;
 
 	uint8_t *buffer;
-	char *hex_buffer;
+	char *frame;
 
 	int retval = ERROR_OK;
 
@@ -1381,11 +1573,16 @@ static int gdb_read_memory_packet(struct connection *connection,
 		return ERROR_OK;
 	}
 
-	buffer = malloc(len);
+	/* the reply is hex encoded straight into the packet buffer, the raw
+	 * memory goes right behind it: '$', 2 * len hex digits, "#xx", data */
+	frame = gdb_packet_buffer(connection, 3 * (size_t)len + 4);
+	if (frame == NULL)
+		return gdb_error(connection, ERROR_FAIL);
+	buffer = (uint8_t *)frame + 2 * (size_t)len + 4;
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	retval = gdb_read_memory(connection, addr, len, buffer);
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -1406,18 +1603,12 @@ static int gdb_read_memory_packet(struct connection *connection,
 	}
 
 	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
+		unsigned char my_checksum = hexify_checksum(frame + 1, buffer, len);
 
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
-
-		gdb_put_packet(connection, hex_buffer, pkt_len);
-
-		free(hex_buffer);
+		gdb_put_framed_packet(connection, frame, len * 2, my_checksum);
 	} else
 		retval = gdb_error(connection, retval);
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -1449,7 +1640,9 @@ static int gdb_write_memory_packet(struct connection *connection,
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
-	buffer = malloc(len);
+	buffer = (uint8_t *)gdb_packet_buffer(connection, len);
+	if (buffer == NULL)
+		return gdb_error(connection, ERROR_FAIL);
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1463,8 +1656,6 @@ static int gdb_write_memory_packet(struct connection *connection,
 	else
 		retval = gdb_error(connection, retval);
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -2554,6 +2745,130 @@ static int gdb_query_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
+/* Remember the banks an image programmed before vFlashDone covers */
+static int gdb_vflash_add_banks(struct connection *connection, struct image *image)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+
+	for (int i = 0; i < image->num_sections; i++) {
+		uint32_t addr = image->sections[i].base_address;
+		uint32_t end = addr + image->sections[i].size;
+		struct flash_bank *bank;
+
+		while (addr < end && get_flash_bank_by_addr(target, addr, false, &bank) == ERROR_OK
+				&& bank != NULL) {
+			unsigned n = gdb_connection->vflash_num_banks;
+			if (n == 0 || gdb_connection->vflash_banks[n - 1] != bank) {
+				struct flash_bank **banks = realloc(gdb_connection->vflash_banks,
+						(n + 1) * sizeof(*banks));
+				if (banks == NULL)
+					return ERROR_FAIL;
+				banks[n] = bank;
+				gdb_connection->vflash_banks = banks;
+				gdb_connection->vflash_num_banks = n + 1;
+			}
+			if (bank->base + bank->size <= addr)
+				break;
+			addr = bank->base + bank->size;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Is any of [addr, addr + length) in a bank that is programmed already? */
+static bool gdb_vflash_bank_written(struct connection *connection,
+		uint32_t addr, uint32_t length)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	for (unsigned i = 0; i < gdb_connection->vflash_num_banks; i++) {
+		struct flash_bank *bank = gdb_connection->vflash_banks[i];
+		if (addr < bank->base + bank->size && bank->base < addr + length)
+			return true;
+	}
+
+	return false;
+}
+
+/* Program and close an image collected from vFlashWrite packets; early
+ * is set when that happens before vFlashDone.  The first error is kept
+ * for vFlashDone, which is where GDB expects it. */
+static void gdb_vflash_write(struct connection *connection, struct image *image, bool early)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	uint32_t written;
+
+	if (!gdb_connection->vflash_writing) {
+		target_call_event_callbacks(target, TARGET_EVENT_GDB_FLASH_WRITE_START);
+		gdb_connection->vflash_writing = true;
+	}
+
+	if (early && gdb_connection->vflash_result == ERROR_OK)
+		gdb_connection->vflash_result = gdb_vflash_add_banks(connection, image);
+
+	/* no point going on after a bank failed */
+	if (gdb_connection->vflash_result == ERROR_OK) {
+		int result = flash_write(target, image, &written, 0);
+		if (result == ERROR_OK)
+			LOG_DEBUG("wrote %u bytes from vFlash image to flash", (unsigned)written);
+		gdb_connection->vflash_result = result;
+	}
+
+	image_close(image);
+	free(image);
+}
+
+/* Finish or abandon a download: drop the data that wasn't programmed and
+ * everything known about it */
+static void gdb_vflash_end(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (gdb_connection->vflash_image) {
+		image_close(gdb_connection->vflash_image);
+		free(gdb_connection->vflash_image);
+		gdb_connection->vflash_image = NULL;
+	}
+	if (gdb_connection->vflash_writing)
+		target_call_event_callbacks(get_target_from_connection(connection),
+				TARGET_EVENT_GDB_FLASH_WRITE_END);
+
+	free(gdb_connection->vflash_banks);
+	gdb_connection->vflash_banks = NULL;
+	gdb_connection->vflash_num_banks = 0;
+	gdb_connection->vflash_next = 0;
+	gdb_connection->vflash_deferred = false;
+	gdb_connection->vflash_writing = false;
+	gdb_connection->vflash_result = ERROR_OK;
+}
+
+/* GDB sends flash data in ascending address order, so the data collected
+ * so far is complete once GDB writes beyond the bank it ends in.  A
+ * download that goes backwards is written at vFlashDone instead. */
+static bool gdb_vflash_bank_complete(struct connection *connection, uint32_t addr)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct image *image = gdb_connection->vflash_image;
+	struct flash_bank *bank;
+
+	if (addr < gdb_connection->vflash_next)
+		gdb_connection->vflash_deferred = true;
+
+	if (image == NULL || image->num_sections == 0 || gdb_connection->vflash_deferred)
+		return false;
+
+	/* the sections of an image being built are sorted */
+	struct imagesection *last = &image->sections[image->num_sections - 1];
+	if (get_flash_bank_by_addr(get_target_from_connection(connection),
+			last->base_address + last->size - 1, false, &bank) != ERROR_OK || bank == NULL)
+		return false;
+
+	return addr > bank->base && addr - bank->base >= bank->size;
+}
+
 static int gdb_v_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -2596,6 +2911,9 @@ static int gdb_v_packet(struct connection *connection,
 		 * when flash_write is called multiple times */
 		flash_set_dirty();
 
+		/* forget about a download GDB gave up on before vFlashDone */
+		gdb_vflash_end(connection);
+
 		/* perform any target specific operations before the erase */
 		target_call_event_callbacks(gdb_service->target,
 			TARGET_EVENT_GDB_FLASH_ERASE_START);
@@ -2641,45 +2959,72 @@ static int gdb_v_packet(struct connection *connection,
 		}
 		length = packet_size - (parse - packet);
 
+		/* the bank was programmed without this data, so it can't be added
+		 * any more; let vFlashDone fail */
+		if (gdb_vflash_bank_written(connection, addr, length)) {
+			LOG_ERROR("vFlashWrite to 0x%8.8lx after its flash bank was programmed", addr);
+			if (gdb_connection->vflash_result == ERROR_OK)
+				gdb_connection->vflash_result = ERROR_FAIL;
+			gdb_put_packet(connection, "OK", 2);
+			return ERROR_OK;
+		}
+
+		/* program the banks GDB is done with while it sends the next one */
+		struct image *complete = NULL;
+		if (gdb_vflash_bank_complete(connection, addr)) {
+			complete = gdb_connection->vflash_image;
+			gdb_connection->vflash_image = NULL;
+		}
+
 		/* create a new image if there isn't already one */
 		if (gdb_connection->vflash_image == NULL) {
 			gdb_connection->vflash_image = malloc(sizeof(struct image));
-			image_open(gdb_connection->vflash_image, "", "build");
+			if (gdb_connection->vflash_image == NULL
+					|| image_open(gdb_connection->vflash_image, "", "build") != ERROR_OK) {
+				LOG_ERROR("couldn't allocate vFlash image");
+				free(gdb_connection->vflash_image);
+				gdb_connection->vflash_image = NULL;
+				return ERROR_FAIL;
+			}
 		}
 
-		/* create new section with content from packet buffer */
+		/* add the data, merging it with the sections next to it */
 		retval = image_add_section(gdb_connection->vflash_image,
 				addr, length, 0x0, (uint8_t const *)parse);
 		if (retval != ERROR_OK)
 			return retval;
+		gdb_connection->vflash_next = addr + length;
 
 		gdb_put_packet(connection, "OK", 2);
 
+		if (complete)
+			gdb_vflash_write(connection, complete, true);
+
 		return ERROR_OK;
 	}
 
 	if (strncmp(packet, "vFlashDone", 10) == 0) {
-		uint32_t written;
+		/* process the rest of the flashing buffer. No need to erase as
+		 * GDB always issues a vFlashErase first. */
+		if (!gdb_connection->vflash_writing)
+			target_call_event_callbacks(gdb_service->target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
+		gdb_connection->vflash_writing = true;
+		if (gdb_connection->vflash_image) {
+			gdb_vflash_write(connection, gdb_connection->vflash_image, false);
+			gdb_connection->vflash_image = NULL;
+		}
+
+		result = gdb_connection->vflash_result;
+		gdb_vflash_end(connection);
 
-		/* process the flashing buffer. No need to erase as GDB
-		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(gdb_service->target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
-		result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0);
-		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
 		if (result != ERROR_OK) {
 			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
 				gdb_put_packet(connection, "E.memtype", 9);
 			else
 				gdb_send_error(connection, EIO);
-		} else {
-			LOG_DEBUG("wrote %u bytes from vFlash image to flash", (unsigned)written);
+		} else
 			gdb_put_packet(connection, "OK", 2);
-		}
-
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
 
 		return ERROR_OK;
 	}
@@ -2768,12 +3113,9 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE];
-
 	struct gdb_service *gdb_service = connection->service->priv;
 	struct target *target = gdb_service->target;
-	char const *packet = gdb_packet_buffer;
+	char *packet;
 	int packet_size;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
@@ -2791,14 +3133,10 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE-1;
-		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
+		retval = gdb_get_packet(connection, &packet, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
 
-		/* terminate with zero */
-		gdb_packet_buffer[packet_size] = '\0';
-
 		if (LOG_LEVEL_IS(LOG_LVL_DEBUG)) {
 			if (packet[0] == 'X') {
 				/* binary packets spew junk into the debug log stream */
@@ -2813,6 +3151,10 @@ static int gdb_input_inner(struct connection *connection)
 		}
 
 		if (packet_size > 0) {
+			/* anything but another read may change memory */
+			if (packet[0] != 'm')
+				gdb_con->read_ahead_len = 0;
+
 			retval = ERROR_OK;
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
@@ -3165,6 +3507,18 @@ COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_read_ahead_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], gdb_read_ahead);
+
+	command_print(CMD_CTX, "gdb read-ahead: %" PRIu32 " bytes", gdb_read_ahead);
+	return ERROR_OK;
+}
+
 /* gdb_breakpoint_override */
 COMMAND_HANDLER(handle_gdb_breakpoint_override_command)
 {
@@ -3286,6 +3640,14 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting data aborts",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_read_ahead",
+		.handler = handle_gdb_read_ahead_command,
+		.mode = COMMAND_ANY,
+		.help = "number of bytes to read ahead of sequential memory reads, "
+			"0 to disable",
+		.usage = "[bytes]"
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
@@ -32,7 +32,10 @@ struct image;
 struct reg;
 #include <target/target.h>
 
-#define GDB_BUFFER_SIZE 16384
+/* Largest packet we accept, announced to GDB as PacketSize.  GDB sizes
+ * its memory read and write packets after it, so a large value means
+ * fewer round trips for "load", "dump memory" and the like. */
+#define GDB_BUFFER_SIZE 65536
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
@@ -27,8 +27,8 @@
 #endif
 
 #include "server.h"
+#include "server_event.h"
 #include <target/target.h>
-#include <target/target_request.h>
 #include <target/openrisc/jsp_server.h>
 #include "openocd.h"
 #include "tcl_server.h"
@@ -59,6 +59,8 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+static int remove_connection(struct service *service, struct connection *connection);
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -73,6 +75,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = 0;
+	c->serviced = 0;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -112,6 +115,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 #endif
 
 		/* do not check for new connections again on stdin */
+		server_event_remove(service->fd);
 		service->fd = -1;
 
 		LOG_INFO("accepting '%s' connection from pipe", service->name);
@@ -125,6 +129,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	} else if (service->type == CONNECTION_PIPE) {
 		c->fd = service->fd;
 		/* do not check for new connections again on stdin */
+		server_event_remove(service->fd);
 		service->fd = -1;
 
 		char *out_file = alloc_printf("%so", service->port);
@@ -153,6 +158,12 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
 
+	if (server_event_add(c->fd, service, c) != ERROR_OK) {
+		LOG_ERROR("couldn't watch '%s' connection, dropping it", service->name);
+		remove_connection(service, c);
+		return ERROR_FAIL;
+	}
+
 	return ERROR_OK;
 }
 
@@ -165,11 +176,13 @@ static int remove_connection(struct service *service, struct connection *connect
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
 			service->connection_closed(c);
+			server_event_remove(c->fd);
 			if (service->type == CONNECTION_TCP)
 				close_socket(c->fd);
 			else if (service->type == CONNECTION_PIPE) {
 				/* The service will listen to the pipe again */
 				c->service->fd = c->fd;
+				server_event_add(c->fd, c->service, NULL);
 			}
 
 			command_done(c->cmd_ctx);
@@ -313,6 +326,11 @@ int add_service(char *name,
 #endif
 	}
 
+	if (server_event_add(c->fd, c, NULL) != ERROR_OK) {
+		LOG_ERROR("couldn't listen for '%s' connections", name);
+		exit(-1);
+	}
+
 	/* add to the end of linked list */
 	for (p = &services; *p; p = &(*p)->next)
 		;
@@ -332,6 +350,9 @@ static int remove_services(void)
 		if (c->name)
 			free(c->name);
 
+		if (c->fd != -1)
+			server_event_remove(c->fd);
+
 		if (c->type == CONNECTION_PIPE) {
 			if (c->fd != -1)
 				close(c->fd);
@@ -354,17 +375,54 @@ static int remove_services(void)
 	return ERROR_OK;
 }
 
+/* upper bound on the number of ready fds handled per pass of server_loop() */
+#define SERVER_MAX_READY	64
+
+static void server_accept(struct service *service, struct command_context *cmd_ctx)
+{
+	if (service->max_connections != 0) {
+		add_connection(service, cmd_ctx);
+		return;
+	}
+
+	if (service->type == CONNECTION_TCP) {
+		struct sockaddr_in sin;
+		socklen_t address_size = sizeof(sin);
+		int tmp_fd;
+		tmp_fd = accept(service->fd,
+				(struct sockaddr *)&service->sin,
+				&address_size);
+		close_socket(tmp_fd);
+	}
+	LOG_INFO("rejected '%s' connection, no more connections allowed",
+		service->name);
+}
+
+static void server_input(struct service *service, struct connection *c)
+{
+	int retval = service->input(c);
+	if (retval == ERROR_OK)
+		return;
+
+	if (service->type == CONNECTION_PIPE ||
+			service->type == CONNECTION_STDINOUT) {
+		/* if connection uses a pipe then
+		 * shutdown openocd on error */
+		shutdown_openocd = 1;
+	}
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+}
+
 int server_loop(struct command_context *command_context)
 {
 	struct service *service;
 
 	bool poll_ok = true;
 
-	/* used in select() */
-	fd_set read_fds;
-	int fd_max;
+	/* fds with input, filled in by server_event_wait() */
+	int ready[SERVER_MAX_READY];
 
-	/* used in accept() */
 	int retval;
 
 #ifndef _WIN32
@@ -373,69 +431,38 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (!shutdown_openocd) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
+		/* whatever was logged while handling the last round */
+		log_flush();
 
-		struct timeval tv;
-		tv.tv_sec = 0;
 		if (poll_ok) {
 			/* we're just polling this iteration, this is faster on embedded
 			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = server_event_wait(0, ready, SERVER_MAX_READY);
 		} else {
-			/* Every 100ms, can be changed with "poll_period" command */
-			tv.tv_usec = polling_period * 1000;
+			/* Sleep until the next timer callback is due, but at most
+			 * 100ms, can be changed with "poll_period" command */
+			int timeout_ms = target_timer_callbacks_next_ms();
+			if (timeout_ms < 0 || timeout_ms > polling_period)
+				timeout_ms = polling_period;
+
 			/* Only while we're sleeping we'll let others run */
 			openocd_sleep_prelude();
 			kept_alive();
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = server_event_wait(timeout_ms, ready, SERVER_MAX_READY);
 			openocd_sleep_postlude();
 		}
 
 		if (retval == -1) {
 #ifdef _WIN32
-
 			errno = WSAGetLastError();
 
-			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				exit(-1);
-			}
+			if (errno != WSAEINTR) {
 #else
-
-			if (errno == EINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
+			if (errno != EINTR) {
+#endif
+				LOG_ERROR("error waiting for server events: %s", strerror(errno));
 				exit(-1);
 			}
-#endif
 		}
 
 		if (retval == 0) {
@@ -444,8 +471,6 @@ int server_loop(struct command_context *command_context)
 			target_call_timer_callbacks();
 			process_jim_events(command_context);
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
-
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
 			poll_ok = false;
@@ -454,59 +479,36 @@ int server_loop(struct command_context *command_context)
 			poll_ok = true;
 		}
 
-		/* This is a simple back-off algorithm where we immediately
-		 * re-poll if we did something this time around.
-		 *
-		 * This greatly improves performance of DCC.
-		 */
-		poll_ok = poll_ok || target_got_message();
+		/* only the fds that have something to say are visited here */
+		for (int i = 0; i < retval; i++) {
+			struct server_event *event = server_event_lookup_ready(ready[i]);
 
-		for (service = services; service; service = service->next) {
-			/* handle new connections on listeners */
-			if ((service->fd != -1)
-			    && (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
-				}
+			/* closed, and maybe reused, by a handler earlier in this pass */
+			if (event == NULL)
+				continue;
+
+			if (event->connection == NULL) {
+				server_accept(event->service, command_context);
+			} else {
+				event->connection->serviced = 1;
+				server_input(event->service, event->connection);
 			}
+		}
+
+		/* handle input that a connection has already buffered, the
+		 * socket itself need not be readable for this; a connection
+		 * handled above gets its next turn in the next pass */
+		for (service = services; service; service = service->next) {
+			struct connection *c;
 
-			/* handle activity on connections */
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; ) {
-					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = 1;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
-						}
-					}
-					c = c->next;
-				}
+			for (c = service->connections; c; ) {
+				struct connection *next = c->next;
+				int serviced = c->serviced;
+
+				c->serviced = 0;
+				if (c->input_pending && !serviced)
+					server_input(service, c);
+				c = next;
 			}
 		}
 
@@ -564,7 +566,7 @@ int server_preinit(void)
 	signal(SIGTERM, sig_handler);
 	signal(SIGABRT, sig_handler);
 
-	return ERROR_OK;
+	return server_event_init();
 }
 
 int server_init(struct command_context *cmd_ctx)
@@ -579,6 +581,7 @@ int server_init(struct command_context *cmd_ctx)
 int server_quit(void)
 {
 	remove_services();
+	server_event_quit();
 	target_quit();
 
 #ifdef _WIN32
@@ -46,6 +46,8 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	int input_pending;
+	/* input was handled in this pass of server_loop() */
+	int serviced;
 	void *priv;
 	struct connection *next;
 };
@@ -0,0 +1,499 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/**
+ * @file
+ * Readiness notification for the fds served by server_loop().
+ *
+ * File descriptors are registered once when a service starts listening or
+ * a connection is accepted, instead of being collected into an fd_set on
+ * every pass of the main loop.  server_event_wait() then only reports the
+ * fds that actually have input, so the cost of an idle connection is zero
+ * with the epoll backend and a single pollfd slot with the poll backend.
+ *
+ * Readiness is level-triggered: the input handlers (gdb in particular) do
+ * not necessarily drain a socket in one call and rely on being called
+ * again while data is left.
+ *
+ * The fds reported by one wait are handled one after the other, and a
+ * handler may close a connection and accept a new one that gets the same
+ * fd number.  Every registration therefore remembers the wait it was made
+ * after, and server_event_lookup_ready() ignores readiness that was
+ * reported before the fd was registered again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "server_event.h"
+#include <helper/log.h>
+#include <helper/replacements.h>
+
+#if !defined(_WIN32) && defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#define SERVER_EVENT_EPOLL
+#endif
+
+#if !defined(_WIN32) && defined(HAVE_POLL_H)
+#define SERVER_EVENT_POLL
+#endif
+
+struct server_event_entry {
+	bool used;
+	/* index into watched_fds[] (and poll_fds[]) */
+	int slot;
+	/* value of wait_count when the fd was added */
+	unsigned int added;
+	/* epoll can't watch it (regular files), report it as always readable */
+	bool always_ready;
+	struct server_event event;
+};
+
+struct server_event_backend {
+	const char *name;
+	int (*init)(void);
+	void (*quit)(void);
+	int (*add)(int fd);
+	int (*remove)(int fd);
+	int (*wait)(int timeout_ms, int *ready, int max_ready);
+};
+
+/* registered fds, indexed by the fd itself */
+static struct server_event_entry *entries;
+static int num_entries;
+
+/* registered fds in dense form, used by the poll and select backends */
+static int *watched_fds;
+static int num_watched;
+static int max_watched;
+
+static const struct server_event_backend *backend;
+
+/* number of calls to server_event_wait() so far */
+static unsigned int wait_count;
+
+/* poll and select start reporting at this index into watched_fds[], so
+ * that the fds at the end get their turn when not all fit in ready[] */
+static int first_slot;
+
+static int watched_add(int fd)
+{
+	if (num_watched == max_watched) {
+		int new_max = max_watched ? max_watched * 2 : 16;
+		int *new_fds = realloc(watched_fds, new_max * sizeof(*watched_fds));
+		if (new_fds == NULL)
+			return ERROR_FAIL;
+		watched_fds = new_fds;
+		max_watched = new_max;
+	}
+
+	entries[fd].slot = num_watched;
+	watched_fds[num_watched++] = fd;
+
+	return ERROR_OK;
+}
+
+/* swap the last slot into the hole so removal stays O(1) */
+static int watched_remove(int fd)
+{
+	int slot = entries[fd].slot;
+	int last = watched_fds[--num_watched];
+
+	watched_fds[slot] = last;
+	entries[last].slot = slot;
+
+	return slot;
+}
+
+#ifdef SERVER_EVENT_EPOLL
+
+static int epoll_fd = -1;
+static int num_always_ready;
+
+static int epoll_backend_init(void)
+{
+	epoll_fd = epoll_create(16);
+	if (epoll_fd == -1) {
+		LOG_DEBUG("epoll_create failed: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	fcntl(epoll_fd, F_SETFD, FD_CLOEXEC);
+
+	return ERROR_OK;
+}
+
+static void epoll_backend_quit(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+	num_always_ready = 0;
+}
+
+static int epoll_backend_add(int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		/* regular files, stdin with "openocd < script" for example, can't
+		 * be watched by epoll; poll() would always find them readable */
+		if (errno == EPERM) {
+			LOG_DEBUG("fd %d can't be watched by epoll, treating it as readable", fd);
+			entries[fd].always_ready = true;
+			num_always_ready++;
+			return ERROR_OK;
+		}
+		LOG_ERROR("couldn't watch fd %d: %s", fd, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int epoll_backend_remove(int fd)
+{
+	/* the event argument is ignored, but pre-2.6.9 kernels want one */
+	struct epoll_event ev;
+
+	if (entries[fd].always_ready) {
+		entries[fd].always_ready = false;
+		num_always_ready--;
+		return ERROR_OK;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+
+	return ERROR_OK;
+}
+
+#define EPOLL_MAX_EVENTS	64
+
+static int epoll_backend_wait(int timeout_ms, int *ready, int max_ready)
+{
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+
+	if (max_ready > EPOLL_MAX_EVENTS)
+		max_ready = EPOLL_MAX_EVENTS;
+
+	/* there is input already if an fd is always readable */
+	if (num_always_ready > 0)
+		timeout_ms = 0;
+
+	/* the kernel moves the level-triggered fds it reports to the end of
+	 * its ready list, so no fd is starved when not all fit */
+	int retval = epoll_wait(epoll_fd, events, max_ready, timeout_ms);
+	if (retval < 0)
+		return retval;
+
+	for (int i = 0; i < retval; i++)
+		ready[i] = events[i].data.fd;
+
+	for (int i = 0; i < num_watched && num_always_ready > 0 && retval < max_ready; i++) {
+		if (entries[watched_fds[i]].always_ready)
+			ready[retval++] = watched_fds[i];
+	}
+
+	return retval;
+}
+
+static const struct server_event_backend epoll_backend = {
+	.name = "epoll",
+	.init = epoll_backend_init,
+	.quit = epoll_backend_quit,
+	.add = epoll_backend_add,
+	.remove = epoll_backend_remove,
+	.wait = epoll_backend_wait,
+};
+
+#endif /* SERVER_EVENT_EPOLL */
+
+#ifdef SERVER_EVENT_POLL
+
+/* kept in step with watched_fds[], slot for slot */
+static struct pollfd *poll_fds;
+static int max_poll_fds;
+
+static int poll_backend_init(void)
+{
+	return ERROR_OK;
+}
+
+static void poll_backend_quit(void)
+{
+	free(poll_fds);
+	poll_fds = NULL;
+	max_poll_fds = 0;
+}
+
+static int poll_backend_add(int fd)
+{
+	int slot = entries[fd].slot;
+
+	if (slot >= max_poll_fds) {
+		struct pollfd *new_fds = realloc(poll_fds, max_watched * sizeof(*poll_fds));
+		if (new_fds == NULL)
+			return ERROR_FAIL;
+		poll_fds = new_fds;
+		max_poll_fds = max_watched;
+	}
+
+	poll_fds[slot].fd = fd;
+	poll_fds[slot].events = POLLIN;
+	poll_fds[slot].revents = 0;
+
+	return ERROR_OK;
+}
+
+static int poll_backend_remove(int fd)
+{
+	int slot = entries[fd].slot;
+
+	/* watched_remove() moves the last fd into this slot right after us */
+	poll_fds[slot] = poll_fds[num_watched - 1];
+
+	return ERROR_OK;
+}
+
+static int poll_backend_wait(int timeout_ms, int *ready, int max_ready)
+{
+	int retval = poll(poll_fds, num_watched, timeout_ms);
+	if (retval <= 0)
+		return retval;
+
+	int n = 0, start = first_slot;
+	for (int i = 0; i < num_watched && n < retval && n < max_ready; i++) {
+		int slot = (start + i) % num_watched;
+
+		/* hangups and errors are reported as input so that the
+		 * handler gets to see the failing read() */
+		if (poll_fds[slot].revents) {
+			ready[n++] = poll_fds[slot].fd;
+			first_slot = slot + 1;
+		}
+	}
+
+	return n;
+}
+
+static const struct server_event_backend poll_backend = {
+	.name = "poll",
+	.init = poll_backend_init,
+	.quit = poll_backend_quit,
+	.add = poll_backend_add,
+	.remove = poll_backend_remove,
+	.wait = poll_backend_wait,
+};
+
+#endif /* SERVER_EVENT_POLL */
+
+static int select_backend_init(void)
+{
+	return ERROR_OK;
+}
+
+static void select_backend_quit(void)
+{
+}
+
+static int select_backend_add(int fd)
+{
+#ifdef _WIN32
+	if (num_watched > FD_SETSIZE) {
+#else
+	if (fd >= FD_SETSIZE) {
+#endif
+		LOG_ERROR("fd %d exceeds FD_SETSIZE (%d)", fd, FD_SETSIZE);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int select_backend_remove(int fd)
+{
+	return ERROR_OK;
+}
+
+static int select_backend_wait(int timeout_ms, int *ready, int max_ready)
+{
+	fd_set read_fds;
+	int fd_max = 0;
+
+	FD_ZERO(&read_fds);
+	for (int i = 0; i < num_watched; i++) {
+		FD_SET(watched_fds[i], &read_fds);
+		if (watched_fds[i] > fd_max)
+			fd_max = watched_fds[i];
+	}
+
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	int retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+	if (retval <= 0)
+		return retval;
+
+	int n = 0, start = first_slot;
+	for (int i = 0; i < num_watched && n < retval && n < max_ready; i++) {
+		int slot = (start + i) % num_watched;
+
+		if (FD_ISSET(watched_fds[slot], &read_fds)) {
+			ready[n++] = watched_fds[slot];
+			first_slot = slot + 1;
+		}
+	}
+
+	return n;
+}
+
+static const struct server_event_backend select_backend = {
+	.name = "select",
+	.init = select_backend_init,
+	.quit = select_backend_quit,
+	.add = select_backend_add,
+	.remove = select_backend_remove,
+	.wait = select_backend_wait,
+};
+
+static const struct server_event_backend *const server_event_backends[] = {
+#ifdef SERVER_EVENT_EPOLL
+	&epoll_backend,
+#endif
+#ifdef SERVER_EVENT_POLL
+	&poll_backend,
+#endif
+	&select_backend,
+};
+
+int server_event_init(void)
+{
+	for (unsigned i = 0; i < ARRAY_SIZE(server_event_backends); i++) {
+		if (server_event_backends[i]->init() == ERROR_OK) {
+			backend = server_event_backends[i];
+			LOG_DEBUG("using %s for server events", backend->name);
+			return ERROR_OK;
+		}
+	}
+
+	return ERROR_FAIL;
+}
+
+void server_event_quit(void)
+{
+	if (backend)
+		backend->quit();
+	backend = NULL;
+
+	free(entries);
+	entries = NULL;
+	num_entries = 0;
+
+	free(watched_fds);
+	watched_fds = NULL;
+	num_watched = 0;
+	max_watched = 0;
+	first_slot = 0;
+}
+
+const char *server_event_backend_name(void)
+{
+	return backend ? backend->name : "none";
+}
+
+int server_event_add(int fd, struct service *service, struct connection *connection)
+{
+	if (fd < 0)
+		return ERROR_FAIL;
+
+	if (fd >= num_entries) {
+		int new_num = num_entries ? num_entries : 16;
+		while (new_num <= fd)
+			new_num *= 2;
+
+		struct server_event_entry *new_entries = realloc(entries, new_num * sizeof(*entries));
+		if (new_entries == NULL)
+			return ERROR_FAIL;
+		memset(new_entries + num_entries, 0, (new_num - num_entries) * sizeof(*entries));
+		entries = new_entries;
+		num_entries = new_num;
+	}
+
+	struct server_event_entry *e = &entries[fd];
+	if (e->used) {
+		LOG_ERROR("fd %d is already being watched", fd);
+		return ERROR_FAIL;
+	}
+
+	if (watched_add(fd) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (backend->add(fd) != ERROR_OK) {
+		watched_remove(fd);
+		return ERROR_FAIL;
+	}
+
+	e->used = true;
+	e->added = wait_count;
+	e->event.service = service;
+	e->event.connection = connection;
+
+	return ERROR_OK;
+}
+
+int server_event_remove(int fd)
+{
+	if (fd < 0 || fd >= num_entries || !entries[fd].used)
+		return ERROR_FAIL;
+
+	backend->remove(fd);
+	watched_remove(fd);
+	entries[fd].used = false;
+
+	return ERROR_OK;
+}
+
+struct server_event *server_event_lookup(int fd)
+{
+	if (fd < 0 || fd >= num_entries || !entries[fd].used)
+		return NULL;
+
+	return &entries[fd].event;
+}
+
+struct server_event *server_event_lookup_ready(int fd)
+{
+	struct server_event *event = server_event_lookup(fd);
+
+	/* added after the last wait, the readiness was the previous fd's */
+	if (event && entries[fd].added == wait_count)
+		return NULL;
+
+	return event;
+}
+
+int server_event_wait(int timeout_ms, int *ready, int max_ready)
+{
+	wait_count++;
+
+	return backend->wait(timeout_ms, ready, max_ready);
+}
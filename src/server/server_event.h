@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_SERVER_EVENT_H
+#define OPENOCD_SERVER_SERVER_EVENT_H
+
+struct service;
+struct connection;
+
+/**
+ * What a file descriptor registered with the event engine is serving.
+ * A NULL @a connection means the fd is the listening side of @a service.
+ */
+struct server_event {
+	struct service *service;
+	struct connection *connection;
+};
+
+/**
+ * Select the best event backend available on this host (epoll, poll or
+ * select, in that order of preference).  Called once from server_preinit().
+ */
+int server_event_init(void);
+void server_event_quit(void);
+
+/** @returns the name of the backend picked by server_event_init(). */
+const char *server_event_backend_name(void);
+
+/** Start watching @a fd for input. */
+int server_event_add(int fd, struct service *service, struct connection *connection);
+/** Stop watching @a fd; must be called before the fd is closed. */
+int server_event_remove(int fd);
+
+/**
+ * Look up what a registered fd belongs to.
+ * @returns NULL if the fd isn't registered.
+ */
+struct server_event *server_event_lookup(int fd);
+
+/**
+ * Like server_event_lookup(), but also returns NULL if the fd has been
+ * added again since the last wait: the number was reused for a new
+ * connection and the reported input was the closed one's.
+ */
+struct server_event *server_event_lookup_ready(int fd);
+
+/**
+ * Wait up to @a timeout_ms for input on the registered fds; zero polls.
+ * Up to @a max_ready readable fds are stored in @a ready.
+ * @returns the number of ready fds, 0 on timeout or -1 with errno set,
+ * just like select().
+ */
+int server_event_wait(int timeout_ms, int *ready, int max_ready);
+
+#endif /* OPENOCD_SERVER_SERVER_EVENT_H */
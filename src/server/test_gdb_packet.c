@@ -0,0 +1,402 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Replays streams of GDB remote protocol packets through gdb_unescape(),
+ * the receive path of gdb_server's fetch_packet().  The stream is handed
+ * over in reads of random sizes, as a socket would, and the receive loop
+ * around gdb_unescape() is the one of fetch_packet(): escapes split over
+ * two reads and refills go through a character at a time.
+ *
+ * Usage: test_gdb_packet [iterations [seed]]
+ *        test_gdb_packet bench
+ *
+ * "make check" replays random packets, text and binary 'X' ones, some too
+ * large for the packet buffer, and checks the data and the checksum of
+ * each.  "bench" replays 16 KiB 'X' packets in 4 KiB reads and compares
+ * the throughput with the character at a time loop that gdb_unescape()
+ * replaced.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gdb_packet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the largest packet, as with PacketSize in gdb_server.c */
+#define TEST_PACKET_MAX		(16 * 1024)
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static bool needs_escape(uint8_t c)
+{
+	return c == '#' || c == '$' || c == '}' || c == '*';
+}
+
+/* Append "$data#cc" to @a stream as gdb sends it, returns its length. */
+static size_t frame_packet(char *stream, const uint8_t *data, size_t size)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char checksum = 0;
+	size_t len = 0;
+
+	stream[len++] = '$';
+	for (size_t i = 0; i < size; i++) {
+		if (needs_escape(data[i])) {
+			stream[len++] = '}';
+			checksum += '}';
+			stream[len] = data[i] ^ 0x20;
+		} else
+			stream[len] = data[i];
+		checksum += stream[len++];
+	}
+	stream[len++] = '#';
+	stream[len++] = hex[checksum >> 4];
+	stream[len++] = hex[checksum & 0xf];
+
+	return len;
+}
+
+/* The socket side: the stream comes in reads of up to max_read bytes,
+ * 4 KiB if it's 0.  Each read is copied to the end of the buffer, so that
+ * looking past what was received reads stale data, or past the buffer. */
+#define REPLAY_READ_MAX		5000
+
+struct replay {
+	const char *stream;
+	size_t size;
+	size_t pos;
+	size_t max_read;
+	char buffer[REPLAY_READ_MAX];
+	const char *buf_p;
+	int buf_cnt;
+};
+
+static int replay_get_char(struct replay *r, int *character)
+{
+	if (r->buf_cnt == 0) {
+		size_t n = r->max_read ? 1 + rng() % r->max_read : 4096;
+
+		if (r->pos == r->size)
+			return -1;
+		if (n > r->size - r->pos)
+			n = r->size - r->pos;
+		r->buf_p = r->buffer + sizeof(r->buffer) - n;
+		memcpy(r->buffer + sizeof(r->buffer) - n, r->stream + r->pos, n);
+		r->buf_cnt = n;
+		r->pos += n;
+	}
+
+	r->buf_cnt--;
+	*character = (uint8_t)*r->buf_p++;
+	return 0;
+}
+
+/* fetch_packet(), with the packet buffer at its largest size */
+static int replay_packet(struct replay *r, char *packet, int packet_max,
+		int *len, bool *checksum_ok)
+{
+	unsigned char my_checksum = 0;
+	char checksum[3];
+	int character;
+	int count = 0;
+
+	do {
+		if (replay_get_char(r, &character))
+			return -1;
+	} while (character != '$');
+
+	for (;; ) {
+		const char *p = r->buf_p;
+		char *out = packet + count;
+		enum gdb_unescape_result result = gdb_unescape(&p, r->buf_p + r->buf_cnt, &out,
+				packet + packet_max - 1, &my_checksum, false);
+
+		count = out - packet;
+		r->buf_cnt -= p - r->buf_p;
+		r->buf_p = p;
+
+		if (result == GDB_UNESCAPE_END)
+			break;
+		if (result == GDB_UNESCAPE_FULL)
+			return 1;
+
+		if (replay_get_char(r, &character))
+			return -1;
+		if (character == '#')
+			break;
+		my_checksum += character;
+		if (character == '}') {
+			if (replay_get_char(r, &character))
+				return -1;
+			my_checksum += character;
+			character ^= 0x20;
+		}
+		if (count + 1 >= packet_max)
+			return 1;
+		packet[count++] = character;
+	}
+
+	if (replay_get_char(r, &character))
+		return -1;
+	checksum[0] = character;
+	if (replay_get_char(r, &character))
+		return -1;
+	checksum[1] = character;
+	checksum[2] = 0;
+
+	*len = count;
+	*checksum_ok = my_checksum == strtoul(checksum, NULL, 16);
+	return 0;
+}
+
+#define FUZZ_PACKETS		8
+
+static int fuzz(unsigned long iterations)
+{
+	static uint8_t data[FUZZ_PACKETS][TEST_PACKET_MAX + 16];
+	static char stream[FUZZ_PACKETS * (2 * TEST_PACKET_MAX + 64)];
+	static char packet[TEST_PACKET_MAX];
+	size_t sizes[FUZZ_PACKETS];
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		unsigned packets = 1 + rng() % FUZZ_PACKETS;
+		struct replay r = {
+			.stream = stream,
+			.max_read = 1 + rng() % REPLAY_READ_MAX,
+		};
+
+		for (unsigned i = 0; i < packets; i++) {
+			unsigned kind = rng() % 4;
+			/* mostly short packets, now and then one larger than fits */
+			size_t size = rng() % ((rng() & 7) ? 64 : TEST_PACKET_MAX + 16);
+
+			for (size_t j = 0; j < size; j++) {
+				switch (kind) {
+				case 0:		/* text, as in most packets */
+					data[i][j] = "0123456789abcdef,:;m"[rng() % 20];
+					break;
+				case 1:		/* binary data with nothing to escape */
+					do
+						data[i][j] = rng();
+					while (needs_escape(data[i][j]));
+					break;
+				case 2:		/* binary data, mostly escapes */
+					data[i][j] = "#$}*x"[rng() % 5];
+					break;
+				default:	/* any binary data */
+					data[i][j] = rng();
+					break;
+				}
+			}
+			sizes[i] = size;
+			/* gdb sends acks and Ctrl-C between packets */
+			if (rng() % 4 == 0)
+				stream[r.size++] = "+-\x03"[rng() % 3];
+			r.size += frame_packet(stream + r.size, data[i], size);
+		}
+
+		for (unsigned i = 0; i < packets; i++) {
+			int len = 0;
+			bool checksum_ok = false;
+			int retval = replay_packet(&r, packet, sizeof(packet), &len, &checksum_ok);
+
+			if (sizes[i] >= sizeof(packet)) {
+				/* too large, the connection would be dropped */
+				if (retval != 1) {
+					printf("FAIL: iteration %lu, packet %u of %zu bytes not refused\n",
+							n, i, sizes[i]);
+					return 1;
+				}
+				break;
+			}
+			if (retval != 0 || !checksum_ok || (size_t)len != sizes[i]
+					|| memcmp(packet, data[i], len)) {
+				printf("FAIL: iteration %lu, packet %u of %zu bytes, reads of up to %zu\n",
+						n, i, sizes[i], r.max_read);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* the receive loop before gdb_unescape(), a character at a time */
+static int ref_replay_packet(struct replay *r, char *packet, int *len)
+{
+	unsigned char my_checksum = 0;
+	int character;
+	int count = 0;
+
+	do {
+		if (replay_get_char(r, &character))
+			return -1;
+	} while (character != '$');
+
+	for (;; ) {
+		if (r->buf_cnt > 2 && r->buf_cnt + count < TEST_PACKET_MAX) {
+			const char *buf = r->buf_p;
+			int run = r->buf_cnt - 2;
+			int i = 0;
+			bool done = false;
+
+			while (i < run) {
+				character = *buf++;
+				i++;
+				if (character == '#') {
+					done = true;
+					break;
+				}
+				if (character == '}') {
+					my_checksum += character & 0xff;
+					character = *buf++;
+					i++;
+					my_checksum += character & 0xff;
+					packet[count++] = (character ^ 0x20) & 0xff;
+				} else {
+					my_checksum += character & 0xff;
+					packet[count++] = character & 0xff;
+				}
+			}
+			r->buf_p += i;
+			r->buf_cnt -= i;
+			if (done)
+				break;
+		}
+
+		if (replay_get_char(r, &character))
+			return -1;
+		if (character == '#')
+			break;
+		my_checksum += character;
+		if (character == '}') {
+			if (replay_get_char(r, &character))
+				return -1;
+			my_checksum += character;
+			character ^= 0x20;
+		}
+		packet[count++] = character;
+	}
+
+	/* the checksum characters, not compared here */
+	if (replay_get_char(r, &character) || replay_get_char(r, &character))
+		return -1;
+	*len = count;
+	return my_checksum;
+}
+
+#define BENCH_PACKETS		64
+#define BENCH_ROUNDS		200
+
+static void bench_stream(const char *what, unsigned escape_every)
+{
+	static uint8_t data[TEST_PACKET_MAX - 1];
+	static char stream[BENCH_PACKETS * (2 * TEST_PACKET_MAX + 16)];
+	static char packet[TEST_PACKET_MAX];
+	size_t size = 0;
+	volatile int sink = 0;
+	clock_t start;
+	double seconds;
+
+	/* 'X' packets as gdb sends them for a load, header and all */
+	for (unsigned i = 0; i < BENCH_PACKETS; i++) {
+		size_t header = sprintf((char *)data, "X%x,%x:", 0x20000000 + i * 0x4000, 0x3f00);
+		for (size_t j = header; j < sizeof(data); j++) {
+			do
+				data[j] = rng();
+			while (needs_escape(data[j]));
+			if (escape_every && j % escape_every == 0)
+				data[j] = '}';
+		}
+		size += frame_packet(stream + size, data, sizeof(data) - 64);
+	}
+
+	start = clock();
+	for (unsigned round = 0; round < BENCH_ROUNDS; round++) {
+		struct replay r = { .stream = stream, .size = size };
+		int len = 0;
+		bool checksum_ok;
+
+		for (unsigned i = 0; i < BENCH_PACKETS; i++) {
+			replay_packet(&r, packet, sizeof(packet), &len, &checksum_ok);
+			sink += len;
+		}
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%-22s gdb_unescape   %6.0f MB/s\n", what, size * BENCH_ROUNDS / seconds / 1e6);
+
+	start = clock();
+	for (unsigned round = 0; round < BENCH_ROUNDS; round++) {
+		struct replay r = { .stream = stream, .size = size };
+		int len = 0;
+
+		for (unsigned i = 0; i < BENCH_PACKETS; i++) {
+			sink += ref_replay_packet(&r, packet, &len);
+			sink += len;
+		}
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%-22s char at a time %6.0f MB/s\n", what, size * BENCH_ROUNDS / seconds / 1e6);
+
+	(void)sink;
+}
+
+static void bench(void)
+{
+	printf("%u 'X' packets of %u KiB in 4 KiB reads:\n",
+			BENCH_PACKETS, TEST_PACKET_MAX / 1024);
+	bench_stream("plain data", 0);
+	bench_stream("one escape in 64", 64);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 20000;
+	uint64_t seed = time(NULL);
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		rng_state = 1;
+		bench();
+		return 0;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("gdb packet replay test, %lu iterations, seed %llu\n",
+			iterations, (unsigned long long)seed);
+
+	return fuzz(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,360 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Checks that server_event_wait() reports exactly the registered fds that
+ * have input, on socket pairs that random writes and reads make readable
+ * and drain again, and that readiness reported for an fd that was closed
+ * and registered again is ignored by server_event_lookup_ready().
+ *
+ * Usage: test_server_event [iterations [seed]]
+ *        test_server_event bench
+ *
+ * "make check" runs the fuzz test; "bench" times a pass of the main loop
+ * with 500 idle connections and one busy one, against building an fd_set
+ * of all of them for select() and scanning it, as server_loop() did.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "server_event.h"
+#include <helper/log.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+/* what server_event.c needs from outside */
+int debug_level = LOG_LVL_USER;
+
+void log_printf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+void log_printf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+/* the end the server reads from is registered, the peer writes to it */
+struct test_pair {
+	int fd;
+	int peer;
+	unsigned pending;
+	/* stands in for the struct connection the fd would belong to */
+	char connection;
+};
+
+static struct test_pair *connection_pair(struct connection *connection)
+{
+	return (struct test_pair *)((char *)connection - offsetof(struct test_pair, connection));
+}
+
+static int pair_open(struct test_pair *p)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		perror("socketpair");
+		return ERROR_FAIL;
+	}
+
+	p->fd = fds[0];
+	p->peer = fds[1];
+	p->pending = 0;
+
+	return server_event_add(p->fd, NULL, (struct connection *)&p->connection);
+}
+
+static void pair_close(struct test_pair *p)
+{
+	server_event_remove(p->fd);
+	close(p->fd);
+	close(p->peer);
+}
+
+static int pair_write(struct test_pair *p, unsigned count)
+{
+	char buf[16] = { 0 };
+
+	if (write(p->peer, buf, count) != (ssize_t)count)
+		return ERROR_FAIL;
+	p->pending += count;
+	return ERROR_OK;
+}
+
+/* like a handler that doesn't take all of the input at once */
+static int pair_read(struct test_pair *p, unsigned count)
+{
+	char buf[16];
+
+	if (count > p->pending)
+		count = p->pending;
+	if (count && read(p->fd, buf, count) != (ssize_t)count)
+		return ERROR_FAIL;
+	p->pending -= count;
+	return ERROR_OK;
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+#define FUZZ_PAIRS		48
+
+static struct test_pair *find_pair(struct test_pair *pairs, int fd)
+{
+	for (unsigned i = 0; i < FUZZ_PAIRS; i++) {
+		if (pairs[i].fd == fd)
+			return &pairs[i];
+	}
+	return NULL;
+}
+
+static int fuzz(unsigned long iterations)
+{
+	struct test_pair pairs[FUZZ_PAIRS];
+	int ready[FUZZ_PAIRS];
+
+	for (unsigned i = 0; i < FUZZ_PAIRS; i++) {
+		if (pair_open(&pairs[i]) != ERROR_OK)
+			return 1;
+	}
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		struct test_pair *p = &pairs[rng() % FUZZ_PAIRS];
+		const char *failed = NULL;
+
+		switch (rng() % 8) {
+		case 0:
+		case 1:
+			if (pair_write(p, 1 + rng() % 16) != ERROR_OK)
+				failed = "write";
+			break;
+		case 2:
+		case 3:
+			if (pair_read(p, 1 + rng() % 16) != ERROR_OK)
+				failed = "read";
+			break;
+		case 4: {
+			/* with room for all of them, exactly the fds with
+			 * input are reported, each once */
+			unsigned expected = 0, seen = 0;
+			int count = server_event_wait(0, ready, FUZZ_PAIRS);
+
+			for (unsigned i = 0; i < FUZZ_PAIRS; i++)
+				expected += pairs[i].pending > 0;
+			for (int i = 0; i < count; i++) {
+				struct test_pair *r = find_pair(pairs, ready[i]);
+				if (r == NULL || r->pending == 0
+						|| server_event_lookup_ready(ready[i]) == NULL
+						|| server_event_lookup_ready(ready[i])->connection
+							!= (struct connection *)&r->connection)
+					failed = "server_event_wait reported an fd without input";
+				else
+					seen++;
+			}
+			for (int i = 0; i < count; i++) {
+				for (int j = 0; j < i; j++) {
+					if (ready[i] == ready[j])
+						failed = "server_event_wait reported an fd twice";
+				}
+			}
+			if (count < 0 || (unsigned)count != expected || seen != expected)
+				failed = "server_event_wait missed an fd with input";
+			break;
+		}
+		case 5: {
+			/* with less room, the fds reported are still ones with
+			 * input, and as many as fit */
+			unsigned expected = 0;
+			int max_ready = 1 + rng() % 4;
+			int count = server_event_wait(0, ready, max_ready);
+
+			for (unsigned i = 0; i < FUZZ_PAIRS; i++)
+				expected += pairs[i].pending > 0;
+			if (expected > (unsigned)max_ready)
+				expected = max_ready;
+			for (int i = 0; i < count; i++) {
+				struct test_pair *r = find_pair(pairs, ready[i]);
+				if (r == NULL || r->pending == 0)
+					failed = "server_event_wait reported an fd without input";
+			}
+			if (count < 0 || (unsigned)count != expected)
+				failed = "server_event_wait filled in the wrong number of fds";
+			break;
+		}
+		case 6: {
+			/* a handler closes a connection that has input and a new
+			 * one gets its fd: the old readiness must be ignored */
+			int count = server_event_wait(0, ready, FUZZ_PAIRS);
+
+			for (int i = 0; i < count; i++) {
+				struct test_pair *r = find_pair(pairs, ready[i]);
+				if (r == NULL || (rng() & 1))
+					continue;
+				int fd = r->fd;
+				pair_close(r);
+				if (pair_open(r) != ERROR_OK) {
+					failed = "reopen";
+					break;
+				}
+				if (r->fd == fd && server_event_lookup_ready(fd) != NULL)
+					failed = "server_event_lookup_ready of a reused fd";
+				if (server_event_lookup(r->fd) == NULL)
+					failed = "server_event_lookup of a new fd";
+			}
+			break;
+		}
+		default:
+			pair_close(p);
+			if (server_event_lookup(p->fd) != NULL)
+				failed = "server_event_lookup of a removed fd";
+			if (pair_open(p) != ERROR_OK)
+				failed = "reopen";
+			break;
+		}
+
+		if (failed) {
+			printf("FAIL: iteration %lu: %s\n", n, failed);
+			return 1;
+		}
+	}
+
+	for (unsigned i = 0; i < FUZZ_PAIRS; i++)
+		pair_close(&pairs[i]);
+
+	return 0;
+}
+
+/* 1000 fds for the pairs still fit in FD_SETSIZE for the select() loop */
+#define BENCH_IDLE		500
+#define BENCH_PASSES		20000
+
+static double elapsed_us(clock_t start, unsigned count)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e6 / count;
+}
+
+static int bench(void)
+{
+	static struct test_pair pairs[BENCH_IDLE + 1];
+	struct test_pair *busy = &pairs[BENCH_IDLE];
+	int ready[16];
+	unsigned handled = 0;
+	clock_t start;
+
+	for (unsigned i = 0; i <= BENCH_IDLE; i++) {
+		if (pair_open(&pairs[i]) != ERROR_OK) {
+			printf("can't open %u connections, raise the limit on open files\n",
+					BENCH_IDLE + 1);
+			return 1;
+		}
+	}
+
+	printf("%u idle connections and a busy one, us per pass:\n", BENCH_IDLE);
+
+	start = clock();
+	for (unsigned n = 0; n < BENCH_PASSES; n++) {
+		pair_write(busy, 1);
+		int count = server_event_wait(0, ready, ARRAY_SIZE(ready));
+		for (int i = 0; i < count; i++) {
+			struct server_event *event = server_event_lookup_ready(ready[i]);
+			if (event != NULL) {
+				pair_read(connection_pair(event->connection), 1);
+				handled++;
+			}
+		}
+	}
+	printf("server_event_wait (%s) %8.2f\n", server_event_backend_name(),
+			elapsed_us(start, BENCH_PASSES));
+
+	start = clock();
+	for (unsigned n = 0; n < BENCH_PASSES; n++) {
+		fd_set read_fds;
+		struct timeval tv = { 0, 0 };
+		int fd_max = -1;
+
+		pair_write(busy, 1);
+		FD_ZERO(&read_fds);
+		for (unsigned i = 0; i <= BENCH_IDLE; i++) {
+			FD_SET(pairs[i].fd, &read_fds);
+			if (pairs[i].fd > fd_max)
+				fd_max = pairs[i].fd;
+		}
+		if (select(fd_max + 1, &read_fds, NULL, NULL, &tv) > 0) {
+			for (unsigned i = 0; i <= BENCH_IDLE; i++) {
+				if (FD_ISSET(pairs[i].fd, &read_fds)) {
+					pair_read(&pairs[i], 1);
+					handled++;
+				}
+			}
+		}
+	}
+	printf("select, all fds         %8.2f\n", elapsed_us(start, BENCH_PASSES));
+
+	for (unsigned i = 0; i <= BENCH_IDLE; i++)
+		pair_close(&pairs[i]);
+
+	printf("%u inputs handled\n", handled);
+	return handled == 2 * BENCH_PASSES ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 100000;
+	uint64_t seed = time(NULL);
+	int retval;
+
+	if (server_event_init() != ERROR_OK) {
+		printf("FAIL: no server event backend\n");
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		retval = bench();
+		server_event_quit();
+		return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("server event fuzz test, %s backend, %lu iterations, seed %llu\n",
+			server_event_backend_name(), iterations, (unsigned long long)seed);
+
+	retval = fuzz(iterations);
+	server_event_quit();
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
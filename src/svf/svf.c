@@ -31,8 +31,13 @@
 
 #include <jtag/jtag.h>
 #include "svf.h"
+#include <helper/fileio.h>
 #include <helper/time_support.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 /* SVF command */
 enum svf_command {
 	ENDDR,
@@ -149,6 +154,16 @@ static const struct svf_statemove svf_statemoves[] = {
 #define XXR_TDO				(1 << 1)
 #define XXR_MASK			(1 << 2)
 #define XXR_SMASK			(1 << 3)
+#define XXR_NUM_FIELDS		4
+
+/* indexed by the bit number of the XXR_* flags */
+static const char *svf_xxr_field_name[XXR_NUM_FIELDS] = {
+	"TDI",
+	"TDO",
+	"MASK",
+	"SMASK"
+};
+
 struct svf_xxr_para {
 	int len;
 	int data_mask;
@@ -198,6 +213,116 @@ static const struct svf_para svf_para_init = {
 	{0,			0,		NULL,	NULL,	NULL,	NULL},
 };
 
+/*
+ * One SVF command, with its parameters decoded.  Commands are parsed from
+ * the text of an SVF file or read from a compiled one; either way they are
+ * run by svf_execute_command().  Decoded data is owned by the parser or
+ * the compiled file and only valid until the next command is read.
+ */
+struct svf_cmd {
+	enum svf_command command;
+	int line_num;
+
+	/* ENDDR, ENDIR */
+	tap_state_t state;
+
+	/* FREQUENCY; no frequency means full speed */
+	bool has_frequency;
+	float frequency;
+
+	/* HDR, HIR, SDR, SIR, TDR, TIR: len bits for each field in data_mask */
+	int len;
+	int data_mask;
+	const uint8_t *data[XXR_NUM_FIELDS];
+
+	/* RUNTEST; states not given are TAP_INVALID */
+	tap_state_t run_state;
+	tap_state_t end_state;
+	int run_count;
+	uint32_t min_usec;
+
+	/* STATE: a single stable state, or a path to follow */
+	int num_states;
+	const tap_state_t *path;
+
+	/* TRST */
+	enum trst_mode trst_mode;
+};
+
+/*
+ * A command read and parsed ahead by the pipeline thread, with its own
+ * copy of the decoded data.  The slot stays owned by the main thread from
+ * svf_pipeline_next() until the next call.
+ */
+struct svf_pipeline_slot {
+	/* false at the end of the file */
+	bool valid;
+	/* false if the command failed to parse; the thread stops there */
+	bool parsed;
+	int line_num;
+	struct svf_cmd cmd;
+	/* last line of the command, for logging unless quiet */
+	char *line;
+	size_t line_size;
+	uint8_t *data;
+	size_t data_size;
+	tap_state_t *path;
+	size_t path_size;
+	/* bytes of data in use, counted against SVF_PIPELINE_MAX_BYTES */
+	size_t bytes;
+};
+
+/*
+ * Compiled SVF files, written by "svf compile", hold the decoded commands so
+ * that running them skips the text parsing, which takes most of the time for
+ * big FPGA and CPLD images.  All fields are little endian.
+ *
+ * Header:
+ *   0  char[8]  magic, SVF_COMPILED_MAGIC
+ *   8  u32      version, SVF_COMPILED_VERSION
+ *  12  u32      reserved, zero
+ *
+ * Record:
+ *   0  u32      record length, including this header
+ *   4  u32      line number in the SVF file, for messages
+ *   8  u8       enum svf_command
+ *   9  u8       ENDDR/ENDIR: state; FREQUENCY: 1 if a frequency is given;
+ *               XXR: data_mask; RUNTEST: run_state; TRST: enum trst_mode
+ *  10  u8       RUNTEST: end_state
+ *  11  u8       reserved, zero
+ *  12  u32      FREQUENCY: float frequency; XXR: length in bits;
+ *               RUNTEST: run_count; STATE: number of states
+ *  16           XXR: DIV_ROUND_UP(length, 8) bytes for each field in
+ *               data_mask, in XXR_* order; RUNTEST: u32 min_usec;
+ *               STATE: one u8 per state
+ *
+ * States are stored as their index in svf_compiled_states[], 0xff meaning
+ * none was given.
+ */
+#define SVF_COMPILED_MAGIC			"OCDSVFC"
+#define SVF_COMPILED_VERSION		1
+#define SVF_COMPILED_HEADER_SIZE	16
+#define SVF_COMPILED_RECORD_SIZE	16
+#define SVF_COMPILED_NO_STATE		0xff
+
+static const tap_state_t svf_compiled_states[] = {
+	TAP_RESET, TAP_IDLE,
+	TAP_DRSELECT, TAP_DRCAPTURE, TAP_DRSHIFT, TAP_DREXIT1,
+	TAP_DRPAUSE, TAP_DREXIT2, TAP_DRUPDATE,
+	TAP_IRSELECT, TAP_IRCAPTURE, TAP_IRSHIFT, TAP_IREXIT1,
+	TAP_IRPAUSE, TAP_IREXIT2, TAP_IRUPDATE,
+};
+
+struct svf_compiled {
+	struct fileio *fileio;
+	/* the whole file if it could be mapped, else read record by record */
+	const uint8_t *map;
+	size_t size;
+	size_t pos;
+	uint8_t *record;
+	size_t record_size;
+};
+
 struct svf_check_tdo_para {
 	int line_num;		/* used to record line number of the check operation */
 	/* so more information could be printed */
@@ -213,8 +338,19 @@ static int svf_check_tdo_para_index;
 static int svf_read_command_from_file(FILE *fd);
 static int svf_check_tdo(void);
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
-static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
+static int svf_parse_command(char *cmd_str, struct svf_cmd *cmd);
+static int svf_execute_command(struct command_context *cmd_ctx, const struct svf_cmd *cmd);
 static int svf_execute_tap(void);
+static bool svf_is_compiled(FILE *fd);
+static int svf_compiled_open(struct svf_compiled *compiled, const char *filename);
+static int svf_compiled_next(struct svf_compiled *compiled, struct svf_cmd *cmd);
+static void svf_compiled_close(struct svf_compiled *compiled);
+static void svf_free_scratch(void);
+
+struct svf_pipeline;
+static struct svf_pipeline *svf_pipeline_start(void);
+static const struct svf_pipeline_slot *svf_pipeline_next(struct svf_pipeline *pipeline);
+static void svf_pipeline_stop(struct svf_pipeline *pipeline);
 
 static FILE *svf_fd;
 static char *svf_read_line;
@@ -224,6 +360,26 @@ static size_t svf_command_buffer_size;
 static int svf_line_number;
 static int svf_getline(char **lineptr, size_t *n, FILE *stream);
 
+/* decoded XXR fields and STATE paths of the command being parsed */
+static uint8_t *svf_xxr_data[XXR_NUM_FIELDS];
+static size_t svf_xxr_data_size[XXR_NUM_FIELDS];
+static tap_state_t *svf_path;
+static size_t svf_path_size;
+
+/* Set while the pipeline thread reads and parses the file.  It must not
+ * log, so the parser keeps quiet and a command that fails to parse is
+ * parsed again on the main thread to report why. */
+static bool svf_parse_silent;
+
+#define SVF_PARSE_LOG(level, expr ...) \
+	do { \
+		if (!svf_parse_silent) \
+			LOG_##level(expr); \
+	} while (0)
+
+/* line of the command being run, for the TDO check messages */
+static int svf_command_line;
+
 #define SVF_MAX_BUFFER_SIZE_TO_COMMIT   (1024 * 1024)
 static uint8_t *svf_tdi_buffer, *svf_tdo_buffer, *svf_mask_buffer;
 static int svf_buffer_index, svf_buffer_size ;
@@ -256,6 +412,10 @@ static void svf_hexbuf_print(int dbg_lvl, const char *file, unsigned line,
 	int byte_len = DIV_ROUND_UP(bit_len, 8);
 	int msbits = bit_len % 8;
 
+	/* e.g. "HDR 0 TDI (0)", nothing to print */
+	if (byte_len == 0)
+		return;
+
 	/* allocate 2 bytes per hex digit */
 	char *prbuf = malloc((byte_len * 2) + 2 + 1);
 	if (!prbuf)
@@ -358,11 +518,22 @@ int svf_add_statemove(tap_state_t state_to)
 COMMAND_HANDLER(handle_svf_command)
 {
 #define SVF_MIN_NUM_OF_OPTIONS 1
-#define SVF_MAX_NUM_OF_OPTIONS 5
+#define SVF_MAX_NUM_OF_OPTIONS 6
 	int command_num = 0;
 	int ret = ERROR_OK;
 	int64_t time_measure_ms;
 	int time_measure_s, time_measure_m;
+	const char *filename = NULL;
+	struct svf_compiled compiled;
+	bool is_compiled = false;
+	struct svf_cmd command;
+	bool use_pipeline = false;
+	struct svf_pipeline *pipeline = NULL;
+	const struct svf_pipeline_slot *slot = NULL;
+	const char *line = NULL;
+	int line_num;
+
+	memset(&compiled, 0, sizeof(compiled));
 
 	/* use NULL to indicate a "plain" svf file which accounts for
 	 * any additional devices in the scan chain, otherwise the device
@@ -397,6 +568,9 @@ COMMAND_HANDLER(handle_svf_command)
 		else if ((strcmp(CMD_ARGV[i],
 				  "ignore_error") == 0) || (strcmp(CMD_ARGV[i], "-ignore_error") == 0))
 			svf_ignore_error = 1;
+		else if ((strcmp(CMD_ARGV[i],
+				  "pipeline") == 0) || (strcmp(CMD_ARGV[i], "-pipeline") == 0))
+			use_pipeline = true;
 		else {
 			svf_fd = fopen(CMD_ARGV[i], "r");
 			if (svf_fd == NULL) {
@@ -406,12 +580,16 @@ COMMAND_HANDLER(handle_svf_command)
 				return ERROR_COMMAND_SYNTAX_ERROR;
 			} else
 				LOG_USER("svf processing file: \"%s\"", CMD_ARGV[i]);
+			filename = CMD_ARGV[i];
 		}
 	}
 
 	if (svf_fd == NULL)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	/* files from "svf compile" are recognized by their magic */
+	is_compiled = svf_is_compiled(svf_fd);
+
 	/* get time */
 	time_measure_ms = timeval_ms();
 
@@ -437,6 +615,11 @@ COMMAND_HANDLER(handle_svf_command)
 		goto free_all;
 	}
 
+	if (is_compiled && svf_compiled_open(&compiled, filename) != ERROR_OK) {
+		ret = ERROR_FAIL;
+		goto free_all;
+	}
+
 	memcpy(&svf_para, &svf_para_init, sizeof(svf_para));
 
 	if (!svf_nil) {
@@ -488,7 +671,7 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 	}
 
-	if (svf_progress_enabled) {
+	if (svf_progress_enabled && !is_compiled) {
 		/* Count total lines in file. */
 		while (!feof(svf_fd)) {
 			svf_getline(&svf_command_buffer, &svf_command_buffer_size, svf_fd);
@@ -496,32 +679,80 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 		rewind(svf_fd);
 	}
-	while (ERROR_OK == svf_read_command_from_file(svf_fd)) {
+
+	/* compiled files have nothing left to parse */
+	if (use_pipeline && !is_compiled)
+		pipeline = svf_pipeline_start();
+
+	while (true) {
+		if (is_compiled) {
+			if (compiled.pos == compiled.size)
+				break;
+			if (ERROR_OK != svf_compiled_next(&compiled, &command)) {
+				ret = ERROR_FAIL;
+				break;
+			}
+			line_num = command.line_num;
+			if (svf_progress_enabled)
+				svf_percentage = (int)(((uint64_t)compiled.pos * 20) / compiled.size) * 5;
+		} else if (pipeline) {
+			slot = svf_pipeline_next(pipeline);
+			if (!slot->valid)
+				break;
+			line_num = slot->line_num;
+			line = slot->line;
+			command = slot->cmd;
+			if (svf_progress_enabled)
+				svf_percentage = ((line_num * 20) / svf_total_lines) * 5;
+		} else {
+			if (ERROR_OK != svf_read_command_from_file(svf_fd))
+				break;
+			line_num = svf_line_number;
+			line = svf_read_line;
+			if (svf_progress_enabled)
+				svf_percentage = ((line_num * 20) / svf_total_lines) * 5;
+		}
+
 		/* Log Output */
 		if (svf_quiet) {
 			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
 				if (svf_last_printed_percentage != svf_percentage) {
 					LOG_USER_N("\r%d%%    ", svf_percentage);
 					svf_last_printed_percentage = svf_percentage;
 				}
 			}
 		} else {
-			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
-				LOG_USER_N("%3d%%  %s", svf_percentage, svf_read_line);
-			} else
-				LOG_USER_N("%s", svf_read_line);
+			/* there is no text to show for compiled files */
+			if (svf_progress_enabled)
+				LOG_USER_N("%3d%%  ", svf_percentage);
+			if (is_compiled)
+				LOG_USER_N("%s at line %d\n", svf_command_name[command.command], command.line_num);
+			else
+				LOG_USER_N("%s", line);
 		}
 		/* Run Command */
-		if (ERROR_OK != svf_run_command(CMD_CTX, svf_command_buffer)) {
-			LOG_ERROR("fail to run command at line %d", svf_line_number);
+		if (pipeline && !slot->parsed) {
+			/* the thread stopped at this command, parse it again to
+			 * log what is wrong with it */
+			svf_pipeline_stop(pipeline);
+			pipeline = NULL;
+			svf_parse_command(svf_command_buffer, &command);
 			ret = ERROR_FAIL;
+		} else if (!is_compiled && !pipeline) {
+			ret = svf_parse_command(svf_command_buffer, &command);
+		}
+		if (ret == ERROR_OK)
+			ret = svf_execute_command(CMD_CTX, &command);
+		if (ret != ERROR_OK) {
+			LOG_ERROR("fail to run command at line %d", line_num);
 			break;
 		}
 		command_num++;
 	}
 
+	if (pipeline)
+		svf_pipeline_stop(pipeline);
+
 	if ((!svf_nil) && (ERROR_OK != jtag_execute_queue()))
 		ret = ERROR_FAIL;
 	else if (ERROR_OK != svf_check_tdo())
@@ -544,6 +775,8 @@ free_all:
 
 	fclose(svf_fd);
 	svf_fd = 0;
+	svf_compiled_close(&compiled);
+	svf_free_scratch();
 
 	/* free buffers */
 	if (svf_command_buffer) {
@@ -593,7 +826,7 @@ free_all:
 
 static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 {
-#define MIN_CHUNK 16	/* Buffer is increased by this size each time as required */
+#define MIN_CHUNK 128	/* Initial buffer size, doubled as required */
 	size_t i = 0;
 
 	if (*lineptr == NULL) {
@@ -603,22 +836,59 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 	}
 
-	(*lineptr)[0] = fgetc(stream);
-	while ((*lineptr)[i] != '\n') {
-		(*lineptr)[++i] = fgetc(stream);
-		if (feof(stream)) {
-			(*lineptr)[0] = 0;
-			return -1;
-		}
-		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
-			*lineptr = realloc(*lineptr, *n);
+	while (fgets(*lineptr + i, *n - i, stream)) {
+		i += strlen(*lineptr + i);
+		if (i > 0 && (*lineptr)[i - 1] == '\n')
+			return i;
+
+		/* no end of line yet, make room for more */
+		if (i + 1 == *n) {
+			char *line = realloc(*lineptr, *n * 2);
+			if (!line)
+				break;
+			*lineptr = line;
+			*n *= 2;
 		}
 	}
 
-	(*lineptr)[++i] = 0;
+	/* a last line without '\n' is dropped */
+	(*lineptr)[0] = 0;
+	return -1;
+}
+
+/* Make sure the command buffer has room for @a size characters. */
+static int svf_reserve_command_buffer(size_t size)
+{
+	if (size <= svf_command_buffer_size)
+		return ERROR_OK;
+
+	size_t new_size = MAX(size, 2 * svf_command_buffer_size);
+	char *buffer = realloc(svf_command_buffer, new_size);
+	if (buffer == NULL) {
+		SVF_PARSE_LOG(ERROR, "not enough memory");
+		return ERROR_FAIL;
+	}
+
+	svf_command_buffer = buffer;
+	svf_command_buffer_size = new_size;
+
+	return ERROR_OK;
+}
+
+/* Read the next line of the SVF file and make sure the command buffer
+ * can take all of it, see svf_read_command_from_file(). */
+static int svf_read_line_from_file(size_t cmd_pos)
+{
+	int line_len = svf_getline(&svf_read_line, &svf_read_line_size, svf_fd);
+	if (line_len <= 0)
+		return ERROR_FAIL;
+	svf_line_number++;
 
-	return sizeof(*lineptr);
+	/* Every character of the line takes at most two bytes of the command
+	 * buffer.  Two more are for the '\n' of the previous line, which is
+	 * only stored after this one was read, and the terminating NUL.
+	 */
+	return svf_reserve_command_buffer(cmd_pos + 2 * line_len + 2);
 }
 
 #define SVFP_CMD_INC_CNT 1024
@@ -629,26 +899,22 @@ static int svf_read_command_from_file(FILE *fd)
 	size_t cmd_pos = 0;
 	int cmd_ok = 0, slash = 0;
 
-	if (svf_getline(&svf_read_line, &svf_read_line_size, svf_fd) <= 0)
+	if (svf_read_line_from_file(cmd_pos) != ERROR_OK)
 		return ERROR_FAIL;
-	svf_line_number++;
 	ch = svf_read_line[0];
 	while (!cmd_ok && (ch != 0)) {
 		switch (ch) {
 			case '!':
 				slash = 0;
-				if (svf_getline(&svf_read_line, &svf_read_line_size, svf_fd) <= 0)
+				if (svf_read_line_from_file(cmd_pos) != ERROR_OK)
 					return ERROR_FAIL;
-				svf_line_number++;
 				i = -1;
 				break;
 			case '/':
 				if (++slash == 2) {
 					slash = 0;
-					if (svf_getline(&svf_read_line, &svf_read_line_size,
-						svf_fd) <= 0)
+					if (svf_read_line_from_file(cmd_pos) != ERROR_OK)
 						return ERROR_FAIL;
-					svf_line_number++;
 					i = -1;
 				}
 				break;
@@ -657,8 +923,7 @@ static int svf_read_command_from_file(FILE *fd)
 				cmd_ok = 1;
 				break;
 			case '\n':
-				svf_line_number++;
-				if (svf_getline(&svf_read_line, &svf_read_line_size, svf_fd) <= 0)
+				if (svf_read_line_from_file(cmd_pos) != ERROR_OK)
 					return ERROR_FAIL;
 				i = -1;
 			case '\r':
@@ -672,27 +937,18 @@ static int svf_read_command_from_file(FILE *fd)
 				 * space afterwards -- "TDI (123) TDO(456)".
 				 * But such spaces are optional... instead of
 				 * parser updates, cope with that by adding the
-				 * spaces as needed.
-				 *
-				 * Ensure there are 3 bytes available, for:
-				 *  - current character
-				 *  - added space.
-				 *  - terminating NUL ('\0')
+				 * spaces as needed.  svf_read_line_from_file()
+				 * made room for them.
 				 */
-				if (cmd_pos + 3 > svf_command_buffer_size) {
-					svf_command_buffer = realloc(svf_command_buffer, cmd_pos + 3);
-					svf_command_buffer_size = cmd_pos + 3;
-					if (svf_command_buffer == NULL) {
-						LOG_ERROR("not enough memory");
-						return ERROR_FAIL;
-					}
-				}
 
 				/* insert a space before '(' */
 				if ('(' == ch)
 					svf_command_buffer[cmd_pos++] = ' ';
 
-				svf_command_buffer[cmd_pos++] = (char)toupper(ch);
+				/* plain ASCII, unlike toupper() no locale lookup */
+				if (ch >= 'a' && ch <= 'z')
+					ch -= 'a' - 'A';
+				svf_command_buffer[cmd_pos++] = ch;
 
 				/* insert a space after ')' */
 				if (')' == ch)
@@ -717,7 +973,7 @@ static int svf_parse_cmd_string(char *str, int len, char **argus, int *num_of_ar
 		switch (str[pos]) {
 			case '!':
 			case '/':
-				LOG_ERROR("fail to parse svf command");
+				SVF_PARSE_LOG(ERROR, "fail to parse svf command");
 				return ERROR_FAIL;
 			case '(':
 				in_bracket = 1;
@@ -793,21 +1049,77 @@ static int svf_set_padding(struct svf_xxr_para *para, int len, unsigned char tdi
 	return error;
 }
 
-static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_len, int bit_len)
+/* Make sure a scratch buffer has room for @a size bytes. */
+static int svf_reserve(void **buf, size_t *buf_size, size_t size)
+{
+	if (size <= *buf_size)
+		return ERROR_OK;
+
+	size_t new_size = MAX(size, 2 * *buf_size);
+	void *new_buf = realloc(*buf, new_size);
+	if (new_buf == NULL) {
+		SVF_PARSE_LOG(ERROR, "not enough memory");
+		return ERROR_FAIL;
+	}
+
+	*buf = new_buf;
+	*buf_size = new_size;
+
+	return ERROR_OK;
+}
+
+#define SVF_HEX_SPACE		0x10
+#define SVF_HEX_INVALID		0x20
+
+/* value of each hex digit, SVF_HEX_SPACE for white space */
+static uint8_t svf_hex_value[256];
+
+static void svf_hex_init(void)
+{
+	if (svf_hex_value[0])
+		return;
+
+	for (int i = 0; i < 256; i++) {
+		if (i >= '0' && i <= '9')
+			svf_hex_value[i] = i - '0';
+		else if (i >= 'A' && i <= 'F')
+			svf_hex_value[i] = i - 'A' + 10;
+		else if (isspace(i))
+			svf_hex_value[i] = SVF_HEX_SPACE;
+		else
+			svf_hex_value[i] = SVF_HEX_INVALID;
+	}
+}
+
+static int svf_copy_hexstring_to_binary(const char *str, uint8_t **bin, size_t *bin_size, int bit_len)
 {
-	int i, str_len = strlen(str), str_hbyte_len = (bit_len + 3) >> 2;
-	uint8_t ch = 0;
+	const unsigned char *start = (const unsigned char *)str;
+	const unsigned char *p = start + strlen(str);
+	int i, str_hbyte_len = (bit_len + 3) >> 2;
 
-	if (ERROR_OK != svf_adjust_array_length(bin, orig_bit_len, bit_len)) {
-		LOG_ERROR("fail to adjust length of array");
+	if (svf_reserve((void **)bin, bin_size, (bit_len + 7) >> 3) != ERROR_OK) {
+		SVF_PARSE_LOG(ERROR, "fail to adjust length of array");
 		return ERROR_FAIL;
 	}
 
 	/* fill from LSB (end of str) to MSB (beginning of str) */
 	for (i = 0; i < str_hbyte_len; i++) {
-		ch = 0;
-		while (str_len > 0) {
-			ch = str[--str_len];
+		uint8_t ch = 0;
+
+		/* the common case: a whole byte without white space in it */
+		if (i % 2 == 0 && i + 1 < str_hbyte_len && p - start >= 2) {
+			uint8_t lo = svf_hex_value[p[-1]];
+			uint8_t hi = svf_hex_value[p[-2]];
+			if ((lo | hi) < 16) {
+				(*bin)[i / 2] = lo | hi << 4;
+				p -= 2;
+				i++;
+				continue;
+			}
+		}
+
+		while (p > start) {
+			ch = svf_hex_value[*--p];
 
 			/* Skip whitespace.  The SVF specification (rev E) is
 			 * deficient in terms of basic lexical issues like
@@ -815,17 +1127,11 @@ static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_l
 			 * require line ends for correctness, since there is
 			 * a hard limit on line length.
 			 */
-			if (!isspace(ch)) {
-				if ((ch >= '0') && (ch <= '9')) {
-					ch = ch - '0';
-					break;
-				} else if ((ch >= 'A') && (ch <= 'F')) {
-					ch = ch - 'A' + 10;
-					break;
-				} else {
-					LOG_ERROR("invalid hex string");
-					return ERROR_FAIL;
-				}
+			if (ch < 16)
+				break;
+			if (ch == SVF_HEX_INVALID) {
+				SVF_PARSE_LOG(ERROR, "invalid hex string");
+				return ERROR_FAIL;
 			}
 
 			ch = 0;
@@ -837,19 +1143,19 @@ static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_l
 			(*bin)[i / 2] |= ch << 4;
 		} else {
 			/* LSB */
-			(*bin)[i / 2] = 0;
-			(*bin)[i / 2] |= ch;
+			(*bin)[i / 2] = ch;
 		}
 	}
 
 	/* consume optional leading '0' MSBs or whitespace */
-	while (str_len > 0 && ((str[str_len - 1] == '0')
-			|| isspace((int) str[str_len - 1])))
-		str_len--;
-
-	/* check validity: we must have consumed everything */
-	if (str_len > 0 || (ch & ~((2 << ((bit_len - 1) % 4)) - 1)) != 0) {
-		LOG_ERROR("value execeeds length");
+	while (p > start && (p[-1] == '0' || svf_hex_value[p[-1]] == SVF_HEX_SPACE))
+		p--;
+
+	/* check validity: we must have consumed everything, and the most
+	 * significant digit must not have bits set beyond bit_len */
+	if (p > start || (bit_len > 0 &&
+			((*bin)[(bit_len - 1) / 8] >> ((bit_len - 1) % 8)) > 1)) {
+		SVF_PARSE_LOG(ERROR, "value execeeds length");
 		return ERROR_FAIL;
 	}
 
@@ -890,7 +1196,7 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 		return ERROR_FAIL;
 	}
 
-	svf_check_tdo_para[svf_check_tdo_para_index].line_num = svf_line_number;
+	svf_check_tdo_para[svf_check_tdo_para_index].line_num = svf_command_line;
 	svf_check_tdo_para[svf_check_tdo_para_index].bit_len = bit_len;
 	svf_check_tdo_para[svf_check_tdo_para_index].enabled = enabled;
 	svf_check_tdo_para[svf_check_tdo_para_index].buffer_offset = buffer_offset;
@@ -911,25 +1217,16 @@ static int svf_execute_tap(void)
 	return ERROR_OK;
 }
 
-static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
+static int svf_parse_command(char *cmd_str, struct svf_cmd *cmd)
 {
-	char *argus[256], command;
+	char *argus[256];
 	int num_of_argu = 0, i;
 
 	/* tmp variable */
 	int i_tmp;
 
 	/* for RUNTEST */
-	int run_count;
 	float min_time;
-	/* for XXR */
-	struct svf_xxr_para *xxr_para_tmp;
-	uint8_t **pbuffer_tmp;
-	struct scan_field field;
-	/* for STATE */
-	tap_state_t *path = NULL, state;
-	/* flag padding commands skipped due to -tap command */
-	int padding_command_skipped = 0;
 
 	if (ERROR_OK != svf_parse_cmd_string(cmd_str, strlen(cmd_str), argus, &num_of_argu))
 		return ERROR_FAIL;
@@ -938,195 +1235,397 @@ static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 	 * TAP state names (instead of insisting on uppercase).
 	 */
 
-	command = svf_find_string_in_array(argus[0],
+	cmd->line_num = svf_line_number;
+	cmd->command = svf_find_string_in_array(argus[0],
 			(char **)svf_command_name, ARRAY_SIZE(svf_command_name));
-	switch (command) {
+	switch (cmd->command) {
 		case ENDDR:
 		case ENDIR:
 			if (num_of_argu != 2) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
 				return ERROR_FAIL;
 			}
 
 			i_tmp = tap_state_by_name(argus[1]);
 
-			if (svf_tap_state_is_stable(i_tmp)) {
-				if (command == ENDIR) {
-					svf_para.ir_end_state = i_tmp;
-					LOG_DEBUG("\tIR end_state = %s",
-							tap_state_name(i_tmp));
-				} else {
-					svf_para.dr_end_state = i_tmp;
-					LOG_DEBUG("\tDR end_state = %s",
-							tap_state_name(i_tmp));
-				}
-			} else {
-				LOG_ERROR("%s: %s is not a stable state",
+			if (!svf_tap_state_is_stable(i_tmp)) {
+				SVF_PARSE_LOG(ERROR, "%s: %s is not a stable state",
 						argus[0], argus[1]);
 				return ERROR_FAIL;
 			}
+			cmd->state = i_tmp;
 			break;
 		case FREQUENCY:
 			if ((num_of_argu != 1) && (num_of_argu != 3)) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
 				return ERROR_FAIL;
 			}
-			if (1 == num_of_argu) {
-				/* TODO: set jtag speed to full speed */
-				svf_para.frequency = 0;
-			} else {
+			cmd->has_frequency = num_of_argu == 3;
+			cmd->frequency = 0;
+			if (cmd->has_frequency) {
 				if (strcmp(argus[2], "HZ")) {
-					LOG_ERROR("HZ not found in FREQUENCY command");
-					return ERROR_FAIL;
-				}
-				if (ERROR_OK != svf_execute_tap())
+					SVF_PARSE_LOG(ERROR, "HZ not found in FREQUENCY command");
 					return ERROR_FAIL;
-				svf_para.frequency = atof(argus[1]);
-				/* TODO: set jtag speed to */
-				if (svf_para.frequency > 0) {
-					command_run_linef(cmd_ctx,
-							"adapter_khz %d",
-							(int)svf_para.frequency / 1000);
-					LOG_DEBUG("\tfrequency = %f", svf_para.frequency);
 				}
+				cmd->frequency = atof(argus[1]);
 			}
 			break;
 		case HDR:
-			if (svf_tap_is_specified) {
-				padding_command_skipped = 1;
-				break;
-			}
-			xxr_para_tmp = &svf_para.hdr_para;
-			goto XXR_common;
 		case HIR:
-			if (svf_tap_is_specified) {
-				padding_command_skipped = 1;
-				break;
-			}
-			xxr_para_tmp = &svf_para.hir_para;
-			goto XXR_common;
 		case TDR:
-			if (svf_tap_is_specified) {
-				padding_command_skipped = 1;
-				break;
-			}
-			xxr_para_tmp = &svf_para.tdr_para;
-			goto XXR_common;
 		case TIR:
-			if (svf_tap_is_specified) {
-				padding_command_skipped = 1;
-				break;
-			}
-			xxr_para_tmp = &svf_para.tir_para;
-			goto XXR_common;
 		case SDR:
-			xxr_para_tmp = &svf_para.sdr_para;
-			goto XXR_common;
 		case SIR:
-			xxr_para_tmp = &svf_para.sir_para;
-			goto XXR_common;
-XXR_common:
 			/* XXR length [TDI (tdi)] [TDO (tdo)][MASK (mask)] [SMASK (smask)] */
 			if ((num_of_argu > 10) || (num_of_argu % 2)) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
 				return ERROR_FAIL;
 			}
-			i_tmp = xxr_para_tmp->len;
-			xxr_para_tmp->len = atoi(argus[1]);
-			/* If we are to enlarge the buffers, all parts of xxr_para_tmp
-			 * need to be freed */
-			if (i_tmp < xxr_para_tmp->len) {
-				free(xxr_para_tmp->tdi);
-				xxr_para_tmp->tdi = NULL;
-				free(xxr_para_tmp->tdo);
-				xxr_para_tmp->tdo = NULL;
-				free(xxr_para_tmp->mask);
-				xxr_para_tmp->mask = NULL;
-				free(xxr_para_tmp->smask);
-				xxr_para_tmp->smask = NULL;
-			}
-
-			LOG_DEBUG("\tlength = %d", xxr_para_tmp->len);
-			xxr_para_tmp->data_mask = 0;
+			cmd->len = atoi(argus[1]);
+			cmd->data_mask = 0;
 			for (i = 2; i < num_of_argu; i += 2) {
 				if ((strlen(argus[i + 1]) < 3) || (argus[i + 1][0] != '(') ||
 				(argus[i + 1][strlen(argus[i + 1]) - 1] != ')')) {
-					LOG_ERROR("data section error");
+					SVF_PARSE_LOG(ERROR, "data section error");
 					return ERROR_FAIL;
 				}
 				argus[i + 1][strlen(argus[i + 1]) - 1] = '\0';
 				/* TDI, TDO, MASK, SMASK */
-				if (!strcmp(argus[i], "TDI")) {
-					/* TDI */
-					pbuffer_tmp = &xxr_para_tmp->tdi;
-					xxr_para_tmp->data_mask |= XXR_TDI;
-				} else if (!strcmp(argus[i], "TDO")) {
-					/* TDO */
-					pbuffer_tmp = &xxr_para_tmp->tdo;
-					xxr_para_tmp->data_mask |= XXR_TDO;
-				} else if (!strcmp(argus[i], "MASK")) {
-					/* MASK */
-					pbuffer_tmp = &xxr_para_tmp->mask;
-					xxr_para_tmp->data_mask |= XXR_MASK;
-				} else if (!strcmp(argus[i], "SMASK")) {
-					/* SMASK */
-					pbuffer_tmp = &xxr_para_tmp->smask;
-					xxr_para_tmp->data_mask |= XXR_SMASK;
-				} else {
-					LOG_ERROR("unknow parameter: %s", argus[i]);
+				for (i_tmp = 0; i_tmp < XXR_NUM_FIELDS; i_tmp++) {
+					if (!strcmp(argus[i], svf_xxr_field_name[i_tmp]))
+						break;
+				}
+				if (i_tmp == XXR_NUM_FIELDS) {
+					SVF_PARSE_LOG(ERROR, "unknow parameter: %s", argus[i]);
 					return ERROR_FAIL;
 				}
-				if (ERROR_OK !=
-				svf_copy_hexstring_to_binary(&argus[i + 1][1], pbuffer_tmp, i_tmp,
-					xxr_para_tmp->len)) {
-					LOG_ERROR("fail to parse hex value");
+				if (ERROR_OK != svf_copy_hexstring_to_binary(&argus[i + 1][1],
+						&svf_xxr_data[i_tmp], &svf_xxr_data_size[i_tmp], cmd->len)) {
+					SVF_PARSE_LOG(ERROR, "fail to parse hex value");
 					return ERROR_FAIL;
 				}
-				SVF_BUF_LOG(DEBUG, *pbuffer_tmp, xxr_para_tmp->len, argus[i]);
+				cmd->data[i_tmp] = svf_xxr_data[i_tmp];
+				cmd->data_mask |= 1 << i_tmp;
 			}
-			/* If a command changes the length of the last scan of the same type and the
-			 * MASK parameter is absent, */
-			/* the mask pattern used is all cares */
-			if (!(xxr_para_tmp->data_mask & XXR_MASK) && (i_tmp != xxr_para_tmp->len)) {
-				/* MASK not defined and length changed */
-				if (ERROR_OK !=
-				svf_adjust_array_length(&xxr_para_tmp->mask, i_tmp,
-					xxr_para_tmp->len)) {
-					LOG_ERROR("fail to adjust length of array");
+			break;
+		case PIO:
+		case PIOMAP:
+			SVF_PARSE_LOG(ERROR, "PIO and PIOMAP are not supported");
+			return ERROR_FAIL;
+			break;
+		case RUNTEST:
+			/* RUNTEST [run_state] run_count run_clk [min_time SEC [MAXIMUM max_time
+			 * SEC]] [ENDSTATE end_state] */
+			/* RUNTEST [run_state] min_time SEC [MAXIMUM max_time SEC] [ENDSTATE
+			 * end_state] */
+			if ((num_of_argu < 3) && (num_of_argu > 11)) {
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
+				return ERROR_FAIL;
+			}
+			/* init */
+			cmd->run_state = TAP_INVALID;
+			cmd->end_state = TAP_INVALID;
+			cmd->run_count = 0;
+			min_time = 0;
+			i = 1;
+
+			/* run_state */
+			i_tmp = tap_state_by_name(argus[i]);
+			if (i_tmp != TAP_INVALID) {
+				if (svf_tap_state_is_stable(i_tmp)) {
+					cmd->run_state = i_tmp;
+					SVF_PARSE_LOG(DEBUG, "\trun_state = %s", tap_state_name(i_tmp));
+					i++;
+				} else {
+					SVF_PARSE_LOG(ERROR, "%s: %s is not a stable state", argus[0], tap_state_name(i_tmp));
 					return ERROR_FAIL;
 				}
-				buf_set_ones(xxr_para_tmp->mask, xxr_para_tmp->len);
 			}
-			/* If TDO is absent, no comparison is needed, set the mask to 0 */
-			if (!(xxr_para_tmp->data_mask & XXR_TDO)) {
-				if (NULL == xxr_para_tmp->tdo) {
-					if (ERROR_OK !=
-					svf_adjust_array_length(&xxr_para_tmp->tdo, i_tmp,
-						xxr_para_tmp->len)) {
-						LOG_ERROR("fail to adjust length of array");
-						return ERROR_FAIL;
-					}
-				}
-				if (NULL == xxr_para_tmp->mask) {
-					if (ERROR_OK !=
-					svf_adjust_array_length(&xxr_para_tmp->mask, i_tmp,
-						xxr_para_tmp->len)) {
-						LOG_ERROR("fail to adjust length of array");
-						return ERROR_FAIL;
-					}
+
+			/* run_count run_clk */
+			if (((i + 2) <= num_of_argu) && strcmp(argus[i + 1], "SEC")) {
+				if (!strcmp(argus[i + 1], "TCK")) {
+					/* clock source is TCK */
+					cmd->run_count = atoi(argus[i]);
+					SVF_PARSE_LOG(DEBUG, "\trun_count@TCK = %d", cmd->run_count);
+				} else {
+					SVF_PARSE_LOG(ERROR, "%s not supported for clock", argus[i + 1]);
+					return ERROR_FAIL;
 				}
-				memset(xxr_para_tmp->mask, 0, (xxr_para_tmp->len + 7) >> 3);
+				i += 2;
 			}
-			/* do scan if necessary */
-			if (SDR == command) {
-				/* check buffer size first, reallocate if necessary */
-				i = svf_para.hdr_para.len + svf_para.sdr_para.len +
-						svf_para.tdr_para.len;
-				if ((svf_buffer_size - svf_buffer_index) < ((i + 7) >> 3)) {
-					/* reallocate buffer */
-					if (svf_realloc_buffers(svf_buffer_index + ((i + 7) >> 3)) != ERROR_OK) {
-						LOG_ERROR("not enough memory");
-						return ERROR_FAIL;
+			/* min_time SEC */
+			if (((i + 2) <= num_of_argu) && !strcmp(argus[i + 1], "SEC")) {
+				min_time = atof(argus[i]);
+				SVF_PARSE_LOG(DEBUG, "\tmin_time = %fs", min_time);
+				i += 2;
+			}
+			/* MAXIMUM max_time SEC */
+			if (((i + 3) <= num_of_argu) &&
+			!strcmp(argus[i], "MAXIMUM") && !strcmp(argus[i + 2], "SEC")) {
+				float max_time = 0;
+				max_time = atof(argus[i + 1]);
+				SVF_PARSE_LOG(DEBUG, "\tmax_time = %fs", max_time);
+				i += 3;
+			}
+			/* ENDSTATE end_state */
+			if (((i + 2) <= num_of_argu) && !strcmp(argus[i], "ENDSTATE")) {
+				i_tmp = tap_state_by_name(argus[i + 1]);
+
+				if (svf_tap_state_is_stable(i_tmp)) {
+					cmd->end_state = i_tmp;
+					SVF_PARSE_LOG(DEBUG, "\tend_state = %s", tap_state_name(i_tmp));
+				} else {
+					SVF_PARSE_LOG(ERROR, "%s: %s is not a stable state", argus[0], tap_state_name(i_tmp));
+					return ERROR_FAIL;
+				}
+				i += 2;
+			}
+
+			/* all parameter should be parsed */
+			if (i != num_of_argu) {
+				SVF_PARSE_LOG(ERROR, "fail to parse parameter of RUNTEST, %d out of %d is parsed",
+						i,
+						num_of_argu);
+				return ERROR_FAIL;
+			}
+			cmd->min_usec = 1000000 * min_time;
+			break;
+		case STATE:
+			/* STATE [pathstate1 [pathstate2 ...[pathstaten]]] stable_state */
+			if (num_of_argu < 2) {
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
+				return ERROR_FAIL;
+			}
+			cmd->num_states = num_of_argu - 1;
+			if (svf_reserve((void **)&svf_path, &svf_path_size,
+					cmd->num_states * sizeof(*svf_path)) != ERROR_OK)
+				return ERROR_FAIL;
+			cmd->path = svf_path;
+
+			if (cmd->num_states == 1) {
+				/* STATE stable_state */
+				svf_path[0] = tap_state_by_name(argus[1]);
+				if (!svf_tap_state_is_stable(svf_path[0])) {
+					SVF_PARSE_LOG(ERROR, "%s: %s is not a stable state",
+							argus[0], tap_state_name(svf_path[0]));
+					return ERROR_FAIL;
+				}
+				break;
+			}
+
+			/* STATE pathstate1 ... stable_state; the path may pass
+			 * TAP_RESET, after which a new one starts */
+			i_tmp = 0;
+			for (i = 0; i < cmd->num_states; i++) {
+				svf_path[i] = tap_state_by_name(argus[i + 1]);
+				if (svf_path[i] == TAP_INVALID) {
+					SVF_PARSE_LOG(ERROR, "%s: %s is not a valid state", argus[0], argus[i + 1]);
+					return ERROR_FAIL;
+				}
+				if (svf_path[i] == TAP_RESET)
+					i_tmp = i + 1;
+			}
+			/* last state MUST be stable state */
+			if (i_tmp < cmd->num_states &&
+					!svf_tap_state_is_stable(svf_path[cmd->num_states - 1])) {
+				SVF_PARSE_LOG(ERROR, "%s: %s is not a stable state",
+						argus[0],
+						tap_state_name(svf_path[cmd->num_states - 1]));
+				return ERROR_FAIL;
+			}
+			break;
+		case TRST:
+			/* TRST trst_mode */
+			if (num_of_argu != 2) {
+				SVF_PARSE_LOG(ERROR, "invalid parameter of %s", argus[0]);
+				return ERROR_FAIL;
+			}
+			i_tmp = svf_find_string_in_array(argus[1],
+					(char **)svf_trst_mode_name,
+					ARRAY_SIZE(svf_trst_mode_name));
+			if (i_tmp > TRST_ABSENT) {
+				SVF_PARSE_LOG(ERROR, "unknown TRST mode: %s", argus[1]);
+				return ERROR_FAIL;
+			}
+			cmd->trst_mode = i_tmp;
+			break;
+		default:
+			SVF_PARSE_LOG(ERROR, "invalid svf command: %s", argus[0]);
+			return ERROR_FAIL;
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+static uint8_t **svf_xxr_buffer(struct svf_xxr_para *para, int field)
+{
+	switch (1 << field) {
+		case XXR_TDI:
+			return &para->tdi;
+		case XXR_TDO:
+			return &para->tdo;
+		case XXR_MASK:
+			return &para->mask;
+		default:
+			return &para->smask;
+	}
+}
+
+static int svf_execute_command(struct command_context *cmd_ctx, const struct svf_cmd *cmd)
+{
+	enum svf_command command = cmd->command;
+	int i;
+
+	/* tmp variable */
+	int i_tmp;
+
+	/* for XXR */
+	struct svf_xxr_para *xxr_para_tmp;
+	uint8_t **pbuffer_tmp;
+	struct scan_field field;
+	/* flag padding commands skipped due to -tap command */
+	int padding_command_skipped = 0;
+
+	svf_command_line = cmd->line_num;
+
+	switch (command) {
+		case ENDDR:
+		case ENDIR:
+			if (command == ENDIR) {
+				svf_para.ir_end_state = cmd->state;
+				LOG_DEBUG("\tIR end_state = %s",
+						tap_state_name(cmd->state));
+			} else {
+				svf_para.dr_end_state = cmd->state;
+				LOG_DEBUG("\tDR end_state = %s",
+						tap_state_name(cmd->state));
+			}
+			break;
+		case FREQUENCY:
+			if (!cmd->has_frequency) {
+				/* TODO: set jtag speed to full speed */
+				svf_para.frequency = 0;
+			} else {
+				if (ERROR_OK != svf_execute_tap())
+					return ERROR_FAIL;
+				svf_para.frequency = cmd->frequency;
+				/* TODO: set jtag speed to */
+				if (svf_para.frequency > 0) {
+					command_run_linef(cmd_ctx,
+							"adapter_khz %d",
+							(int)svf_para.frequency / 1000);
+					LOG_DEBUG("\tfrequency = %f", svf_para.frequency);
+				}
+			}
+			break;
+		case HDR:
+			if (svf_tap_is_specified) {
+				padding_command_skipped = 1;
+				break;
+			}
+			xxr_para_tmp = &svf_para.hdr_para;
+			goto XXR_common;
+		case HIR:
+			if (svf_tap_is_specified) {
+				padding_command_skipped = 1;
+				break;
+			}
+			xxr_para_tmp = &svf_para.hir_para;
+			goto XXR_common;
+		case TDR:
+			if (svf_tap_is_specified) {
+				padding_command_skipped = 1;
+				break;
+			}
+			xxr_para_tmp = &svf_para.tdr_para;
+			goto XXR_common;
+		case TIR:
+			if (svf_tap_is_specified) {
+				padding_command_skipped = 1;
+				break;
+			}
+			xxr_para_tmp = &svf_para.tir_para;
+			goto XXR_common;
+		case SDR:
+			xxr_para_tmp = &svf_para.sdr_para;
+			goto XXR_common;
+		case SIR:
+			xxr_para_tmp = &svf_para.sir_para;
+			goto XXR_common;
+XXR_common:
+			i_tmp = xxr_para_tmp->len;
+			xxr_para_tmp->len = cmd->len;
+			/* If we are to enlarge the buffers, all parts of xxr_para_tmp
+			 * need to be freed */
+			if (i_tmp < xxr_para_tmp->len) {
+				free(xxr_para_tmp->tdi);
+				xxr_para_tmp->tdi = NULL;
+				free(xxr_para_tmp->tdo);
+				xxr_para_tmp->tdo = NULL;
+				free(xxr_para_tmp->mask);
+				xxr_para_tmp->mask = NULL;
+				free(xxr_para_tmp->smask);
+				xxr_para_tmp->smask = NULL;
+			}
+
+			LOG_DEBUG("\tlength = %d", xxr_para_tmp->len);
+			xxr_para_tmp->data_mask = cmd->data_mask;
+			for (i = 0; i < XXR_NUM_FIELDS; i++) {
+				if (!(cmd->data_mask & (1 << i)))
+					continue;
+				pbuffer_tmp = svf_xxr_buffer(xxr_para_tmp, i);
+				if (ERROR_OK != svf_adjust_array_length(pbuffer_tmp, i_tmp, xxr_para_tmp->len)) {
+					LOG_ERROR("fail to adjust length of array");
+					return ERROR_FAIL;
+				}
+				memcpy(*pbuffer_tmp, cmd->data[i], (xxr_para_tmp->len + 7) >> 3);
+				SVF_BUF_LOG(DEBUG, *pbuffer_tmp, xxr_para_tmp->len, svf_xxr_field_name[i]);
+			}
+			/* If a command changes the length of the last scan of the same type and the
+			 * MASK parameter is absent, */
+			/* the mask pattern used is all cares */
+			if (!(xxr_para_tmp->data_mask & XXR_MASK) && (i_tmp != xxr_para_tmp->len)) {
+				/* MASK not defined and length changed */
+				if (ERROR_OK !=
+				svf_adjust_array_length(&xxr_para_tmp->mask, i_tmp,
+					xxr_para_tmp->len)) {
+					LOG_ERROR("fail to adjust length of array");
+					return ERROR_FAIL;
+				}
+				buf_set_ones(xxr_para_tmp->mask, xxr_para_tmp->len);
+			}
+			/* If TDO is absent, no comparison is needed, set the mask to 0 */
+			if (!(xxr_para_tmp->data_mask & XXR_TDO)) {
+				if (NULL == xxr_para_tmp->tdo) {
+					if (ERROR_OK !=
+					svf_adjust_array_length(&xxr_para_tmp->tdo, i_tmp,
+						xxr_para_tmp->len)) {
+						LOG_ERROR("fail to adjust length of array");
+						return ERROR_FAIL;
+					}
+				}
+				if (NULL == xxr_para_tmp->mask) {
+					if (ERROR_OK !=
+					svf_adjust_array_length(&xxr_para_tmp->mask, i_tmp,
+						xxr_para_tmp->len)) {
+						LOG_ERROR("fail to adjust length of array");
+						return ERROR_FAIL;
+					}
+				}
+				memset(xxr_para_tmp->mask, 0, (xxr_para_tmp->len + 7) >> 3);
+			}
+			/* do scan if necessary */
+			if (SDR == command) {
+				/* check buffer size first, reallocate if necessary */
+				i = svf_para.hdr_para.len + svf_para.sdr_para.len +
+						svf_para.tdr_para.len;
+				if ((svf_buffer_size - svf_buffer_index) < ((i + 7) >> 3)) {
+					/* reallocate buffer */
+					if (svf_realloc_buffers(svf_buffer_index + ((i + 7) >> 3)) != ERROR_OK) {
+						LOG_ERROR("not enough memory");
+						return ERROR_FAIL;
 					}
 				}
 
@@ -1301,207 +1800,90 @@ XXR_common:
 				svf_buffer_index += (i + 7) >> 3;
 			}
 			break;
-		case PIO:
-		case PIOMAP:
-			LOG_ERROR("PIO and PIOMAP are not supported");
-			return ERROR_FAIL;
-			break;
 		case RUNTEST:
-			/* RUNTEST [run_state] run_count run_clk [min_time SEC [MAXIMUM max_time
-			 * SEC]] [ENDSTATE end_state] */
-			/* RUNTEST [run_state] min_time SEC [MAXIMUM max_time SEC] [ENDSTATE
-			 * end_state] */
-			if ((num_of_argu < 3) && (num_of_argu > 11)) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
-				return ERROR_FAIL;
+			if (cmd->run_state != TAP_INVALID) {
+				svf_para.runtest_run_state = cmd->run_state;
+
+				/* When a run_state is specified, the new
+				 * run_state becomes the default end_state.
+				 */
+				svf_para.runtest_end_state = cmd->run_state;
 			}
-			/* init */
-			run_count = 0;
-			min_time = 0;
-			i = 1;
+			if (cmd->end_state != TAP_INVALID)
+				svf_para.runtest_end_state = cmd->end_state;
+			{
+#if 1
+				/* FIXME handle statemove failures */
+				uint32_t min_usec = cmd->min_usec;
 
-			/* run_state */
-			i_tmp = tap_state_by_name(argus[i]);
-			if (i_tmp != TAP_INVALID) {
-				if (svf_tap_state_is_stable(i_tmp)) {
-					svf_para.runtest_run_state = i_tmp;
+				/* enter into run_state if necessary */
+				if (cmd_queue_cur_state != svf_para.runtest_run_state)
+					svf_add_statemove(svf_para.runtest_run_state);
 
-					/* When a run_state is specified, the new
-					 * run_state becomes the default end_state.
-					 */
-					svf_para.runtest_end_state = i_tmp;
-					LOG_DEBUG("\trun_state = %s", tap_state_name(i_tmp));
-					i++;
-				} else {
-					LOG_ERROR("%s: %s is not a stable state", argus[0], tap_state_name(i_tmp));
-					return ERROR_FAIL;
+				/* add clocks and/or min wait */
+				if (cmd->run_count > 0) {
+					if (!svf_nil)
+						jtag_add_clocks(cmd->run_count);
 				}
-			}
 
-			/* run_count run_clk */
-			if (((i + 2) <= num_of_argu) && strcmp(argus[i + 1], "SEC")) {
-				if (!strcmp(argus[i + 1], "TCK")) {
-					/* clock source is TCK */
-					run_count = atoi(argus[i]);
-					LOG_DEBUG("\trun_count@TCK = %d", run_count);
-				} else {
-					LOG_ERROR("%s not supported for clock", argus[i + 1]);
+				if (min_usec > 0) {
+					if (!svf_nil)
+						jtag_add_sleep(min_usec);
+				}
+
+				/* move to end_state if necessary */
+				if (svf_para.runtest_end_state != svf_para.runtest_run_state)
+					svf_add_statemove(svf_para.runtest_end_state);
+
+#else
+				if (svf_para.runtest_run_state != TAP_IDLE) {
+					LOG_ERROR("cannot runtest in %s state",
+							tap_state_name(svf_para.runtest_run_state));
 					return ERROR_FAIL;
 				}
-				i += 2;
-			}
-			/* min_time SEC */
-			if (((i + 2) <= num_of_argu) && !strcmp(argus[i + 1], "SEC")) {
-				min_time = atof(argus[i]);
-				LOG_DEBUG("\tmin_time = %fs", min_time);
-				i += 2;
-			}
-			/* MAXIMUM max_time SEC */
-			if (((i + 3) <= num_of_argu) &&
-			!strcmp(argus[i], "MAXIMUM") && !strcmp(argus[i + 2], "SEC")) {
-				float max_time = 0;
-				max_time = atof(argus[i + 1]);
-				LOG_DEBUG("\tmax_time = %fs", max_time);
-				i += 3;
-			}
-			/* ENDSTATE end_state */
-			if (((i + 2) <= num_of_argu) && !strcmp(argus[i], "ENDSTATE")) {
-				i_tmp = tap_state_by_name(argus[i + 1]);
-
-				if (svf_tap_state_is_stable(i_tmp)) {
-					svf_para.runtest_end_state = i_tmp;
-					LOG_DEBUG("\tend_state = %s", tap_state_name(i_tmp));
-				} else {
-					LOG_ERROR("%s: %s is not a stable state", argus[0], tap_state_name(i_tmp));
-					return ERROR_FAIL;
-				}
-				i += 2;
-			}
-
-			/* all parameter should be parsed */
-			if (i == num_of_argu) {
-#if 1
-				/* FIXME handle statemove failures */
-				uint32_t min_usec = 1000000 * min_time;
-
-				/* enter into run_state if necessary */
-				if (cmd_queue_cur_state != svf_para.runtest_run_state)
-					svf_add_statemove(svf_para.runtest_run_state);
-
-				/* add clocks and/or min wait */
-				if (run_count > 0) {
-					if (!svf_nil)
-						jtag_add_clocks(run_count);
-				}
-
-				if (min_usec > 0) {
-					if (!svf_nil)
-						jtag_add_sleep(min_usec);
-				}
-
-				/* move to end_state if necessary */
-				if (svf_para.runtest_end_state != svf_para.runtest_run_state)
-					svf_add_statemove(svf_para.runtest_end_state);
-
-#else
-				if (svf_para.runtest_run_state != TAP_IDLE) {
-					LOG_ERROR("cannot runtest in %s state",
-							tap_state_name(svf_para.runtest_run_state));
-					return ERROR_FAIL;
-				}
-
-				if (!svf_nil)
-					jtag_add_runtest(run_count, svf_para.runtest_end_state);
-#endif
-			} else {
-				LOG_ERROR("fail to parse parameter of RUNTEST, %d out of %d is parsed",
-						i,
-						num_of_argu);
-				return ERROR_FAIL;
+
+				if (!svf_nil)
+					jtag_add_runtest(cmd->run_count, svf_para.runtest_end_state);
+#endif
 			}
 			break;
 		case STATE:
-			/* STATE [pathstate1 [pathstate2 ...[pathstaten]]] stable_state */
-			if (num_of_argu < 2) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
-				return ERROR_FAIL;
+			if (cmd->num_states == 1) {
+				/* STATE stable_state */
+				LOG_DEBUG("\tmove to %s by svf_add_statemove",
+						tap_state_name(cmd->path[0]));
+				/* FIXME handle statemove failures */
+				svf_add_statemove(cmd->path[0]);
+				break;
 			}
-			if (num_of_argu > 2) {
-				/* STATE pathstate1 ... stable_state */
-				path = malloc((num_of_argu - 1) * sizeof(tap_state_t));
-				if (NULL == path) {
-					LOG_ERROR("not enough memory");
-					return ERROR_FAIL;
-				}
-				num_of_argu--;	/* num of path */
-				i_tmp = 1;		/* path is from parameter 1 */
-				for (i = 0; i < num_of_argu; i++, i_tmp++) {
-					path[i] = tap_state_by_name(argus[i_tmp]);
-					if (path[i] == TAP_INVALID) {
-						LOG_ERROR("%s: %s is not a valid state", argus[0], argus[i_tmp]);
-						free(path);
-						return ERROR_FAIL;
-					}
-					/* OpenOCD refuses paths containing TAP_RESET */
-					if (TAP_RESET == path[i]) {
-						/* FIXME last state MUST be stable! */
-						if (i > 0) {
-							if (!svf_nil)
-								jtag_add_pathmove(i, path);
-						}
-						if (!svf_nil)
-							jtag_add_tlr();
-						num_of_argu -= i + 1;
-						i = -1;
-					}
-				}
-				if (num_of_argu > 0) {
-					/* execute last path if necessary */
-					if (svf_tap_state_is_stable(path[num_of_argu - 1])) {
-						/* last state MUST be stable state */
+
+			/* STATE pathstate1 ... stable_state */
+			i_tmp = 0;		/* start of the current path */
+			for (i = 0; i < cmd->num_states; i++) {
+				/* OpenOCD refuses paths containing TAP_RESET */
+				if (TAP_RESET == cmd->path[i]) {
+					if (i > i_tmp) {
 						if (!svf_nil)
-							jtag_add_pathmove(num_of_argu, path);
-						LOG_DEBUG("\tmove to %s by path_move",
-								tap_state_name(path[num_of_argu - 1]));
-					} else {
-						LOG_ERROR("%s: %s is not a stable state",
-								argus[0],
-								tap_state_name(path[num_of_argu - 1]));
-						free(path);
-						return ERROR_FAIL;
+							jtag_add_pathmove(i - i_tmp, cmd->path + i_tmp);
 					}
+					if (!svf_nil)
+						jtag_add_tlr();
+					i_tmp = i + 1;
 				}
-
-				free(path);
-				path = NULL;
-			} else {
-				/* STATE stable_state */
-				state = tap_state_by_name(argus[1]);
-				if (svf_tap_state_is_stable(state)) {
-					LOG_DEBUG("\tmove to %s by svf_add_statemove",
-							tap_state_name(state));
-					/* FIXME handle statemove failures */
-					svf_add_statemove(state);
-				} else {
-					LOG_ERROR("%s: %s is not a stable state",
-							argus[0], tap_state_name(state));
-					return ERROR_FAIL;
-				}
+			}
+			if (i_tmp < cmd->num_states) {
+				/* execute last path if necessary */
+				if (!svf_nil)
+					jtag_add_pathmove(cmd->num_states - i_tmp, cmd->path + i_tmp);
+				LOG_DEBUG("\tmove to %s by path_move",
+						tap_state_name(cmd->path[cmd->num_states - 1]));
 			}
 			break;
 		case TRST:
-			/* TRST trst_mode */
-			if (num_of_argu != 2) {
-				LOG_ERROR("invalid parameter of %s", argus[0]);
-				return ERROR_FAIL;
-			}
 			if (svf_para.trst_mode != TRST_ABSENT) {
 				if (ERROR_OK != svf_execute_tap())
 					return ERROR_FAIL;
-				i_tmp = svf_find_string_in_array(argus[1],
-						(char **)svf_trst_mode_name,
-						ARRAY_SIZE(svf_trst_mode_name));
-				switch (i_tmp) {
+				switch (cmd->trst_mode) {
 				case TRST_ON:
 					if (!svf_nil)
 						jtag_add_reset(1, 0);
@@ -1513,11 +1895,8 @@ XXR_common:
 					break;
 				case TRST_ABSENT:
 					break;
-				default:
-					LOG_ERROR("unknown TRST mode: %s", argus[1]);
-					return ERROR_FAIL;
 				}
-				svf_para.trst_mode = i_tmp;
+				svf_para.trst_mode = cmd->trst_mode;
 				LOG_DEBUG("\ttrst_mode = %s", svf_trst_mode_name[svf_para.trst_mode]);
 			} else {
 				LOG_ERROR("can not accpet TRST command if trst_mode is ABSENT");
@@ -1525,7 +1904,7 @@ XXR_common:
 			}
 			break;
 		default:
-			LOG_ERROR("invalid svf command: %s", argus[0]);
+			LOG_ERROR("invalid svf command: %d", command);
 			return ERROR_FAIL;
 			break;
 	}
@@ -1539,7 +1918,7 @@ XXR_common:
 		/* for convenient debugging, execute tap if possible */
 		if ((svf_buffer_index > 0) && \
 				(((command != STATE) && (command != RUNTEST)) || \
-						((command == STATE) && (num_of_argu == 2)))) {
+						((command == STATE) && (cmd->num_states == 1)))) {
 			if (ERROR_OK != svf_execute_tap())
 				return ERROR_FAIL;
 
@@ -1554,25 +1933,623 @@ XXR_common:
 		if (((svf_buffer_index >= SVF_MAX_BUFFER_SIZE_TO_COMMIT) ||
 				(svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE / 2)) && \
 				(((command != STATE) && (command != RUNTEST)) || \
-						((command == STATE) && (num_of_argu == 2))))
+						((command == STATE) && (cmd->num_states == 1))))
 			return svf_execute_tap();
 	}
 
 	return ERROR_OK;
 }
 
+static void svf_free_scratch(void)
+{
+	for (int i = 0; i < XXR_NUM_FIELDS; i++) {
+		free(svf_xxr_data[i]);
+		svf_xxr_data[i] = NULL;
+		svf_xxr_data_size[i] = 0;
+	}
+
+	free(svf_path);
+	svf_path = NULL;
+	svf_path_size = 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/*
+ * With the "pipeline" option, a thread reads and parses the SVF file into
+ * a ring of slots while the main thread runs the commands, so that parsing
+ * the next commands overlaps with the adapter executing the queue.  Only
+ * the thread touches the reader and parser state (svf_fd, svf_read_line,
+ * svf_command_buffer, svf_line_number and the scratch buffers) until it
+ * has been stopped; the main thread only sees the slots.
+ */
+#define SVF_PIPELINE_SLOTS		64
+/* stop parsing ahead once this much decoded data is waiting to be run */
+#define SVF_PIPELINE_MAX_BYTES	(4 * SVF_MAX_BUFFER_SIZE_TO_COMMIT)
+
+struct svf_pipeline {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct svf_pipeline_slot slots[SVF_PIPELINE_SLOTS];
+	/* slots[first] is the oldest of count filled slots */
+	unsigned first;
+	unsigned count;
+	size_t bytes;
+	/* the main thread holds slots[first] */
+	bool holding;
+	bool stop;
+
+	/* the thread parses a copy of svf_command_buffer, which is left as
+	 * it was read for the main thread to parse again on an error */
+	char *command;
+	size_t command_size;
+};
+
+/* Copy the decoded data of the command just parsed out of the scratch
+ * buffers, which the next command reuses. */
+static int svf_pipeline_copy(struct svf_pipeline_slot *slot)
+{
+	struct svf_cmd *cmd = &slot->cmd;
+	size_t bytes = DIV_ROUND_UP(cmd->len, 8);
+	size_t offset = 0;
+
+	slot->bytes = 0;
+
+	switch (cmd->command) {
+		case HDR:
+		case HIR:
+		case TDR:
+		case TIR:
+		case SDR:
+		case SIR:
+			for (int i = 0; i < XXR_NUM_FIELDS; i++) {
+				if (cmd->data_mask & (1 << i))
+					slot->bytes += bytes;
+			}
+			/* "HDR 0" still needs a valid pointer */
+			if (svf_reserve((void **)&slot->data, &slot->data_size, MAX(slot->bytes, 1)) != ERROR_OK)
+				return ERROR_FAIL;
+			for (int i = 0; i < XXR_NUM_FIELDS; i++) {
+				if (!(cmd->data_mask & (1 << i)))
+					continue;
+				memcpy(slot->data + offset, cmd->data[i], bytes);
+				cmd->data[i] = slot->data + offset;
+				offset += bytes;
+			}
+			break;
+		case STATE:
+			slot->bytes = cmd->num_states * sizeof(*slot->path);
+			if (svf_reserve((void **)&slot->path, &slot->path_size, slot->bytes) != ERROR_OK)
+				return ERROR_FAIL;
+			memcpy(slot->path, cmd->path, slot->bytes);
+			cmd->path = slot->path;
+			break;
+		default:
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+static void svf_pipeline_fill(struct svf_pipeline *pipeline, struct svf_pipeline_slot *slot)
+{
+	slot->valid = svf_read_command_from_file(svf_fd) == ERROR_OK;
+	if (!slot->valid)
+		return;
+
+	slot->line_num = svf_line_number;
+	slot->bytes = 0;
+
+	if (!svf_quiet) {
+		size_t len = strlen(svf_read_line) + 1;
+		if (svf_reserve((void **)&slot->line, &slot->line_size, len) == ERROR_OK)
+			memcpy(slot->line, svf_read_line, len);
+		else if (slot->line)
+			slot->line[0] = 0;
+	}
+
+	/* parsing splits the command up in place */
+	size_t len = strlen(svf_command_buffer) + 1;
+	slot->parsed = svf_reserve((void **)&pipeline->command, &pipeline->command_size, len) == ERROR_OK;
+	if (slot->parsed) {
+		memcpy(pipeline->command, svf_command_buffer, len);
+		slot->parsed = svf_parse_command(pipeline->command, &slot->cmd) == ERROR_OK
+				&& svf_pipeline_copy(slot) == ERROR_OK;
+	}
+}
+
+static void *svf_pipeline_thread(void *arg)
+{
+	struct svf_pipeline *pipeline = arg;
+	struct svf_pipeline_slot *slot;
+	bool done = false;
+
+	while (!done) {
+		pthread_mutex_lock(&pipeline->lock);
+		while (!pipeline->stop && (pipeline->count == SVF_PIPELINE_SLOTS
+				|| (pipeline->count > 0 && pipeline->bytes >= SVF_PIPELINE_MAX_BYTES)))
+			pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+		done = pipeline->stop;
+		slot = &pipeline->slots[(pipeline->first + pipeline->count) % SVF_PIPELINE_SLOTS];
+		pthread_mutex_unlock(&pipeline->lock);
+
+		if (done)
+			break;
+
+		svf_pipeline_fill(pipeline, slot);
+		/* nothing follows the end of the file or a parse error */
+		done = !slot->valid || !slot->parsed;
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->count++;
+		pipeline->bytes += slot->bytes;
+		pthread_cond_signal(&pipeline->cond);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+
+	return NULL;
+}
+
+static struct svf_pipeline *svf_pipeline_start(void)
+{
+	struct svf_pipeline *pipeline = calloc(1, sizeof(*pipeline));
+	if (pipeline == NULL) {
+		LOG_WARNING("not enough memory for the svf pipeline, parsing in line");
+		return NULL;
+	}
+
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->cond, NULL);
+
+	svf_parse_silent = true;
+	int retval = pthread_create(&pipeline->thread, NULL, svf_pipeline_thread, pipeline);
+	if (retval != 0) {
+		LOG_WARNING("couldn't start the svf pipeline thread: %s, parsing in line",
+				strerror(retval));
+		svf_parse_silent = false;
+		pthread_cond_destroy(&pipeline->cond);
+		pthread_mutex_destroy(&pipeline->lock);
+		free(pipeline);
+		return NULL;
+	}
+
+	return pipeline;
+}
+
+/* Release the slot of the previous command and wait for the next one.
+ * The thread always ends with a slot that is not valid or not parsed. */
+static const struct svf_pipeline_slot *svf_pipeline_next(struct svf_pipeline *pipeline)
+{
+	struct svf_pipeline_slot *slot;
+
+	pthread_mutex_lock(&pipeline->lock);
+
+	if (pipeline->holding) {
+		slot = &pipeline->slots[pipeline->first];
+		/* don't let every slot keep the buffer of the longest scan */
+		if (slot->data_size > SVF_PIPELINE_MAX_BYTES / SVF_PIPELINE_SLOTS) {
+			free(slot->data);
+			slot->data = NULL;
+			slot->data_size = 0;
+		}
+		pipeline->bytes -= slot->bytes;
+		pipeline->first = (pipeline->first + 1) % SVF_PIPELINE_SLOTS;
+		pipeline->count--;
+		pthread_cond_signal(&pipeline->cond);
+	}
+
+	while (pipeline->count == 0)
+		pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+	pipeline->holding = true;
+	slot = &pipeline->slots[pipeline->first];
+
+	pthread_mutex_unlock(&pipeline->lock);
+
+	return slot;
+}
+
+static void svf_pipeline_stop(struct svf_pipeline *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->stop = true;
+	pthread_cond_signal(&pipeline->cond);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	pthread_join(pipeline->thread, NULL);
+	svf_parse_silent = false;
+
+	for (int i = 0; i < SVF_PIPELINE_SLOTS; i++) {
+		free(pipeline->slots[i].line);
+		free(pipeline->slots[i].data);
+		free(pipeline->slots[i].path);
+	}
+	free(pipeline->command);
+
+	pthread_cond_destroy(&pipeline->cond);
+	pthread_mutex_destroy(&pipeline->lock);
+	free(pipeline);
+}
+
+#else
+
+static struct svf_pipeline *svf_pipeline_start(void)
+{
+	LOG_WARNING("svf pipeline needs threads, which this build lacks; parsing in line");
+	return NULL;
+}
+
+static const struct svf_pipeline_slot *svf_pipeline_next(struct svf_pipeline *pipeline)
+{
+	return NULL;
+}
+
+static void svf_pipeline_stop(struct svf_pipeline *pipeline)
+{
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+static uint8_t svf_compiled_state(tap_state_t state)
+{
+	for (unsigned i = 0; i < ARRAY_SIZE(svf_compiled_states); i++) {
+		if (svf_compiled_states[i] == state)
+			return i;
+	}
+
+	return SVF_COMPILED_NO_STATE;
+}
+
+static int svf_compiled_get_state(uint8_t value, bool optional, tap_state_t *state)
+{
+	if (optional && value == SVF_COMPILED_NO_STATE) {
+		*state = TAP_INVALID;
+		return ERROR_OK;
+	}
+
+	if (value >= ARRAY_SIZE(svf_compiled_states))
+		return ERROR_FAIL;
+
+	*state = svf_compiled_states[value];
+	return ERROR_OK;
+}
+
+static int svf_compiled_write(FILE *fd, const struct svf_cmd *cmd)
+{
+	uint8_t record[SVF_COMPILED_RECORD_SIZE + 4];
+	size_t header_size = SVF_COMPILED_RECORD_SIZE;
+	uint32_t length = SVF_COMPILED_RECORD_SIZE;
+	uint32_t value = 0;
+	int bytes = 0;
+	int i;
+
+	memset(record, 0, sizeof(record));
+	record[8] = cmd->command;
+
+	switch (cmd->command) {
+		case ENDDR:
+		case ENDIR:
+			record[9] = svf_compiled_state(cmd->state);
+			break;
+		case FREQUENCY:
+			record[9] = cmd->has_frequency;
+			memcpy(&value, &cmd->frequency, sizeof(value));
+			break;
+		case HDR:
+		case HIR:
+		case TDR:
+		case TIR:
+		case SDR:
+		case SIR:
+			record[9] = cmd->data_mask;
+			value = cmd->len;
+			bytes = (cmd->len + 7) >> 3;
+			for (i = 0; i < XXR_NUM_FIELDS; i++) {
+				if (cmd->data_mask & (1 << i))
+					length += bytes;
+			}
+			break;
+		case RUNTEST:
+			record[9] = svf_compiled_state(cmd->run_state);
+			record[10] = svf_compiled_state(cmd->end_state);
+			value = cmd->run_count;
+			h_u32_to_le(record + SVF_COMPILED_RECORD_SIZE, cmd->min_usec);
+			header_size += 4;
+			length += 4;
+			break;
+		case STATE:
+			value = cmd->num_states;
+			length += cmd->num_states;
+			break;
+		case TRST:
+			record[9] = cmd->trst_mode;
+			break;
+		default:
+			return ERROR_FAIL;
+	}
+
+	h_u32_to_le(record, length);
+	h_u32_to_le(record + 4, cmd->line_num);
+	h_u32_to_le(record + 12, value);
+
+	if (fwrite(record, 1, header_size, fd) != header_size)
+		return ERROR_FAIL;
+
+	if (cmd->command == STATE) {
+		for (i = 0; i < cmd->num_states; i++) {
+			if (fputc(svf_compiled_state(cmd->path[i]), fd) == EOF)
+				return ERROR_FAIL;
+		}
+	} else if (bytes > 0) {
+		for (i = 0; i < XXR_NUM_FIELDS; i++) {
+			if ((cmd->data_mask & (1 << i)) &&
+					fwrite(cmd->data[i], 1, bytes, fd) != (size_t)bytes)
+				return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static bool svf_is_compiled(FILE *fd)
+{
+	char magic[8];
+	bool compiled = fread(magic, 1, sizeof(magic), fd) == sizeof(magic)
+			&& memcmp(magic, SVF_COMPILED_MAGIC, sizeof(magic)) == 0;
+
+	rewind(fd);
+	return compiled;
+}
+
+/* Returns the next @a size bytes of a compiled file, either from the
+ * mapping or read into compiled->record. */
+static int svf_compiled_read(struct svf_compiled *compiled, size_t size, const uint8_t **data)
+{
+	size_t size_read;
+
+	if (size > compiled->size - compiled->pos)
+		return ERROR_FAIL;
+
+	if (compiled->map) {
+		*data = compiled->map + compiled->pos;
+	} else {
+		/* at least a byte, so that even an empty record has valid data */
+		if (svf_reserve((void **)&compiled->record, &compiled->record_size, MAX(size, 1)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (size > 0 && (fileio_read(compiled->fileio, size, compiled->record, &size_read) != ERROR_OK
+				|| size_read != size))
+			return ERROR_FAIL;
+		*data = compiled->record;
+	}
+
+	compiled->pos += size;
+	return ERROR_OK;
+}
+
+static int svf_compiled_open(struct svf_compiled *compiled, const char *filename)
+{
+	const uint8_t *header;
+
+	if (fileio_open(&compiled->fileio, filename, FILEIO_READ, FILEIO_BINARY) != ERROR_OK) {
+		compiled->fileio = NULL;
+		return ERROR_FAIL;
+	}
+
+	/* stream the file if it can't be mapped */
+	if (fileio_map(compiled->fileio, &compiled->map, &compiled->size) != ERROR_OK) {
+		compiled->map = NULL;
+		if (fileio_size(compiled->fileio, &compiled->size) != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	if (svf_compiled_read(compiled, SVF_COMPILED_HEADER_SIZE, &header) != ERROR_OK
+			|| le_to_h_u32(header + 8) != SVF_COMPILED_VERSION) {
+		LOG_ERROR("%s: unsupported compiled SVF file, compile it again", filename);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static void svf_compiled_close(struct svf_compiled *compiled)
+{
+	if (compiled->fileio)
+		fileio_close(compiled->fileio);
+
+	free(compiled->record);
+	memset(compiled, 0, sizeof(*compiled));
+}
+
+static int svf_compiled_next(struct svf_compiled *compiled, struct svf_cmd *cmd)
+{
+	size_t offset = compiled->pos;
+	const uint8_t *data;
+	uint8_t record[SVF_COMPILED_RECORD_SIZE];
+	uint32_t length, value;
+	uint64_t bytes, data_len;
+	int i;
+
+	if (svf_compiled_read(compiled, SVF_COMPILED_RECORD_SIZE, &data) != ERROR_OK)
+		goto corrupt;
+	/* the data of the record may replace this when streaming */
+	memcpy(record, data, sizeof(record));
+
+	length = le_to_h_u32(record);
+	value = le_to_h_u32(record + 12);
+	if (length < SVF_COMPILED_RECORD_SIZE)
+		goto corrupt;
+	length -= SVF_COMPILED_RECORD_SIZE;
+	if (svf_compiled_read(compiled, length, &data) != ERROR_OK)
+		goto corrupt;
+
+	cmd->line_num = le_to_h_u32(record + 4);
+	cmd->command = record[8];
+
+	switch (cmd->command) {
+		case ENDDR:
+		case ENDIR:
+			if (length != 0 || svf_compiled_get_state(record[9], false, &cmd->state) != ERROR_OK
+					|| !svf_tap_state_is_stable(cmd->state))
+				goto corrupt;
+			break;
+		case FREQUENCY:
+			if (length != 0)
+				goto corrupt;
+			cmd->has_frequency = record[9];
+			memcpy(&cmd->frequency, &value, sizeof(value));
+			break;
+		case HDR:
+		case HIR:
+		case TDR:
+		case TIR:
+		case SDR:
+		case SIR:
+			if (record[9] >= (1 << XXR_NUM_FIELDS) || value > INT_MAX)
+				goto corrupt;
+			bytes = ((uint64_t)value + 7) >> 3;
+			data_len = 0;
+			for (i = 0; i < XXR_NUM_FIELDS; i++) {
+				if (record[9] & (1 << i)) {
+					cmd->data[i] = data + data_len;
+					data_len += bytes;
+				}
+			}
+			if (length != data_len)
+				goto corrupt;
+			cmd->len = value;
+			cmd->data_mask = record[9];
+			break;
+		case RUNTEST:
+			if (length != 4 || value > INT_MAX
+					|| svf_compiled_get_state(record[9], true, &cmd->run_state) != ERROR_OK
+					|| svf_compiled_get_state(record[10], true, &cmd->end_state) != ERROR_OK)
+				goto corrupt;
+			if ((cmd->run_state != TAP_INVALID && !svf_tap_state_is_stable(cmd->run_state))
+					|| (cmd->end_state != TAP_INVALID && !svf_tap_state_is_stable(cmd->end_state)))
+				goto corrupt;
+			cmd->run_count = value;
+			cmd->min_usec = le_to_h_u32(data);
+			break;
+		case STATE:
+			if (value == 0 || length != value)
+				goto corrupt;
+			if (svf_reserve((void **)&svf_path, &svf_path_size, value * sizeof(*svf_path)) != ERROR_OK)
+				return ERROR_FAIL;
+			for (i = 0; i < (int)value; i++) {
+				if (svf_compiled_get_state(data[i], false, &svf_path[i]) != ERROR_OK)
+					goto corrupt;
+			}
+			cmd->num_states = value;
+			cmd->path = svf_path;
+			break;
+		case TRST:
+			if (length != 0 || record[9] > TRST_ABSENT)
+				goto corrupt;
+			cmd->trst_mode = record[9];
+			break;
+		default:
+			goto corrupt;
+	}
+
+	return ERROR_OK;
+
+corrupt:
+	LOG_ERROR("compiled SVF file is corrupt at offset %lu", (unsigned long)offset);
+	return ERROR_FAIL;
+}
+
+COMMAND_HANDLER(handle_svf_compile_command)
+{
+	uint8_t header[SVF_COMPILED_HEADER_SIZE];
+	struct svf_cmd command;
+	int command_num = 0;
+	int ret = ERROR_OK;
+	FILE *out;
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	svf_fd = fopen(CMD_ARGV[0], "r");
+	if (svf_fd == NULL) {
+		command_print(CMD_CTX, "open(\"%s\"): %s", CMD_ARGV[0], strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	out = fopen(CMD_ARGV[1], "wb");
+	if (out == NULL) {
+		command_print(CMD_CTX, "open(\"%s\"): %s", CMD_ARGV[1], strerror(errno));
+		fclose(svf_fd);
+		svf_fd = 0;
+		return ERROR_FAIL;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, SVF_COMPILED_MAGIC, sizeof(SVF_COMPILED_MAGIC));
+	h_u32_to_le(header + 8, SVF_COMPILED_VERSION);
+	if (fwrite(header, 1, sizeof(header), out) != sizeof(header))
+		ret = ERROR_FAIL;
+
+	svf_line_number = 0;
+	while (ERROR_OK == ret && ERROR_OK == svf_read_command_from_file(svf_fd)) {
+		if (ERROR_OK != svf_parse_command(svf_command_buffer, &command)) {
+			LOG_ERROR("fail to parse command at line %d", svf_line_number);
+			ret = ERROR_FAIL;
+		} else if (ERROR_OK != svf_compiled_write(out, &command)) {
+			LOG_ERROR("couldn't write %s", CMD_ARGV[1]);
+			ret = ERROR_FAIL;
+		} else
+			command_num++;
+	}
+
+	if (fclose(out) != 0)
+		ret = ERROR_FAIL;
+	fclose(svf_fd);
+	svf_fd = 0;
+
+	free(svf_command_buffer);
+	svf_command_buffer = NULL;
+	svf_command_buffer_size = 0;
+	svf_free_scratch();
+
+	if (ERROR_OK != ret) {
+		/* don't leave a truncated file behind */
+		remove(CMD_ARGV[1]);
+		command_print(CMD_CTX, "svf compile failed");
+		return ret;
+	}
+
+	command_print(CMD_CTX, "compiled %d svf commands into %s", command_num, CMD_ARGV[1]);
+	return ERROR_OK;
+}
+
+static const struct command_registration svf_subcommand_handlers[] = {
+	{
+		.name = "compile",
+		.handler = handle_svf_compile_command,
+		.mode = COMMAND_ANY,
+		.help = "Parses a SVF file ahead of time into a binary file "
+			"that the svf command runs faster.",
+		.usage = "<file> <output file>",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration svf_command_handlers[] = {
 	{
 		.name = "svf",
 		.handler = handle_svf_command,
 		.mode = COMMAND_EXEC,
-		.help = "Runs a SVF file.",
-		.usage = "svf [-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error]",
+		.help = "Runs a SVF file, or one compiled by 'svf compile'.",
+		.usage = "svf [-tap device.tap] <file> [quiet] [nil] [progress] [ignore_error] [pipeline]",
+		.chain = svf_subcommand_handlers,
 	},
 	COMMAND_REGISTRATION_DONE
 };
 
 int svf_register_commands(struct command_context *cmd_ctx)
 {
+	svf_hex_init();
+
 	return register_commands(cmd_ctx, NULL, svf_command_handlers);
 }
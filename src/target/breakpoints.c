@@ -41,44 +41,285 @@ static const char * const watchpoint_rw_strings[] = {
 /* monotonic counter/id-number for breakpoints and watch points */
 static int bpwp_unique_id;
 
+/*
+ * The breakpoint and watchpoint lists of a target stay in the order the
+ * points were added, which is the order targets (re)insert them in.  Next
+ * to the lists, each target has a hash table per list, keyed by address,
+ * so that adding, finding and removing a point doesn't depend on how many
+ * others are set; GDB scripts may well set thousands of them.
+ */
+#define BPWP_INDEX_MIN_BITS	6
+
+struct bpwp_index {
+	struct breakpoint **bp_buckets;
+	unsigned bp_bits;
+	unsigned bp_count;
+	struct breakpoint *bp_tail;
+
+	struct watchpoint **wp_buckets;
+	unsigned wp_bits;
+	unsigned wp_count;
+	struct watchpoint *wp_tail;
+};
+
+static inline unsigned bpwp_hash(uint32_t address, unsigned bits)
+{
+	/* multiplicative hashing, the low address bits are mostly zero */
+	return (uint32_t)(address * 2654435761u) >> (32 - bits);
+}
+
+static struct bpwp_index *bpwp_index_get(struct target *target)
+{
+	if (target->bpwp_index == NULL)
+		target->bpwp_index = calloc(1, sizeof(struct bpwp_index));
+
+	return target->bpwp_index;
+}
+
+static int breakpoint_index_grow(struct bpwp_index *index, unsigned bits)
+{
+	struct breakpoint **buckets = calloc(1u << bits, sizeof(*buckets));
+
+	if (buckets == NULL)
+		return ERROR_FAIL;
+
+	for (unsigned i = 0; index->bp_buckets && i < (1u << index->bp_bits); i++) {
+		struct breakpoint *breakpoint = index->bp_buckets[i];
+		while (breakpoint) {
+			struct breakpoint *next = breakpoint->hash_next;
+			unsigned h = bpwp_hash(breakpoint->address, bits);
+			breakpoint->hash_next = buckets[h];
+			buckets[h] = breakpoint;
+			breakpoint = next;
+		}
+	}
+
+	free(index->bp_buckets);
+	index->bp_buckets = buckets;
+	index->bp_bits = bits;
+
+	return ERROR_OK;
+}
+
+/* Size the table for count more breakpoints, so that a bulk insert
+ * rehashes at most once rather than at every doubling */
+static int breakpoint_index_reserve(struct target *target, unsigned count)
+{
+	struct bpwp_index *index = bpwp_index_get(target);
+	unsigned bits = BPWP_INDEX_MIN_BITS;
+
+	if (index == NULL)
+		return ERROR_FAIL;
+
+	while (bits < 31 && (1u << bits) < index->bp_count + count)
+		bits++;
+
+	if (index->bp_buckets && bits <= index->bp_bits)
+		return ERROR_OK;
+
+	return breakpoint_index_grow(index, bits);
+}
+
+/* Append a new breakpoint to the target's list */
+static int breakpoint_index_insert(struct target *target, struct breakpoint *breakpoint)
+{
+	struct bpwp_index *index = bpwp_index_get(target);
+
+	if (index == NULL)
+		return ERROR_FAIL;
+
+	if (index->bp_buckets == NULL || index->bp_count >= (1u << index->bp_bits)) {
+		/* a table that can't grow is merely slower */
+		unsigned bits = index->bp_buckets ? index->bp_bits + 1 : BPWP_INDEX_MIN_BITS;
+		if (breakpoint_index_grow(index, bits) != ERROR_OK && index->bp_buckets == NULL)
+			return ERROR_FAIL;
+	}
+
+	unsigned h = bpwp_hash(breakpoint->address, index->bp_bits);
+	breakpoint->hash_next = index->bp_buckets[h];
+	index->bp_buckets[h] = breakpoint;
+
+	breakpoint->next = NULL;
+	breakpoint->prev = index->bp_tail;
+	if (index->bp_tail)
+		index->bp_tail->next = breakpoint;
+	else
+		target->breakpoints = breakpoint;
+	index->bp_tail = breakpoint;
+	index->bp_count++;
+
+	return ERROR_OK;
+}
+
+static void breakpoint_index_remove(struct target *target, struct breakpoint *breakpoint)
+{
+	struct bpwp_index *index = target->bpwp_index;
+	struct breakpoint **p = &index->bp_buckets[bpwp_hash(breakpoint->address, index->bp_bits)];
+
+	while (*p != breakpoint)
+		p = &(*p)->hash_next;
+	*p = breakpoint->hash_next;
+
+	if (breakpoint->prev)
+		breakpoint->prev->next = breakpoint->next;
+	else
+		target->breakpoints = breakpoint->next;
+	if (breakpoint->next)
+		breakpoint->next->prev = breakpoint->prev;
+	else
+		index->bp_tail = breakpoint->prev;
+	index->bp_count--;
+}
+
+/* Of the breakpoints at address, return the one that was added first,
+ * i.e. the first one on the target's list */
+static struct breakpoint *breakpoint_index_find(struct target *target, uint32_t address)
+{
+	struct bpwp_index *index = target->bpwp_index;
+	struct breakpoint *found = NULL;
+
+	if (index == NULL || index->bp_buckets == NULL)
+		return NULL;
+
+	struct breakpoint *breakpoint = index->bp_buckets[bpwp_hash(address, index->bp_bits)];
+	for (; breakpoint; breakpoint = breakpoint->hash_next) {
+		if (breakpoint->address == address &&
+				(found == NULL || breakpoint->unique_id < found->unique_id))
+			found = breakpoint;
+	}
+
+	return found;
+}
+
+static int watchpoint_index_grow(struct bpwp_index *index)
+{
+	unsigned bits = index->wp_buckets ? index->wp_bits + 1 : BPWP_INDEX_MIN_BITS;
+	struct watchpoint **buckets = calloc(1u << bits, sizeof(*buckets));
+
+	if (buckets == NULL)
+		return ERROR_FAIL;
+
+	for (unsigned i = 0; index->wp_buckets && i < (1u << index->wp_bits); i++) {
+		struct watchpoint *watchpoint = index->wp_buckets[i];
+		while (watchpoint) {
+			struct watchpoint *next = watchpoint->hash_next;
+			unsigned h = bpwp_hash(watchpoint->address, bits);
+			watchpoint->hash_next = buckets[h];
+			buckets[h] = watchpoint;
+			watchpoint = next;
+		}
+	}
+
+	free(index->wp_buckets);
+	index->wp_buckets = buckets;
+	index->wp_bits = bits;
+
+	return ERROR_OK;
+}
+
+/* Append a new watchpoint to the target's list */
+static int watchpoint_index_insert(struct target *target, struct watchpoint *watchpoint)
+{
+	struct bpwp_index *index = bpwp_index_get(target);
+
+	if (index == NULL)
+		return ERROR_FAIL;
+
+	if (index->wp_buckets == NULL || index->wp_count >= (1u << index->wp_bits)) {
+		if (watchpoint_index_grow(index) != ERROR_OK && index->wp_buckets == NULL)
+			return ERROR_FAIL;
+	}
+
+	unsigned h = bpwp_hash(watchpoint->address, index->wp_bits);
+	watchpoint->hash_next = index->wp_buckets[h];
+	index->wp_buckets[h] = watchpoint;
+
+	watchpoint->next = NULL;
+	watchpoint->prev = index->wp_tail;
+	if (index->wp_tail)
+		index->wp_tail->next = watchpoint;
+	else
+		target->watchpoints = watchpoint;
+	index->wp_tail = watchpoint;
+	index->wp_count++;
+
+	return ERROR_OK;
+}
+
+static void watchpoint_index_remove(struct target *target, struct watchpoint *watchpoint)
+{
+	struct bpwp_index *index = target->bpwp_index;
+	struct watchpoint **p = &index->wp_buckets[bpwp_hash(watchpoint->address, index->wp_bits)];
+
+	while (*p != watchpoint)
+		p = &(*p)->hash_next;
+	*p = watchpoint->hash_next;
+
+	if (watchpoint->prev)
+		watchpoint->prev->next = watchpoint->next;
+	else
+		target->watchpoints = watchpoint->next;
+	if (watchpoint->next)
+		watchpoint->next->prev = watchpoint->prev;
+	else
+		index->wp_tail = watchpoint->prev;
+	index->wp_count--;
+}
+
+/* watchpoint addresses are unique */
+static struct watchpoint *watchpoint_index_find(struct target *target, uint32_t address)
+{
+	struct bpwp_index *index = target->bpwp_index;
+
+	if (index == NULL || index->wp_buckets == NULL)
+		return NULL;
+
+	struct watchpoint *watchpoint = index->wp_buckets[bpwp_hash(address, index->wp_bits)];
+	for (; watchpoint; watchpoint = watchpoint->hash_next) {
+		if (watchpoint->address == address)
+			return watchpoint;
+	}
+
+	return NULL;
+}
+
 int breakpoint_add_internal(struct target *target,
 	uint32_t address,
 	uint32_t length,
 	enum breakpoint_type type)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
+	struct breakpoint *breakpoint;
 	const char *reason;
 	int retval;
-	int n;
 
-	n = 0;
-	while (breakpoint) {
-		n++;
-		if (breakpoint->address == address) {
-			/* FIXME don't assume "same address" means "same
-			 * breakpoint" ... check all the parameters before
-			 * succeeding.
-			 */
-			LOG_DEBUG("Duplicate Breakpoint address: 0x%08" PRIx32 " (BP %" PRIu32 ")",
-				address, breakpoint->unique_id);
-			return ERROR_OK;
-		}
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
+	breakpoint = breakpoint_index_find(target, address);
+	if (breakpoint) {
+		/* FIXME don't assume "same address" means "same
+		 * breakpoint" ... check all the parameters before
+		 * succeeding.
+		 */
+		LOG_DEBUG("Duplicate Breakpoint address: 0x%08" PRIx32 " (BP %" PRIu32 ")",
+			address, breakpoint->unique_id);
+		return ERROR_OK;
 	}
 
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = address;
-	(*breakpoint_p)->asid = 0;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-
-	retval = target_add_breakpoint(target, *breakpoint_p);
+	breakpoint = malloc(sizeof(struct breakpoint));
+	breakpoint->address = address;
+	breakpoint->asid = 0;
+	breakpoint->length = length;
+	breakpoint->type = type;
+	breakpoint->set = 0;
+	breakpoint->orig_instr = malloc(length);
+	breakpoint->unique_id = bpwp_unique_id++;
+
+	retval = breakpoint_index_insert(target, breakpoint);
+	if (retval != ERROR_OK) {
+		free(breakpoint->orig_instr);
+		free(breakpoint);
+		return retval;
+	}
+
+	retval = target_add_breakpoint(target, breakpoint);
 	switch (retval) {
 		case ERROR_OK:
 			break;
@@ -92,16 +333,16 @@ int breakpoint_add_internal(struct target *target,
 			reason = "unknown reason";
 fail:
 			LOG_ERROR("can't add breakpoint: %s", reason);
-			free((*breakpoint_p)->orig_instr);
-			free(*breakpoint_p);
-			*breakpoint_p = NULL;
+			breakpoint_index_remove(target, breakpoint);
+			free(breakpoint->orig_instr);
+			free(breakpoint);
 			return retval;
 	}
 
 	LOG_DEBUG("added %s breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->address, (*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->address, breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -112,13 +353,11 @@ int context_breakpoint_add_internal(struct target *target,
 	enum breakpoint_type type)
 {
 	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
 	int retval;
-	int n;
 
-	n = 0;
+	/* context breakpoints are few (they need hardware comparators),
+	 * so this one isn't worth an index of its own */
 	while (breakpoint) {
-		n++;
 		if (breakpoint->asid == asid) {
 			/* FIXME don't assume "same address" means "same
 			 * breakpoint" ... check all the parameters before
@@ -128,32 +367,35 @@ int context_breakpoint_add_internal(struct target *target,
 				asid, breakpoint->unique_id);
 			return -1;
 		}
-		breakpoint_p = &breakpoint->next;
 		breakpoint = breakpoint->next;
 	}
 
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = 0;
-	(*breakpoint_p)->asid = asid;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-	retval = target_add_context_breakpoint(target, *breakpoint_p);
+	breakpoint = malloc(sizeof(struct breakpoint));
+	breakpoint->address = 0;
+	breakpoint->asid = asid;
+	breakpoint->length = length;
+	breakpoint->type = type;
+	breakpoint->set = 0;
+	breakpoint->orig_instr = malloc(length);
+	breakpoint->unique_id = bpwp_unique_id++;
+
+	retval = breakpoint_index_insert(target, breakpoint);
+	if (retval == ERROR_OK) {
+		retval = target_add_context_breakpoint(target, breakpoint);
+		if (retval != ERROR_OK)
+			breakpoint_index_remove(target, breakpoint);
+	}
 	if (retval != ERROR_OK) {
 		LOG_ERROR("could not add breakpoint");
-		free((*breakpoint_p)->orig_instr);
-		free(*breakpoint_p);
-		*breakpoint_p = NULL;
+		free(breakpoint->orig_instr);
+		free(breakpoint);
 		return retval;
 	}
 
 	LOG_DEBUG("added %s Context breakpoint at 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->asid, (*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->asid, breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -164,13 +406,13 @@ int hybrid_breakpoint_add_internal(struct target *target,
 	uint32_t length,
 	enum breakpoint_type type)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
+	struct bpwp_index *index = target->bpwp_index;
+	struct breakpoint *breakpoint = NULL;
 	int retval;
-	int n;
-	n = 0;
-	while (breakpoint) {
-		n++;
+
+	if (index && index->bp_buckets)
+		breakpoint = index->bp_buckets[bpwp_hash(address, index->bp_bits)];
+	for (; breakpoint; breakpoint = breakpoint->hash_next) {
 		if ((breakpoint->asid == asid) && (breakpoint->address == address)) {
 			/* FIXME don't assume "same address" means "same
 			 * breakpoint" ... check all the parameters before
@@ -185,34 +427,34 @@ int hybrid_breakpoint_add_internal(struct target *target,
 			return -1;
 
 		}
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
 	}
-	(*breakpoint_p) = malloc(sizeof(struct breakpoint));
-	(*breakpoint_p)->address = address;
-	(*breakpoint_p)->asid = asid;
-	(*breakpoint_p)->length = length;
-	(*breakpoint_p)->type = type;
-	(*breakpoint_p)->set = 0;
-	(*breakpoint_p)->orig_instr = malloc(length);
-	(*breakpoint_p)->next = NULL;
-	(*breakpoint_p)->unique_id = bpwp_unique_id++;
-
-
-	retval = target_add_hybrid_breakpoint(target, *breakpoint_p);
+	breakpoint = malloc(sizeof(struct breakpoint));
+	breakpoint->address = address;
+	breakpoint->asid = asid;
+	breakpoint->length = length;
+	breakpoint->type = type;
+	breakpoint->set = 0;
+	breakpoint->orig_instr = malloc(length);
+	breakpoint->unique_id = bpwp_unique_id++;
+
+	retval = breakpoint_index_insert(target, breakpoint);
+	if (retval == ERROR_OK) {
+		retval = target_add_hybrid_breakpoint(target, breakpoint);
+		if (retval != ERROR_OK)
+			breakpoint_index_remove(target, breakpoint);
+	}
 	if (retval != ERROR_OK) {
 		LOG_ERROR("could not add breakpoint");
-		free((*breakpoint_p)->orig_instr);
-		free(*breakpoint_p);
-		*breakpoint_p = NULL;
+		free(breakpoint->orig_instr);
+		free(breakpoint);
 		return retval;
 	}
 	LOG_DEBUG(
 		"added %s Hybrid breakpoint at address 0x%8.8" PRIx32 " of length 0x%8.8x, (BPID: %" PRIu32 ")",
-		breakpoint_type_strings[(*breakpoint_p)->type],
-		(*breakpoint_p)->address,
-		(*breakpoint_p)->length,
-		(*breakpoint_p)->unique_id);
+		breakpoint_type_strings[breakpoint->type],
+		breakpoint->address,
+		breakpoint->length,
+		breakpoint->unique_id);
 
 	return ERROR_OK;
 }
@@ -286,42 +528,32 @@ int hybrid_breakpoint_add(struct target *target,
 }
 
 /* free up a breakpoint */
-static void breakpoint_free(struct target *target, struct breakpoint *breakpoint_to_remove)
+static void breakpoint_free(struct target *target, struct breakpoint *breakpoint)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-	struct breakpoint **breakpoint_p = &target->breakpoints;
 	int retval;
 
-	while (breakpoint) {
-		if (breakpoint == breakpoint_to_remove)
-			break;
-		breakpoint_p = &breakpoint->next;
-		breakpoint = breakpoint->next;
-	}
-
-	if (breakpoint == NULL)
-		return;
-
 	retval = target_remove_breakpoint(target, breakpoint);
 
 	LOG_DEBUG("free BPID: %" PRIu32 " --> %d", breakpoint->unique_id, retval);
-	(*breakpoint_p) = breakpoint->next;
+	breakpoint_index_remove(target, breakpoint);
 	free(breakpoint->orig_instr);
 	free(breakpoint);
 }
 
 int breakpoint_remove_internal(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-
-	while (breakpoint) {
-		if ((breakpoint->address == address) && (breakpoint->asid == 0))
-			break;
-		else if ((breakpoint->address == 0) && (breakpoint->asid == address))
-			break;
-		else if ((breakpoint->address == address) && (breakpoint->asid != 0))
-			break;
-		breakpoint = breakpoint->next;
+	/* a breakpoint at the address, of any kind ... */
+	struct breakpoint *breakpoint = breakpoint_index_find(target, address);
+	struct bpwp_index *index = target->bpwp_index;
+
+	/* ... or a context breakpoint for the asid, whichever was added first */
+	if (index && index->bp_buckets) {
+		struct breakpoint *context = index->bp_buckets[bpwp_hash(0, index->bp_bits)];
+		for (; context; context = context->hash_next) {
+			if ((context->address == 0) && (context->asid == address) &&
+					(breakpoint == NULL || context->unique_id < breakpoint->unique_id))
+				breakpoint = context;
+		}
 	}
 
 	if (breakpoint) {
@@ -333,6 +565,35 @@ int breakpoint_remove_internal(struct target *target, uint32_t address)
 		return 0;
 	}
 }
+/* Add breakpoints at count addresses, stopping at the first that fails.
+ * The ones added before that stay set, as with a series of "bp"s. */
+int breakpoint_add_bulk(struct target *target, const uint32_t *addresses,
+	unsigned count, uint32_t length, enum breakpoint_type type)
+{
+	/* without the room reserved, the table merely grows as it goes */
+	if (target->smp) {
+		struct target_list *head = target->head;
+		/* soft breakpoints only go to the first core, see breakpoint_add() */
+		for (; head; head = (type == BKPT_SOFT) ? NULL : head->next)
+			breakpoint_index_reserve(head->target, count);
+	} else
+		breakpoint_index_reserve(target, count);
+
+	for (unsigned i = 0; i < count; i++) {
+		int retval = breakpoint_add(target, addresses[i], length, type);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+void breakpoint_remove_bulk(struct target *target, const uint32_t *addresses, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+		breakpoint_remove(target, addresses[i]);
+}
+
 void breakpoint_remove(struct target *target, uint32_t address)
 {
 	int found = 0;
@@ -351,12 +612,27 @@ void breakpoint_remove(struct target *target, uint32_t address)
 		breakpoint_remove_internal(target, address);
 }
 
+/* Drop the index once both of its lists are empty */
+static void bpwp_index_release(struct target *target)
+{
+	struct bpwp_index *index = target->bpwp_index;
+
+	if (index == NULL || index->bp_count || index->wp_count)
+		return;
+
+	free(index->bp_buckets);
+	free(index->wp_buckets);
+	free(index);
+	target->bpwp_index = NULL;
+}
+
 void breakpoint_clear_target_internal(struct target *target)
 {
 	LOG_DEBUG("Delete all breakpoints for target: %s",
 		target_name(target));
 	while (target->breakpoints != NULL)
 		breakpoint_free(target, target->breakpoints);
+	bpwp_index_release(target);
 }
 
 void breakpoint_clear_target(struct target *target)
@@ -377,53 +653,47 @@ void breakpoint_clear_target(struct target *target)
 
 struct breakpoint *breakpoint_find(struct target *target, uint32_t address)
 {
-	struct breakpoint *breakpoint = target->breakpoints;
-
-	while (breakpoint) {
-		if (breakpoint->address == address)
-			return breakpoint;
-		breakpoint = breakpoint->next;
-	}
-
-	return NULL;
+	return breakpoint_index_find(target, address);
 }
 
 int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 	enum watchpoint_rw rw, uint32_t value, uint32_t mask)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-	struct watchpoint **watchpoint_p = &target->watchpoints;
+	struct watchpoint *watchpoint;
 	int retval;
 	const char *reason;
 
-	while (watchpoint) {
-		if (watchpoint->address == address) {
-			if (watchpoint->length != length
-				|| watchpoint->value != value
-				|| watchpoint->mask != mask
-				|| watchpoint->rw != rw) {
-				LOG_ERROR("address 0x%8.8" PRIx32
-					" already has watchpoint %d",
-					address, watchpoint->unique_id);
-				return ERROR_FAIL;
-			}
-
-			/* ignore duplicate watchpoint */
-			return ERROR_OK;
+	watchpoint = watchpoint_index_find(target, address);
+	if (watchpoint) {
+		if (watchpoint->length != length
+			|| watchpoint->value != value
+			|| watchpoint->mask != mask
+			|| watchpoint->rw != rw) {
+			LOG_ERROR("address 0x%8.8" PRIx32
+				" already has watchpoint %d",
+				address, watchpoint->unique_id);
+			return ERROR_FAIL;
 		}
-		watchpoint_p = &watchpoint->next;
-		watchpoint = watchpoint->next;
+
+		/* ignore duplicate watchpoint */
+		return ERROR_OK;
 	}
 
-	(*watchpoint_p) = calloc(1, sizeof(struct watchpoint));
-	(*watchpoint_p)->address = address;
-	(*watchpoint_p)->length = length;
-	(*watchpoint_p)->value = value;
-	(*watchpoint_p)->mask = mask;
-	(*watchpoint_p)->rw = rw;
-	(*watchpoint_p)->unique_id = bpwp_unique_id++;
+	watchpoint = calloc(1, sizeof(struct watchpoint));
+	watchpoint->address = address;
+	watchpoint->length = length;
+	watchpoint->value = value;
+	watchpoint->mask = mask;
+	watchpoint->rw = rw;
+	watchpoint->unique_id = bpwp_unique_id++;
+
+	retval = watchpoint_index_insert(target, watchpoint);
+	if (retval != ERROR_OK) {
+		free(watchpoint);
+		return retval;
+	}
 
-	retval = target_add_watchpoint(target, *watchpoint_p);
+	retval = target_add_watchpoint(target, watchpoint);
 	switch (retval) {
 		case ERROR_OK:
 			break;
@@ -437,53 +707,36 @@ int watchpoint_add(struct target *target, uint32_t address, uint32_t length,
 			reason = "unrecognized error";
 bye:
 			LOG_ERROR("can't add %s watchpoint at 0x%8.8" PRIx32 ", %s",
-				watchpoint_rw_strings[(*watchpoint_p)->rw],
+				watchpoint_rw_strings[watchpoint->rw],
 				address, reason);
-			free(*watchpoint_p);
-			*watchpoint_p = NULL;
+			watchpoint_index_remove(target, watchpoint);
+			free(watchpoint);
 			return retval;
 	}
 
 	LOG_DEBUG("added %s watchpoint at 0x%8.8" PRIx32
 		" of length 0x%8.8" PRIx32 " (WPID: %d)",
-		watchpoint_rw_strings[(*watchpoint_p)->rw],
-		(*watchpoint_p)->address,
-		(*watchpoint_p)->length,
-		(*watchpoint_p)->unique_id);
+		watchpoint_rw_strings[watchpoint->rw],
+		watchpoint->address,
+		watchpoint->length,
+		watchpoint->unique_id);
 
 	return ERROR_OK;
 }
 
-static void watchpoint_free(struct target *target, struct watchpoint *watchpoint_to_remove)
+static void watchpoint_free(struct target *target, struct watchpoint *watchpoint)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-	struct watchpoint **watchpoint_p = &target->watchpoints;
 	int retval;
 
-	while (watchpoint) {
-		if (watchpoint == watchpoint_to_remove)
-			break;
-		watchpoint_p = &watchpoint->next;
-		watchpoint = watchpoint->next;
-	}
-
-	if (watchpoint == NULL)
-		return;
 	retval = target_remove_watchpoint(target, watchpoint);
 	LOG_DEBUG("free WPID: %d --> %d", watchpoint->unique_id, retval);
-	(*watchpoint_p) = watchpoint->next;
+	watchpoint_index_remove(target, watchpoint);
 	free(watchpoint);
 }
 
 void watchpoint_remove(struct target *target, uint32_t address)
 {
-	struct watchpoint *watchpoint = target->watchpoints;
-
-	while (watchpoint) {
-		if (watchpoint->address == address)
-			break;
-		watchpoint = watchpoint->next;
-	}
+	struct watchpoint *watchpoint = watchpoint_index_find(target, address);
 
 	if (watchpoint)
 		watchpoint_free(target, watchpoint);
@@ -497,6 +750,32 @@ void watchpoint_clear_target(struct target *target)
 		target_name(target));
 	while (target->watchpoints != NULL)
 		watchpoint_free(target, target->watchpoints);
+	bpwp_index_release(target);
+}
+
+/* Free the bookkeeping of all breakpoints and watchpoints of a target
+ * that is going away, without touching the target itself */
+void breakpoint_watchpoint_free_all(struct target *target)
+{
+	struct bpwp_index *index = target->bpwp_index;
+
+	while (target->breakpoints) {
+		struct breakpoint *breakpoint = target->breakpoints;
+		target->breakpoints = breakpoint->next;
+		free(breakpoint->orig_instr);
+		free(breakpoint);
+	}
+	while (target->watchpoints) {
+		struct watchpoint *watchpoint = target->watchpoints;
+		target->watchpoints = watchpoint->next;
+		free(watchpoint);
+	}
+
+	if (index) {
+		index->bp_count = 0;
+		index->wp_count = 0;
+		bpwp_index_release(target);
+	}
 }
 
 int watchpoint_hit(struct target *target, enum watchpoint_rw *rw, uint32_t *address)
@@ -42,6 +42,9 @@ struct breakpoint {
 	struct breakpoint *next;
 	uint32_t unique_id;
 	int linked_BRP;
+	/* address index, maintained by breakpoints.c */
+	struct breakpoint *prev;
+	struct breakpoint *hash_next;
 };
 
 struct watchpoint {
@@ -53,6 +56,9 @@ struct watchpoint {
 	int set;
 	struct watchpoint *next;
 	int unique_id;
+	/* address index, maintained by breakpoints.c */
+	struct watchpoint *prev;
+	struct watchpoint *hash_next;
 };
 
 void breakpoint_clear_target(struct target *target);
@@ -63,6 +69,9 @@ int context_breakpoint_add(struct target *target,
 int hybrid_breakpoint_add(struct target *target,
 		uint32_t address, uint32_t asid, uint32_t length, enum breakpoint_type type);
 void breakpoint_remove(struct target *target, uint32_t address);
+int breakpoint_add_bulk(struct target *target, const uint32_t *addresses,
+		unsigned count, uint32_t length, enum breakpoint_type type);
+void breakpoint_remove_bulk(struct target *target, const uint32_t *addresses, unsigned count);
 
 struct breakpoint *breakpoint_find(struct target *target, uint32_t address);
 
@@ -72,6 +81,9 @@ int watchpoint_add(struct target *target,
 		enum watchpoint_rw rw, uint32_t value, uint32_t mask);
 void watchpoint_remove(struct target *target, uint32_t address);
 
+/* free all breakpoint and watchpoint bookkeeping when the target goes away */
+void breakpoint_watchpoint_free_all(struct target *target);
+
 /* report type and address of just hit watchpoint */
 int watchpoint_hit(struct target *target, enum watchpoint_rw *rw, uint32_t *address);
 
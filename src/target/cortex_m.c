@@ -94,6 +94,162 @@ static int cortexm_dap_read_coreregister_u32(struct target *target,
 	return retval;
 }
 
+/* Largest number of DCRSR transfers needed for the register cache:
+ * R0..R15, xPSR, MSP, PSP, the special registers, S0..S31 and FPSCR */
+#define CORTEX_M_MAX_REG_READS	(ARMV7M_PSP + 1 + 1 + 32 + 1)
+
+/*
+ * Read all invalid registers of the core cache with a single DAP queue.
+ * Every transfer is a write to DCRSR, a read of DHCSR and a read of
+ * DCRDR.  The DCRDR value is only used when the DHCSR read returned
+ * S_REGRDY, i.e. the transfer had finished by the time DCRDR was read;
+ * registers that weren't ready are left invalid for the caller to read
+ * one at a time.
+ */
+static int cortex_m_queue_read_all_regs(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	uint32_t selector[CORTEX_M_MAX_REG_READS];
+	uint32_t dhcsr[CORTEX_M_MAX_REG_READS];
+	uint32_t dcrdr[CORTEX_M_MAX_REG_READS];
+	int slot[ARMV7M_LAST_REG];
+	int special = -1;
+	int n = 0;
+	int retval;
+
+	for (int i = 0; i < ARMV7M_LAST_REG; i++)
+		slot[i] = CORTEX_M_MAX_REG_READS;
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+		int num = arm_reg->num;
+
+		if (r->valid)
+			continue;
+
+		int needed = (num >= ARMV7M_D0 && num <= ARMV7M_D15) ? 2 : 1;
+		if (n + needed > CORTEX_M_MAX_REG_READS)
+			break;
+
+		switch (num) {
+			case 0 ... 18:
+				slot[num] = n;
+				selector[n++] = num;
+				break;
+
+			case ARMV7M_PRIMASK:
+			case ARMV7M_BASEPRI:
+			case ARMV7M_FAULTMASK:
+			case ARMV7M_CONTROL:
+				/* all four come from Debug Core register 20 */
+				if (special < 0) {
+					special = n;
+					selector[n++] = 20;
+				}
+				slot[num] = special;
+				break;
+
+			case ARMV7M_D0 ... ARMV7M_D15:
+				/* S(2n) and S(2n+1) */
+				slot[num] = n;
+				selector[n++] = 0x40 + 2 * (num - ARMV7M_D0);
+				selector[n++] = 0x40 + 2 * (num - ARMV7M_D0) + 1;
+				break;
+
+			case ARMV7M_FPSCR:
+				slot[num] = n;
+				selector[n++] = 0x21;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	if (n == 0)
+		return ERROR_OK;
+
+	retval = ERROR_OK;
+	for (int i = 0; i < n && retval == ERROR_OK; i++) {
+		retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, selector[i]);
+		if (retval == ERROR_OK)
+			retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, &dhcsr[i]);
+		if (retval == ERROR_OK)
+			retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, &dcrdr[i]);
+	}
+
+	/* the reads queued so far store into the arrays above, so the queue
+	 * has to be run before returning even if queuing failed */
+	int run_retval = dap_run(armv7m->debug_ap->dap);
+	if (retval == ERROR_OK)
+		retval = run_retval;
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* reading DHCSR cleared these, don't let poll miss a reset or lockup */
+	for (int i = 0; i < n; i++) {
+		uint32_t sticky = dhcsr[i] & (S_RESET_ST | S_RETIRE_ST);
+		cortex_m->dcb_dhcsr |= sticky;
+		cortex_m->dcb_dhcsr_sticky |= sticky;
+	}
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+		int num = arm_reg->num;
+		int k;
+		uint32_t value;
+
+		if (r->valid)
+			continue;
+
+		switch (num) {
+			case 0 ... 18:
+			case ARMV7M_FPSCR:
+			case ARMV7M_PRIMASK ... ARMV7M_CONTROL:
+			case ARMV7M_D0 ... ARMV7M_D15:
+				k = slot[num];
+				break;
+			default:
+				continue;
+		}
+
+		/* not queued, or not ready in time */
+		if (k >= n || !(dhcsr[k] & S_REGRDY))
+			continue;
+
+		value = dcrdr[k];
+		switch (num) {
+			case ARMV7M_PRIMASK:
+				value = dcrdr[k] & 0x1;
+				break;
+			case ARMV7M_BASEPRI:
+				value = (dcrdr[k] >> 8) & 0xff;
+				break;
+			case ARMV7M_FAULTMASK:
+				value = (dcrdr[k] >> 16) & 0x1;
+				break;
+			case ARMV7M_CONTROL:
+				value = (dcrdr[k] >> 24) & 0x3;
+				break;
+			case ARMV7M_D0 ... ARMV7M_D15:
+				if (!(dhcsr[k + 1] & S_REGRDY))
+					continue;
+				buf_set_u32(r->value + 4, 0, 32, dcrdr[k + 1]);
+				break;
+		}
+
+		buf_set_u32(r->value, 0, 32, value);
+		r->valid = 1;
+		r->dirty = 0;
+	}
+
+	return ERROR_OK;
+}
+
 static int cortexm_dap_write_coreregister_u32(struct target *target,
 	uint32_t value, int regnum)
 {
@@ -425,6 +581,15 @@ static int cortex_m_debug_entry(struct target *target)
 	 * First load register accessible through core debug port */
 	int num_regs = arm->core_cache->num_regs;
 
+	/* DCRDR doubles as the emulated DCC channel, whose data would have to
+	 * be saved and restored around every register read */
+	if (!target->dbg_msg_enabled) {
+		retval = cortex_m_queue_read_all_regs(target);
+		if (retval != ERROR_OK)
+			LOG_DEBUG("queued register read failed, reading them one by one");
+	}
+
+	/* whatever is left */
 	for (i = 0; i < num_regs; i++) {
 		r = &armv7m->arm.core_cache->reg_list[i];
 		if (!r->valid)
@@ -495,6 +660,8 @@ static int cortex_m_poll(struct target *target)
 		target->state = TARGET_UNKNOWN;
 		return retval;
 	}
+	cortex_m->dcb_dhcsr |= cortex_m->dcb_dhcsr_sticky;
+	cortex_m->dcb_dhcsr_sticky = 0;
 
 	/* Recover from lockup.  See ARMv7-M architecture spec,
 	 * section B1.5.15 "Unrecoverable exception cases".
@@ -2142,6 +2309,74 @@ static int cortex_m_handle_target_request(void *priv)
 	return ERROR_OK;
 }
 
+/* PCSR reads per DAP queue flush while profiling */
+#define CORTEX_M_PCSR_BATCH	256
+
+/*
+ * Sample the PC through DWT_PCSR while the core keeps running.  PCSR is
+ * read in batches queued back to back, so the sample rate is bounded by
+ * the adapter rather than by round trips.  Cores without PCSR (it reads
+ * as zero) fall back to halting and resuming.
+ */
+static int cortex_m_profiling(struct target *target, struct target_profile *profile,
+		uint32_t seconds)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	uint32_t samples[CORTEX_M_PCSR_BATCH];
+	uint32_t sample_count = 0;
+	int retval;
+
+	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DWT_PCSR, &samples[0]);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while reading PCSR");
+		return retval;
+	}
+	if (samples[0] == 0) {
+		LOG_INFO("PCSR sampling not supported on this processor.");
+		return target_profiling_default(target, profile, seconds);
+	}
+
+	retval = target_resume(target, 1, 0, 0, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	LOG_INFO("Starting profiling. Sampling DWT_PCSR as fast as we can...");
+
+	int64_t timeout = timeval_ms() + seconds * 1000;
+
+	while (timeval_ms() < timeout) {
+		retval = ERROR_OK;
+		for (int i = 0; i < CORTEX_M_PCSR_BATCH && retval == ERROR_OK; i++)
+			retval = mem_ap_read_u32(armv7m->debug_ap, DWT_PCSR, &samples[i]);
+
+		/* run the queue even if queuing failed, the reads queued so
+		 * far store into samples[] */
+		int run_retval = dap_run(armv7m->debug_ap->dap);
+		if (retval == ERROR_OK)
+			retval = run_retval;
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error while reading PCSR");
+			return retval;
+		}
+
+		for (int i = 0; i < CORTEX_M_PCSR_BATCH; i++) {
+			/* all ones while the core is halted or sleeping */
+			if (samples[i] == 0xFFFFFFFF)
+				continue;
+			retval = target_profile_add_sample(profile, samples[i]);
+			if (retval != ERROR_OK)
+				return retval;
+			sample_count++;
+		}
+
+		keep_alive();
+	}
+
+	LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+
+	return ERROR_OK;
+}
+
 static int cortex_m_init_arch_info(struct target *target,
 	struct cortex_m_common *cortex_m, struct jtag_tap *tap)
 {
@@ -2451,6 +2686,8 @@ struct target_type cortexm_target = {
 	.add_watchpoint = cortex_m_add_watchpoint,
 	.remove_watchpoint = cortex_m_remove_watchpoint,
 
+	.profiling = cortex_m_profiling,
+
 	.commands = cortex_m_command_handlers,
 	.target_create = cortex_m_target_create,
 	.target_jim_configure = adiv5_jim_configure,
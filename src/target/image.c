@@ -32,6 +32,7 @@
 #include "image.h"
 #include "target.h"
 #include <helper/log.h>
+#include <helper/binarybuffer.h>
 
 /* convert ELF header field to host endianness */
 #define field16(elf, field) \
@@ -115,222 +116,377 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
-static int image_ihex_buffer_complete_inner(struct image *image,
-	char *lpszLine,
-	struct imagesection *section)
-{
-	struct image_ihex *ihex = image->type_private;
-	struct fileio *fileio = ihex->fileio;
-	uint32_t full_address = 0x0;
-	uint32_t cooked_bytes;
-	int i;
+/* A record of an IHEX or S19 image, pointing into the image text */
+struct image_record {
+	uint32_t type;
+	uint32_t address;
+	bool is_data;
+	const char *data;	/* hex digits of the data bytes */
+	uint32_t count;		/* number of data bytes */
+	const char *bytes;	/* hex digits of all the bytes covered by the checksum */
+	uint32_t num_bytes;	/* number of those bytes, including the checksum */
+};
 
-	/* we can't determine the number of sections that we'll have to create ahead of time,
-	 * so we locally hold them until parsing is finished */
+typedef int (*image_record_parser)(const char *line, size_t len,
+		struct image_record *record);
 
-	size_t filesize;
+/**
+ * Get the whole text of an IHEX or S19 image.  The file gets mapped when
+ * the host allows it, so that only the pages being decoded are resident.
+ */
+static int image_text_load(struct fileio *fileio, const char **text,
+		size_t *text_size, char **text_buffer)
+{
+	const uint8_t *data;
+	size_t size;
 	int retval;
-	retval = fileio_size(fileio, &filesize);
+
+	*text_buffer = NULL;
+
+	if (fileio_map(fileio, &data, &size) == ERROR_OK) {
+		*text = (const char *)data;
+		*text_size = size;
+		return ERROR_OK;
+	}
+
+	retval = fileio_size(fileio, &size);
 	if (retval != ERROR_OK)
 		return retval;
 
-	ihex->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
-	image->num_sections = 0;
-	section[image->num_sections].private = &ihex->buffer[cooked_bytes];
-	section[image->num_sections].base_address = 0x0;
-	section[image->num_sections].size = 0x0;
-	section[image->num_sections].flags = 0;
-
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-		uint32_t count;
-		uint32_t address;
-		uint32_t record_type;
-		uint32_t checksum;
-		uint8_t cal_checksum = 0;
-		size_t bytes_read = 0;
-
-		if (lpszLine[0] == '#')
-			continue;
+	*text_buffer = malloc(size + 1);
+	if (*text_buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
-		if (sscanf(&lpszLine[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-			&address, &record_type) != 3)
-			return ERROR_IMAGE_FORMAT_ERROR;
-		bytes_read += 9;
-
-		cal_checksum += (uint8_t)count;
-		cal_checksum += (uint8_t)(address >> 8);
-		cal_checksum += (uint8_t)address;
-		cal_checksum += (uint8_t)record_type;
-
-		if (record_type == 0) {	/* Data Record */
-			if ((full_address & 0xffff) != address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff0000) | address;
-				full_address = (full_address & 0xffff0000) | address;
-			}
+	retval = fileio_read(fileio, size, *text_buffer, text_size);
+	if (retval != ERROR_OK) {
+		free(*text_buffer);
+		*text_buffer = NULL;
+		return retval;
+	}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				ihex->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
-		} else if (record_type == 1) {	/* End of File Record */
-			/* finish the current section */
-			image->num_sections++;
+	*text = *text_buffer;
 
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
+	return ERROR_OK;
+}
 
-			return ERROR_OK;
-		} else if (record_type == 2) {	/* Linear Address Record */
-			uint16_t upper_address;
-
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
-
-			if ((full_address >> 4) != upper_address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 4);
-				full_address = (full_address & 0xffff) | (upper_address << 4);
-			}
-		} else if (record_type == 3) {	/* Start Segment Address Record */
-			uint32_t dummy;
+/* Find the line starting at text offset @a pos, without its line terminator
+ * and trailing white space, and move @a pos to the next line. */
+static bool image_text_next_line(const char *text, size_t size, size_t *pos,
+		const char **line, size_t *len)
+{
+	if (*pos >= size)
+		return false;
 
-			/* "Start Segment Address Record" will not be supported
-			 * but we must consume it, and do not create an error.  */
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
-		} else if (record_type == 4) {	/* Extended Linear Address Record */
-			uint16_t upper_address;
-
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
-
-			if ((full_address >> 16) != upper_address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 16);
-				full_address = (full_address & 0xffff) | (upper_address << 16);
-			}
-		} else if (record_type == 5) {	/* Start Linear Address Record */
-			uint32_t start_address;
+	const char *start = text + *pos;
+	const char *eol = memchr(start, '\n', size - *pos);
+	size_t n = eol ? (size_t)(eol - start) : size - *pos;
 
-			sscanf(&lpszLine[bytes_read], "%8" SCNx32, &start_address);
-			cal_checksum += (uint8_t)(start_address >> 24);
-			cal_checksum += (uint8_t)(start_address >> 16);
-			cal_checksum += (uint8_t)(start_address >> 8);
-			cal_checksum += (uint8_t)start_address;
-			bytes_read += 8;
+	*pos += eol ? n + 1 : n;
 
-			image->start_address_set = 1;
-			image->start_address = be_to_h_u32((uint8_t *)&start_address);
-		} else {
-			LOG_ERROR("unhandled IHEX record type: %i", (int)record_type);
-			return ERROR_IMAGE_FORMAT_ERROR;
-		}
+	while (n > 0 && isspace((unsigned char)start[n - 1]))
+		n--;
 
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
+	*line = start;
+	*len = n;
 
-		if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-			/* checksum failed */
-			LOG_ERROR("incorrect record checksum found in IHEX file");
-			return ERROR_IMAGE_CHECKSUM;
+	return true;
+}
+
+static bool image_text_hex(const char *hex, unsigned digits, uint32_t *value)
+{
+	uint32_t result = 0;
+
+	for (unsigned i = 0; i < digits; i++) {
+		char c = hex[i];
+
+		if (c >= '0' && c <= '9')
+			result = (result << 4) | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			result = (result << 4) | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			result = (result << 4) | (c - 'A' + 10);
+		else
+			return false;
+	}
+
+	*value = result;
+
+	return true;
+}
+
+/* The bytes of a record, checksum included, must add up to @a sum */
+static int image_text_verify_record(const struct image_record *record, uint8_t sum)
+{
+	uint8_t bytes[256 + 4];
+	uint8_t cal_checksum = 0;
+
+	if (unhexify(bytes, record->bytes, record->num_bytes) != record->num_bytes)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	for (uint32_t i = 0; i < record->num_bytes; i++)
+		cal_checksum += bytes[i];
+
+	return (cal_checksum == sum) ? ERROR_OK : ERROR_IMAGE_CHECKSUM;
+}
+
+/* we can't determine the number of sections that we'll have to create ahead
+ * of time, so the section arrays grow while the records are scanned */
+static int image_text_new_section(struct image *image,
+		struct image_text_section **text_sections, int *max_sections, size_t start)
+{
+	if (image->num_sections == *max_sections) {
+		int new_max = *max_sections ? *max_sections * 2 : 16;
+		struct imagesection *new_sections;
+		struct image_text_section *new_text_sections;
+
+		new_sections = realloc(image->sections, new_max * sizeof(*new_sections));
+		if (new_sections == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
 		}
+		image->sections = new_sections;
+
+		new_text_sections = realloc(*text_sections, new_max * sizeof(*new_text_sections));
+		if (new_text_sections == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		*text_sections = new_text_sections;
+
+		*max_sections = new_max;
 	}
 
-	LOG_ERROR("premature end of IHEX file, no end-of-file record found");
-	return ERROR_IMAGE_FORMAT_ERROR;
+	struct imagesection *section = &image->sections[image->num_sections];
+	section->base_address = 0x0;
+	section->size = 0x0;
+	section->flags = 0;
+	section->private = NULL;
+
+	struct image_text_section *text_section = &(*text_sections)[image->num_sections];
+	text_section->start = start;
+	text_section->end = start;
+	text_section->cursor = start;
+	text_section->cursor_offset = 0;
+
+	image->num_sections++;
+
+	return ERROR_OK;
+}
+
+/* start a new section at a nonconsecutive location, unless the current
+ * section has zero size, in which case this specifies the current section's
+ * base address */
+static int image_text_set_base(struct image *image,
+		struct image_text_section **text_sections, int *max_sections,
+		size_t line_start, uint32_t base_address)
+{
+	if (image->sections[image->num_sections - 1].size != 0) {
+		(*text_sections)[image->num_sections - 1].end = line_start;
+
+		int retval = image_text_new_section(image, text_sections, max_sections, line_start);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	image->sections[image->num_sections - 1].base_address = base_address;
+
+	return ERROR_OK;
+}
+
+static void image_text_finish(struct image *image,
+		struct image_text_section *text_sections, size_t end)
+{
+	text_sections[image->num_sections - 1].end = end;
+
+	for (int i = 0; i < image->num_sections; i++)
+		image->sections[i].private = &text_sections[i];
+}
+
+static void image_text_discard(struct image *image,
+		struct image_text_section *text_sections)
+{
+	free(text_sections);
+	free(image->sections);
+	image->sections = NULL;
+	image->num_sections = 0;
 }
 
 /**
- * Allocate memory dynamically instead of on the stack. This
- * is important w/embedded hosts.
+ * Decode a part of a section of a text image.  The records of the section
+ * are walked from a cursor left behind by the previous read, so reading a
+ * section front to back in pieces decodes every record only once.
  */
-static int image_ihex_buffer_complete(struct image *image)
+static int image_text_read_section(struct image *image,
+	int section,
+	uint32_t offset,
+	uint32_t size,
+	uint8_t *buffer,
+	size_t *size_read,
+	const char *text,
+	image_record_parser parse_record)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
+	struct image_text_section *text_section = image->sections[section].private;
+
+	*size_read = 0;
+
+	if (offset < text_section->cursor_offset) {
+		text_section->cursor = text_section->start;
+		text_section->cursor_offset = 0;
 	}
-	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (section == NULL) {
-		free(lpszLine);
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
+
+	while (size > 0) {
+		struct image_record record;
+		size_t pos = text_section->cursor;
+		const char *line;
+		size_t len;
+
+		if (!image_text_next_line(text, text_section->end, &pos, &line, &len)) {
+			LOG_ERROR("BUG: section %d ends before its last record", section);
+			return ERROR_FAIL;
+		}
+
+		/* the records have been checked when the image was opened, what
+		 * fails to parse now is a comment or an empty line */
+		if (parse_record(line, len, &record) == ERROR_OK && record.is_data) {
+			uint32_t record_end = text_section->cursor_offset + record.count;
+
+			if (offset < record_end) {
+				uint32_t skip = offset - text_section->cursor_offset;
+				uint32_t n = MIN(record.count - skip, size);
+
+				unhexify(buffer, record.data + 2 * skip, n);
+				buffer += n;
+				offset += n;
+				size -= n;
+				*size_read += n;
+
+				/* leave the cursor on a partially read record */
+				if (offset < record_end)
+					break;
+			}
+
+			text_section->cursor_offset = record_end;
+		}
+
+		text_section->cursor = pos;
 	}
+
+	return ERROR_OK;
+}
+
+static int image_ihex_parse_record(const char *line, size_t len,
+		struct image_record *record)
+{
+	uint32_t count;
+
+	/* ":" count address(2 bytes) type data(count bytes) checksum */
+	if (len < 11 || line[0] != ':'
+		|| !image_text_hex(line + 1, 2, &count)
+		|| len < 11 + 2 * count
+		|| !image_text_hex(line + 3, 4, &record->address)
+		|| !image_text_hex(line + 7, 2, &record->type))
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	record->is_data = (record->type == 0);
+	record->data = line + 9;
+	record->count = count;
+	record->bytes = line + 1;
+	record->num_bytes = count + 5;
+
+	return ERROR_OK;
+}
+
+static int image_ihex_scan(struct image *image)
+{
+	struct image_ihex *ihex = image->type_private;
+	struct image_text_section *text_sections = NULL;
+	int max_sections = 0;
+	uint32_t full_address = 0x0;
+	size_t pos = 0;
 	int retval;
 
-	retval = image_ihex_buffer_complete_inner(image, lpszLine, section);
+	image->num_sections = 0;
+	image->sections = NULL;
+
+	retval = image_text_new_section(image, &text_sections, &max_sections, 0);
+
+	while (retval == ERROR_OK) {
+		struct image_record record;
+		size_t line_start = pos;
+		const char *line;
+		size_t len;
 
-	free(section);
-	free(lpszLine);
+		if (!image_text_next_line(ihex->text, ihex->text_size, &pos, &line, &len)) {
+			LOG_ERROR("premature end of IHEX file, no end-of-file record found");
+			retval = ERROR_IMAGE_FORMAT_ERROR;
+			break;
+		}
+
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		retval = image_ihex_parse_record(line, len, &record);
+		if (retval != ERROR_OK)
+			break;
+
+		if (record.type == 1) {	/* End of File Record */
+			image_text_finish(image, text_sections, line_start);
+			ihex->sections = text_sections;
+			return ERROR_OK;
+		}
+
+		retval = image_text_verify_record(&record, 0x00);
+		if (retval == ERROR_IMAGE_CHECKSUM)
+			LOG_ERROR("incorrect record checksum found in IHEX file");
+		if (retval != ERROR_OK)
+			break;
+
+		if (record.type == 0) {	/* Data Record */
+			if ((full_address & 0xffff) != record.address) {
+				full_address = (full_address & 0xffff0000) | record.address;
+				retval = image_text_set_base(image, &text_sections, &max_sections,
+						line_start, full_address);
+			}
+
+			image->sections[image->num_sections - 1].size += record.count;
+			full_address += record.count;
+		} else if (record.type == 2 || record.type == 4) {
+			/* (Extended) Linear Address Record */
+			uint32_t upper_address;
+			unsigned shift = (record.type == 2) ? 4 : 16;
+
+			if (record.count < 2 || !image_text_hex(record.data, 4, &upper_address)) {
+				retval = ERROR_IMAGE_FORMAT_ERROR;
+				break;
+			}
+
+			if ((full_address >> shift) != upper_address) {
+				full_address = (full_address & 0xffff) | (upper_address << shift);
+				retval = image_text_set_base(image, &text_sections, &max_sections,
+						line_start, full_address);
+			}
+		} else if (record.type == 3) {	/* Start Segment Address Record */
+			/* "Start Segment Address Record" will not be supported
+			 * but we must consume it, and do not create an error.  */
+		} else if (record.type == 5) {	/* Start Linear Address Record */
+			uint32_t start_address;
+
+			if (record.count < 4 || !image_text_hex(record.data, 8, &start_address)) {
+				retval = ERROR_IMAGE_FORMAT_ERROR;
+				break;
+			}
+
+			image->start_address_set = 1;
+			image->start_address = start_address;
+		} else {
+			LOG_ERROR("unhandled IHEX record type: %i", (int)record.type);
+			retval = ERROR_IMAGE_FORMAT_ERROR;
+		}
+	}
+
+	image_text_discard(image, text_sections);
 
 	return retval;
 }
@@ -484,15 +640,20 @@ static int image_elf_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zu at 0x%" PRIx32 "", read_size,
 			field32(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
-			return retval;
+		uint64_t file_offset = (uint64_t)field32(elf, segment->p_offset) + offset;
+		if (elf->data && file_offset + read_size <= elf->data_size) {
+			memcpy(buffer, elf->data + file_offset, read_size);
+		} else {
+			retval = fileio_seek(elf->fileio, file_offset);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot find ELF segment content, seek failed");
+				return retval;
+			}
+			retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot read ELF segment content, read failed");
+				return retval;
+			}
 		}
 		size -= read_size;
 		*size_read += read_size;
@@ -504,187 +665,113 @@ static int image_elf_read_section(struct image *image,
 	return ERROR_OK;
 }
 
-static int image_mot_buffer_complete_inner(struct image *image,
-	char *lpszLine,
-	struct imagesection *section)
+static int image_mot_parse_record(const char *line, size_t len,
+		struct image_record *record)
 {
-	struct image_mot *mot = image->type_private;
-	struct fileio *fileio = mot->fileio;
-	uint32_t full_address = 0x0;
-	uint32_t cooked_bytes;
-	int i;
-
-	/* we can't determine the number of sections that we'll have to create ahead of time,
-	 * so we locally hold them until parsing is finished */
-
-	int retval;
-	size_t filesize;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
+	uint32_t count;
+	unsigned address_bytes;
+
+	/* "S" type count address data checksum, count covers all but the type */
+	if (len < 4 || line[0] != 'S'
+		|| !image_text_hex(line + 1, 1, &record->type)
+		|| !image_text_hex(line + 2, 2, &count)
+		|| len < 4 + 2 * count)
+		return ERROR_IMAGE_FORMAT_ERROR;
 
-	mot->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
-	image->num_sections = 0;
-	section[image->num_sections].private = &mot->buffer[cooked_bytes];
-	section[image->num_sections].base_address = 0x0;
-	section[image->num_sections].size = 0x0;
-	section[image->num_sections].flags = 0;
-
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-		uint32_t count;
-		uint32_t address;
-		uint32_t record_type;
-		uint32_t checksum;
-		uint8_t cal_checksum = 0;
-		uint32_t bytes_read = 0;
-
-		/* get record type and record length */
-		if (sscanf(&lpszLine[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-			&count) != 2)
+	switch (record->type) {
+		case 0:	/* S0 - starting record (optional) */
+		case 1:	/* S1 - 16 bit address data record */
+		case 5:	/* S5 - data count record */
+		case 9:
+			address_bytes = 2;
+			break;
+		case 2:	/* S2 - 24 bit address data record */
+		case 8:
+			address_bytes = 3;
+			break;
+		case 3:	/* S3 - 32 bit address data record */
+		case 7:	/* S7, S8, S9 - ending records for 32, 24 and 16bit */
+			address_bytes = 4;
+			break;
+		default:
+			LOG_ERROR("unhandled S19 record type: %i", (int)record->type);
 			return ERROR_IMAGE_FORMAT_ERROR;
+	}
 
-		bytes_read += 4;
-		cal_checksum += (uint8_t)count;
+	if (count < address_bytes + 1
+		|| !image_text_hex(line + 4, 2 * address_bytes, &record->address))
+		return ERROR_IMAGE_FORMAT_ERROR;
 
-		/* skip checksum byte */
-		count -= 1;
+	record->is_data = (record->type >= 1 && record->type <= 3);
+	record->data = line + 4 + 2 * address_bytes;
+	record->count = count - address_bytes - 1;
+	record->bytes = line + 2;
+	record->num_bytes = count + 1;
 
-		if (record_type == 0) {
-			/* S0 - starting record (optional) */
-			int iValue;
+	return ERROR_OK;
+}
 
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2x", &iValue);
-				cal_checksum += (uint8_t)iValue;
-				bytes_read += 2;
-			}
-		} else if (record_type >= 1 && record_type <= 3) {
-			switch (record_type) {
-				case 1:
-					/* S1 - 16 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%4" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 4;
-					count -= 2;
-					break;
+static int image_mot_scan(struct image *image)
+{
+	struct image_mot *mot = image->type_private;
+	struct image_text_section *text_sections = NULL;
+	int max_sections = 0;
+	uint32_t full_address = 0x0;
+	size_t pos = 0;
+	int retval;
 
-				case 2:
-					/* S2 - 24 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%6" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 6;
-					count -= 3;
-					break;
+	image->num_sections = 0;
+	image->sections = NULL;
 
-				case 3:
-					/* S3 - 32 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%8" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 24);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 8;
-					count -= 4;
-					break;
+	retval = image_text_new_section(image, &text_sections, &max_sections, 0);
 
-			}
+	while (retval == ERROR_OK) {
+		struct image_record record;
+		size_t line_start = pos;
+		const char *line;
+		size_t len;
 
-			if (full_address != address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&mot->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address = address;
-				full_address = address;
-			}
+		if (!image_text_next_line(mot->text, mot->text_size, &pos, &line, &len)) {
+			LOG_ERROR("premature end of S19 file, no end-of-file record found");
+			retval = ERROR_IMAGE_FORMAT_ERROR;
+			break;
+		}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				mot->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
-		} else if (record_type == 5) {
-			/* S5 is the data count record, we ignore it */
-			uint32_t dummy;
-
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
-		} else if (record_type >= 7 && record_type <= 9) {
-			/* S7, S8, S9 - ending records for 32, 24 and 16bit */
-			image->num_sections++;
+		if (len == 0)
+			continue;
 
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
+		retval = image_mot_parse_record(line, len, &record);
+		if (retval != ERROR_OK)
+			break;
 
+		if (record.type >= 7 && record.type <= 9) {
+			image_text_finish(image, text_sections, line_start);
+			mot->sections = text_sections;
 			return ERROR_OK;
-		} else {
-			LOG_ERROR("unhandled S19 record type: %i", (int)(record_type));
-			return ERROR_IMAGE_FORMAT_ERROR;
 		}
 
 		/* account for checksum, will always be 0xFF */
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-		cal_checksum += (uint8_t)checksum;
-
-		if (cal_checksum != 0xFF) {
-			/* checksum failed */
+		retval = image_text_verify_record(&record, 0xff);
+		if (retval == ERROR_IMAGE_CHECKSUM)
 			LOG_ERROR("incorrect record checksum found in S19 file");
-			return ERROR_IMAGE_CHECKSUM;
-		}
-	}
+		if (retval != ERROR_OK)
+			break;
 
-	LOG_ERROR("premature end of S19 file, no end-of-file record found");
-	return ERROR_IMAGE_FORMAT_ERROR;
-}
+		/* S0 and S5 are checked and otherwise ignored */
+		if (!record.is_data)
+			continue;
 
-/**
- * Allocate memory dynamically instead of on the stack. This
- * is important w/embedded hosts.
- */
-static int image_mot_buffer_complete(struct image *image)
-{
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
-	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (section == NULL) {
-		free(lpszLine);
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
-	int retval;
+		if (full_address != record.address) {
+			full_address = record.address;
+			retval = image_text_set_base(image, &text_sections, &max_sections,
+					line_start, full_address);
+		}
 
-	retval = image_mot_buffer_complete_inner(image, lpszLine, section);
+		image->sections[image->num_sections - 1].size += record.count;
+		full_address += record.count;
+	}
 
-	free(section);
-	free(lpszLine);
+	image_text_discard(image, text_sections);
 
 	return retval;
 }
@@ -712,6 +799,10 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			return retval;
 		}
 
+		size_t mapped_size;
+		if (fileio_map(image_binary->fileio, &image_binary->data, &mapped_size) != ERROR_OK)
+			image_binary->data = NULL;
+
 		image->num_sections = 1;
 		image->sections = malloc(sizeof(struct imagesection));
 		image->sections[0].base_address = 0x0;
@@ -726,10 +817,14 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_ihex_buffer_complete(image);
+		retval = image_text_load(image_ihex->fileio, &image_ihex->text,
+				&image_ihex->text_size, &image_ihex->text_buffer);
+		if (retval == ERROR_OK)
+			retval = image_ihex_scan(image);
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
-				"failed buffering IHEX image, check server output for additional information");
+				"failed parsing IHEX image, check server output for additional information");
+			free(image_ihex->text_buffer);
 			fileio_close(image_ihex->fileio);
 			return retval;
 		}
@@ -747,6 +842,10 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			fileio_close(image_elf->fileio);
 			return retval;
 		}
+
+		/* segments are copied straight from the mapping when there is one */
+		if (fileio_map(image_elf->fileio, &image_elf->data, &image_elf->data_size) != ERROR_OK)
+			image_elf->data = NULL;
 	} else if (image->type == IMAGE_MEMORY) {
 		struct target *target = get_target(url);
 
@@ -777,10 +876,14 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_mot_buffer_complete(image);
+		retval = image_text_load(image_mot->fileio, &image_mot->text,
+				&image_mot->text_size, &image_mot->text_buffer);
+		if (retval == ERROR_OK)
+			retval = image_mot_scan(image);
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
-				"failed buffering S19 image, check server output for additional information");
+				"failed parsing S19 image, check server output for additional information");
+			free(image_mot->text_buffer);
 			fileio_close(image_mot->fileio);
 			return retval;
 		}
@@ -788,7 +891,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image->num_sections = 0;
 		image->base_address_set = 0;
 		image->sections = NULL;
-		image->type_private = NULL;
+		image->type_private = calloc(1, sizeof(struct image_builder));
+		if (image->type_private == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
 	}
 
 	if (image->base_address_set) {
@@ -832,6 +939,12 @@ int image_read_section(struct image *image,
 		if (section != 0)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 
+		if (image_binary->data) {
+			memcpy(buffer, image_binary->data + offset, size);
+			*size_read = size;
+			return ERROR_OK;
+		}
+
 		/* seek to offset */
 		retval = fileio_seek(image_binary->fileio, offset);
 		if (retval != ERROR_OK)
@@ -842,10 +955,10 @@ int image_read_section(struct image *image,
 		if (retval != ERROR_OK)
 			return retval;
 	} else if (image->type == IMAGE_IHEX) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		struct image_ihex *image_ihex = image->type_private;
 
-		return ERROR_OK;
+		return image_text_read_section(image, section, offset, size, buffer, size_read,
+				image_ihex->text, image_ihex_parse_record);
 	} else if (image->type == IMAGE_ELF)
 		return image_elf_read_section(image, section, offset, size, buffer, size_read);
 	else if (image->type == IMAGE_MEMORY) {
@@ -887,53 +1000,188 @@ int image_read_section(struct image *image,
 			address += (size_in_cache > size) ? size : size_in_cache;
 		}
 	} else if (image->type == IMAGE_SRECORD) {
+		struct image_mot *image_mot = image->type_private;
+
+		return image_text_read_section(image, section, offset, size, buffer, size_read,
+				image_mot->text, image_mot_parse_record);
+	} else if (image->type == IMAGE_BUILDER) {
 		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
 		*size_read = size;
 
 		return ERROR_OK;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * Get a section's contents without copying them, for the image types that
+ * hold them in memory as they are: mapped binary and ELF files, and images
+ * being built.  The data stays valid until image_close().
+ *
+ * @returns ERROR_IMAGE_TEMPORARILY_UNAVAILABLE if the data has to be read
+ * with image_read_section() instead.
+ */
+int image_section_data(struct image *image,
+	int section,
+	uint32_t offset,
+	uint32_t size,
+	const uint8_t **data)
+{
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (image_binary->data) {
+			*data = image_binary->data + offset;
+			return ERROR_OK;
+		}
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		Elf32_Phdr *segment = (Elf32_Phdr *)image->sections[section].private;
+		uint64_t file_offset = (uint64_t)field32(elf, segment->p_offset) + offset;
+
+		if (elf->data && file_offset + size <= elf->data_size) {
+			*data = elf->data + file_offset;
+			return ERROR_OK;
+		}
 	} else if (image->type == IMAGE_BUILDER) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		*data = (uint8_t *)image->sections[section].private + offset;
+		return ERROR_OK;
+	}
+
+	return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+}
+
+/* Make room for @a size bytes of data in section @a i of an image being
+ * built, growing it geometrically so that appending is cheap. */
+static int image_builder_reserve(struct image *image, int i, uint32_t size)
+{
+	struct image_builder *builder = image->type_private;
 
+	if (size <= builder->alloc[i])
 		return ERROR_OK;
+
+	uint32_t alloc = MAX(size, builder->alloc[i] + builder->alloc[i] / 2);
+	void *data = realloc(image->sections[i].private, alloc);
+	if (data == NULL) {
+		LOG_ERROR("Out of memory for image section");
+		return ERROR_FAIL;
 	}
 
+	image->sections[i].private = data;
+	builder->alloc[i] = alloc;
+
 	return ERROR_OK;
 }
 
+static void image_builder_remove(struct image *image, int i)
+{
+	struct image_builder *builder = image->type_private;
+	int tail = image->num_sections - i - 1;
+
+	free(image->sections[i].private);
+	memmove(&image->sections[i], &image->sections[i + 1], tail * sizeof(*image->sections));
+	memmove(&builder->alloc[i], &builder->alloc[i + 1], tail * sizeof(*builder->alloc));
+	image->num_sections--;
+}
+
 int image_add_section(struct image *image, uint32_t base, uint32_t size, int flags, uint8_t const *data)
 {
+	struct image_builder *builder = image->type_private;
 	struct imagesection *section;
 
 	/* only image builder supports adding sections */
 	if (image->type != IMAGE_BUILDER)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	/* see if there's a previous section */
-	if (image->num_sections) {
-		section = &image->sections[image->num_sections - 1];
-
-		/* see if it's enough to extend the last section,
-		 * adding data to previous sections or merging is not supported */
-		if (((section->base_address + section->size) == base) &&
-			(section->flags == flags)) {
-			section->private = realloc(section->private, section->size + size);
-			memcpy((uint8_t *)section->private + section->size, data, size);
-			section->size += size;
-			return ERROR_OK;
+	if (size == 0)
+		return ERROR_OK;
+
+	/* find the first section after the new data */
+	int lo = 0, hi = image->num_sections;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (image->sections[mid].base_address <= base)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	struct imagesection *prev = lo > 0 ? &image->sections[lo - 1] : NULL;
+	struct imagesection *next = lo < image->num_sections ? &image->sections[lo] : NULL;
+	bool joins_prev = prev && prev->base_address + prev->size == base && prev->flags == flags;
+	bool joins_next = next && base + size == next->base_address && next->flags == flags;
+
+	if (joins_prev) {
+		/* the common case: data following the last write */
+		uint32_t new_size = prev->size + size + (joins_next ? next->size : 0);
+		if (image_builder_reserve(image, lo - 1, new_size) != ERROR_OK)
+			return ERROR_FAIL;
+
+		prev = &image->sections[lo - 1];
+		memcpy((uint8_t *)prev->private + prev->size, data, size);
+		prev->size += size;
+
+		if (joins_next) {
+			memcpy((uint8_t *)prev->private + prev->size, image->sections[lo].private,
+					image->sections[lo].size);
+			prev->size += image->sections[lo].size;
+			image_builder_remove(image, lo);
 		}
+
+		return ERROR_OK;
+	}
+
+	if (joins_next) {
+		if (image_builder_reserve(image, lo, next->size + size) != ERROR_OK)
+			return ERROR_FAIL;
+
+		next = &image->sections[lo];
+		memmove((uint8_t *)next->private + size, next->private, next->size);
+		memcpy(next->private, data, size);
+		next->base_address = base;
+		next->size += size;
+
+		return ERROR_OK;
 	}
 
 	/* allocate new section */
+	if (image->num_sections == builder->max_sections) {
+		int max = builder->max_sections ? builder->max_sections * 2 : 8;
+		struct imagesection *sections = realloc(image->sections, max * sizeof(*sections));
+		uint32_t *alloc = realloc(builder->alloc, max * sizeof(*alloc));
+		if (sections)
+			image->sections = sections;
+		if (alloc)
+			builder->alloc = alloc;
+		if (sections == NULL || alloc == NULL) {
+			LOG_ERROR("Out of memory for image section");
+			return ERROR_FAIL;
+		}
+		builder->max_sections = max;
+	}
+
+	void *section_data = malloc(size);
+	if (section_data == NULL) {
+		LOG_ERROR("Out of memory for image section");
+		return ERROR_FAIL;
+	}
+	memcpy(section_data, data, size);
+
+	int tail = image->num_sections - lo;
+	memmove(&image->sections[lo + 1], &image->sections[lo], tail * sizeof(*image->sections));
+	memmove(&builder->alloc[lo + 1], &builder->alloc[lo], tail * sizeof(*builder->alloc));
 	image->num_sections++;
-	image->sections =
-		realloc(image->sections, sizeof(struct imagesection) * image->num_sections);
-	section = &image->sections[image->num_sections - 1];
+
+	section = &image->sections[lo];
 	section->base_address = base;
 	section->size = size;
 	section->flags = flags;
-	section->private = malloc(sizeof(uint8_t) * size);
-	memcpy((uint8_t *)section->private, data, size);
+	section->private = section_data;
+	builder->alloc[lo] = size;
 
 	return ERROR_OK;
 }
@@ -949,10 +1197,11 @@ void image_close(struct image *image)
 
 		fileio_close(image_ihex->fileio);
 
-		if (image_ihex->buffer) {
-			free(image_ihex->buffer);
-			image_ihex->buffer = NULL;
-		}
+		free(image_ihex->text_buffer);
+		image_ihex->text_buffer = NULL;
+
+		free(image_ihex->sections);
+		image_ihex->sections = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
 
@@ -979,17 +1228,22 @@ void image_close(struct image *image)
 
 		fileio_close(image_mot->fileio);
 
-		if (image_mot->buffer) {
-			free(image_mot->buffer);
-			image_mot->buffer = NULL;
-		}
+		free(image_mot->text_buffer);
+		image_mot->text_buffer = NULL;
+
+		free(image_mot->sections);
+		image_mot->sections = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
+		struct image_builder *builder = image->type_private;
 		int i;
 
 		for (i = 0; i < image->num_sections; i++) {
 			free(image->sections[i].private);
 			image->sections[i].private = NULL;
 		}
+
+		free(builder->alloc);
+		builder->alloc = NULL;
 	}
 
 	if (image->type_private) {
@@ -1003,37 +1257,75 @@ void image_close(struct image *image)
 	}
 }
 
-int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
-{
-	uint32_t crc = 0xffffffff;
-	LOG_DEBUG("Calculating checksum");
-
-	static uint32_t crc32_table[256];
+/* CRC tables for slice-by-8: crc32_table[0] is the classic byte at a time
+ * table, crc32_table[k] advances a byte through k further zero bytes. */
+static uint32_t crc32_table[8][256];
 
+static void image_crc32_init(void)
+{
 	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		int i, j;
-		unsigned int c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
+	if (first_init)
+		return;
+
+	/* Initialize the CRC table and the decoding table.  */
+	int i, j;
+	unsigned int c;
+	for (i = 0; i < 256; i++) {
+		/* as per gdb */
+		for (c = (unsigned int)i << 24, j = 8; j > 0; --j)
+			c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		crc32_table[0][i] = c;
+	}
+
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			c = crc32_table[j - 1][i];
+			crc32_table[j][i] = (c << 8) ^ crc32_table[0][c >> 24];
 		}
+	}
+
+	first_init = true;
+}
+
+/* Same CRC as gdb's "compare-sections", eight bytes per step */
+static uint32_t image_crc32(uint32_t crc, const uint8_t *buffer, uint32_t nbytes)
+{
+	while (nbytes >= 8) {
+		crc ^= be_to_h_u32(buffer);
+		crc = crc32_table[7][crc >> 24] ^
+			crc32_table[6][(crc >> 16) & 255] ^
+			crc32_table[5][(crc >> 8) & 255] ^
+			crc32_table[4][crc & 255] ^
+			crc32_table[3][buffer[4]] ^
+			crc32_table[2][buffer[5]] ^
+			crc32_table[1][buffer[6]] ^
+			crc32_table[0][buffer[7]];
+		buffer += 8;
+		nbytes -= 8;
+	}
 
-		first_init = true;
+	while (nbytes--) {
+		/* as per gdb */
+		crc = (crc << 8) ^ crc32_table[0][((crc >> 24) ^ *buffer++) & 255];
 	}
 
+	return crc;
+}
+
+int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+{
+	uint32_t crc = 0xffffffff;
+	LOG_DEBUG("Calculating checksum");
+
+	image_crc32_init();
+
 	while (nbytes > 0) {
-		int run = nbytes;
+		uint32_t run = nbytes;
 		if (run > 32768)
 			run = 32768;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
+		crc = image_crc32(crc, buffer, run);
+		buffer += run;
 		keep_alive();
 	}
 
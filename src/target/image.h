@@ -32,7 +32,6 @@
 #endif
 
 #define IMAGE_MAX_ERROR_STRING		(256)
-#define IMAGE_MAX_SECTIONS			(512)
 
 #define IMAGE_MEMORY_CACHE_SIZE		(2048)
 
@@ -65,11 +64,25 @@ struct image {
 
 struct image_binary {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file content, NULL if not mapped */
+};
+
+/* A section of a text (IHEX or S19) image.  Only the extent of its records
+ * is determined when the image is opened, the data gets decoded from the
+ * text when the section is read. */
+struct image_text_section {
+	size_t start;		/* text offset of the first record of the section */
+	size_t end;			/* text offset just past its last record */
+	size_t cursor;		/* text offset of the next record to decode */
+	uint32_t cursor_offset;	/* section offset of the data in that record */
 };
 
 struct image_ihex {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	const char *text;	/* file content, mapped or read into text_buffer */
+	size_t text_size;
+	char *text_buffer;
+	struct image_text_section *sections;
 };
 
 struct image_memory {
@@ -80,6 +93,8 @@ struct image_memory {
 
 struct image_elf {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file content, NULL if not mapped */
+	size_t data_size;
 	Elf32_Ehdr *header;
 	Elf32_Phdr *segments;
 	uint32_t segment_count;
@@ -88,18 +103,31 @@ struct image_elf {
 
 struct image_mot {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	const char *text;	/* file content, mapped or read into text_buffer */
+	size_t text_size;
+	char *text_buffer;
+	struct image_text_section *sections;
+};
+
+/* Sections of an image being built are kept sorted by address, and data
+ * added right behind or in front of a section is merged into it, so
+ * that a stream of small writes ends up as a few large sections. */
+struct image_builder {
+	int max_sections;		/* allocated entries of image->sections */
+	uint32_t *alloc;		/* allocated bytes of each section's data */
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, uint32_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+int image_section_data(struct image *image, int section, uint32_t offset,
+		uint32_t size, const uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, uint32_t base, uint32_t size,
 		int flags, uint8_t const *data);
 
-int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes,
+int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes,
 		uint32_t *checksum);
 
 #define ERROR_IMAGE_FORMAT_ERROR	(-1400)
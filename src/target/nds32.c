@@ -2492,22 +2492,28 @@ int nds32_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, b
 	return ERROR_OK;
 }
 
-int nds32_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+int nds32_profiling(struct target *target, struct target_profile *profile,
+			uint32_t seconds)
 {
 	/* sample $PC every 10 milliseconds */
 	uint32_t iteration = seconds * 100;
 	struct aice_port_s *aice = target_to_aice(target);
 	struct nds32 *nds32 = target_to_nds32(target);
+	uint32_t num_samples = 0;
 
-	if (max_num_samples < iteration)
-		iteration = max_num_samples;
+	uint32_t *samples = malloc(iteration * sizeof(uint32_t));
+	if (samples == NULL)
+		return ERROR_FAIL;
 
 	int pc_regnum = nds32->register_map(nds32, PC);
-	aice_profiling(aice, 10, iteration, pc_regnum, samples, num_samples);
+	aice_profiling(aice, 10, iteration, pc_regnum, samples, &num_samples);
 
 	register_cache_invalidate(nds32->core_cache);
 
+	for (uint32_t i = 0; i < num_samples; i++)
+		target_profile_add_sample(profile, samples[i]);
+	free(samples);
+
 	return ERROR_OK;
 }
 
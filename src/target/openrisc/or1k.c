@@ -1209,8 +1209,8 @@ static int or1k_checksum_memory(struct target *target, uint32_t address,
 	return ERROR_FAIL;
 }
 
-static int or1k_profiling(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+static int or1k_profiling(struct target *target, struct target_profile *profile,
+		uint32_t seconds)
 {
 	struct timeval timeout, now;
 	struct or1k_common *or1k = target_to_or1k(target);
@@ -1242,17 +1242,18 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 			return retval;
 		}
 
-		samples[sample_count++] = reg_value;
+		retval = target_profile_add_sample(profile, reg_value);
+		if (retval != ERROR_OK)
+			return retval;
+		sample_count++;
 
 		gettimeofday(&now, NULL);
-		if ((sample_count >= max_num_samples) ||
-			((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec))) {
+		if ((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec)) {
 			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
 
-	*num_samples = sample_count;
 	return retval;
 }
 
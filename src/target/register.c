@@ -36,7 +36,174 @@
  * may be separate registers associated with debug or trace modules.
  */
 
-struct reg *register_get_by_name(struct reg_cache *first,
+/*
+ * Name lookups are served from an index per chain of caches, built on
+ * first use.  It holds all registers of the chain in order, for lookups
+ * by ordinal number, and an open addressing hash table of their names.
+ * Every index remembers the caches it was built from and is rebuilt when
+ * the chain no longer matches, so it never hands out a register of a
+ * cache that was unlinked or reallocated.  Linking and unlinking caches
+ * drops all indexes, they are cheap to rebuild.
+ */
+struct reg_index_cache {
+	const struct reg_cache *cache;
+	const struct reg *reg_list;
+	unsigned num_regs;
+};
+
+struct reg_index {
+	struct reg_cache *first;
+	struct reg_index_cache *caches;
+	unsigned num_caches;
+
+	struct reg **regs;			/* all registers of the chain, in order */
+	unsigned num_regs;
+
+	unsigned *hash;				/* index into regs[] plus one, 0 if empty */
+	unsigned hash_mask;
+
+	struct reg_index *next;
+};
+
+static struct reg_index *reg_indexes;
+
+static unsigned register_name_hash(const char *name)
+{
+	/* FNV-1a */
+	unsigned h = 2166136261u;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static void register_index_free(struct reg_index *index)
+{
+	free(index->caches);
+	free(index->regs);
+	free(index->hash);
+	free(index);
+}
+
+static void register_index_drop_all(void)
+{
+	while (reg_indexes) {
+		struct reg_index *next = reg_indexes->next;
+		register_index_free(reg_indexes);
+		reg_indexes = next;
+	}
+}
+
+/* Does the chain still consist of the caches the index was built from? */
+static bool register_index_is_current(const struct reg_index *index)
+{
+	const struct reg_cache *cache = index->first;
+
+	for (unsigned i = 0; i < index->num_caches; i++, cache = cache->next) {
+		if (cache != index->caches[i].cache
+				|| cache->reg_list != index->caches[i].reg_list
+				|| cache->num_regs != index->caches[i].num_regs)
+			return false;
+	}
+
+	return cache == NULL;
+}
+
+static struct reg_index *register_index_build(struct reg_cache *first)
+{
+	struct reg_index *index = calloc(1, sizeof(*index));
+	if (index == NULL)
+		return NULL;
+
+	index->first = first;
+
+	for (struct reg_cache *cache = first; cache; cache = cache->next) {
+		index->num_caches++;
+		index->num_regs += cache->num_regs;
+	}
+
+	unsigned hash_size = 16;
+	while (hash_size < 2 * index->num_regs)
+		hash_size *= 2;
+	index->hash_mask = hash_size - 1;
+
+	index->caches = malloc(index->num_caches * sizeof(*index->caches));
+	index->regs = malloc((index->num_regs ? index->num_regs : 1) * sizeof(*index->regs));
+	index->hash = calloc(hash_size, sizeof(*index->hash));
+	if (index->caches == NULL || index->regs == NULL || index->hash == NULL) {
+		register_index_free(index);
+		return NULL;
+	}
+
+	unsigned n = 0, c = 0;
+	for (struct reg_cache *cache = first; cache; cache = cache->next) {
+		index->caches[c].cache = cache;
+		index->caches[c].reg_list = cache->reg_list;
+		index->caches[c].num_regs = cache->num_regs;
+		c++;
+
+		for (unsigned i = 0; i < cache->num_regs; i++) {
+			struct reg *reg = &cache->reg_list[i];
+			index->regs[n++] = reg;
+
+			if (reg->name == NULL)
+				continue;
+
+			/* only the first register of a name can be found by name */
+			unsigned h = register_name_hash(reg->name) & index->hash_mask;
+			while (index->hash[h] && strcmp(index->regs[index->hash[h] - 1]->name, reg->name))
+				h = (h + 1) & index->hash_mask;
+			if (index->hash[h] == 0)
+				index->hash[h] = n;
+		}
+	}
+
+	return index;
+}
+
+static struct reg_index *register_index_get(struct reg_cache *first)
+{
+	struct reg_index **index_p = &reg_indexes;
+
+	while (*index_p && (*index_p)->first != first)
+		index_p = &(*index_p)->next;
+
+	if (*index_p) {
+		if (register_index_is_current(*index_p))
+			return *index_p;
+
+		struct reg_index *stale = *index_p;
+		*index_p = stale->next;
+		register_index_free(stale);
+	}
+
+	struct reg_index *index = register_index_build(first);
+	if (index) {
+		index->next = reg_indexes;
+		reg_indexes = index;
+	}
+
+	return index;
+}
+
+static struct reg *register_index_find(struct reg_index *index, const char *name)
+{
+	unsigned h = register_name_hash(name) & index->hash_mask;
+
+	while (index->hash[h]) {
+		struct reg *reg = index->regs[index->hash[h] - 1];
+		if (strcmp(reg->name, name) == 0)
+			return reg;
+		h = (h + 1) & index->hash_mask;
+	}
+
+	return NULL;
+}
+
+static struct reg *register_get_by_name_slow(struct reg_cache *first,
 		const char *name, bool search_all)
 {
 	unsigned i;
@@ -57,10 +224,54 @@ struct reg *register_get_by_name(struct reg_cache *first,
 	return NULL;
 }
 
+struct reg *register_get_by_name(struct reg_cache *first,
+		const char *name, bool search_all)
+{
+	if (first == NULL)
+		return NULL;
+
+	struct reg_index *index = register_index_get(first);
+	if (index == NULL)
+		return register_get_by_name_slow(first, name, search_all);
+
+	struct reg *reg = register_index_find(index, name);
+
+	/* Registers don't usually get renamed, but if one was, the index
+	 * doesn't know; a register that isn't found is looked for the slow way */
+	if (reg == NULL)
+		return register_get_by_name_slow(first, name, search_all);
+
+	if (!search_all && (reg < first->reg_list || reg >= first->reg_list + first->num_regs))
+		return NULL;
+
+	return reg;
+}
+
+struct reg *register_get_by_number(struct reg_cache *first, unsigned num)
+{
+	if (first == NULL)
+		return NULL;
+
+	struct reg_index *index = register_index_get(first);
+	if (index == NULL) {
+		for (struct reg_cache *cache = first; cache; cache = cache->next) {
+			if (num < cache->num_regs)
+				return &cache->reg_list[num];
+			num -= cache->num_regs;
+		}
+		return NULL;
+	}
+
+	return (num < index->num_regs) ? index->regs[num] : NULL;
+}
+
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first)
 {
 	struct reg_cache **cache_p = first;
 
+	/* the caller is about to link another cache */
+	register_index_drop_all();
+
 	if (*cache_p)
 		while (*cache_p)
 			cache_p = &((*cache_p)->next);
@@ -72,6 +283,8 @@ struct reg_cache **register_get_last_cache_p(struct reg_cache **first)
 
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache)
 {
+	register_index_drop_all();
+
 	while (*cache_p && *cache_p != cache)
 		cache_p = &((*cache_p)->next);
 	if (*cache_p)
@@ -143,6 +143,8 @@ struct reg_arch_type {
 
 struct reg *register_get_by_name(struct reg_cache *first,
 		const char *name, bool search_all);
+/** @returns the @a num th register of the chain of caches, counting from 0 */
+struct reg *register_get_by_number(struct reg_cache *first, unsigned num);
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first);
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache);
 void register_cache_invalidate(struct reg_cache *cache);
@@ -71,8 +71,9 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+static void working_area_written(struct target *target, uint32_t address, uint32_t size);
+static void working_area_backup_invalidate_all(struct target *target);
+static void mem_cache_free(struct target *target);
 
 /* targets */
 extern struct target_type arm7tdmi_target;
@@ -141,10 +142,25 @@ static struct target_type *target_types[] = {
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
 static struct target_timer_callback *target_timer_callbacks;
+/* the registered timer callbacks again, as a min-heap on their deadline */
+static struct target_timer_callback **timer_heap;
+static int timer_heap_len;
+static int timer_heap_max;
+static uint64_t timer_seq;
+/* set while timer callbacks are being called, unregistering is deferred */
+static bool timer_callback_processing;
+static bool timer_callbacks_removed;
+/* set while target_call_timer_callbacks_now() calls the callbacks */
+static bool timer_callbacks_forced;
 LIST_HEAD(target_reset_callback_list);
 LIST_HEAD(target_trace_callback_list);
 static const int polling_interval = 100;
 
+/* background polling, adapted per target between these limits */
+static struct target_timer_callback *target_poll_timer;
+static int poll_interval_min = 10;
+static int poll_interval_max = 100;
+
 static const Jim_Nvp nvp_assert[] = {
 	{ .name = "assert", NVP_ASSERT },
 	{ .name = "deassert", NVP_DEASSERT },
@@ -609,6 +625,10 @@ int target_resume(struct target *target, int current, uint32_t address, int hand
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_START);
 
+	/* the application may change the memory behind the working area */
+	if (!debug_execution)
+		working_area_backup_invalidate_all(target);
+
 	/* note that resume *must* be asynchronous. The CPU can halt before
 	 * we poll. The CPU can even halt at the current PC as a result of
 	 * a software breakpoint being inserted by (a bug?) the application.
@@ -617,6 +637,9 @@ int target_resume(struct target *target, int current, uint32_t address, int hand
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* a target that was just resumed is the one most likely to halt soon */
+	target_poll_soon(target);
+
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_END);
 
 	return retval;
@@ -793,12 +816,14 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_param,
 			entry_point, exit_point, timeout_ms, arch_info);
 	target->running_alg = false;
+	target_mem_cache_invalidate(target);
 
 done:
 	return retval;
@@ -833,6 +858,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1072,6 +1098,8 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	working_area_written(target, address, size * count);
+	target_mem_cache_invalidate(target);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1086,6 +1114,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	working_area_written(target, address, size * count);
+	target_mem_cache_invalidate(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1166,6 +1196,9 @@ int target_get_gdb_reg_list(struct target *target,
 int target_step(struct target *target,
 		int current, uint32_t address, int handle_breakpoints)
 {
+	working_area_backup_invalidate_all(target);
+	target_mem_cache_invalidate(target);
+
 	return target->type->step(target, current, address, handle_breakpoints);
 }
 
@@ -1187,15 +1220,14 @@ int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno,
 	return target->type->gdb_fileio_end(target, retcode, fileio_errno, ctrl_c);
 }
 
-int target_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+int target_profiling(struct target *target, struct target_profile *profile,
+		uint32_t seconds)
 {
 	if (target->state != TARGET_HALTED) {
 		LOG_WARNING("target %s is not halted", target->cmd_name);
 		return ERROR_TARGET_NOT_HALTED;
 	}
-	return target->type->profiling(target, samples, max_num_samples,
-			num_samples, seconds);
+	return target->type->profiling(target, profile, seconds);
 }
 
 /**
@@ -1208,6 +1240,8 @@ static void target_reset_examined(struct target *target)
 }
 
 static int handle_target(void *priv);
+static struct target_timer_callback *target_find_timer_callback(
+		int (*callback)(void *priv), void *priv);
 
 static int target_init_one(struct command_context *cmd_ctx,
 		struct target *target)
@@ -1292,6 +1326,9 @@ static int target_init(struct command_context *cmd_ctx)
 	if (ERROR_OK != retval)
 		return retval;
 
+	/* handle_target() adjusts its period to the next target due */
+	target_poll_timer = target_find_timer_callback(&handle_target, cmd_ctx->interp);
+
 	return ERROR_OK;
 }
 
@@ -1391,37 +1428,140 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
+static bool timer_before(const struct target_timer_callback *a,
+		const struct target_timer_callback *b)
+{
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void timer_heap_set(int i, struct target_timer_callback *cb)
+{
+	timer_heap[i] = cb;
+	cb->heap_index = i;
+}
+
+static void timer_heap_up(int i)
+{
+	struct target_timer_callback *cb = timer_heap[i];
+
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!timer_before(cb, timer_heap[parent]))
+			break;
+		timer_heap_set(i, timer_heap[parent]);
+		i = parent;
+	}
+	timer_heap_set(i, cb);
+}
+
+static void timer_heap_down(int i)
+{
+	struct target_timer_callback *cb = timer_heap[i];
+
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= timer_heap_len)
+			break;
+		if (child + 1 < timer_heap_len && timer_before(timer_heap[child + 1], timer_heap[child]))
+			child++;
+		if (!timer_before(timer_heap[child], cb))
+			break;
+		timer_heap_set(i, timer_heap[child]);
+		i = child;
+	}
+	timer_heap_set(i, cb);
+}
+
+static int timer_heap_push(struct target_timer_callback *cb)
+{
+	if (timer_heap_len == timer_heap_max) {
+		int new_max = timer_heap_max ? timer_heap_max * 2 : 16;
+		struct target_timer_callback **new_heap =
+			realloc(timer_heap, new_max * sizeof(*timer_heap));
+		if (new_heap == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		timer_heap = new_heap;
+		timer_heap_max = new_max;
+	}
+
+	cb->seq = timer_seq++;
+	timer_heap_set(timer_heap_len++, cb);
+	timer_heap_up(cb->heap_index);
+
+	return ERROR_OK;
+}
+
+static void timer_heap_remove(struct target_timer_callback *cb)
+{
+	int i = cb->heap_index;
+	struct target_timer_callback *last = timer_heap[--timer_heap_len];
+
+	cb->heap_index = -1;
+	if (last == cb)
+		return;
+
+	timer_heap_set(i, last);
+	timer_heap_down(i);
+	timer_heap_up(last->heap_index);
+}
+
+static struct target_timer_callback *target_find_timer_callback(
+		int (*callback)(void *priv), void *priv)
+{
+	for (struct target_timer_callback *c = target_timer_callbacks; c; c = c->next) {
+		if (!c->removed && c->callback == callback && c->priv == priv)
+			return c;
+	}
+
+	return NULL;
+}
+
+/* make a timer callback due no later than @a when */
+static void target_timer_callback_advance(struct target_timer_callback *cb, int64_t when)
+{
+	/* a callback that is being called is rescheduled when it returns */
+	if (cb->heap_index < 0 || cb->when <= when)
+		return;
+
+	timer_heap_remove(cb);
+	cb->when = when;
+	/* can't fail, the heap just shrunk */
+	timer_heap_push(cb);
+}
+
 int target_register_timer_callback(int (*callback)(void *priv), int time_ms, int periodic, void *priv)
 {
 	struct target_timer_callback **callbacks_p = &target_timer_callbacks;
-	struct timeval now;
 
 	if (callback == NULL)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (*callbacks_p) {
-		while ((*callbacks_p)->next)
-			callbacks_p = &((*callbacks_p)->next);
+	while (*callbacks_p)
 		callbacks_p = &((*callbacks_p)->next);
+
+	struct target_timer_callback *cb = malloc(sizeof(struct target_timer_callback));
+	if (cb == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
 	}
 
-	(*callbacks_p) = malloc(sizeof(struct target_timer_callback));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->periodic = periodic;
-	(*callbacks_p)->time_ms = time_ms;
-	(*callbacks_p)->removed = false;
+	cb->callback = callback;
+	cb->periodic = periodic;
+	cb->time_ms = time_ms;
+	cb->removed = false;
+	cb->when = monotonic_ms() + time_ms;
+	cb->heap_index = -1;
+	cb->priv = priv;
+	cb->next = NULL;
 
-	gettimeofday(&now, NULL);
-	(*callbacks_p)->when.tv_usec = now.tv_usec + (time_ms % 1000) * 1000;
-	time_ms -= (time_ms % 1000);
-	(*callbacks_p)->when.tv_sec = now.tv_sec + (time_ms / 1000);
-	if ((*callbacks_p)->when.tv_usec > 1000000) {
-		(*callbacks_p)->when.tv_usec = (*callbacks_p)->when.tv_usec - 1000000;
-		(*callbacks_p)->when.tv_sec += 1;
+	if (timer_heap_push(cb) != ERROR_OK) {
+		free(cb);
+		return ERROR_FAIL;
 	}
 
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	*callbacks_p = cb;
 
 	return ERROR_OK;
 }
@@ -1492,12 +1632,23 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 	if (callback == NULL)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	for (struct target_timer_callback *c = target_timer_callbacks;
-	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
+	for (struct target_timer_callback **p = &target_timer_callbacks; *p; p = &(*p)->next) {
+		struct target_timer_callback *c = *p;
+
+		if (c->removed || c->callback != callback || c->priv != priv)
+			continue;
+
+		if (timer_callback_processing) {
+			/* the callback may be the one running right now */
 			c->removed = true;
-			return ERROR_OK;
+			timer_callbacks_removed = true;
+		} else {
+			if (c->heap_index >= 0)
+				timer_heap_remove(c);
+			*p = c->next;
+			free(c);
 		}
+		return ERROR_OK;
 	}
 
 	return ERROR_FAIL;
@@ -1516,6 +1667,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 	LOG_DEBUG("target event %i (%s)", event,
 			Jim_Nvp_value2name_simple(nvp_target_event, event)->name);
 
+	/* resume, halt, reset, flash programming: memory may have changed */
+	target_mem_cache_invalidate(target);
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1550,74 +1704,122 @@ int target_call_trace_callbacks(struct target *target, size_t len, uint8_t *data
 	return ERROR_OK;
 }
 
-static int target_timer_callback_periodic_restart(
-		struct target_timer_callback *cb, struct timeval *now)
+static void target_call_timer_callback(struct target_timer_callback *cb, int64_t now)
 {
-	int time_ms = cb->time_ms;
-	cb->when.tv_usec = now->tv_usec + (time_ms % 1000) * 1000;
-	time_ms -= (time_ms % 1000);
-	cb->when.tv_sec = now->tv_sec + time_ms / 1000;
-	if (cb->when.tv_usec > 1000000) {
-		cb->when.tv_usec = cb->when.tv_usec - 1000000;
-		cb->when.tv_sec += 1;
-	}
-	return ERROR_OK;
+	cb->callback(cb->priv);
+
+	if (cb->periodic)
+		cb->when = now + cb->time_ms;
+	else
+		target_unregister_timer_callback(cb->callback, cb->priv);
 }
 
-static int target_call_timer_callback(struct target_timer_callback *cb,
-		struct timeval *now)
+/* free the callbacks unregistered while timer callbacks were being called */
+static void target_timer_callbacks_sweep(void)
 {
-	cb->callback(cb->priv);
+	struct target_timer_callback **p = &target_timer_callbacks;
 
-	if (cb->periodic)
-		return target_timer_callback_periodic_restart(cb, now);
+	while (*p) {
+		struct target_timer_callback *c = *p;
+		if (!c->removed) {
+			p = &c->next;
+			continue;
+		}
+		if (c->heap_index >= 0)
+			timer_heap_remove(c);
+		*p = c->next;
+		free(c);
+	}
 
-	return target_unregister_timer_callback(cb->callback, cb->priv);
+	timer_callbacks_removed = false;
 }
 
 static int target_call_timer_callbacks_check_time(int checktime)
 {
-	static bool callback_processing;
+	static struct target_timer_callback **due;
+	static int max_due;
 
 	/* Do not allow nesting */
-	if (callback_processing)
+	if (timer_callback_processing)
 		return ERROR_OK;
 
-	callback_processing = true;
+	timer_callback_processing = true;
+	timer_callbacks_forced = !checktime;
 
 	keep_alive();
 
-	struct timeval now;
-	gettimeofday(&now, NULL);
-
-	/* Store an address of the place containing a pointer to the
-	 * next item; initially, that's a standalone "root of the
-	 * list" variable. */
-	struct target_timer_callback **callback = &target_timer_callbacks;
-	while (*callback) {
-		if ((*callback)->removed) {
-			struct target_timer_callback *p = *callback;
-			*callback = (*callback)->next;
-			free(p);
-			continue;
+	int64_t now = monotonic_ms();
+
+	if (checktime) {
+		/* Take all due callbacks off the heap before calling any, so a
+		 * callback rescheduled or registered by one of them waits for
+		 * the next round, even with a period of 0. */
+		int num_due = 0;
+		while (timer_heap_len > 0 && timer_heap[0]->when <= now) {
+			if (num_due == max_due) {
+				int new_max = max_due ? max_due * 2 : 16;
+				struct target_timer_callback **new_due =
+					realloc(due, new_max * sizeof(*due));
+				if (new_due == NULL)
+					break;
+				due = new_due;
+				max_due = new_max;
+			}
+			due[num_due] = timer_heap[0];
+			timer_heap_remove(due[num_due++]);
 		}
 
-		bool call_it = (*callback)->callback &&
-			((!checktime && (*callback)->periodic) ||
-			 now.tv_sec > (*callback)->when.tv_sec ||
-			 (now.tv_sec == (*callback)->when.tv_sec &&
-			  now.tv_usec >= (*callback)->when.tv_usec));
+		for (int i = 0; i < num_due; i++) {
+			if (!due[i]->removed)
+				target_call_timer_callback(due[i], now);
+		}
+
+		/* in the order they were due, which keeps ties in that order */
+		for (int i = 0; i < num_due; i++) {
+			if (!due[i]->removed && timer_heap_push(due[i]) != ERROR_OK) {
+				due[i]->removed = true;
+				timer_callbacks_removed = true;
+			}
+		}
+	} else {
+		/* all periodic callbacks, in the order they were registered;
+		 * callbacks registered meanwhile are appended and seen too */
+		for (struct target_timer_callback *c = target_timer_callbacks; c; c = c->next) {
+			if (c->removed || !(c->periodic || c->when <= now))
+				continue;
 
-		if (call_it)
-			target_call_timer_callback(*callback, &now);
+			target_call_timer_callback(c, now);
 
-		callback = &(*callback)->next;
+			if (!c->removed && c->heap_index >= 0) {
+				timer_heap_remove(c);
+				if (timer_heap_push(c) != ERROR_OK) {
+					c->removed = true;
+					timer_callbacks_removed = true;
+				}
+			}
+		}
 	}
 
-	callback_processing = false;
+	if (timer_callbacks_removed)
+		target_timer_callbacks_sweep();
+
+	timer_callbacks_forced = false;
+	timer_callback_processing = false;
 	return ERROR_OK;
 }
 
+int target_timer_callbacks_next_ms(void)
+{
+	if (timer_heap_len == 0)
+		return -1;
+
+	int64_t left = timer_heap[0]->when - monotonic_ms();
+	if (left < 0)
+		return 0;
+
+	return left < INT_MAX ? left : INT_MAX;
+}
+
 int target_call_timer_callbacks(void)
 {
 	return target_call_timer_callbacks_check_time(1);
@@ -1629,6 +1831,188 @@ int target_call_timer_callbacks_now(void)
 	return target_call_timer_callbacks_check_time(0);
 }
 
+#define WORKING_AREA_CLASSES	32
+
+/*
+ * Working area bookkeeping beyond the address ordered list of areas.
+ *
+ * Free areas are also kept on one list per size class (the index of the
+ * most significant bit of their size) so that allocating and freeing
+ * don't have to walk the whole list, and freed areas are merged with
+ * their neighbours directly.
+ *
+ * When the working area is backed up, the saved target memory is kept
+ * in one copy of the whole working area.  Memory only gets read the
+ * first time it is allocated; as long as nothing but working area users
+ * could have changed it, later allocations reuse the saved copy.  It is
+ * dropped when the target resumes or steps, and memory writes outside
+ * of allocated areas drop the part they overlap.
+ */
+struct working_area_pool {
+	uint32_t address;
+	uint32_t size;
+
+	struct working_area *free_areas[WORKING_AREA_CLASSES];
+	uint32_t free_classes;		/* bit n set if free_areas[n] isn't empty */
+
+	uint8_t *backup;			/* saved target memory of the whole area */
+	uint32_t *backup_valid;		/* one bit per word of backup[] */
+
+	/* statistics for the "working_area stats" command */
+	uint32_t allocs;
+	uint32_t alloc_failures;
+	uint32_t frees;
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint64_t backup_read;		/* bytes read from the target to back up */
+	uint64_t backup_reused;		/* bytes whose saved copy could be reused */
+	uint64_t restored;			/* bytes written back to the target */
+};
+
+static inline int working_area_class(uint32_t size)
+{
+	return 31 - __builtin_clz(size);
+}
+
+static void working_area_add_free(struct working_area_pool *pool, struct working_area *area)
+{
+	int class = working_area_class(area->size);
+
+	area->free_prev = NULL;
+	area->free_next = pool->free_areas[class];
+	if (area->free_next)
+		area->free_next->free_prev = area;
+	pool->free_areas[class] = area;
+	pool->free_classes |= 1u << class;
+}
+
+static void working_area_remove_free(struct working_area_pool *pool, struct working_area *area)
+{
+	int class = working_area_class(area->size);
+
+	if (area->free_prev)
+		area->free_prev->free_next = area->free_next;
+	else
+		pool->free_areas[class] = area->free_next;
+	if (area->free_next)
+		area->free_next->free_prev = area->free_prev;
+
+	if (pool->free_areas[class] == NULL)
+		pool->free_classes &= ~(1u << class);
+}
+
+/* Find a free area of at least size bytes */
+static struct working_area *working_area_find_free(struct working_area_pool *pool, uint32_t size)
+{
+	int class = working_area_class(size);
+
+	/* areas in the class of the request may still be too small */
+	for (struct working_area *c = pool->free_areas[class]; c; c = c->free_next) {
+		if (c->size >= size)
+			return c;
+	}
+
+	/* any area of a larger class will do */
+	uint32_t larger = (class < 31) ? pool->free_classes & ~((2u << class) - 1) : 0;
+	if (larger == 0)
+		return NULL;
+
+	return pool->free_areas[__builtin_ctz(larger)];
+}
+
+/* Drop the saved copy of the given part of the working area */
+static void working_area_backup_invalidate(struct working_area_pool *pool,
+		uint32_t address, uint32_t size)
+{
+	uint32_t first = (address - pool->address) / 4;
+	uint32_t last = (address - pool->address + size + 3) / 4;
+
+	for (uint32_t i = first; i < last; i++)
+		pool->backup_valid[i / 32] &= ~(1u << (i % 32));
+}
+
+static void working_area_backup_invalidate_all(struct target *target)
+{
+	struct working_area_pool *pool = target->working_area_pool;
+
+	if (pool && pool->backup_valid)
+		memset(pool->backup_valid, 0, DIV_ROUND_UP(pool->size / 4, 32) * sizeof(uint32_t));
+}
+
+/* Memory is being written outside of the working area allocator, forget
+ * what was saved of the free areas it overlaps.  Allocated areas belong to
+ * whoever writes them and are restored from the saved copy anyway. */
+static void working_area_written(struct target *target, uint32_t address, uint32_t size)
+{
+	struct working_area_pool *pool = target->working_area_pool;
+
+	if (pool == NULL || pool->backup_valid == NULL || size == 0)
+		return;
+
+	if (address >= pool->address + pool->size || address + size <= pool->address)
+		return;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (!c->free)
+			continue;
+
+		uint32_t start = MAX(address, c->address);
+		uint32_t end = MIN(address + size, c->address + c->size);
+		if (start < end)
+			working_area_backup_invalidate(pool, start, end - start);
+	}
+}
+
+static inline bool working_area_backup_is_valid(struct working_area_pool *pool, uint32_t word)
+{
+	return pool->backup_valid[word / 32] & (1u << (word % 32));
+}
+
+/* Save the target memory an area is about to use; only the words that
+ * have not been saved yet are read from the target */
+static int target_backup_working_area(struct target *target, struct working_area *area)
+{
+	struct working_area_pool *pool = target->working_area_pool;
+
+	if (pool->backup == NULL) {
+		pool->backup = malloc(pool->size);
+		pool->backup_valid = calloc(DIV_ROUND_UP(pool->size / 4, 32), sizeof(uint32_t));
+		if (pool->backup == NULL || pool->backup_valid == NULL) {
+			free(pool->backup);
+			free(pool->backup_valid);
+			pool->backup = NULL;
+			pool->backup_valid = NULL;
+			return ERROR_FAIL;
+		}
+	}
+
+	uint32_t word = (area->address - pool->address) / 4;
+	uint32_t last = word + area->size / 4;
+
+	while (word < last) {
+		if (working_area_backup_is_valid(pool, word)) {
+			pool->backup_reused += 4;
+			word++;
+			continue;
+		}
+
+		uint32_t end = word;
+		while (end < last && !working_area_backup_is_valid(pool, end))
+			end++;
+
+		int retval = target_read_memory(target, pool->address + word * 4, 4, end - word,
+				pool->backup + word * 4);
+		if (retval != ERROR_OK)
+			return retval;
+
+		pool->backup_read += (end - word) * 4;
+		for (; word < end; word++)
+			pool->backup_valid[word / 32] |= 1u << (word % 32);
+	}
+
+	return ERROR_OK;
+}
+
 /* Prints the working area layout for debug purposes */
 static void print_wa_layout(struct target *target)
 {
@@ -1636,14 +2020,14 @@ static void print_wa_layout(struct target *target)
 
 	while (c) {
 		LOG_DEBUG("%c%c 0x%08"PRIx32"-0x%08"PRIx32" (%"PRIu32" bytes)",
-			c->backup ? 'b' : ' ', c->free ? ' ' : '*',
+			(target->backup_working_area && !c->free) ? 'b' : ' ', c->free ? ' ' : '*',
 			c->address, c->address + c->size - 1, c->size);
 		c = c->next;
 	}
 }
 
 /* Reduce area to size bytes, create a new free area from the remaining bytes, if any. */
-static void target_split_working_area(struct working_area *area, uint32_t size)
+static void target_split_working_area(struct target *target, struct working_area *area, uint32_t size)
 {
 	assert(area->free); /* Shouldn't split an allocated area */
 	assert(size <= area->size); /* Caller should guarantee this */
@@ -1656,54 +2040,55 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 			return;
 
 		new_wa->next = area->next;
+		new_wa->prev = area;
 		new_wa->size = area->size - size;
 		new_wa->address = area->address + size;
-		new_wa->backup = NULL;
 		new_wa->user = NULL;
 		new_wa->free = true;
 
+		if (area->next)
+			area->next->prev = new_wa;
 		area->next = new_wa;
 		area->size = size;
 
-		/* If backup memory was allocated to this area, it has the wrong size
-		 * now so free it and it will be reallocated if/when needed */
-		if (area->backup) {
-			free(area->backup);
-			area->backup = NULL;
-		}
+		working_area_add_free(target->working_area_pool, new_wa);
 	}
 }
 
-/* Merge all adjacent free areas into one */
-static void target_merge_working_areas(struct target *target)
+/* Merge a free area with its free neighbours, and put the result on the
+ * free list of its size class.  Returns the merged area. */
+static struct working_area *target_merge_working_area(struct target *target, struct working_area *area)
 {
-	struct working_area *c = target->working_areas;
+	struct working_area_pool *pool = target->working_area_pool;
+	struct working_area *next = area->next;
+	struct working_area *prev = area->prev;
 
-	while (c && c->next) {
-		assert(c->next->address == c->address + c->size); /* This is an invariant */
-
-		/* Find two adjacent free areas */
-		if (c->free && c->next->free) {
-			/* Merge the last into the first */
-			c->size += c->next->size;
-
-			/* Remove the last */
-			struct working_area *to_be_freed = c->next;
-			c->next = c->next->next;
-			if (to_be_freed->backup)
-				free(to_be_freed->backup);
-			free(to_be_freed);
-
-			/* If backup memory was allocated to the remaining area, it's has
-			 * the wrong size now */
-			if (c->backup) {
-				free(c->backup);
-				c->backup = NULL;
-			}
-		} else {
-			c = c->next;
-		}
+	if (next && next->free) {
+		assert(next->address == area->address + area->size); /* This is an invariant */
+
+		working_area_remove_free(pool, next);
+		area->size += next->size;
+		area->next = next->next;
+		if (area->next)
+			area->next->prev = area;
+		free(next);
 	}
+
+	if (prev && prev->free) {
+		assert(area->address == prev->address + prev->size); /* This is an invariant */
+
+		working_area_remove_free(pool, prev);
+		prev->size += area->size;
+		prev->next = area->next;
+		if (prev->next)
+			prev->next->prev = prev;
+		free(area);
+		area = prev;
+	}
+
+	working_area_add_free(pool, area);
+
+	return area;
 }
 
 int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
@@ -1743,49 +2128,65 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 
 		/* Set up initial working area on first call */
 		struct working_area *new_wa = malloc(sizeof(*new_wa));
-		if (new_wa) {
-			new_wa->next = NULL;
-			new_wa->size = target->working_area_size & ~3UL; /* 4-byte align */
-			new_wa->address = target->working_area;
-			new_wa->backup = NULL;
-			new_wa->user = NULL;
-			new_wa->free = true;
+		struct working_area_pool *pool = target->working_area_pool;
+		if (pool == NULL)
+			pool = calloc(1, sizeof(*pool));
+		if (new_wa == NULL || pool == NULL) {
+			free(new_wa);
+			free(pool);
+			target->working_area_pool = NULL;
+			return ERROR_FAIL;
 		}
 
+		new_wa->next = NULL;
+		new_wa->prev = NULL;
+		new_wa->size = target->working_area_size & ~3UL; /* 4-byte align */
+		new_wa->address = target->working_area;
+		new_wa->user = NULL;
+		new_wa->free = true;
+
+		/* the statistics survive a change of the working area */
+		memset(pool->free_areas, 0, sizeof(pool->free_areas));
+		pool->free_classes = 0;
+		free(pool->backup);
+		free(pool->backup_valid);
+		pool->backup = NULL;
+		pool->backup_valid = NULL;
+		pool->address = new_wa->address;
+		pool->size = new_wa->size;
+
+		target->working_area_pool = pool;
 		target->working_areas = new_wa;
+
+		if (new_wa->size)
+			working_area_add_free(pool, new_wa);
 	}
 
+	struct working_area_pool *pool = target->working_area_pool;
+
 	/* only allocate multiples of 4 byte */
-	if (size % 4)
-		size = (size + 3) & (~3UL);
+	if (size % 4 || size == 0)
+		size = (size + 4) & (~3UL);
 
-	struct working_area *c = target->working_areas;
+	struct working_area *c = working_area_find_free(pool, size);
 
-	/* Find the first large enough working area */
-	while (c) {
-		if (c->free && c->size >= size)
-			break;
-		c = c->next;
-	}
-
-	if (c == NULL)
+	if (c == NULL) {
+		pool->alloc_failures++;
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
 
 	/* Split the working area into the requested size */
-	target_split_working_area(c, size);
+	working_area_remove_free(pool, c);
+	target_split_working_area(target, c, size);
 
 	LOG_DEBUG("allocated new working area of %"PRIu32" bytes at address 0x%08"PRIx32, size, c->address);
 
 	if (target->backup_working_area) {
-		if (c->backup == NULL) {
-			c->backup = malloc(c->size);
-			if (c->backup == NULL)
-				return ERROR_FAIL;
-		}
-
-		int retval = target_read_memory(target, c->address, 4, c->size / 4, c->backup);
-		if (retval != ERROR_OK)
+		int retval = target_backup_working_area(target, c);
+		if (retval != ERROR_OK) {
+			target_merge_working_area(target, c);
 			return retval;
+		}
 	}
 
 	/* mark as used, and return the new (reused) area */
@@ -1795,6 +2196,11 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	/* user pointer */
 	c->user = area;
 
+	pool->allocs++;
+	pool->in_use += c->size;
+	if (pool->in_use > pool->peak_in_use)
+		pool->peak_in_use = pool->in_use;
+
 	print_wa_layout(target);
 
 	return ERROR_OK;
@@ -1813,18 +2219,43 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 static int target_restore_working_area(struct target *target, struct working_area *area)
 {
+	struct working_area_pool *pool = target->working_area_pool;
 	int retval = ERROR_OK;
 
-	if (target->backup_working_area && area->backup != NULL) {
-		retval = target_write_memory(target, area->address, 4, area->size / 4, area->backup);
+	if (target->backup_working_area && pool->backup != NULL) {
+		retval = target_write_memory(target, area->address, 4, area->size / 4,
+				pool->backup + (area->address - pool->address));
 		if (retval != ERROR_OK)
 			LOG_ERROR("failed to restore %"PRIu32" bytes of working area at address 0x%08"PRIx32,
 					area->size, area->address);
+		else
+			pool->restored += area->size;
 	}
 
 	return retval;
 }
 
+/* Return an allocated area to the pool, without restoring its memory.
+ * Returns the free area it ended up in. */
+static struct working_area *target_release_working_area(struct target *target, struct working_area *area)
+{
+	struct working_area_pool *pool = target->working_area_pool;
+
+	area->free = true;
+
+	pool->frees++;
+	pool->in_use -= area->size;
+
+	/* mark user pointer invalid */
+	/* TODO: Is this really safe? It points to some previous caller's memory.
+	 * How could we know that the area pointer is still in that place and not
+	 * some other vital data? What's the purpose of this, anyway? */
+	*area->user = NULL;
+	area->user = NULL;
+
+	return target_merge_working_area(target, area);
+}
+
 /* Restore the area's backup memory, if any, and return the area to the allocation pool */
 static int target_free_working_area_restore(struct target *target, struct working_area *area, int restore)
 {
@@ -1840,19 +2271,10 @@ static int target_free_working_area_restore(struct target *target, struct workin
 			return retval;
 	}
 
-	area->free = true;
-
 	LOG_DEBUG("freed %"PRIu32" bytes of working area at address 0x%08"PRIx32,
 			area->size, area->address);
 
-	/* mark user pointer invalid */
-	/* TODO: Is this really safe? It points to some previous caller's memory.
-	 * How could we know that the area pointer is still in that place and not
-	 * some other vital data? What's the purpose of this, anyway? */
-	*area->user = NULL;
-	area->user = NULL;
-
-	target_merge_working_areas(target);
+	target_release_working_area(target, area);
 
 	print_wa_layout(target);
 
@@ -1882,10 +2304,19 @@ void target_quit(void)
 	}
 	target_timer_callbacks = NULL;
 
+	target_poll_timer = NULL;
+
+	free(timer_heap);
+	timer_heap = NULL;
+	timer_heap_len = 0;
+	timer_heap_max = 0;
+
 	for (struct target *target = all_targets;
 	     target; target = target->next) {
 		if (target->type->deinit_target)
 			target->type->deinit_target(target);
+		mem_cache_free(target);
+		breakpoint_watchpoint_free_all(target);
 	}
 }
 
@@ -1898,20 +2329,20 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 
 	LOG_DEBUG("freeing all working areas");
 
-	/* Loop through all areas, restoring the allocated ones and marking them as free */
+	/* Loop through all areas, restoring the allocated ones and returning
+	 * them to the pool, which merges them with their free neighbours */
 	while (c) {
 		if (!c->free) {
 			if (restore)
 				target_restore_working_area(target, c);
-			c->free = true;
-			*c->user = NULL; /* Same as above */
-			c->user = NULL;
+			c = target_release_working_area(target, c);
 		}
 		c = c->next;
 	}
 
-	/* Run a merge pass to combine all areas into one */
-	target_merge_working_areas(target);
+	/* this is called when the target gets resumed or reset, after which
+	 * the saved memory can't be trusted anymore */
+	working_area_backup_invalidate_all(target);
 
 	print_wa_layout(target);
 }
@@ -1924,17 +2355,22 @@ void target_free_all_working_areas(struct target *target)
 /* Find the largest number of bytes that can be allocated */
 uint32_t target_get_working_area_avail(struct target *target)
 {
-	struct working_area *c = target->working_areas;
+	struct working_area_pool *pool = target->working_area_pool;
 	uint32_t max_size = 0;
 
-	if (c == NULL)
+	if (target->working_areas == NULL)
 		return target->working_area_size;
 
+	if (pool->free_classes == 0)
+		return 0;
+
+	/* the largest area is in the largest class */
+	struct working_area *c = pool->free_areas[working_area_class(pool->free_classes)];
 	while (c) {
-		if (c->free && max_size < c->size)
+		if (max_size < c->size)
 			max_size = c->size;
 
-		c = c->next;
+		c = c->free_next;
 	}
 
 	return max_size;
@@ -1971,8 +2407,8 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+int target_profiling_default(struct target *target, struct target_profile *profile,
+		uint32_t seconds)
 {
 	struct timeval timeout, now;
 
@@ -1991,7 +2427,10 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 		target_poll(target);
 		if (target->state == TARGET_HALTED) {
 			uint32_t t = buf_get_u32(reg->value, 0, 32);
-			samples[sample_count++] = t;
+			retval = target_profile_add_sample(profile, t);
+			if (retval != ERROR_OK)
+				break;
+			sample_count++;
 			/* current pc, addr = 0, do not handle breakpoints, not debugging */
 			retval = target_resume(target, 1, 0, 0, 0);
 			target_poll(target);
@@ -2009,14 +2448,12 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 			break;
 
 		gettimeofday(&now, NULL);
-		if ((sample_count >= max_num_samples) ||
-			((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec))) {
+		if ((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec)) {
 			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
 
-	*num_samples = sample_count;
 	return retval;
 }
 
@@ -2045,6 +2482,8 @@ int target_write_buffer(struct target *target, uint32_t address, uint32_t size,
 		return ERROR_FAIL;
 	}
 
+	working_area_written(target, address, size);
+	target_mem_cache_invalidate(target);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2081,6 +2520,261 @@ static int target_write_buffer_default(struct target *target, uint32_t address,
 	return ERROR_OK;
 }
 
+/*
+ * Memory read cache.
+ *
+ * While a target is halted its memory only changes when we change it, so
+ * reads through target_read_buffer() can be answered from a copy.  GDB
+ * reads the same stack and code again and again while unwinding,
+ * disassembling and displaying variables, mostly a few bytes at a time;
+ * with the cache enabled such reads fetch the whole surrounding page
+ * once and the following reads cost no adapter round trip at all.
+ *
+ * Pages live in a small open addressed hash table.  Everything is
+ * dropped at once by bumping the generation: slots of older generations
+ * count as empty.  That happens on every resume, step, algorithm run,
+ * memory write and target event, so a write while programming flash
+ * costs no more than an increment.
+ *
+ * The cache is only used while the target is halted and without MMU
+ * translation, and never for reads whose pages overlap a volatile range.
+ */
+#define MEM_CACHE_PAGE_SIZE		256
+#define MEM_CACHE_SLOTS_LOG2	9
+#define MEM_CACHE_SLOTS			(1 << MEM_CACHE_SLOTS_LOG2)
+/* keep the table at most three quarters full */
+#define MEM_CACHE_MAX_PAGES		(MEM_CACHE_SLOTS / 4 * 3)
+/* larger reads go straight to the target */
+#define MEM_CACHE_MAX_READ		(64 * MEM_CACHE_PAGE_SIZE)
+
+struct mem_cache_range {
+	uint32_t address;
+	uint32_t size;
+};
+
+struct target_mem_cache {
+	bool enabled;
+
+	uint32_t generation;		/* slots of other generations are empty */
+	uint32_t num_pages;			/* pages cached in this generation */
+	uint32_t slot_page[MEM_CACHE_SLOTS];
+	uint32_t slot_generation[MEM_CACHE_SLOTS];
+	uint8_t *data;				/* MEM_CACHE_PAGE_SIZE bytes per slot */
+	uint8_t *fill_buffer;		/* room for the pages of the largest read */
+
+	struct mem_cache_range *volatile_ranges;
+	unsigned num_volatile;
+
+	/* statistics for the "mem_cache stats" command */
+	uint64_t reads;				/* reads answered using the cache */
+	uint64_t bypassed;			/* reads passed straight to the target */
+	uint64_t page_hits;
+	uint64_t page_misses;
+	uint64_t target_reads;		/* reads issued to fill pages */
+	uint64_t fill_failures;
+	uint64_t invalidations;
+};
+
+static struct target_mem_cache *mem_cache_get(struct target *target)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL) {
+		cache = calloc(1, sizeof(*cache));
+		if (cache == NULL) {
+			LOG_ERROR("out of memory");
+			return NULL;
+		}
+		cache->generation = 1;
+		target->mem_cache = cache;
+	}
+
+	return cache;
+}
+
+static void mem_cache_free(struct target *target)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL)
+		return;
+
+	free(cache->data);
+	free(cache->fill_buffer);
+	free(cache->volatile_ranges);
+	free(cache);
+	target->mem_cache = NULL;
+}
+
+static void mem_cache_drop(struct target_mem_cache *cache)
+{
+	if (cache == NULL || cache->num_pages == 0)
+		return;
+
+	cache->num_pages = 0;
+	cache->invalidations++;
+
+	if (++cache->generation == 0) {
+		/* old slots could look valid again after the wrap */
+		memset(cache->slot_generation, 0, sizeof(cache->slot_generation));
+		cache->generation = 1;
+	}
+}
+
+static void mem_cache_invalidate(struct target *target)
+{
+	target->mem_generation++;
+	mem_cache_drop(target->mem_cache);
+}
+
+void target_mem_cache_invalidate(struct target *target)
+{
+	/* the cores of an SMP group share their memory */
+	if (target->smp) {
+		for (struct target_list *head = target->head; head; head = head->next)
+			mem_cache_invalidate(head->target);
+	}
+
+	mem_cache_invalidate(target);
+}
+
+bool target_mem_is_volatile(struct target *target, uint32_t address, uint32_t size)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL)
+		return false;
+
+	for (unsigned i = 0; i < cache->num_volatile; i++) {
+		struct mem_cache_range *r = &cache->volatile_ranges[i];
+		if (address <= r->address + r->size - 1 && r->address <= address + size - 1)
+			return true;
+	}
+
+	return false;
+}
+
+static inline unsigned mem_cache_hash(uint32_t page)
+{
+	return (page * 2654435761u) >> (32 - MEM_CACHE_SLOTS_LOG2);
+}
+
+/* @returns the slot holding @a page, or -1 */
+static int mem_cache_lookup(struct target_mem_cache *cache, uint32_t page)
+{
+	for (unsigned slot = mem_cache_hash(page); ; slot = (slot + 1) % MEM_CACHE_SLOTS) {
+		if (cache->slot_generation[slot] != cache->generation)
+			return -1;
+		if (cache->slot_page[slot] == page)
+			return slot;
+	}
+}
+
+static uint8_t *mem_cache_insert(struct target_mem_cache *cache, uint32_t page)
+{
+	unsigned slot = mem_cache_hash(page);
+
+	while (cache->slot_generation[slot] == cache->generation)
+		slot = (slot + 1) % MEM_CACHE_SLOTS;
+
+	cache->slot_generation[slot] = cache->generation;
+	cache->slot_page[slot] = page;
+	cache->num_pages++;
+
+	return cache->data + slot * MEM_CACHE_PAGE_SIZE;
+}
+
+static bool mem_cache_usable(struct target *target, uint32_t address, uint32_t size)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL || !cache->enabled)
+		return false;
+
+	if (target->state != TARGET_HALTED || target->running_alg)
+		return false;
+
+	if (size > MEM_CACHE_MAX_READ)
+		return false;
+
+	/* virtual to physical mappings may change with any register write */
+	int mmu_enabled;
+	if (target->type->mmu(target, &mmu_enabled) != ERROR_OK || mmu_enabled)
+		return false;
+
+	/* whole pages are read, so check what they cover */
+	uint32_t first = address & ~(MEM_CACHE_PAGE_SIZE - 1);
+	uint32_t last = (address + size - 1) | (MEM_CACHE_PAGE_SIZE - 1);
+
+	return !target_mem_is_volatile(target, first, last - first + 1);
+}
+
+/* read @a count pages starting at @a page from the target into the cache */
+static int mem_cache_fill(struct target *target, uint32_t page, uint32_t count)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	cache->target_reads++;
+	int retval = target->type->read_buffer(target, page * MEM_CACHE_PAGE_SIZE,
+			count * MEM_CACHE_PAGE_SIZE, cache->fill_buffer);
+	if (retval != ERROR_OK) {
+		cache->fill_failures++;
+		return retval;
+	}
+
+	if (cache->num_pages + count > MEM_CACHE_MAX_PAGES)
+		mem_cache_drop(cache);
+
+	for (uint32_t i = 0; i < count; i++)
+		memcpy(mem_cache_insert(cache, page + i),
+				cache->fill_buffer + i * MEM_CACHE_PAGE_SIZE, MEM_CACHE_PAGE_SIZE);
+
+	cache->page_misses += count;
+
+	return ERROR_OK;
+}
+
+static int mem_cache_read(struct target *target, uint32_t address, uint32_t size, uint8_t *buffer)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+	uint32_t page = address / MEM_CACHE_PAGE_SIZE;
+	uint32_t last = (address + size - 1) / MEM_CACHE_PAGE_SIZE;
+	uint32_t pos = address;
+	uint8_t *dst = buffer;
+
+	cache->reads++;
+
+	while (page <= last) {
+		int slot = mem_cache_lookup(cache, page);
+
+		if (slot < 0) {
+			/* fetch this page and the missing ones after it in one go */
+			uint32_t count = 1;
+			while (page + count <= last && mem_cache_lookup(cache, page + count) < 0)
+				count++;
+
+			/* A page may reach into memory that can't be read, but the
+			 * requested bytes themselves might still be fine */
+			if (mem_cache_fill(target, page, count) != ERROR_OK)
+				return target->type->read_buffer(target, address, size, buffer);
+
+			continue;
+		}
+
+		cache->page_hits++;
+
+		uint32_t offset = pos - page * MEM_CACHE_PAGE_SIZE;
+		uint32_t n = MIN(address + size - pos, MEM_CACHE_PAGE_SIZE - offset);
+
+		memcpy(dst, cache->data + slot * MEM_CACHE_PAGE_SIZE + offset, n);
+		pos += n;
+		dst += n;
+		page++;
+	}
+
+	return ERROR_OK;
+}
+
 /* Single aligned words are guaranteed to use 16 or 32 bit access
  * mode respectively, otherwise data is handled as quickly as
  * possible
@@ -2106,6 +2800,12 @@ int target_read_buffer(struct target *target, uint32_t address, uint32_t size, u
 		return ERROR_FAIL;
 	}
 
+	if (mem_cache_usable(target, address, size))
+		return mem_cache_read(target, address, size, buffer);
+
+	if (target->mem_cache)
+		target->mem_cache->bypassed++;
+
 	return target->type->read_buffer(target, address, size, buffer);
 }
 
@@ -2498,11 +3198,72 @@ static int sense_handler(void)
 	return ERROR_OK;
 }
 
+void target_poll_soon(struct target *target)
+{
+	struct target_poll_sched *ps = &target->poll_sched;
+
+	ps->change_prob += (256 - ps->change_prob) / 8;
+	ps->interval_ms = poll_interval_min;
+	ps->next_ms = MIN(ps->next_ms, monotonic_ms() + poll_interval_min);
+
+	if (target_poll_timer)
+		target_timer_callback_advance(target_poll_timer, ps->next_ms);
+}
+
+/*
+ * Pick the interval until the next poll of a target that was just
+ * polled successfully.  A state change drops it to the minimum, after
+ * that it backs off exponentially; more slowly for targets that have
+ * recently been changing state often.
+ */
+static void target_poll_sched_update(struct target *target,
+		enum target_state prev_state, int64_t now)
+{
+	struct target_poll_sched *ps = &target->poll_sched;
+	bool changed = target->state != prev_state;
+
+	ps->num_polls++;
+	ps->change_prob -= ps->change_prob / 8;
+
+	if (changed) {
+		ps->num_changes++;
+		ps->change_prob += 256 / 8;
+
+		if (prev_state == TARGET_RUNNING && target->state == TARGET_HALTED &&
+				ps->last_ms) {
+			int64_t latency = now - ps->last_ms;
+			ps->num_halts++;
+			ps->halt_latency_total_ms += latency;
+			if (latency > ps->halt_latency_max_ms)
+				ps->halt_latency_max_ms = latency;
+		}
+
+		ps->interval_ms = poll_interval_min;
+	} else if (ps->change_prob >= 256 / 4) {
+		ps->interval_ms += ps->interval_ms / 4 + 1;
+	} else {
+		ps->interval_ms *= 2;
+	}
+
+	if (ps->interval_ms < poll_interval_min)
+		ps->interval_ms = poll_interval_min;
+	if (ps->interval_ms > poll_interval_max)
+		ps->interval_ms = poll_interval_max;
+
+	ps->last_ms = now;
+	ps->next_ms = now + ps->interval_ms;
+}
+
 /* process target state changes */
 static int handle_target(void *priv)
 {
 	Jim_Interp *interp = (Jim_Interp *)priv;
 	int retval = ERROR_OK;
+	int64_t now = monotonic_ms();
+	static int64_t last_sense;
+
+	if (target_poll_timer)
+		target_poll_timer->time_ms = polling_interval;
 
 	if (!is_jtag_poll_safe()) {
 		/* polling is disabled currently */
@@ -2511,8 +3272,9 @@ static int handle_target(void *priv)
 
 	/* we do not want to recurse here... */
 	static int recursive;
-	if (!recursive) {
+	if (!recursive && (timer_callbacks_forced || now - last_sense >= polling_interval)) {
 		recursive = 1;
+		last_sense = now;
 		sense_handler();
 		/* danger! running these procedures can trigger srst assertions and power dropouts.
 		 * We need to avoid an infinite loop/recursion here and we do that by
@@ -2554,7 +3316,8 @@ static int handle_target(void *priv)
 	}
 
 	/* Poll targets for state changes unless that's globally disabled.
-	 * Skip targets that are currently disabled.
+	 * Skip targets that are currently disabled, and those that are not
+	 * due yet unless all callbacks are being forced.
 	 */
 	for (struct target *target = all_targets;
 			is_jtag_poll_safe() && target;
@@ -2566,6 +3329,13 @@ static int handle_target(void *priv)
 		if (!target->tap->enabled)
 			continue;
 
+		struct target_poll_sched *ps = &target->poll_sched;
+		if (!timer_callbacks_forced && ps->next_ms > now)
+			continue;
+
+		/* until a poll succeeds, the backoff below counts in polling_interval */
+		ps->next_ms = now + polling_interval;
+
 		if (target->backoff.times > target->backoff.count) {
 			/* do not poll this time as we failed previously */
 			target->backoff.count++;
@@ -2575,6 +3345,8 @@ static int handle_target(void *priv)
 
 		/* only poll target if we've got power and srst isn't asserted */
 		if (!powerDropout && !srstAsserted) {
+			enum target_state prev_state = target->state;
+
 			/* polling may fail silently until the target has been examined */
 			retval = target_poll(target);
 			if (retval != ERROR_OK) {
@@ -2599,15 +3371,29 @@ static int handle_target(void *priv)
 					target->examined = true;
 					LOG_USER("Examination failed, GDB will be halted. Polling again in %dms",
 						 target->backoff.times * polling_interval);
-					return retval;
+					break;
 				}
 			}
 
 			/* Since we succeeded, we reset backoff count */
 			target->backoff.times = 0;
+
+			target_poll_sched_update(target, prev_state, now);
 		}
 	}
 
+	/* come back when the next target is due */
+	if (target_poll_timer) {
+		int64_t next = now + polling_interval;
+
+		for (struct target *target = all_targets; target; target = target->next) {
+			if (target_was_examined(target) && target->tap->enabled)
+				next = MIN(next, target->poll_sched.next_ms);
+		}
+
+		target_poll_timer->time_ms = next > now ? next - now : 0;
+	}
+
 	return retval;
 }
 
@@ -2664,22 +3450,13 @@ COMMAND_HANDLER(handle_reg_command)
 		unsigned num;
 		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num);
 
-		struct reg_cache *cache = target->reg_cache;
-		count = 0;
-		while (cache) {
-			unsigned i;
-			for (i = 0; i < cache->num_regs; i++) {
-				if (count++ == num) {
-					reg = &cache->reg_list[i];
-					break;
-				}
-			}
-			if (reg)
-				break;
-			cache = cache->next;
-		}
+		reg = register_get_by_number(target->reg_cache, num);
 
 		if (!reg) {
+			count = 0;
+			for (struct reg_cache *cache = target->reg_cache; cache; cache = cache->next)
+				count += cache->num_regs;
+
 			command_print(CMD_CTX, "%i is out of bounds, the current target "
 					"has only %i registers (0 - %i)", num, count, count - 1);
 			return ERROR_OK;
@@ -2728,7 +3505,31 @@ COMMAND_HANDLER(handle_reg_command)
 		return ERROR_OK;
 	}
 
-	return ERROR_COMMAND_SYNTAX_ERROR;
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+COMMAND_HANDLER(handle_poll_stats_command)
+{
+	command_print(CMD_CTX, "polling interval: %d..%d ms",
+			poll_interval_min, poll_interval_max);
+
+	for (struct target *target = all_targets; target; target = target->next) {
+		struct target_poll_sched *ps = &target->poll_sched;
+
+		command_print(CMD_CTX, "%s: %s, polled every %d ms, %" PRIu64 " polls, "
+				"%" PRIu64 " state changes, change probability %u%%",
+				target_name(target), target_state_name(target),
+				ps->interval_ms, ps->num_polls, ps->num_changes,
+				ps->change_prob * 100 / 256);
+
+		if (ps->num_halts)
+			command_print(CMD_CTX, "  halt detected within %" PRId64 " ms on average, "
+					"%" PRId64 " ms at worst (%" PRIu64 " halts)",
+					ps->halt_latency_total_ms / (int64_t)ps->num_halts,
+					ps->halt_latency_max_ms, ps->num_halts);
+	}
+
+	return ERROR_OK;
 }
 
 COMMAND_HANDLER(handle_poll_command)
@@ -2750,6 +3551,26 @@ COMMAND_HANDLER(handle_poll_command)
 		retval = target_arch_state(target);
 		if (retval != ERROR_OK)
 			return retval;
+	} else if (strcmp(CMD_ARGV[0], "stats") == 0) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		return CALL_COMMAND_HANDLER(handle_poll_stats_command);
+	} else if (strcmp(CMD_ARGV[0], "interval") == 0) {
+		if (CMD_ARGC > 3)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		int min_ms = poll_interval_min, max_ms = poll_interval_max;
+		if (CMD_ARGC >= 2)
+			COMMAND_PARSE_NUMBER(int, CMD_ARGV[1], min_ms);
+		if (CMD_ARGC == 3)
+			COMMAND_PARSE_NUMBER(int, CMD_ARGV[2], max_ms);
+		if (min_ms < 1 || max_ms < min_ms) {
+			command_print(CMD_CTX, "need 1 <= min_ms <= max_ms");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		poll_interval_min = min_ms;
+		poll_interval_max = max_ms;
+		command_print(CMD_CTX, "polling interval: %d..%d ms",
+				poll_interval_min, poll_interval_max);
 	} else if (CMD_ARGC == 1) {
 		bool enable;
 		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
@@ -3186,19 +4007,27 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
+		const uint8_t *data;
+
+		/* use the section in place if the image has it in memory */
+		buffer = NULL;
+		buf_cnt = image.sections[i].size;
+		if (image_section_data(&image, i, 0x0, buf_cnt, &data) != ERROR_OK) {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				retval = ERROR_FAIL;
+				break;
+			}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3219,7 +4048,7 @@ COMMAND_HANDLER(handle_load_image_command)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3358,22 +4187,30 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 	int diffs = 0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-					"error allocating buffer for section (%d bytes)",
-					(int)(image.sections[i].size));
-			break;
-		}
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+		const uint8_t *image_data;
+
+		/* use the section in place if the image has it in memory */
+		buffer = NULL;
+		buf_cnt = image.sections[i].size;
+		if (image_section_data(&image, i, 0x0, buf_cnt, &image_data) != ERROR_OK) {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+						"error allocating buffer for section (%d bytes)",
+						(int)(image.sections[i].size));
+				break;
+			}
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			image_data = buffer;
 		}
 
 		if (verify >= IMAGE_VERIFY) {
 			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
+			retval = image_calculate_checksum(image_data, buf_cnt, &checksum);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3410,13 +4247,13 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 				if (retval == ERROR_OK) {
 					uint32_t t;
 					for (t = 0; t < buf_cnt; t++) {
-						if (data[t] != buffer[t]) {
+						if (data[t] != image_data[t]) {
 							command_print(CMD_CTX,
 										  "diff %d address 0x%08x. Was 0x%02x instead of 0x%02x",
 										  diffs,
 										  (unsigned)(t + image.sections[i].base_address),
 										  data[t],
-										  buffer[t]);
+										  image_data[t]);
 							if (diffs++ >= 127) {
 								command_print(CMD_CTX, "More than 128 errors, the rest are not printed.");
 								free(data);
@@ -3592,17 +4429,73 @@ COMMAND_HANDLER(handle_bp_command)
 	}
 }
 
+/* parse the addresses at the end of a bp_bulk or rbp command line */
+static int parse_bp_addresses(struct command_context *cmd_ctx, unsigned argc,
+		const char **argv, uint32_t **addresses)
+{
+	*addresses = malloc(argc * sizeof(uint32_t));
+	if (*addresses == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned i = 0; i < argc; i++) {
+		int retval = parse_u32(argv[i], &(*addresses)[i]);
+		if (retval != ERROR_OK) {
+			command_print(cmd_ctx, "invalid address: %s", argv[i]);
+			free(*addresses);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_bp_bulk_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	enum breakpoint_type type = BKPT_SOFT;
+	unsigned first = 1;
+	uint32_t length;
+	uint32_t *addresses;
+
+	if (CMD_ARGC >= 2 && strcmp(CMD_ARGV[1], "hw") == 0) {
+		type = BKPT_HARD;
+		first = 2;
+	}
+	if (CMD_ARGC <= first)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], length);
+
+	int retval = parse_bp_addresses(CMD_CTX, CMD_ARGC - first, CMD_ARGV + first, &addresses);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = breakpoint_add_bulk(target, addresses, CMD_ARGC - first, length, type);
+	if (retval == ERROR_OK)
+		command_print(CMD_CTX, "%u breakpoints set", CMD_ARGC - first);
+	else
+		LOG_ERROR("Failure setting breakpoints, those before the failing one stay set");
+
+	free(addresses);
+	return retval;
+}
+
 COMMAND_HANDLER(handle_rbp_command)
 {
-	if (CMD_ARGC != 1)
+	if (CMD_ARGC < 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	uint32_t addr;
-	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], addr);
+	uint32_t *addresses;
+	int retval = parse_bp_addresses(CMD_CTX, CMD_ARGC, CMD_ARGV, &addresses);
+	if (retval != ERROR_OK)
+		return retval;
 
 	struct target *target = get_current_target(CMD_CTX);
-	breakpoint_remove(target, addr);
+	breakpoint_remove_bulk(target, addresses, CMD_ARGC);
 
+	free(addresses);
 	return ERROR_OK;
 }
 
@@ -3733,9 +4626,116 @@ static void writeString(FILE *f, char *s)
 
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
+/*
+ * PC samples, counted per address.  Profiling with a fast sampling method
+ * yields far more samples than there are distinct addresses, so they are
+ * counted in an open addressing hash table as they arrive instead of being
+ * stored; the histogram buckets are only laid out once the address range
+ * is known, when the profile is written.
+ */
+struct target_profile {
+	uint32_t *address;
+	uint32_t *count;		/* 0 marks an unused entry */
+	uint32_t size;			/* a power of two */
+	uint32_t used;
+	uint64_t num_samples;
+};
+
+static struct target_profile *target_profile_new(void)
+{
+	struct target_profile *profile = calloc(1, sizeof(*profile));
+	if (profile == NULL)
+		return NULL;
+
+	profile->size = 1024;
+	profile->address = malloc(profile->size * sizeof(uint32_t));
+	profile->count = calloc(profile->size, sizeof(uint32_t));
+	if (profile->address == NULL || profile->count == NULL) {
+		free(profile->address);
+		free(profile->count);
+		free(profile);
+		return NULL;
+	}
+
+	return profile;
+}
+
+static void target_profile_free(struct target_profile *profile)
+{
+	free(profile->address);
+	free(profile->count);
+	free(profile);
+}
+
+static inline uint32_t target_profile_hash(uint32_t address, uint32_t size)
+{
+	/* the lowest bit of a PC sample is usually zero */
+	return ((address >> 1) * 2654435761u) & (size - 1);
+}
+
+static int target_profile_grow(struct target_profile *profile)
+{
+	uint32_t size = profile->size * 2;
+	uint32_t *address = malloc(size * sizeof(uint32_t));
+	uint32_t *count = calloc(size, sizeof(uint32_t));
+
+	if (address == NULL || count == NULL) {
+		free(address);
+		free(count);
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < profile->size; i++) {
+		if (profile->count[i] == 0)
+			continue;
+
+		uint32_t h = target_profile_hash(profile->address[i], size);
+		while (count[h])
+			h = (h + 1) & (size - 1);
+		address[h] = profile->address[i];
+		count[h] = profile->count[i];
+	}
+
+	free(profile->address);
+	free(profile->count);
+	profile->address = address;
+	profile->count = count;
+	profile->size = size;
+
+	return ERROR_OK;
+}
+
+int target_profile_add_sample(struct target_profile *profile, uint32_t address)
+{
+	uint32_t h = target_profile_hash(address, profile->size);
+
+	while (profile->count[h] && profile->address[h] != address)
+		h = (h + 1) & (profile->size - 1);
+
+	if (profile->count[h] == 0) {
+		/* keep the table at most half full */
+		if (2 * (profile->used + 1) > profile->size) {
+			if (target_profile_grow(profile) != ERROR_OK) {
+				LOG_ERROR("No memory to store samples.");
+				return ERROR_FAIL;
+			}
+			return target_profile_add_sample(profile, address);
+		}
+		profile->address[h] = address;
+		profile->used++;
+	}
+
+	if (profile->count[h] < UINT32_MAX)
+		profile->count[h]++;
+	profile->num_samples++;
+
+	return ERROR_OK;
+}
+
 /* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filename, bool with_range,
-			uint32_t start_address, uint32_t end_address, struct target *target)
+static void write_gmon(struct target_profile *profile, const char *filename, bool with_range,
+			uint32_t start_address, uint32_t end_address, uint32_t sample_rate,
+			struct target *target)
 {
 	uint32_t i;
 	FILE *f = fopen(filename, "w");
@@ -3757,18 +4757,24 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 		min = start_address;
 		max = end_address;
 	} else {
-		min = samples[0];
-		max = samples[0];
-		for (i = 0; i < sampleNum; i++) {
-			if (min > samples[i])
-				min = samples[i];
-			if (max < samples[i])
-				max = samples[i];
+		min = UINT32_MAX;
+		max = 0;
+		for (i = 0; i < profile->size; i++) {
+			if (profile->count[i] == 0)
+				continue;
+			if (min > profile->address[i])
+				min = profile->address[i];
+			if (max < profile->address[i])
+				max = profile->address[i];
 		}
 
 		/* max should be (largest sample + 1)
 		 * Refer to binutils/gprof/hist.c (find_histogram_for_pc) */
 		max++;
+
+		/* a core spinning on a single instruction */
+		if (max - min < 2)
+			max = min + 2;
 	}
 
 	int addressSpace = max - min;
@@ -3780,14 +4786,16 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	uint32_t numBuckets = addressSpace / sizeof(UNIT);
 	if (numBuckets > maxBuckets)
 		numBuckets = maxBuckets;
-	int *buckets = malloc(sizeof(int) * numBuckets);
+	uint64_t *buckets = calloc(numBuckets, sizeof(*buckets));
 	if (buckets == NULL) {
 		fclose(f);
 		return;
 	}
-	memset(buckets, 0, sizeof(int) * numBuckets);
-	for (i = 0; i < sampleNum; i++) {
-		uint32_t address = samples[i];
+	for (i = 0; i < profile->size; i++) {
+		uint32_t address = profile->address[i];
+
+		if (profile->count[i] == 0)
+			continue;
 
 		if ((address < min) || (max <= address))
 			continue;
@@ -3796,14 +4804,29 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 		long long b = numBuckets;
 		long long c = addressSpace;
 		int index_t = (a * b) / c; /* danger!!!! int32 overflows */
-		buckets[index_t]++;
+		buckets[index_t] += profile->count[i];
+	}
+
+	/* gmon buckets are 16 bits wide.  Rather than clipping the hot spots,
+	 * scale all buckets and the sample rate down by the same factor, which
+	 * keeps both the relative weights and the times gprof reports. */
+	uint64_t max_bucket = 0;
+	for (i = 0; i < numBuckets; i++)
+		max_bucket = MAX(max_bucket, buckets[i]);
+	if (max_bucket > 65535) {
+		uint64_t scale = DIV_ROUND_UP(max_bucket, 65535);
+
+		for (i = 0; i < numBuckets; i++)
+			buckets[i] = (buckets[i] + scale / 2) / scale;
+		sample_rate = MAX((sample_rate + scale / 2) / scale, 1);
+		LOG_INFO("scaled the gmon histogram down by %" PRIu64 " to fit 16 bit buckets", scale);
 	}
 
 	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
 	writeLong(f, min, target);			/* low_pc */
 	writeLong(f, max, target);			/* high_pc */
 	writeLong(f, numBuckets, target);	/* # of buckets */
-	writeLong(f, 100, target);			/* KLUDGE! We lie, ca. 100Hz best case. */
+	writeLong(f, sample_rate, target);	/* samples per second */
 	writeString(f, "seconds");
 	for (i = 0; i < (15-strlen("seconds")); i++)
 		writeData(f, &zero, 1);
@@ -3814,10 +4837,7 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	char *data = malloc(2 * numBuckets);
 	if (data != NULL) {
 		for (i = 0; i < numBuckets; i++) {
-			int val;
-			val = buckets[i];
-			if (val > 65535)
-				val = 65535;
+			uint32_t val = MIN(buckets[i], 65535);
 			data[i * 2] = val&0xff;
 			data[i * 2 + 1] = (val >> 8) & 0xff;
 		}
@@ -3839,15 +4859,22 @@ COMMAND_HANDLER(handle_profile_command)
 	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	const uint32_t MAX_PROFILE_SAMPLE_NUM = 10000;
 	uint32_t offset;
-	uint32_t num_of_samples;
 	int retval = ERROR_OK;
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], offset);
 
-	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
-	if (samples == NULL) {
+	uint32_t start_address = 0;
+	uint32_t end_address = 0;
+	bool with_range = false;
+	if (CMD_ARGC == 4) {
+		with_range = true;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+	}
+
+	struct target_profile *profile = target_profile_new();
+	if (profile == NULL) {
 		LOG_ERROR("No memory to store samples.");
 		return ERROR_FAIL;
 	}
@@ -3857,48 +4884,49 @@ COMMAND_HANDLER(handle_profile_command)
 	 * annoying halt/resume step; for example, ARMv7 PCSR.
 	 * Provide a way to use that more efficient mechanism.
 	 */
-	retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
-				&num_of_samples, offset);
+	int64_t started = timeval_ms();
+	retval = target_profiling(target, profile, offset);
+	int64_t elapsed = timeval_ms() - started;
 	if (retval != ERROR_OK) {
-		free(samples);
+		target_profile_free(profile);
 		return retval;
 	}
 
-	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
-
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
-		free(samples);
+		target_profile_free(profile);
 		return retval;
 	}
 	if (target->state == TARGET_RUNNING) {
 		retval = target_halt(target);
 		if (retval != ERROR_OK) {
-			free(samples);
+			target_profile_free(profile);
 			return retval;
 		}
 	}
 
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
-		free(samples);
+		target_profile_free(profile);
 		return retval;
 	}
 
-	uint32_t start_address = 0;
-	uint32_t end_address = 0;
-	bool with_range = false;
-	if (CMD_ARGC == 4) {
-		with_range = true;
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+	if (profile->num_samples == 0 && !with_range) {
+		command_print(CMD_CTX, "No samples collected, not writing %s", CMD_ARGV[1]);
+		target_profile_free(profile);
+		return ERROR_OK;
 	}
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
-		   with_range, start_address, end_address, target);
-	command_print(CMD_CTX, "Wrote %s", CMD_ARGV[1]);
+	uint32_t sample_rate = 1;
+	if (elapsed > 0 && profile->num_samples * 1000 / elapsed > 1)
+		sample_rate = profile->num_samples * 1000 / elapsed;
+
+	write_gmon(profile, CMD_ARGV[1], with_range, start_address, end_address,
+		   sample_rate, target);
+	command_print(CMD_CTX, "Wrote %s (%" PRIu64 " samples at %" PRIu32 " samples/s)",
+		      CMD_ARGV[1], profile->num_samples, sample_rate);
 
-	free(samples);
+	target_profile_free(profile);
 	return retval;
 }
 
@@ -5404,6 +6432,7 @@ static int target_create(Jim_GetOptInfo *goi)
 	target->working_area        = 0x0;
 	target->working_area_size   = 0x0;
 	target->working_areas       = NULL;
+	target->working_area_pool   = NULL;
 	target->backup_working_area = 0;
 
 	target->state               = TARGET_UNKNOWN;
@@ -5411,6 +6440,7 @@ static int target_create(Jim_GetOptInfo *goi)
 	target->reg_cache           = NULL;
 	target->breakpoints         = NULL;
 	target->watchpoints         = NULL;
+	target->bpwp_index          = NULL;
 	target->next                = NULL;
 	target->arch_info           = NULL;
 
@@ -5808,6 +6838,225 @@ COMMAND_HANDLER(handle_fast_load_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_working_area_stats_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct working_area_pool *pool = target->working_area_pool;
+
+	if (pool == NULL) {
+		command_print(CMD_CTX, "working area not used yet");
+		return ERROR_OK;
+	}
+
+	uint32_t free_bytes = 0;
+	unsigned free_areas = 0, used_areas = 0;
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (c->free) {
+			free_bytes += c->size;
+			free_areas++;
+		} else
+			used_areas++;
+	}
+
+	command_print(CMD_CTX, "working area 0x%8.8" PRIx32 ", %" PRIu32 " bytes, backup %s",
+			pool->address, pool->size,
+			target->backup_working_area ? "enabled" : "disabled");
+	command_print(CMD_CTX, "%u areas in use (%" PRIu32 " bytes, peak %" PRIu32 "), "
+			"%u free (%" PRIu32 " bytes, largest %" PRIu32 ")",
+			used_areas, pool->in_use, pool->peak_in_use,
+			free_areas, free_bytes, target_get_working_area_avail(target));
+	command_print(CMD_CTX, "%" PRIu32 " allocations, %" PRIu32 " failed, %" PRIu32 " frees",
+			pool->allocs, pool->alloc_failures, pool->frees);
+	command_print(CMD_CTX, "backup: %" PRIu64 " bytes read, %" PRIu64 " bytes reused, "
+			"%" PRIu64 " bytes restored",
+			pool->backup_read, pool->backup_reused, pool->restored);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration working_area_command_handlers[] = {
+	{
+		.name = "stats",
+		.handler = handle_working_area_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show working area allocation and backup statistics",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+COMMAND_HANDLER(handle_mem_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+
+		struct target_mem_cache *cache = mem_cache_get(target);
+		if (cache == NULL)
+			return ERROR_FAIL;
+
+		if (enable && !cache->enabled) {
+			cache->data = malloc(MEM_CACHE_SLOTS * MEM_CACHE_PAGE_SIZE);
+			cache->fill_buffer = malloc(MEM_CACHE_MAX_READ + MEM_CACHE_PAGE_SIZE);
+			if (cache->data == NULL || cache->fill_buffer == NULL) {
+				LOG_ERROR("out of memory");
+				enable = false;
+			}
+		}
+
+		if (!enable) {
+			mem_cache_drop(cache);
+			free(cache->data);
+			cache->data = NULL;
+			free(cache->fill_buffer);
+			cache->fill_buffer = NULL;
+		}
+
+		cache->enabled = enable;
+	}
+
+	bool enabled = target->mem_cache && target->mem_cache->enabled;
+	command_print(CMD_CTX, "memory read cache of %s is %s",
+			target_name(target), enabled ? "on" : "off");
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_volatile_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct target_mem_cache *cache;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "clear") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		cache = target->mem_cache;
+		if (cache) {
+			free(cache->volatile_ranges);
+			cache->volatile_ranges = NULL;
+			cache->num_volatile = 0;
+		}
+	} else if (CMD_ARGC == 2) {
+		uint32_t address, size;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+		if (size == 0 || address + size - 1 < address) {
+			command_print(CMD_CTX, "invalid range 0x%8.8" PRIx32 " + 0x%" PRIx32,
+					address, size);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+
+		cache = mem_cache_get(target);
+		if (cache == NULL)
+			return ERROR_FAIL;
+
+		struct mem_cache_range *ranges = realloc(cache->volatile_ranges,
+				(cache->num_volatile + 1) * sizeof(*ranges));
+		if (ranges == NULL) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		ranges[cache->num_volatile].address = address;
+		ranges[cache->num_volatile].size = size;
+		cache->volatile_ranges = ranges;
+		cache->num_volatile++;
+
+		/* pages read so far may lie in the new range */
+		mem_cache_invalidate(target);
+	} else if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	cache = target->mem_cache;
+	if (cache == NULL || cache->num_volatile == 0) {
+		command_print(CMD_CTX, "no volatile memory ranges");
+		return ERROR_OK;
+	}
+
+	for (unsigned i = 0; i < cache->num_volatile; i++) {
+		struct mem_cache_range *r = &cache->volatile_ranges[i];
+		command_print(CMD_CTX, "0x%8.8" PRIx32 " - 0x%8.8" PRIx32,
+				r->address, r->address + r->size - 1);
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_flush_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_mem_cache_invalidate(get_current_target(CMD_CTX));
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_stats_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL || !cache->enabled) {
+		command_print(CMD_CTX, "memory read cache is off");
+		return ERROR_OK;
+	}
+
+	uint64_t pages = cache->page_hits + cache->page_misses;
+
+	command_print(CMD_CTX, "%" PRIu32 " of %d pages of %d bytes in use, "
+			"%" PRIu64 " invalidations",
+			cache->num_pages, MEM_CACHE_MAX_PAGES, MEM_CACHE_PAGE_SIZE,
+			cache->invalidations);
+	command_print(CMD_CTX, "%" PRIu64 " reads cached, %" PRIu64 " passed through",
+			cache->reads, cache->bypassed);
+	command_print(CMD_CTX, "pages: %" PRIu64 " hits, %" PRIu64 " misses (%u%% hit rate)",
+			cache->page_hits, cache->page_misses,
+			pages ? (unsigned)(cache->page_hits * 100 / pages) : 0);
+	command_print(CMD_CTX, "%" PRIu64 " target reads to fill pages, %" PRIu64 " failed",
+			cache->target_reads, cache->fill_failures);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_cache_command_handlers[] = {
+	{
+		.name = "volatile",
+		.handler = handle_mem_cache_volatile_command,
+		.mode = COMMAND_ANY,
+		.help = "list or add memory ranges that are never cached, "
+			"or remove all of them",
+		.usage = "[address size | 'clear']",
+	},
+	{
+		.name = "flush",
+		.handler = handle_mem_cache_flush_command,
+		.mode = COMMAND_EXEC,
+		.help = "drop all cached memory",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_mem_cache_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show memory read cache statistics",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration target_command_handlers[] = {
 	{
 		.name = "targets",
@@ -6084,6 +7333,21 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.usage = "seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
+	{
+		.name = "working_area",
+		.mode = COMMAND_ANY,
+		.help = "working area commands",
+		.usage = "",
+		.chain = working_area_command_handlers,
+	},
+	{
+		.name = "mem_cache",
+		.handler = handle_mem_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "turn the memory read cache of the current target on or off",
+		.usage = "['on'|'off']",
+		.chain = mem_cache_command_handlers,
+	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
 		.name = "virt2phys",
@@ -6104,8 +7368,9 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "poll",
 		.handler = handle_poll_command,
 		.mode = COMMAND_EXEC,
-		.help = "poll target state; or reconfigure background polling",
-		.usage = "['on'|'off']",
+		.help = "poll target state; or reconfigure background polling; "
+			"or show how background polling adapted to the targets",
+		.usage = "['on'|'off'|'stats'|'interval' [min_ms [max_ms]]]",
 	},
 	{
 		.name = "wait_halt",
@@ -6201,12 +7466,20 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "list or set hardware or software breakpoint",
 		.usage = "<address> [<asid>]<length> ['hw'|'hw_ctx']",
 	},
+	{
+		.name = "bp_bulk",
+		.handler = handle_bp_bulk_command,
+		.mode = COMMAND_EXEC,
+		.help = "set software or hardware breakpoints of the same length "
+			"at several addresses",
+		.usage = "length ['hw'] address [address ...]",
+	},
 	{
 		.name = "rbp",
 		.handler = handle_rbp_command,
 		.mode = COMMAND_EXEC,
-		.help = "remove breakpoint",
-		.usage = "address",
+		.help = "remove breakpoints",
+		.usage = "address [address ...]",
 	},
 	{
 		.name = "wp",
@@ -96,11 +96,18 @@ struct working_area {
 	uint32_t address;
 	uint32_t size;
 	bool free;
-	uint8_t *backup;
 	struct working_area **user;
-	struct working_area *next;
+	struct working_area *next;			/* areas are kept in address order */
+	struct working_area *prev;
+	struct working_area *free_next;		/* free areas of the same size class */
+	struct working_area *free_prev;
 };
 
+struct working_area_pool;
+struct target_mem_cache;
+struct bpwp_index;
+struct target_profile;
+
 struct gdb_service {
 	struct target *target;
 	/*  field for smp display  */
@@ -116,6 +123,23 @@ struct backoff_timer {
 	int count;
 };
 
+/* adaptive background polling, see handle_target() */
+struct target_poll_sched {
+	int interval_ms;		/* current polling interval */
+	int64_t next_ms;		/* next poll is due, in monotonic_ms() */
+	int64_t last_ms;		/* last poll, 0 if never polled */
+	/* estimated probability that a poll sees a state change, in 1/256 */
+	unsigned change_prob;
+
+	/* for "poll stats" */
+	uint64_t num_polls;
+	uint64_t num_changes;
+	uint64_t num_halts;
+	/* time between the poll that saw a halt and the one before it */
+	int64_t halt_latency_total_ms;
+	int64_t halt_latency_max_ms;
+};
+
 /* split target registers into multiple class */
 enum target_register_class {
 	REG_CLASS_ALL,
@@ -162,6 +186,9 @@ struct target {
 	uint32_t working_area_size;			/* size in bytes */
 	uint32_t backup_working_area;		/* whether the content of the working area has to be preserved */
 	struct working_area *working_areas;/* list of allocated working areas */
+	struct working_area_pool *working_area_pool;	/* free lists, backup and statistics */
+	struct target_mem_cache *mem_cache;	/* memory read cache, see "mem_cache" */
+	uint32_t mem_generation;			/* changes whenever memory may have changed */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
@@ -169,6 +196,7 @@ struct target {
 	struct reg_cache *reg_cache;		/* the first register cache of the target (core regs) */
 	struct breakpoint *breakpoints;		/* list of breakpoints */
 	struct watchpoint *watchpoints;		/* list of watchpoints */
+	struct bpwp_index *bpwp_index;		/* address index of both lists */
 	struct trace *trace_info;			/* generic trace information */
 	struct debug_msg_receiver *dbgmsg;	/* list of debug message receivers */
 	uint32_t dbg_msg_enabled;			/* debug message status */
@@ -189,6 +217,7 @@ struct target {
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
 	struct backoff_timer backoff;
+	struct target_poll_sched poll_sched;
 	int smp;							/* add some target attributes for smp support */
 	struct target_list *head;
 	/* the gdb service is there in case of smp, we have only one gdb server
@@ -305,7 +334,12 @@ struct target_timer_callback {
 	int time_ms;
 	int periodic;
 	bool removed;
-	struct timeval when;
+	/* deadline, in monotonic_ms() */
+	int64_t when;
+	/* orders callbacks with the same deadline by when they were scheduled */
+	uint64_t seq;
+	/* position in the deadline heap, -1 while being called */
+	int heap_index;
 	void *priv;
 	struct target_timer_callback *next;
 };
@@ -368,12 +402,24 @@ int target_register_timer_callback(int (*callback)(void *priv),
 		int time_ms, int periodic, void *priv);
 int target_unregister_timer_callback(int (*callback)(void *priv), void *priv);
 int target_call_timer_callbacks(void);
+/**
+ * @returns the number of ms until the next timer callback is due, 0 if
+ * one is overdue and -1 if there are no timer callbacks.
+ */
+int target_timer_callbacks_next_ms(void);
 /**
  * Invoke this to ensure that e.g. polling timer callbacks happen before
  * a synchronous command completes.
  */
 int target_call_timer_callbacks_now(void);
 
+/**
+ * Poll @a target at the shortest polling interval for a while, because it
+ * is likely to change state soon: it was just resumed, or it is talking
+ * to us over DCC.
+ */
+void target_poll_soon(struct target *target);
+
 struct target *get_target_by_num(int num);
 struct target *get_current_target(struct command_context *cmd_ctx);
 struct target *get_target(const char *id);
@@ -580,6 +626,22 @@ int target_write_buffer(struct target *target,
 		uint32_t address, uint32_t size, const uint8_t *buffer);
 int target_read_buffer(struct target *target,
 		uint32_t address, uint32_t size, uint8_t *buffer);
+
+/**
+ * Drop everything the memory read cache of @a target holds and bump
+ * target->mem_generation, which tells other copies of target memory
+ * that they are stale.  The target layer does this itself whenever it
+ * resumes, steps, runs an algorithm, writes memory or sends an event;
+ * call it after changing target memory behind its back (a flash
+ * controller, for instance).
+ */
+void target_mem_cache_invalidate(struct target *target);
+
+/**
+ * @returns true if [@a address, @a address + @a size) overlaps memory
+ * declared with "mem_cache volatile", which must only be read on demand.
+ */
+bool target_mem_is_volatile(struct target *target, uint32_t address, uint32_t size);
 int target_checksum_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t *crc);
 int target_blank_check_memory(struct target *target,
@@ -600,6 +662,25 @@ int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fi
  */
 int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
+/**
+ * Sample the PC of a halted target for @a seconds, counting the samples
+ * in @a profile.
+ *
+ * This routine is a wrapper for target->type->profiling.
+ */
+int target_profiling(struct target *target, struct target_profile *profile,
+		uint32_t seconds);
+
+/**
+ * Sample the PC by halting and resuming the target; for targets that have
+ * no better way, or as their fallback.
+ */
+int target_profiling_default(struct target *target, struct target_profile *profile,
+		uint32_t seconds);
+
+/** Count one PC sample at @a address. */
+int target_profile_add_sample(struct target_profile *profile, uint32_t address);
+
 
 
 /** Return the *name* of this targets current state */
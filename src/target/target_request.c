@@ -34,15 +34,6 @@
 #include "target_type.h"
 #include "trace.h"
 
-static bool got_message;
-
-bool target_got_message(void)
-{
-	bool t = got_message;
-	got_message = false;
-	return t;
-}
-
 static int charmsg_mode;
 
 static int target_asciimsg(struct target *target, uint32_t length)
@@ -122,8 +113,8 @@ int target_request(struct target *target, uint32_t request)
 
 	assert(target->type->target_request_data);
 
-	/* Record that we got a target message for back-off algorithm */
-	got_message = true;
+	/* a target talking over DCC is busy, and may well halt next */
+	target_poll_soon(target);
 
 	if (charmsg_mode) {
 		target_charmsg(target, target_req_cmd);
@@ -270,10 +270,11 @@ struct target_type {
 	 */
 	int (*gdb_fileio_end)(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
-	/* do target profiling
+	/* do target profiling, adding the PC samples to the profile with
+	 * target_profile_add_sample()
 	 */
-	int (*profiling)(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+	int (*profiling)(struct target *target, struct target_profile *profile,
+			uint32_t seconds);
 };
 
 #endif /* OPENOCD_TARGET_TARGET_TYPE_H */
@@ -0,0 +1,366 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Checks the address index of breakpoints.c against walks of the
+ * target's breakpoint list, which is what lookups did before there was
+ * an index.  Random adds, removes and lookups of all kinds of breakpoints
+ * and watchpoints are run on a target with no hardware behind it, which
+ * refuses a breakpoint now and then.
+ *
+ * Usage: test_breakpoints [iterations [seed]]
+ *        test_breakpoints bench
+ *
+ * "make check" runs the fuzz test; "bench" times setting, finding and
+ * removing 10k breakpoints, one at a time and in bulk, and the same
+ * lookups done by walking the list.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "target.h"
+#include "breakpoints.h"
+#include <helper/log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* what breakpoints.c needs from outside, without a target type */
+int debug_level = LOG_LVL_USER;
+
+void log_printf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+void log_printf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+/* one in refuse_one_in breakpoints fails to be set, 0 for none */
+static unsigned refuse_one_in;
+static unsigned refuse_count;
+
+int target_add_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	if (refuse_one_in && ++refuse_count % refuse_one_in == 0)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	return ERROR_OK;
+}
+
+int target_add_context_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	return ERROR_OK;
+}
+
+int target_add_hybrid_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	return ERROR_OK;
+}
+
+int target_remove_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	return ERROR_OK;
+}
+
+int target_add_watchpoint(struct target *target, struct watchpoint *watchpoint)
+{
+	return ERROR_OK;
+}
+
+int target_remove_watchpoint(struct target *target, struct watchpoint *watchpoint)
+{
+	return ERROR_OK;
+}
+
+int target_hit_watchpoint(struct target *target, struct watchpoint **hit_watchpoint)
+{
+	return ERROR_FAIL;
+}
+
+/* the lookups as they were done on the list alone */
+static struct breakpoint *ref_find(struct target *target, uint32_t address)
+{
+	for (struct breakpoint *b = target->breakpoints; b; b = b->next) {
+		if (b->address == address)
+			return b;
+	}
+	return NULL;
+}
+
+/* breakpoint_remove() takes a breakpoint at the address or a context
+ * breakpoint for it as the asid, whichever comes first on the list */
+static struct breakpoint *ref_find_removed(struct target *target, uint32_t address)
+{
+	for (struct breakpoint *b = target->breakpoints; b; b = b->next) {
+		if (b->address == address || (b->address == 0 && b->asid == address))
+			return b;
+	}
+	return NULL;
+}
+
+static struct watchpoint *ref_find_watchpoint(struct target *target, uint32_t address)
+{
+	for (struct watchpoint *w = target->watchpoints; w; w = w->next) {
+		if (w->address == address)
+			return w;
+	}
+	return NULL;
+}
+
+static unsigned count_breakpoints(struct target *target)
+{
+	unsigned count = 0;
+
+	for (struct breakpoint *b = target->breakpoints; b; b = b->next)
+		count++;
+	return count;
+}
+
+/* the list must stay doubly linked and in the order points were added */
+static bool lists_consistent(struct target *target)
+{
+	struct breakpoint *prev = NULL;
+
+	for (struct breakpoint *b = target->breakpoints; b; prev = b, b = b->next) {
+		if (b->prev != prev || (prev && prev->unique_id >= b->unique_id))
+			return false;
+	}
+
+	struct watchpoint *wprev = NULL;
+	for (struct watchpoint *w = target->watchpoints; w; wprev = w, w = w->next) {
+		if (w->prev != wprev || (wprev && wprev->unique_id >= w->unique_id))
+			return false;
+	}
+
+	return true;
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+/* few enough addresses that adds, removes and lookups often collide */
+#define FUZZ_ADDRESSES		3000
+
+static int fuzz(unsigned long iterations)
+{
+	struct target target;
+	uint32_t addresses[16];
+
+	memset(&target, 0, sizeof(target));
+	refuse_one_in = 50;
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		uint32_t address = 2 * (rng() % FUZZ_ADDRESSES);
+		const char *failed = NULL;
+
+		switch (rng() % 12) {
+		case 0:
+		case 1:
+		case 2:
+			breakpoint_add(&target, address, 2, BKPT_SOFT);
+			break;
+		case 3:
+			hybrid_breakpoint_add(&target, address, rng() % 4, 4, BKPT_HARD);
+			break;
+		case 4:
+			if (rng() % 20 == 0)
+				context_breakpoint_add(&target, address, 4, BKPT_HARD);
+			break;
+		case 5: {
+			struct breakpoint *removed = ref_find_removed(&target, address);
+			unsigned count = count_breakpoints(&target);
+
+			breakpoint_remove(&target, address);
+			if (count_breakpoints(&target) != count - (removed ? 1 : 0)
+					|| (removed && ref_find_removed(&target, address) == removed))
+				failed = "breakpoint_remove";
+			break;
+		}
+		case 6:
+		case 7:
+			if (breakpoint_find(&target, address) != ref_find(&target, address))
+				failed = "breakpoint_find";
+			break;
+		case 8: {
+			unsigned count = 1 + rng() % ARRAY_SIZE(addresses);
+
+			for (unsigned i = 0; i < count; i++)
+				addresses[i] = 2 * (rng() % FUZZ_ADDRESSES);
+			if (rng() & 1) {
+				breakpoint_add_bulk(&target, addresses, count, 2, BKPT_SOFT);
+			} else {
+				/* several breakpoints can share an address, each
+				 * address takes off the first one still there */
+				struct breakpoint *removed[ARRAY_SIZE(addresses)];
+				unsigned removed_count = 0;
+				unsigned before = count_breakpoints(&target);
+
+				for (unsigned i = 0; i < count; i++) {
+					for (struct breakpoint *b = target.breakpoints; b; b = b->next) {
+						bool taken = false;
+						for (unsigned j = 0; j < removed_count; j++)
+							taken |= removed[j] == b;
+						if (!taken && (b->address == addresses[i]
+								|| (b->address == 0 && b->asid == addresses[i]))) {
+							removed[removed_count++] = b;
+							break;
+						}
+					}
+				}
+
+				breakpoint_remove_bulk(&target, addresses, count);
+				if (count_breakpoints(&target) != before - removed_count)
+					failed = "breakpoint_remove_bulk";
+				for (struct breakpoint *b = target.breakpoints; b; b = b->next) {
+					for (unsigned j = 0; j < removed_count; j++) {
+						if (removed[j] == b)
+							failed = "breakpoint_remove_bulk";
+					}
+				}
+			}
+			break;
+		}
+		case 9:
+			watchpoint_add(&target, address, 4, WPT_WRITE, 0, 0xffffffff);
+			break;
+		case 10:
+			watchpoint_remove(&target, address);
+			if (ref_find_watchpoint(&target, address))
+				failed = "watchpoint_remove";
+			break;
+		default:
+			if (rng() % 2000 == 0) {
+				breakpoint_clear_target(&target);
+				if (target.breakpoints)
+					failed = "breakpoint_clear_target";
+			}
+			break;
+		}
+
+		/* walking the lists costs more than all the rest, so not always */
+		if (failed == NULL && n % 64 == 0 && !lists_consistent(&target))
+			failed = "list order";
+		if (failed) {
+			printf("FAIL: iteration %lu, address 0x%" PRIx32 ": %s\n", n, address, failed);
+			return 1;
+		}
+	}
+
+	breakpoint_watchpoint_free_all(&target);
+	if (target.breakpoints || target.watchpoints || target.bpwp_index) {
+		printf("FAIL: breakpoint_watchpoint_free_all left points or the index\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+#define BENCH_BREAKPOINTS	10000
+#define BENCH_LOOKUPS		1000000
+
+static double elapsed_ns(clock_t start, unsigned count)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count;
+}
+
+static uint32_t bench_address(void)
+{
+	/* hits spread over the list, and as many misses */
+	return 0x08000000 + 2 * (rng() % (2 * BENCH_BREAKPOINTS));
+}
+
+static void bench(void)
+{
+	static uint32_t addresses[BENCH_BREAKPOINTS];
+	struct target target;
+	unsigned hits = 0;
+	clock_t start;
+
+	memset(&target, 0, sizeof(target));
+	refuse_one_in = 0;
+	for (unsigned i = 0; i < BENCH_BREAKPOINTS; i++)
+		addresses[i] = 0x08000000 + 4 * i;
+
+	printf("%u breakpoints, ns per breakpoint or lookup:\n", BENCH_BREAKPOINTS);
+
+	start = clock();
+	for (unsigned i = 0; i < BENCH_BREAKPOINTS; i++)
+		breakpoint_add(&target, addresses[i], 2, BKPT_SOFT);
+	printf("breakpoint_add          %10.1f\n", elapsed_ns(start, BENCH_BREAKPOINTS));
+
+	start = clock();
+	for (unsigned i = 0; i < BENCH_BREAKPOINTS; i++)
+		breakpoint_remove(&target, addresses[i]);
+	printf("breakpoint_remove       %10.1f\n", elapsed_ns(start, BENCH_BREAKPOINTS));
+
+	start = clock();
+	breakpoint_add_bulk(&target, addresses, BENCH_BREAKPOINTS, 2, BKPT_SOFT);
+	printf("breakpoint_add_bulk     %10.1f\n", elapsed_ns(start, BENCH_BREAKPOINTS));
+
+	start = clock();
+	for (unsigned i = 0; i < BENCH_LOOKUPS; i++)
+		hits += breakpoint_find(&target, bench_address()) != NULL;
+	printf("breakpoint_find         %10.1f\n", elapsed_ns(start, BENCH_LOOKUPS));
+
+	start = clock();
+	for (unsigned i = 0; i < BENCH_LOOKUPS / 1000; i++)
+		hits += ref_find(&target, bench_address()) != NULL;
+	printf("list walk               %10.1f\n", elapsed_ns(start, BENCH_LOOKUPS / 1000));
+
+	start = clock();
+	breakpoint_remove_bulk(&target, addresses, BENCH_BREAKPOINTS);
+	printf("breakpoint_remove_bulk  %10.1f\n", elapsed_ns(start, BENCH_BREAKPOINTS));
+
+	breakpoint_watchpoint_free_all(&target);
+	printf("%u lookups found a breakpoint\n", hits);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 100000;
+	uint64_t seed = time(NULL);
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		rng_state = 1;
+		bench();
+		return 0;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("breakpoint fuzz test, %lu iterations, seed %llu\n",
+			iterations, (unsigned long long)seed);
+
+	return fuzz(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Checks that image_calculate_checksum() computes exactly the CRC32 that
+ * gdb's "compare-sections" and the target-side checksum algorithms do:
+ * MSB first, polynomial 0x04c11db7, starting from 0xffffffff, no final
+ * xor.  The slice-by-8 code is compared with the byte at a time table
+ * gdb uses, for random lengths and alignments, and with the check value
+ * of that CRC (CRC-32/MPEG-2).
+ *
+ * Usage: test_image_crc [iterations [seed]]
+ *        test_image_crc bench
+ *
+ * "make check" runs the fuzz test; "bench" compares the throughput with
+ * the byte at a time code on a 16 MiB buffer.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "image.h"
+#include <helper/log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* what image.c needs from outside, without a target */
+int debug_level = LOG_LVL_USER;
+
+void log_printf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+void log_printf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+void keep_alive(void)
+{
+}
+
+struct target *get_target(const char *id)
+{
+	return NULL;
+}
+
+int target_read_buffer(struct target *target, uint32_t address, uint32_t size, uint8_t *buffer)
+{
+	return ERROR_FAIL;
+}
+
+FILE *open_file_from_path(const char *file, const char *mode)
+{
+	return NULL;
+}
+
+/* the CRC as gdb computes it, a byte at a time */
+static uint32_t ref_table[256];
+
+static void ref_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (int j = 0; j < 8; j++)
+			c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		ref_table[i] = c;
+	}
+}
+
+static uint32_t ref_crc32(const uint8_t *buffer, uint32_t nbytes)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (nbytes--)
+		crc = (crc << 8) ^ ref_table[((crc >> 24) ^ *buffer++) & 255];
+
+	return crc;
+}
+
+/* xorshift64*, so that a failure can be reproduced from the seed */
+static uint64_t rng_state;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static void rng_fill(uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		buf[i] = rng();
+}
+
+/* across the 32 KiB runs image_calculate_checksum() splits buffers in */
+#define TEST_MAX_BYTES		(70 * 1024)
+
+static int fuzz(unsigned long iterations)
+{
+	static const uint8_t check[] = "123456789";
+	uint8_t *buf = malloc(TEST_MAX_BYTES + 8);
+	uint32_t crc;
+
+	if (buf == NULL)
+		return 1;
+
+	image_calculate_checksum(check, sizeof(check) - 1, &crc);
+	if (crc != 0x0376e6e7) {
+		printf("FAIL: check value 0x%08" PRIx32 ", expected 0x0376e6e7\n", crc);
+		return 1;
+	}
+
+	for (unsigned long n = 0; n < iterations; n++) {
+		unsigned align = rng() % 8;
+		/* mostly short buffers, where the tail handling matters most */
+		uint32_t nbytes = (rng() & 3) ? rng() % 64 : rng() % (TEST_MAX_BYTES + 1);
+
+		rng_fill(buf + align, nbytes);
+		image_calculate_checksum(buf + align, nbytes, &crc);
+		if (crc != ref_crc32(buf + align, nbytes)) {
+			printf("FAIL: iteration %lu, %" PRIu32 " bytes at alignment %u\n",
+					n, nbytes, align);
+			return 1;
+		}
+	}
+
+	free(buf);
+	return 0;
+}
+
+#define BENCH_BYTES		(16 * 1024 * 1024)
+#define BENCH_ROUNDS		10
+
+static double mb_per_s(clock_t start, unsigned rounds)
+{
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	return (double)BENCH_BYTES * rounds / seconds / 1e6;
+}
+
+static int bench(void)
+{
+	uint8_t *buf = malloc(BENCH_BYTES);
+	volatile uint32_t sink = 0;
+	uint32_t crc;
+	clock_t start;
+
+	if (buf == NULL)
+		return 1;
+
+	rng_fill(buf, BENCH_BYTES);
+	printf("CRC32 of %u MiB, MB per second:\n", BENCH_BYTES / (1024 * 1024));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++) {
+		image_calculate_checksum(buf, BENCH_BYTES, &crc);
+		sink += crc;
+	}
+	printf("slice-by-8     %8.0f\n", mb_per_s(start, BENCH_ROUNDS));
+
+	start = clock();
+	for (unsigned r = 0; r < BENCH_ROUNDS; r++)
+		sink += ref_crc32(buf, BENCH_BYTES);
+	printf("byte at a time %8.0f\n", mb_per_s(start, BENCH_ROUNDS));
+
+	free(buf);
+	(void)sink;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 10000;
+	uint64_t seed = time(NULL);
+
+	ref_init();
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		rng_state = 1;
+		return bench() ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+
+	/* xorshift must not start from zero */
+	rng_state = seed ? seed : 1;
+	printf("CRC32 fuzz test, %lu iterations, seed %llu\n",
+			iterations, (unsigned long long)seed);
+
+	return fuzz(iterations) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
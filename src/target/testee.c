@@ -23,6 +23,7 @@
 
 #include "target.h"
 #include "target_type.h"
+#include "breakpoints.h"
 #include "hello.h"
 
 static const struct command_registration testee_command_handlers[] = {
@@ -61,6 +62,28 @@ static int testee_reset_deassert(struct target *target)
 	target->state = TARGET_RUNNING;
 	return ERROR_OK;
 }
+/* breakpoints and watchpoints are only recorded, which is enough to
+ * exercise (and time) their bookkeeping without any hardware */
+static int testee_add_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	breakpoint->set = 1;
+	return ERROR_OK;
+}
+static int testee_remove_breakpoint(struct target *target, struct breakpoint *breakpoint)
+{
+	breakpoint->set = 0;
+	return ERROR_OK;
+}
+static int testee_add_watchpoint(struct target *target, struct watchpoint *watchpoint)
+{
+	watchpoint->set = 1;
+	return ERROR_OK;
+}
+static int testee_remove_watchpoint(struct target *target, struct watchpoint *watchpoint)
+{
+	watchpoint->set = 0;
+	return ERROR_OK;
+}
 struct target_type testee_target = {
 	.name = "testee",
 	.commands = testee_command_handlers,
@@ -70,4 +93,9 @@ struct target_type testee_target = {
 	.halt = &testee_halt,
 	.assert_reset = &testee_reset_assert,
 	.deassert_reset = &testee_reset_deassert,
+
+	.add_breakpoint = &testee_add_breakpoint,
+	.remove_breakpoint = &testee_remove_breakpoint,
+	.add_watchpoint = &testee_add_watchpoint,
+	.remove_watchpoint = &testee_remove_watchpoint,
 };
@@ -41,6 +41,7 @@
 #include "xsvf.h"
 #include <jtag/jtag.h>
 #include <svf/svf.h>
+#include <helper/fileio.h>
 
 /* XSVF commands, from appendix B of xapp503.pdf  */
 #define XCOMPLETE			0x00
@@ -119,7 +120,31 @@ TDO  (1);
 
 #define XSTATE_MAX_PATH 12
 
-static int xsvf_fd;
+/* The whole XSVF file, mapped or else read into memory in one go. */
+struct xsvf_file {
+	struct fileio *fileio;
+	const uint8_t *data;
+	uint8_t *buffer;
+	size_t size;
+	size_t pos;
+};
+
+static struct xsvf_file xsvf_file;
+
+/*
+ * XSDR and XSDRTDO scans whose TDO isn't compared (XTDOMASK is all zero)
+ * and that are not retried don't need the queue to be flushed right
+ * away, they are left queued until a command that needs the queue to be
+ * run comes along, or XSVF_MAX_BATCH_BITS of them have piled up.  Scans
+ * that do compare TDO are still run one at a time, so that nothing is
+ * shifted into the device after a failed compare.
+ */
+#define XSVF_MAX_BATCH_BITS		(8 * 1024 * 1024)
+
+struct xsvf_batch {
+	unsigned scans;
+	size_t bits;
+};
 
 /* map xsvf tap state to an openocd "tap_state_t" */
 static tap_state_t xsvf_to_tap(int xsvf_state)
@@ -183,19 +208,248 @@ static tap_state_t xsvf_to_tap(int xsvf_state)
 	return ret;
 }
 
-static int xsvf_read_buffer(int num_bits, int fd, uint8_t *buf)
+static int xsvf_open(struct xsvf_file *file, const char *filename)
 {
-	int num_bytes;
+	memset(file, 0, sizeof(*file));
+
+	if (fileio_open(&file->fileio, filename, FILEIO_READ, FILEIO_BINARY) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (fileio_map(file->fileio, &file->data, &file->size) == ERROR_OK)
+		return ERROR_OK;
+
+	size_t read_bytes;
+	if (fileio_size(file->fileio, &file->size) != ERROR_OK)
+		goto fail;
+	file->buffer = malloc(file->size ? file->size : 1);
+	if (file->buffer == NULL)
+		goto fail;
+	if (fileio_read(file->fileio, file->size, file->buffer, &read_bytes) != ERROR_OK
+			|| read_bytes != file->size)
+		goto fail;
+	file->data = file->buffer;
+
+	return ERROR_OK;
+
+fail:
+	free(file->buffer);
+	file->buffer = NULL;
+	fileio_close(file->fileio);
+	file->fileio = NULL;
+	return ERROR_FAIL;
+}
+
+static void xsvf_close(struct xsvf_file *file)
+{
+	/* closing the fileio unmaps the file */
+	if (file->fileio)
+		fileio_close(file->fileio);
+	free(file->buffer);
+	memset(file, 0, sizeof(*file));
+}
+
+static int xsvf_read(struct xsvf_file *file, void *buf, size_t len)
+{
+	if (len > file->size - file->pos)
+		return ERROR_XSVF_EOF;
+
+	memcpy(buf, file->data + file->pos, len);
+	file->pos += len;
+
+	return ERROR_OK;
+}
+
+static int xsvf_read_buffer(int num_bits, struct xsvf_file *file, uint8_t *buf)
+{
+	size_t num_bytes = DIV_ROUND_UP(num_bits, 8);
+
+	if (num_bytes > file->size - file->pos)
+		return ERROR_XSVF_EOF;
+
+	/* reverse the order of bytes as they are read sequentially from file */
+	const uint8_t *p = file->data + file->pos;
+	for (size_t i = 0; i < num_bytes; i++)
+		buf[num_bytes - 1 - i] = p[i];
+	file->pos += num_bytes;
+
+	return ERROR_OK;
+}
+
+/*
+ * Walk the whole file once before anything is sent to the TAPs, so that
+ * a truncated file or one with opcodes we can't run is rejected up front
+ * rather than halfway through programming a device.
+ * @returns ERROR_OK, ERROR_XSVF_EOF or ERROR_XSVF_FAILED with @a offset
+ * set to the opcode in question.
+ */
+static int xsvf_validate(const struct xsvf_file *file, size_t *offset)
+{
+	const uint8_t *data = file->data;
+	size_t size = file->size;
+	size_t pos = 0;
+	uint64_t xsdrbytes = 0;
+
+	while (pos < size) {
+		uint8_t opcode = data[pos];
+		const uint8_t *arg = data + pos + 1;
+		size_t left = size - pos - 1;
+		uint64_t len;
+
+		*offset = pos;
+
+		switch (opcode) {
+			case XCOMPLETE:
+				len = 0;
+				break;
+			case XTDOMASK:
+			case XSDR:
+				len = xsdrbytes;
+				break;
+			case XSDRTDO:
+			case LSDR:
+				len = 2 * xsdrbytes;
+				break;
+			case XSIR:
+				if (left < 1)
+					return ERROR_XSVF_EOF;
+				len = 1 + DIV_ROUND_UP(arg[0], 8);
+				break;
+			case XSIR2:
+				if (left < 2)
+					return ERROR_XSVF_EOF;
+				len = 2 + DIV_ROUND_UP(be_to_h_u16(arg), 8);
+				break;
+			case XRUNTEST:
+			case LCOUNT:
+				len = 4;
+				break;
+			case XSDRSIZE:
+				if (left < 4)
+					return ERROR_XSVF_EOF;
+				xsdrbytes = DIV_ROUND_UP((uint64_t)be_to_h_u32(arg), 8);
+				len = 4;
+				break;
+			case XREPEAT:
+				len = 1;
+				break;
+			case XSTATE:
+				if (left >= 1 && arg[0] > XSV_IRUPDATE)
+					return ERROR_XSVF_FAILED;
+				len = 1;
+				break;
+			case XENDIR:
+			case XENDDR:
+				if (left >= 1 && arg[0] > 1)
+					return ERROR_XSVF_FAILED;
+				len = 1;
+				break;
+			case XTRST:
+				if (left >= 1 && arg[0] > XTRST_ABSENT)
+					return ERROR_XSVF_FAILED;
+				len = 1;
+				break;
+			case XCOMMENT:
+			{
+				const uint8_t *end = memchr(arg, 0, left);
+				if (end == NULL)
+					return ERROR_XSVF_EOF;
+				len = end - arg + 1;
+				break;
+			}
+			case XWAIT:
+			case XWAITSTATE:
+				if (left >= 2 && (arg[0] > XSV_IRUPDATE || arg[1] > XSV_IRUPDATE))
+					return ERROR_XSVF_FAILED;
+				len = opcode == XWAIT ? 6 : 10;
+				break;
+			case LDELAY:
+				if (left >= 1 && arg[0] > XSV_IRUPDATE)
+					return ERROR_XSVF_FAILED;
+				len = 9;
+				break;
+			default:
+				/* unknown, or one of the XSDRB ... XSDRTDOE family */
+				return ERROR_XSVF_FAILED;
+		}
 
-	for (num_bytes = (num_bits + 7) / 8; num_bytes > 0; num_bytes--) {
-		/* reverse the order of bytes as they are read sequentially from file */
-		if (read(fd, buf + num_bytes - 1, 1) < 0)
+		if (len > left)
 			return ERROR_XSVF_EOF;
+		pos += 1 + len;
 	}
 
 	return ERROR_OK;
 }
 
+/* Whether XSDR and XSDRTDO compare TDO at all; they check it against the
+ * last expected value under XTDOMASK, and an all zero mask checks nothing. */
+static bool xsvf_tdo_checked(const uint8_t *expected, const uint8_t *mask, int num_bits)
+{
+	if (expected == NULL)
+		return false;
+	if (mask == NULL)
+		return true;
+
+	for (int i = 0; i < num_bits / 8; i++) {
+		if (mask[i])
+			return true;
+	}
+
+	return num_bits % 8 && (mask[num_bits / 8] & ((1 << (num_bits % 8)) - 1));
+}
+
+/* Queue an XSDR or XSDRTDO scan that has no TDO to check. */
+static void xsvf_add_batched_scan(struct xsvf_batch *batch, struct jtag_tap *tap,
+		int num_bits, uint8_t *out_value)
+{
+	if (tap == NULL) {
+		jtag_add_plain_dr_scan(num_bits, out_value, NULL, TAP_DRPAUSE);
+	} else {
+		struct scan_field field;
+
+		field.num_bits = num_bits;
+		field.out_value = out_value;
+		field.in_value = NULL;
+		jtag_add_dr_scan(tap, 1, &field, TAP_DRPAUSE);
+	}
+
+	batch->scans++;
+	batch->bits += num_bits;
+}
+
+/* Run the queue with the batched scans in it. */
+static int xsvf_flush_batch(struct xsvf_batch *batch)
+{
+	int result = ERROR_OK;
+
+	if (batch->scans)
+		result = jtag_execute_queue();
+
+	batch->scans = 0;
+	batch->bits = 0;
+
+	return result;
+}
+
+/* Whether @a opcode may run with batched scans still queued. */
+static bool xsvf_batchable(uint8_t opcode, int xrepeat)
+{
+	switch (opcode) {
+		case XSDR:
+		case XSDRTDO:
+			return xrepeat <= 1;
+		case XTDOMASK:
+		case XRUNTEST:
+		case XREPEAT:
+		case XSDRSIZE:
+		case XENDIR:
+		case XENDDR:
+		case XCOMMENT:
+			return true;
+		default:
+			return false;
+	}
+}
+
 COMMAND_HANDLER(handle_xsvf_command)
 {
 	uint8_t *dr_out_buf = NULL;				/* from host to device (TDI) */
@@ -229,6 +483,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 	tap_state_t path[XSTATE_MAX_PATH];
 	unsigned pathlen = 0;
 
+	struct xsvf_batch batch = { 0 };
+	size_t bad_offset;
+
 	/* a flag telling whether to clock TCK during waits,
 	 * or simply sleep, controled by virt2
 	 */
@@ -254,8 +511,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 		}
 	}
 
-	xsvf_fd = open(filename, O_RDONLY);
-	if (xsvf_fd < 0) {
+	if (xsvf_open(&xsvf_file, filename) != ERROR_OK) {
 		command_print(CMD_CTX, "file \"%s\" not found", filename);
 		return ERROR_FAIL;
 	}
@@ -274,9 +530,30 @@ COMMAND_HANDLER(handle_xsvf_command)
 	LOG_WARNING("XSVF support in OpenOCD is limited. Consider using SVF instead");
 	LOG_USER("xsvf processing file: \"%s\"", filename);
 
-	while (read(xsvf_fd, &opcode, 1) > 0) {
+	result = xsvf_validate(&xsvf_file, &bad_offset);
+	if (result == ERROR_XSVF_EOF) {
+		command_print(CMD_CTX, "premature end of xsvf file detected, aborting");
+		result = ERROR_FAIL;
+		goto free_all;
+	} else if (result != ERROR_OK) {
+		command_print(CMD_CTX,
+			"unsupported xsvf command (0x%02X) or argument at offset %zu, aborting",
+			xsvf_file.data[bad_offset], bad_offset);
+		result = ERROR_FAIL;
+		goto free_all;
+	}
+
+	while (xsvf_read(&xsvf_file, &opcode, 1) == ERROR_OK) {
 		/* record the position of this opcode within the file */
-		file_offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
+		file_offset = xsvf_file.pos - 1;
+
+		/* run the batched scans before anything that depends on them */
+		if (batch.scans && !xsvf_batchable(opcode, xrepeat)) {
+			if (xsvf_flush_batch(&batch) != ERROR_OK) {
+				tdo_mismatch = 1;
+				goto failed;
+			}
+		}
 
 		/* maybe collect another state for a pathmove();
 		 * or terminate a path.
@@ -296,7 +573,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 						break;
 					}
 
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(&xsvf_file, &uc, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -368,7 +645,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			case XTDOMASK:
 				LOG_DEBUG("XTDOMASK");
 				if (dr_in_mask &&
-						(xsvf_read_buffer(xsdrsize, xsvf_fd, dr_in_mask) != ERROR_OK))
+						(xsvf_read_buffer(xsdrsize, &xsvf_file, dr_in_mask) != ERROR_OK))
 					do_abort = 1;
 				break;
 
@@ -376,7 +653,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xruntest_buf[4];
 
-				if (read(xsvf_fd, xruntest_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, xruntest_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -390,7 +667,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t myrepeat;
 
-				if (read(xsvf_fd, &myrepeat, 1) < 0)
+				if (xsvf_read(&xsvf_file, &myrepeat, 1) != ERROR_OK)
 					do_abort = 1;
 				else {
 					xrepeat = myrepeat;
@@ -403,7 +680,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t xsdrsize_buf[4];
 
-				if (read(xsvf_fd, xsdrsize_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, xsdrsize_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -433,13 +710,13 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				const char *op_name = (opcode == XSDR ? "XSDR" : "XSDRTDO");
 
-				if (xsvf_read_buffer(xsdrsize, xsvf_fd, dr_out_buf) != ERROR_OK) {
+				if (xsvf_read_buffer(xsdrsize, &xsvf_file, dr_out_buf) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
 
 				if (opcode == XSDRTDO) {
-					if (xsvf_read_buffer(xsdrsize, xsvf_fd,
+					if (xsvf_read_buffer(xsdrsize, &xsvf_file,
 						dr_in_buf)  != ERROR_OK) {
 						do_abort = 1;
 						break;
@@ -451,7 +728,22 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				LOG_DEBUG("%s %d", op_name, xsdrsize);
 
-				for (attempt = 0; attempt < limit; ++attempt) {
+				if (limit == 1 && !xsvf_tdo_checked(dr_in_buf, dr_in_mask, xsdrsize)) {
+					/* nothing to check or retry, leave it queued */
+					xsvf_add_batched_scan(&batch, tap, xsdrsize, dr_out_buf);
+					matched = 1;
+					if (batch.bits >= XSVF_MAX_BATCH_BITS
+							&& xsvf_flush_batch(&batch) != ERROR_OK) {
+						tdo_mismatch = 1;
+						break;
+					}
+				} else if (xsvf_flush_batch(&batch) != ERROR_OK) {
+					/* the compare must not be mixed up with earlier scans */
+					tdo_mismatch = 1;
+					break;
+				}
+
+				for (attempt = 0; attempt < limit && !matched; ++attempt) {
 					struct scan_field field;
 
 					if (attempt > 0) {
@@ -519,7 +811,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				if (xruntest) {
 					result = svf_add_statemove(TAP_IDLE);
 					if (result != ERROR_OK)
-						return result;
+						goto free_all;
 
 					if (runtest_requires_tck)
 						jtag_add_clocks(xruntest);
@@ -529,7 +821,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 					/* we are already in TAP_DRPAUSE */
 					result = svf_add_statemove(xenddr);
 					if (result != ERROR_OK)
-						return result;
+						goto free_all;
 				}
 			}
 			break;
@@ -578,7 +870,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				tap_state_t mystate;
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&xsvf_file, &uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -621,7 +913,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDIR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&xsvf_file, &uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -642,7 +934,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 			case XENDDR:
 
-				if (read(xsvf_fd, &uc, 1) < 0) {
+				if (xsvf_read(&xsvf_file, &uc, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -671,14 +963,14 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				if (opcode == XSIR) {
 					/* one byte bitcount */
-					if (read(xsvf_fd, short_buf, 1) < 0) {
+					if (xsvf_read(&xsvf_file, short_buf, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
 					bitcount = short_buf[0];
 					LOG_DEBUG("XSIR %d", bitcount);
 				} else {
-					if (read(xsvf_fd, short_buf, 2) < 0) {
+					if (xsvf_read(&xsvf_file, short_buf, 2) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -688,7 +980,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				ir_buf = malloc((bitcount + 7) / 8);
 
-				if (xsvf_read_buffer(bitcount, xsvf_fd, ir_buf) != ERROR_OK)
+				if (xsvf_read_buffer(bitcount, &xsvf_file, ir_buf) != ERROR_OK)
 					do_abort = 1;
 				else {
 					struct scan_field field;
@@ -731,7 +1023,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				char comment[128];
 
 				do {
-					if (read(xsvf_fd, &uc, 1) < 0) {
+					if (xsvf_read(&xsvf_file, &uc, 1) != ERROR_OK) {
 						do_abort = 1;
 						break;
 					}
@@ -761,9 +1053,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				tap_state_t end_state;
 				int delay;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-					|| read(xsvf_fd, &end, 1) < 0
-					|| read(xsvf_fd, delay_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, &wait_local, 1) != ERROR_OK
+					|| xsvf_read(&xsvf_file, &end, 1) != ERROR_OK
+					|| xsvf_read(&xsvf_file, delay_buf, 4) != ERROR_OK) {
 						do_abort = 1;
 						break;
 				}
@@ -781,11 +1073,11 @@ COMMAND_HANDLER(handle_xsvf_command)
 					/* FIXME handle statemove errors ... */
 					result = svf_add_statemove(wait_state);
 					if (result != ERROR_OK)
-						return result;
+						goto free_all;
 					jtag_add_sleep(delay);
 					result = svf_add_statemove(end_state);
 					if (result != ERROR_OK)
-						return result;
+						goto free_all;
 				}
 			}
 			break;
@@ -806,10 +1098,10 @@ COMMAND_HANDLER(handle_xsvf_command)
 				int clock_count;
 				int usecs;
 
-				if (read(xsvf_fd, &wait_local, 1) < 0
-						||  read(xsvf_fd, &end, 1) < 0
-						||  read(xsvf_fd, clock_buf, 4) < 0
-						||  read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, &wait_local, 1) != ERROR_OK
+						||  xsvf_read(&xsvf_file, &end, 1) != ERROR_OK
+						||  xsvf_read(&xsvf_file, clock_buf, 4) != ERROR_OK
+						||  xsvf_read(&xsvf_file, usecs_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -840,14 +1132,14 @@ COMMAND_HANDLER(handle_xsvf_command)
 				/* FIXME handle statemove errors ... */
 				result = svf_add_statemove(wait_state);
 				if (result != ERROR_OK)
-					return result;
+					goto free_all;
 
 				jtag_add_clocks(clock_count);
 				jtag_add_sleep(usecs);
 
 				result = svf_add_statemove(end_state);
 				if (result != ERROR_OK)
-					return result;
+					goto free_all;
 			}
 			break;
 
@@ -858,7 +1150,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 				*/
 				uint8_t count_buf[4];
 
-				if (read(xsvf_fd, count_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, count_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -877,9 +1169,9 @@ COMMAND_HANDLER(handle_xsvf_command)
 				uint8_t clock_buf[4];
 				uint8_t usecs_buf[4];
 
-				if (read(xsvf_fd, &state, 1) < 0
-						|| read(xsvf_fd, clock_buf, 4) < 0
-						|| read(xsvf_fd, usecs_buf, 4) < 0) {
+				if (xsvf_read(&xsvf_file, &state, 1) != ERROR_OK
+						|| xsvf_read(&xsvf_file, clock_buf, 4) != ERROR_OK
+						|| xsvf_read(&xsvf_file, usecs_buf, 4) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -905,8 +1197,8 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 				LOG_DEBUG("LSDR");
 
-				if (xsvf_read_buffer(xsdrsize, xsvf_fd, dr_out_buf) != ERROR_OK
-						|| xsvf_read_buffer(xsdrsize, xsvf_fd, dr_in_buf) != ERROR_OK) {
+				if (xsvf_read_buffer(xsdrsize, &xsvf_file, dr_out_buf) != ERROR_OK
+						|| xsvf_read_buffer(xsdrsize, &xsvf_file, dr_in_buf) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -919,7 +1211,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 
 					result = svf_add_statemove(loop_state);
 					if (result != ERROR_OK)
-						return result;
+						goto free_all;
 					jtag_add_clocks(loop_clocks);
 					jtag_add_sleep(loop_usecs);
 
@@ -963,7 +1255,7 @@ COMMAND_HANDLER(handle_xsvf_command)
 			{
 				uint8_t trst_mode;
 
-				if (read(xsvf_fd, &trst_mode, 1) < 0) {
+				if (xsvf_read(&xsvf_file, &trst_mode, 1) != ERROR_OK) {
 					do_abort = 1;
 					break;
 				}
@@ -986,59 +1278,65 @@ COMMAND_HANDLER(handle_xsvf_command)
 			break;
 
 			default:
-				LOG_ERROR("unknown xsvf command (0x%02X)", uc);
+				LOG_ERROR("unknown xsvf command (0x%02X)", opcode);
 				unsupported = 1;
 		}
 
+		/* at the end of the file, run what is left of the batch */
+		if (xsvf_file.pos == xsvf_file.size && !do_abort && !unsupported && !tdo_mismatch
+				&& xsvf_flush_batch(&batch) != ERROR_OK)
+			tdo_mismatch = 1;
+
+failed:
 		if (do_abort || unsupported || tdo_mismatch) {
 			LOG_DEBUG("xsvf failed, setting taps to reasonable state");
 
 			/* upon error, return the TAPs to a reasonable state */
+			xsvf_flush_batch(&batch);
 			result = svf_add_statemove(TAP_IDLE);
 			if (result != ERROR_OK)
-				return result;
+				goto free_all;
 			result = jtag_execute_queue();
 			if (result != ERROR_OK)
-				return result;
+				goto free_all;
 			break;
 		}
 	}
 
+	result = ERROR_FAIL;
+
 	if (tdo_mismatch) {
 		command_print(CMD_CTX,
 			"TDO mismatch, somewhere near offset %lu in xsvf file, aborting",
 			file_offset);
-
-		return ERROR_FAIL;
+		goto free_all;
 	}
 
 	if (unsupported) {
-		off_t offset = lseek(xsvf_fd, 0, SEEK_CUR) - 1;
 		command_print(CMD_CTX,
-			"unsupported xsvf command (0x%02X) at offset %jd, aborting",
-			uc, (intmax_t)offset);
-		return ERROR_FAIL;
+			"unsupported xsvf command (0x%02X) at offset %ld, aborting",
+			opcode, file_offset);
+		goto free_all;
 	}
 
 	if (do_abort) {
 		command_print(CMD_CTX, "premature end of xsvf file detected, aborting");
-		return ERROR_FAIL;
+		goto free_all;
 	}
 
-	if (dr_out_buf)
-		free(dr_out_buf);
-
-	if (dr_in_buf)
-		free(dr_in_buf);
+	command_print(CMD_CTX, "XSVF file programmed successfully");
+	result = ERROR_OK;
 
-	if (dr_in_mask)
-		free(dr_in_mask);
+free_all:
+	xsvf_flush_batch(&batch);
 
-	close(xsvf_fd);
+	free(dr_out_buf);
+	free(dr_in_buf);
+	free(dr_in_mask);
 
-	command_print(CMD_CTX, "XSVF file programmed successfully");
+	xsvf_close(&xsvf_file);
 
-	return ERROR_OK;
+	return result;
 }
 
 static const struct command_registration xsvf_command_handlers[] = {